@@ -14,6 +14,7 @@
 
 #pragma once
 
+#include <algorithm>
 #include <functional>
 #include <execinfo.h>
 #include <type_traits>
@@ -108,6 +109,11 @@ enum MysqlCommand : uint8_t {
     COM_STMT_FETCH          = 0x1c
 };
 
+// https://dev.mysql.com/doc/internals/en/capability-flags.html
+const uint32_t MYSQL_CLIENT_MULTI_STATEMENTS    = 0x00010000;
+// https://dev.mysql.com/doc/internals/en/status-flags.html
+const uint16_t MYSQL_SERVER_MORE_RESULTS_EXISTS = 0x0008;
+
 class TimeCost {
 public:
     TimeCost() {
@@ -321,6 +327,45 @@ private:
     BthreadCond _cond;
     const bthread_attr_t* _attr = NULL;
 };
+// 令牌桶限速, 可被多个bthread共享
+// rate为每秒的令牌数, 每次调用时传入, 便于动态修改gflag; rate<=0不限速
+// 允许透支, 透支的部分由本次调用sleep偿还, 单次消耗较大时也不会饿死
+class TokenBucket {
+public:
+    TokenBucket() {
+        bthread_mutex_init(&_mutex, NULL);
+    }
+    ~TokenBucket() {
+        bthread_mutex_destroy(&_mutex);
+    }
+    void consume(int64_t tokens, int64_t rate) {
+        if (rate <= 0 || tokens <= 0) {
+            return;
+        }
+        int64_t wait_us = 0;
+        bthread_mutex_lock(&_mutex);
+        int64_t now = butil::gettimeofday_us();
+        if (_last_time_us == 0) {
+            _last_time_us = now;
+        }
+        // 最多积累1秒的令牌, 避免空闲后瞬间突发
+        int64_t elapsed_us = std::min(now - _last_time_us, (int64_t)1000000);
+        _tokens = std::min(_tokens + elapsed_us * rate / 1000000, rate);
+        _last_time_us = now;
+        _tokens -= tokens;
+        if (_tokens < 0) {
+            wait_us = -_tokens * 1000000 / rate;
+        }
+        bthread_mutex_unlock(&_mutex);
+        if (wait_us > 0) {
+            bthread_usleep(wait_us);
+        }
+    }
+private:
+    bthread_mutex_t _mutex;
+    int64_t _tokens = 0;
+    int64_t _last_time_us = 0;
+};
 // RAII
 class ScopeGuard {
 public:
@@ -14,6 +14,8 @@
 
 #pragma once
 
+#include <mutex>
+#include <unordered_map>
 #include "table_record.h"
 #include "schema_factory.h"
 #include "runtime_state.h"
@@ -25,8 +27,52 @@ enum ErrorType {
     E_OK = 0,
     E_WARNING,
     E_FATAL,
-    E_BIG_SQL
+    E_BIG_SQL,
+    E_MEM_QUOTA
 };
+// 单个store的rpc延迟统计, 用于自适应并发和对冲请求
+class StoreLatencyStat {
+public:
+    explicit StoreLatencyStat(const std::string& addr);
+    void record(int64_t latency_us) {
+        _latency << latency_us;
+    }
+    // 按最近窗口平均延迟与历史最小延迟之比调整单store并发,
+    // store变慢时收缩, 恢复后逐步放开
+    int concurrency();
+    // 对冲请求的等待时间, 取p99
+    int64_t hedge_delay_us();
+private:
+    bvar::LatencyRecorder _latency;
+    bvar::Status<int> _concurrency_status;
+    std::mutex _mutex;
+    int _concurrency;
+    int64_t _min_latency_us = 0;
+    TimeCost _last_update;
+    TimeCost _last_min_reset;
+};
+typedef std::shared_ptr<StoreLatencyStat> SmartStoreLatencyStat;
+
+class StoreLatencyManager {
+public:
+    static StoreLatencyManager* get_instance() {
+        static StoreLatencyManager _instance;
+        return &_instance;
+    }
+    SmartStoreLatencyStat get(const std::string& addr) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto& stat = _stats[addr];
+        if (stat == nullptr) {
+            stat.reset(new StoreLatencyStat(addr));
+        }
+        return stat;
+    }
+private:
+    StoreLatencyManager() {}
+    std::mutex _mutex;
+    std::unordered_map<std::string, SmartStoreLatencyStat> _stats;
+};
+
 class FetcherStore {
 public:
     FetcherStore() {
@@ -62,6 +108,9 @@ public:
         return run(state, region_infos, store_request, start_seq_id, start_seq_id, op_type);
     }
     void choose_opt_instance(pb::RegionInfo& info, std::string& addr);
+    // 选一个不同于addr的副本发对冲请求, 没有则返回false
+    bool choose_backup_instance(const pb::RegionInfo& info, const std::string& addr,
+            std::string& backup_addr);
 public:
     std::map<int64_t, std::shared_ptr<RowBatch>> region_batch;
     std::map<int64_t, std::vector<SmartRecord>>  index_records; //key: index_id
@@ -72,6 +121,8 @@ public:
     // 因为split会导致多region出来,加锁保护公共资源
     int64_t row_cnt = 0;
     std::atomic<int> affected_rows;
+    // region_batch占用的内存配额, 下一轮run清空region_batch时归还
+    std::atomic<int64_t> memory_consumed{0};
 };
 }
 
@@ -0,0 +1,75 @@
+// Copyright (c) 2018-present Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+#include <string>
+#include "mut_table_key.h"
+#include "proto/meta.interface.pb.h"
+
+namespace baikaldb {
+// data cf中key的布局: 8字节前缀 + 8字节index_id + 索引key
+// 默认前缀为region_id, 分裂时需要把数据拷贝到新region_id前缀下
+// 索引布局(index_key_layout)的前缀为分区前缀, 同一分区的region共享key空间,
+// region只由[start_key, end_key)界定, 分裂只修改元数据; 每个region只能有一个有序索引
+// (主键或全局索引), 局部二级索引不是按主键有序的, 无法按区间划分
+// 分区前缀取负数, 不会与region_id冲突, 前缀长度不变, 按16字节前缀处理的逻辑不受影响
+inline int64_t index_layout_prefix(int64_t partition_id) {
+    return -partition_id - 1;
+}
+
+inline int64_t data_key_prefix(const pb::RegionInfo& region_info) {
+    if (region_info.index_key_layout()) {
+        return index_layout_prefix(region_info.partition_id());
+    }
+    return region_info.region_id();
+}
+
+// region在data cf中的数据区间[start, end)
+inline void region_data_range(const pb::RegionInfo& region_info,
+        std::string* start, std::string* end) {
+    MutTableKey start_key;
+    MutTableKey end_key;
+    if (!region_info.index_key_layout()) {
+        start_key.append_i64(region_info.region_id());
+        end_key.append_i64(region_info.region_id()).append_u64(UINT64_MAX);
+    } else {
+        int64_t prefix = data_key_prefix(region_info);
+        int64_t index_id = region_info.table_id();
+        start_key.append_i64(prefix).append_i64(index_id).append_index(region_info.start_key());
+        if (region_info.end_key().empty()) {
+            end_key.append_i64(prefix).append_i64(index_id + 1);
+        } else {
+            end_key.append_i64(prefix).append_i64(index_id).append_index(region_info.end_key());
+        }
+    }
+    *start = start_key.data();
+    *end = end_key.data();
+}
+
+// 两个索引布局的region在data cf中的区间是否重叠
+inline bool region_data_overlap(const pb::RegionInfo& r1, const pb::RegionInfo& r2) {
+    if (!r1.index_key_layout() || !r2.index_key_layout()
+            || data_key_prefix(r1) != data_key_prefix(r2) || r1.table_id() != r2.table_id()) {
+        return false;
+    }
+    if (r1.start_key() == r1.end_key() || r2.start_key() == r2.end_key()) {
+        return false;
+    }
+    // 空的end_key表示无穷大
+    return (r2.end_key().empty() || r1.start_key() < r2.end_key())
+        && (r1.end_key().empty() || r2.start_key() < r1.end_key());
+}
+}
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
@@ -29,18 +29,21 @@ template <typename ItemKey, typename ItemType>
 struct LruNode : public butil::LinkNode<LruNode<ItemKey, ItemType>> {
     ItemType value;
     ItemKey key;
+    int64_t size = 0;
 };
 
 template <typename ItemKey, typename ItemType>
 class Cache {
 public:
     Cache() : _total_count(0), _hit_count(0), 
-        _len_threshold(10000){}
-    int init(int64_t len_threshold);
+        _len_threshold(10000), _byte_size(0), _byte_threshold(0) {}
+    // byte_threshold: 按字节淘汰, 0表示只按条数淘汰
+    int init(int64_t len_threshold, int64_t byte_threshold = 0);
     std::string get_info();
     int check(const ItemKey& key);
     int find(const ItemKey& key, ItemType* value);
-    int add(const ItemKey& key, const ItemType& value);
+    // size: 该条目占用的字节数, 只在设置了byte_threshold时生效
+    int add(const ItemKey& key, const ItemType& value, int64_t size = 0);
     int del(const ItemKey& key);
 private:
     //双链表，从尾部插入数据，超过阈值数据从头部删除
@@ -50,6 +53,8 @@ private:
     int64_t _total_count;
     int64_t _hit_count;
     int64_t _len_threshold;
+    int64_t _byte_size;
+    int64_t _byte_threshold;
 };
 
 }
@@ -20,15 +20,17 @@
 namespace baikaldb  {
 
 template <typename ItemKey, typename ItemType>
-int Cache<ItemKey, ItemType>::init(int64_t len_threshold) {
+int Cache<ItemKey, ItemType>::init(int64_t len_threshold, int64_t byte_threshold) {
     _len_threshold = len_threshold;
+    _byte_threshold = byte_threshold;
     return 0;
 }
 
 template <typename ItemKey, typename ItemType>
 std::string Cache<ItemKey, ItemType>::get_info() {
     char buf[100];
-    snprintf(buf, sizeof(buf), "hit:%ld, total:%ld,", _hit_count, _total_count);
+    snprintf(buf, sizeof(buf), "hit:%ld, total:%ld, bytes:%ld,", 
+            _hit_count, _total_count, _byte_size);
     return buf;
 }
 
@@ -57,24 +59,32 @@ int Cache<ItemKey, ItemType>::find(const ItemKey& key, ItemType* value) {
 }
 
 template <typename ItemKey, typename ItemType>
-int Cache<ItemKey, ItemType>::add(const ItemKey& key, const ItemType& value) {
+int Cache<ItemKey, ItemType>::add(const ItemKey& key, const ItemType& value, int64_t size) {
     std::lock_guard<std::mutex> lock(_mutex);
+    if (_byte_threshold > 0 && size > _byte_threshold) {
+        return -1;
+    }
     LruNode<ItemKey, ItemType>* node = NULL;
     if (_lru_map.count(key) == 1) {
         node = _lru_map[key];
         node->RemoveFromList();
+        _byte_size -= node->size;
     } else {
         node = new LruNode<ItemKey, ItemType>();
         _lru_map[key] = node;
     }
-    while (_lru_map.size() >= _len_threshold && !_lru_list.empty()) {
+    while (!_lru_list.empty() && ((int64_t)_lru_map.size() >= _len_threshold 
+                || (_byte_threshold > 0 && _byte_size + size > _byte_threshold))) {
         LruNode<ItemKey, ItemType>* head = (LruNode<ItemKey, ItemType>*)_lru_list.head();
         head->RemoveFromList();
         _lru_map.erase(head->key);
+        _byte_size -= head->size;
         delete head;
     }
     node->value = value;
     node->key = key;
+    node->size = size;
+    _byte_size += size;
     _lru_list.Append(node);
     return 0;
 }
@@ -87,6 +97,8 @@ int Cache<ItemKey, ItemType>::del(const ItemKey& key) {
         node = _lru_map[key];
         node->RemoveFromList();
         _lru_map.erase(node->key);
+        _byte_size -= node->size;
+        delete node;
     }
     return 0;
 }
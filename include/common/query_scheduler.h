@@ -0,0 +1,101 @@
+// Copyright (c) 2018-present Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <mutex>
+#include <memory>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "common.h"
+
+namespace baikaldb {
+DECLARE_bool(enable_query_scheduler);
+DECLARE_int64(long_query_region_threshold);
+
+enum QueryClass {
+    QC_SHORT = 0,   // point lookups and small DML
+    QC_LONG  = 1    // scans over many regions
+};
+
+// 一个资源组(用户/表)的并发限制
+struct ResourceGroup {
+    explicit ResourceGroup(int concurrency) : cond(-concurrency) {}
+    BthreadCond cond;
+};
+typedef std::shared_ptr<ResourceGroup> SmartResourceGroup;
+
+// acquire成功后持有的资源, 析构时归还
+class QueryTicket {
+public:
+    QueryTicket() {}
+    ~QueryTicket() {
+        release();
+    }
+    void release() {
+        for (auto& group : _groups) {
+            group->cond.decrease_signal();
+        }
+        _groups.clear();
+    }
+    QueryClass query_class() const {
+        return _class;
+    }
+private:
+    QueryTicket(const QueryTicket&) = delete;
+    QueryTicket& operator=(const QueryTicket&) = delete;
+
+    QueryClass _class = QC_SHORT;
+    std::vector<SmartResourceGroup> _groups;
+    friend class QueryScheduler;
+};
+
+// baikaldb端的准入控制:
+// 按估算代价把query分为短/长两个队列, 各自有独立的并发上限;
+// 长query再按用户和表分资源组限流, 防止大查询饿死点查
+class QueryScheduler {
+public:
+    static QueryScheduler* get_instance() {
+        static QueryScheduler _instance;
+        return &_instance;
+    }
+
+    static QueryClass classify(int64_t cost) {
+        return cost > FLAGS_long_query_region_threshold ? QC_LONG : QC_SHORT;
+    }
+
+    // cost: 估算代价(涉及的region数)
+    // 排队超时返回-1, 此时ticket不持有任何资源
+    int acquire(QueryTicket* ticket, const std::string& user,
+            const std::string& table, int64_t cost);
+
+private:
+    QueryScheduler();
+    SmartResourceGroup get_group(std::unordered_map<std::string, SmartResourceGroup>& groups,
+            const std::string& key, int concurrency);
+    int enter(QueryTicket* ticket, SmartResourceGroup group, int64_t timeout_us);
+
+    SmartResourceGroup _class_groups[2];
+    std::mutex _group_mutex;
+    std::unordered_map<std::string, SmartResourceGroup> _user_groups;
+    std::unordered_map<std::string, SmartResourceGroup> _table_groups;
+
+    bvar::Adder<int64_t> _queued_count[2];
+    bvar::Adder<int64_t> _rejected_count;
+    bvar::LatencyRecorder _queue_time[2];
+};
+}
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 */
@@ -0,0 +1,92 @@
+// Copyright (c) 2018-present Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "common.h"
+#include "lru_cache.h"
+#include "runtime_state.h"
+
+namespace baikaldb {
+DECLARE_int64(result_cache_bytes);
+
+// 缓存的结果集: 直接缓存发给客户端的mysql packet
+struct CachedResult {
+    std::string packets;
+    int packet_id = 0;
+    int num_returned_rows = 0;
+    // region_id => 读取时的version/applied_index
+    std::map<int64_t, RegionSnapshot> regions;
+};
+typedef std::shared_ptr<CachedResult> SmartCachedResult;
+
+// baikaldb端只读query的结果缓存
+// key为规范化后的sql, 任意region的version或applied_index变化则缓存失效
+// 默认每次命中都向读取时的peer查询applied_index;
+// 配置check_interval后, 同一peer在该时间内返回过的applied_index直接比较, 不再rpc,
+// 此时其他db写入的数据最多延迟check_interval可见, 经本db写入的region立即失效
+class ResultCache {
+public:
+    static ResultCache* get_instance() {
+        static ResultCache _instance;
+        return &_instance;
+    }
+    bool enabled() const {
+        return FLAGS_result_cache_bytes > 0;
+    }
+    // 去掉多余空白, 与库名/字符集一起构成key
+    static std::string make_key(const std::string& sql, const std::string& db,
+            const std::string& charset);
+
+    // region_versions: 当前plan中的region_id => version
+    // 命中且校验通过返回0
+    int find(const std::string& key, const std::map<int64_t, int64_t>& region_versions,
+            SmartCachedResult* result);
+    void add(const std::string& key, SmartCachedResult result);
+
+    // addr: 返回applied_index的peer
+    // request_start_us: 读取请求的发送时间, 早于region失效时间的结果不更新
+    void update_region(int64_t region_id, const std::string& addr, int64_t applied_index,
+            int64_t request_start_us);
+    void invalidate_region(int64_t region_id);
+
+    // 结果随执行时间或次数变化的函数, 包含这些函数的查询不缓存
+    static bool is_nondeterministic_fn(const std::string& fn_name, size_t num_args);
+
+private:
+    struct RegionState {
+        std::string addr;
+        int64_t applied_index = 0;
+        int64_t update_time_us = 0;
+        int64_t invalid_time_us = 0;
+    };
+
+    ResultCache();
+    bool validate(const CachedResult& result);
+
+    Cache<std::string, SmartCachedResult> _cache;
+    std::mutex _region_mutex;
+    std::unordered_map<int64_t, RegionState> _region_states;
+    bvar::Adder<int64_t> _hit_count;
+    bvar::Adder<int64_t> _miss_count;
+    bvar::Adder<int64_t> _invalid_count;
+};
+}
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 */
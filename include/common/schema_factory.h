@@ -165,6 +165,7 @@ struct TableInfo {
     //table字段不变的话不需要重新构建动态pb
     std::string             fields_sign;
     int64_t                 ttl_duration = 0;
+    int32_t                 ttl_format_version = 0;
 
     const Descriptor*       tbl_desc;
     DescriptorProto*        tbl_proto = nullptr;
@@ -174,6 +175,10 @@ struct TableInfo {
     const Message*          msg_proto = nullptr;
     
     TableInfo() {}
+    // value带过期时间头, 之前建的ttl表不带
+    bool use_ttl_value() const {
+        return ttl_duration > 0 && ttl_format_version > 0 && engine == pb::ROCKSDB;
+    }
     FieldInfo* get_field_ptr(int32_t field_id) {
         for (auto& info : fields) {
             if (info.id == field_id) {
@@ -372,6 +377,7 @@ public:
     bool get_merge_switch(int64_t table_id);
     bool get_separate_switch(int64_t table_id);
     int64_t get_ttl_duration(int64_t table_id);
+    bool use_ttl_value(int64_t table_id);
     
     int get_region_by_key(int64_t main_table_id, 
             IndexInfo& index,
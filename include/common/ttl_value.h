@@ -0,0 +1,53 @@
+// Copyright (c) 2018-present Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+#include <cstring>
+#include <string>
+#include <rocksdb/slice.h>
+#include "key_encoder.h"
+
+namespace baikaldb {
+// ttl表(ttl_duration > 0且ttl_format_version > 0)在data cf中的value布局:
+// 8字节过期时间(us, 小端) + 原始value
+// 主键和局部二级索引的value都带过期时间, 同一行的所有kv一起写入, 过期时间相同
+// compaction时直接丢弃过期的kv, 读取时把过期的行当作不存在
+const size_t TTL_HEADER_LEN = sizeof(uint64_t);
+
+inline int64_t ttl_expire_time_us(int64_t ttl_duration_s, int64_t now_us) {
+    return now_us + ttl_duration_s * 1000000LL;
+}
+
+inline void ttl_encode(int64_t expire_time_us, std::string* value) {
+    uint64_t encode = KeyEncoder::to_little_endian_u64(static_cast<uint64_t>(expire_time_us));
+    value->insert(0, reinterpret_cast<const char*>(&encode), TTL_HEADER_LEN);
+}
+
+// 去掉value的过期时间头并返回过期时间, 长度不足时返回0(不过期)
+inline int64_t ttl_decode(rocksdb::Slice* value) {
+    if (value->size() < TTL_HEADER_LEN) {
+        return 0;
+    }
+    uint64_t encode = 0;
+    memcpy(&encode, value->data(), TTL_HEADER_LEN);
+    value->remove_prefix(TTL_HEADER_LEN);
+    return static_cast<int64_t>(KeyEncoder::to_little_endian_u64(encode));
+}
+
+inline bool ttl_expired(int64_t expire_time_us, int64_t now_us) {
+    return expire_time_us > 0 && expire_time_us <= now_us;
+}
+}
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
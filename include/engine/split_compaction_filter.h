@@ -15,22 +15,37 @@
 #pragma once
 
 #include <rocksdb/compaction_filter.h>
-#include <bthread/mutex.h>
+#include <atomic>
+#include <unordered_map>
 #include "key_encoder.h"
 #include "type_utils.h"
 #include "schema_factory.h"
 #include "transaction.h"
+#include "ttl_value.h"
 
 namespace baikaldb {
+DECLARE_int64(ttl_compaction_grace_s);
+// 每次compaction的查找缓存, compaction按key有序处理, 相邻key大多属于同一region和索引
+struct SplitFilterCache {
+    int64_t region_id = 0;
+    int64_t version = -1;   // region区间表的版本, 变化后缓存失效
+    std::string end_key;
+    int64_t index_id = 0;
+    SmartIndex index_info;
+    SmartIndex pk_info;
+    bool use_ttl = false;   // 该索引的value带过期时间
+};
+
+// data cf只能配置一个compaction filter, 分裂后不属于本region的数据和ttl表过期的数据都在这里删除
 class SplitCompactionFilter : public rocksdb::CompactionFilter {
 public:
+    // region_id => end_key, 读无锁, 写时两份数据依次更新
+    typedef butil::DoublyBufferedData<std::unordered_map<int64_t, std::string>> RangeMap;
+
     static SplitCompactionFilter* get_instance() {
         static SplitCompactionFilter _instance;
         return &_instance;
     }
-    ~SplitCompactionFilter() {
-        bthread_mutex_destroy(&_mutex);
-    }
     const char* Name() const override {
         return "SplitCompactionFilter";
     }
@@ -43,40 +58,79 @@ public:
                 const rocksdb::Slice& value,
                 std::string* /*new_value*/,
                 bool* /*value_changed*/) const override {
+        return filter(key, value, nullptr);
+    }
+
+    // cache为空时每个key都查一次区间表和schema
+    bool filter(const rocksdb::Slice& key, const rocksdb::Slice& value,
+            SplitFilterCache* cache) const {
         static int prefix_len = sizeof(int64_t) * 2;
         if ((int)key.size() < prefix_len) {
             return false;
         }
         TableKey table_key(key);
         int64_t region_id = table_key.extract_i64(0);
-        //std::string start_key;
-        std::string end_key;
-        {
-            BAIDU_SCOPED_LOCK(_mutex);
-            //start_key = _range_key_map[region_id].first;
-            end_key = _range_key_map[region_id].second;
-        }
-        if (/*start_key.empty() &&*/end_key.empty()) {
-            return false;
+        SplitFilterCache local_cache;
+        if (cache == nullptr) {
+            cache = &local_cache;
         }
         int64_t index_id = table_key.extract_i64(sizeof(int64_t));
         // cstore, primary column key format: index_id = table_id(32byte) + field_id(32byte)
         if ((index_id & SIGN_MASK_32) != 0) {
             index_id = index_id >> 32;
         }
-        auto index_info = _factory->get_index_info_ptr(index_id);
-        if (index_info == nullptr) {
+        if (cache->index_info == nullptr || cache->index_id != index_id) {
+            cache->index_id = index_id;
+            cache->index_info = _factory->get_index_info_ptr(index_id);
+            cache->pk_info = nullptr;
+            cache->use_ttl = false;
+            if (cache->index_info != nullptr) {
+                cache->pk_info = _factory->get_index_info_ptr(cache->index_info->pk);
+                auto type = cache->index_info->type;
+                cache->use_ttl = !cache->index_info->is_global
+                    && (type == pb::I_PRIMARY || type == pb::I_UNIQ || type == pb::I_KEY)
+                    && _factory->use_ttl_value(cache->index_info->pk);
+            }
+        }
+        auto& index_info = cache->index_info;
+        auto& pk_info = cache->pk_info;
+        if (index_info == nullptr || pk_info == nullptr) {
             return false;
         }
-        auto pk_info = _factory->get_index_info_ptr(index_info->pk);
-        if (pk_info == nullptr) {
+        // ttl表过期的kv直接删除
+        // 写入时按leader在请求中带的时间判断过期, 落后的副本apply时该时间可能早于本地时间,
+        // 过期超过grace才删除, 避免副本间判断不一致
+        rocksdb::Slice value_slice(value);
+        if (cache->use_ttl && ttl_expired(ttl_decode(&value_slice),
+                    butil::gettimeofday_us() - FLAGS_ttl_compaction_grace_s * 1000000LL)) {
+            return true;
+        }
+        // 索引布局(分区前缀为负数)的key区间由多个region共享, 分裂后按区间删除, 不在此过滤
+        if (region_id < 0) {
+            return false;
+        }
+        int64_t version = _version.load(std::memory_order_acquire);
+        if (cache->region_id != region_id || cache->version != version) {
+            cache->region_id = region_id;
+            cache->version = version;
+            cache->end_key.clear();
+            RangeMap::ScopedPtr ptr;
+            if (_range_key_map.Read(&ptr) == 0) {
+                auto iter = ptr->find(region_id);
+                if (iter != ptr->end()) {
+                    cache->end_key = iter->second;
+                }
+            }
+        }
+        const std::string& end_key = cache->end_key;
+        if (end_key.empty()) {
             return false;
         }
 
         //int ret1 = 0;
         int ret2 = 0;
         if (index_info->type == pb::I_PRIMARY || index_info->is_global) {
-            ret2 = end_key.empty()? 1 : end_key.compare(0, std::string::npos, 
+            ret2 = end_key.compare(0, std::string::npos, 
                     key.data() + prefix_len, key.size() - prefix_len);
            // DB_WARNING("split compaction filter, region_id: %ld, index_id: %ld, end_key: %s, key: %s, ret: %d",
            //     region_id, index_id, rocksdb::Slice(end_key).ToString(true).c_str(), 
@@ -85,29 +139,60 @@ public:
         } else if (index_info->type == pb::I_UNIQ || index_info->type == pb::I_KEY) {
             rocksdb::Slice key_slice(key);
             key_slice.remove_prefix(sizeof(int64_t) * 2);
-            return !Transaction::fits_region_range(key_slice, value, 
+            return !Transaction::fits_region_range(key_slice, value_slice, 
                 nullptr, &end_key, *pk_info, *index_info);
         }
         return false;
     }
 
     void set_range_key(int64_t region_id, const std::string& start_key, const std::string& end_key) {
-        BAIDU_SCOPED_LOCK(_mutex);
-        _range_key_map[region_id].first = start_key;
-        _range_key_map[region_id].second = end_key;
+        (void)start_key;
+        _range_key_map.Modify(update_range, region_id, end_key);
+        _version.fetch_add(1, std::memory_order_release);
     }
 
 private:
     SplitCompactionFilter() {
-        bthread_mutex_init(&_mutex, NULL);
         _factory = SchemaFactory::get_instance();
     }
+    static size_t update_range(std::unordered_map<int64_t, std::string>& map,
+            int64_t region_id, const std::string& end_key) {
+        map[region_id] = end_key;
+        return 1;
+    }
 
-    // region_id => end_key
-    mutable std::unordered_map<int64_t, std::pair<std::string, std::string> > _range_key_map;
-    mutable bthread_mutex_t _mutex;
+    RangeMap _range_key_map;
+    std::atomic<int64_t> _version{0};
     SchemaFactory* _factory;
 };
+
+// 每次compaction创建一个filter, 只在该compaction线程内使用, 可以缓存上一个key的查找结果
+class CachedSplitCompactionFilter : public rocksdb::CompactionFilter {
+public:
+    const char* Name() const override {
+        return "SplitCompactionFilter";
+    }
+    bool Filter(int /*level*/,
+                const rocksdb::Slice& key,
+                const rocksdb::Slice& value,
+                std::string* /*new_value*/,
+                bool* /*value_changed*/) const override {
+        return SplitCompactionFilter::get_instance()->filter(key, value, &_cache);
+    }
+private:
+    mutable SplitFilterCache _cache;
+};
+
+class SplitCompactionFilterFactory : public rocksdb::CompactionFilterFactory {
+public:
+    std::unique_ptr<rocksdb::CompactionFilter> CreateCompactionFilter(
+            const rocksdb::CompactionFilter::Context& /*context*/) override {
+        return std::unique_ptr<rocksdb::CompactionFilter>(new CachedSplitCompactionFilter);
+    }
+    const char* Name() const override {
+        return "SplitCompactionFilterFactory";
+    }
+};
 }//namespace
 
 /* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
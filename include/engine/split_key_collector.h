@@ -0,0 +1,97 @@
+// Copyright (c) 2018-present Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <rocksdb/table_properties.h>
+#include <gflags/gflags.h>
+
+namespace baikaldb {
+DECLARE_int32(split_sample_interval);
+
+// flush/compaction生成sst时, 对每个(region_id, index_id)前缀每隔N个key采样一个,
+// 写入sst的user collected properties, 分裂时据此选取分裂点而无需扫描region
+class SplitKeyCollector : public rocksdb::TablePropertiesCollector {
+public:
+    static const std::string SAMPLES_PROPERTY;
+    static const size_t PREFIX_LEN = sizeof(int64_t) * 2;
+
+    rocksdb::Status AddUserKey(const rocksdb::Slice& key, const rocksdb::Slice& /*value*/,
+                               rocksdb::EntryType type, rocksdb::SequenceNumber /*seq*/,
+                               uint64_t /*file_size*/) override {
+        if (type != rocksdb::kEntryPut || key.size() <= PREFIX_LEN) {
+            return rocksdb::Status::OK();
+        }
+        if (_cur_prefix.size() != PREFIX_LEN
+                || memcmp(_cur_prefix.data(), key.data(), PREFIX_LEN) != 0) {
+            _cur_prefix.assign(key.data(), PREFIX_LEN);
+            _prefix_count = 0;
+        }
+        if (_prefix_count++ % FLAGS_split_sample_interval == 0) {
+            uint32_t len = key.size();
+            _samples.append((const char*)&len, sizeof(len));
+            _samples.append(key.data(), key.size());
+        }
+        return rocksdb::Status::OK();
+    }
+
+    rocksdb::Status Finish(rocksdb::UserCollectedProperties* properties) override {
+        (*properties)[SAMPLES_PROPERTY] = _samples;
+        return rocksdb::Status::OK();
+    }
+
+    rocksdb::UserCollectedProperties GetReadableProperties() const override {
+        return rocksdb::UserCollectedProperties();
+    }
+
+    const char* Name() const override {
+        return "SplitKeyCollector";
+    }
+
+    // 解析一个sst中的采样key, 追加到keys
+    static void parse_samples(const std::string& samples, std::vector<std::string>* keys) {
+        size_t pos = 0;
+        while (pos + sizeof(uint32_t) <= samples.size()) {
+            uint32_t len = 0;
+            memcpy(&len, samples.data() + pos, sizeof(len));
+            pos += sizeof(len);
+            if (pos + len > samples.size()) {
+                break;
+            }
+            keys->emplace_back(samples.data() + pos, len);
+            pos += len;
+        }
+    }
+
+private:
+    std::string _cur_prefix;
+    int64_t _prefix_count = 0;
+    std::string _samples;
+};
+
+class SplitKeyCollectorFactory : public rocksdb::TablePropertiesCollectorFactory {
+public:
+    rocksdb::TablePropertiesCollector* CreateTablePropertiesCollector(
+            rocksdb::TablePropertiesCollectorFactory::Context /*context*/) override {
+        return new SplitKeyCollector();
+    }
+    const char* Name() const override {
+        return "SplitKeyCollectorFactory";
+    }
+};
+}//namespace
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
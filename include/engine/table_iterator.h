@@ -154,6 +154,7 @@ protected:
     //int64_t               _index;
     //int64_t               _pk_index;
     int64_t                 _region;
+    int64_t                 _key_prefix;    // data key的前8字节, 索引布局时为分区前缀
     pb::RegionInfo*          _region_info;
     IndexInfo*               _index_info;
     IndexInfo*               _pri_info;
@@ -172,11 +173,17 @@ protected:
 
     int _prefix_len = sizeof(int64_t) * 2;
 
+    bool                    _use_ttl = false;   // value带过期时间头
+    int64_t                 _ttl_now_us = 0;    // 本次扫描判断过期的时间点
+
     bool _fits_left_bound();
 
     bool _fits_right_bound();
 
-    bool _fits_region();
+    bool _fits_region(const rocksdb::Slice& value);
+
+    // 取当前value, ttl表去掉过期时间头, 已过期时返回false
+    bool _get_value(rocksdb::Slice* value);
 
     bool _fits_prefix(rocksdb::Iterator* iter, int32_t field_id = 0); // cstore
     bool is_cstore();
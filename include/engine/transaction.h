@@ -22,6 +22,8 @@
 #include "table_iterator.h"
 #include "rocks_wrapper.h"
 #include "mut_table_key.h"
+#include "key_layout.h"
+#include "ttl_value.h"
 #include "proto/meta.interface.pb.h"
 #include "proto/store.interface.pb.h" 
 
@@ -88,6 +90,11 @@ public:
         _ddl_state = nullptr;
     }
 
+    // raft apply中开启的事务在各副本上独立加锁等锁, 死锁检测选出的victim各副本不一致,
+    // 需要在begin之前关闭
+    void disable_deadlock_detect() {
+        _deadlock_detect = false;
+    }
     // Begin a new transaction
     int begin();
     int begin(rocksdb::TransactionOptions txn_opt);
@@ -202,6 +209,11 @@ public:
         return _is_rolledback;
     }
 
+    // 当前语句加锁时被死锁检测选为victim
+    bool is_deadlock() {
+        return _is_deadlock;
+    }
+
     bool prepare_apply() {
         return _prepare_apply;
     }
@@ -239,6 +251,13 @@ public:
         }
         _table_info = SchemaFactory::get_instance()->get_table_info_ptr(_region_info->table_id());
         _pri_info = SchemaFactory::get_instance()->get_index_info_ptr(_region_info->table_id());
+        // 全局索引region的value不带过期时间
+        _ttl_duration = 0;
+        if (_table_info != nullptr && _table_info->use_ttl_value()
+                && (!_region_info->has_main_table_id()
+                    || _region_info->main_table_id() == _region_info->table_id())) {
+            _ttl_duration = _table_info->ttl_duration;
+        }
         if (is_cstore()) {
            _pri_field_ids.clear();
            for (auto& field_info : _pri_info->fields) {
@@ -246,6 +265,20 @@ public:
            }
        }
     }
+    bool use_ttl() const {
+        return _ttl_duration > 0;
+    }
+    // ttl表判断过期和计算过期时间使用的时间, raft apply中取自leader写入请求的时间,
+    // 保证各副本结果一致; 未设置时取事务第一次使用时的本地时间
+    void set_ttl_timestamp_us(int64_t timestamp_us) {
+        _ttl_timestamp_us = timestamp_us;
+    }
+    int64_t ttl_timestamp_us() {
+        if (_ttl_timestamp_us == 0) {
+            _ttl_timestamp_us = butil::gettimeofday_us();
+        }
+        return _ttl_timestamp_us;
+    }
     bool is_cstore() {
         if (_table_info.get() == nullptr) {
             DB_FATAL("error: no table_info");
@@ -338,8 +371,27 @@ public:
     int         dml_num_affected_rows = 0; //for autocommit dml return
     int64_t     batch_num_increase_rows = 0;//用于batch txn
     pb::ErrCode err_code = pb::SUCCESS;
+    std::string first_primary_key; //第一个读写的主键(不含前缀), 用于region负载采样
 
 private:
+    // 加行锁并按表统计锁等待耗时, 检测到死锁时标记当前事务
+    rocksdb::Status lock_for_update(int64_t table_id, const std::string& key, std::string* value);
+
+    // 当前region为索引布局时, key前缀为分区前缀而非region_id
+    int64_t key_prefix(int64_t region) const {
+        if (_region_info != nullptr && _region_info->region_id() == region) {
+            return data_key_prefix(*_region_info);
+        }
+        return region;
+    }
+
+    // ttl表写入的value加上过期时间头
+    void ttl_encode_value(std::string* value) {
+        if (use_ttl()) {
+            ttl_encode(ttl_expire_time_us(_ttl_duration, ttl_timestamp_us()), value);
+        }
+    }
+
     int get_update_primary(
             int64_t         region, 
             IndexInfo&      pk_index, 
@@ -372,6 +424,8 @@ private:
     bool                            _is_prepared = false;
     bool                            _is_finished = false;
     bool                            _is_rolledback = false;
+    bool                            _is_deadlock = false;
+    bool                            _deadlock_detect = true;
     bool                            _prepare_apply = false;
     int64_t                         _prepare_time_us = 0;
     std::stack<int>                 _save_point_seq;
@@ -394,6 +448,8 @@ private:
     SmartTable                      _table_info; // for cstore
     SmartIndex                      _pri_info;  // for cstore
     std::set<int32_t>               _pri_field_ids; // for cstore
+    int64_t                         _ttl_duration = 0; // 秒, >0时value带过期时间
+    int64_t                         _ttl_timestamp_us = 0;
 
     bthread_mutex_t                 _txn_mutex;
     SmartDllTransactionState            _ddl_state = nullptr;
@@ -22,17 +22,20 @@ namespace baikaldb {
 DECLARE_int32(transaction_clear_delay_ms);
 //class Region;
 
-// TODO: remove locking for thread-safe codes
+// 事务按txn_id分片, 每个分片单独加锁, 并发dml只在同一分片内互斥
 class TransactionPool {
 public:
+    static const uint32_t TXN_MAP_COUNT = 31;
     virtual ~TransactionPool() {}
 
     void close() {
-        std::unique_lock<std::mutex> lock(_map_mutex);
-        auto iter = _txn_map.begin();
-        while (iter != _txn_map.end()) {
-            iter->second = nullptr;
-            iter = _txn_map.erase(iter);
+        for (auto& shard : _shards) {
+            std::unique_lock<std::mutex> lock(shard.mutex);
+            auto iter = shard.txn_map.begin();
+            while (iter != shard.txn_map.end()) {
+                iter->second = nullptr;
+                iter = shard.txn_map.erase(iter);
+            }
         }
     }
 
@@ -41,26 +44,30 @@ public:
     int init(int64_t region_id);
 
     // -1 means insert error (already exists)
-    int begin_txn(uint64_t txn_id, SmartTransaction& txn);
+    int begin_txn(uint64_t txn_id, SmartTransaction& txn, bool deadlock_detect = true);
 
     void remove_txn(uint64_t txn_id);
 
     SmartTransaction get_txn(uint64_t txn_id) {
-        std::unique_lock<std::mutex> lock(_map_mutex);
-        if (_txn_map.count(txn_id) == 0) {
+        TxnMapShard& shard = get_shard(txn_id);
+        std::unique_lock<std::mutex> lock(shard.mutex);
+        auto iter = shard.txn_map.find(txn_id);
+        if (iter == shard.txn_map.end()) {
             return nullptr;
         }
-        return _txn_map[txn_id];
+        return iter->second;
     }
     // -1 not found;
     int get_finished_txn_affected_rows(uint64_t txn_id) {
-
-        std::unique_lock<std::mutex> lock(_map_mutex);
-        if (_finished_txn_map.read()->count(txn_id) == 1) {
-            return _finished_txn_map.read()->at(txn_id);
+        TxnMapShard& shard = get_shard(txn_id);
+        std::unique_lock<std::mutex> lock(shard.mutex);
+        auto iter = shard.finished_txn_map.read()->find(txn_id);
+        if (iter != shard.finished_txn_map.read()->end()) {
+            return iter->second;
         }
-        if (_finished_txn_map.read_background()->count(txn_id) == 1) {
-            return _finished_txn_map.read_background()->at(txn_id);
+        iter = shard.finished_txn_map.read_background()->find(txn_id);
+        if (iter != shard.finished_txn_map.read_background()->end()) {
+            return iter->second;
         }
         return -1;
     }
@@ -106,14 +113,23 @@ public:
     //清空所有的状态
     void clear();
 private:
+    struct TxnMapShard {
+        std::mutex mutex;
+        // txn_id => txn handler mapping
+        std::unordered_map<uint64_t, SmartTransaction>  txn_map;
+        // txn_id => affected_rows use for idempotent
+        // 两代轮转回收: 每个清理周期丢弃上上代, 已结束事务的记录至少保留一个周期
+        DoubleBuffer<std::unordered_map<uint64_t, int>> finished_txn_map;
+    };
+    TxnMapShard& get_shard(uint64_t txn_id) {
+        return _shards[txn_id % TXN_MAP_COUNT];
+    }
+    void clear_transactions(TxnMapShard& shard, int32_t clear_delay_ms);
+
     int64_t _region_id = 0;
 
-    // txn_id => txn handler mapping
-    std::unordered_map<uint64_t, SmartTransaction>  _txn_map;
-    // txn_id => affected_rows use for idempotent
-    DoubleBuffer<std::unordered_map<uint64_t, int>> _finished_txn_map;
+    TxnMapShard _shards[TXN_MAP_COUNT];
     TimeCost _clean_finished_txn_cost;
-    std::mutex _map_mutex;
 
     BthreadCond  _num_prepared_txn;  // total number of prepared transactions
     std::atomic<int32_t> _txn_count;
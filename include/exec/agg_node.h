@@ -48,7 +48,8 @@ public:
     virtual void close(RuntimeState* state);
     virtual void transfer_pb(int64_t region_id, pb::PlanNode* pb_node);
     void encode_agg_key(MemRow* row, MutTableKey& key);
-    void process_row_batch(RowBatch& batch);
+    // new_group_bytes: 新建分组的行占用的内存
+    void process_row_batch(RowBatch& batch, int64_t& new_group_bytes);
 private:
     //需要推导_group_tuple_id _agg_tuple_id内部slot的类型
     std::vector<ExprNode*> _group_exprs;
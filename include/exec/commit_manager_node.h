@@ -68,7 +68,7 @@ public:
         }
         if (state->optimize_1pc() == false) {
             client_conn->seq_id++;
-            ret = exec_commit_node(state, commit_node);
+            ret = exec_async_commit_node(state, commit_node);
         } else {
             DB_WARNING("TransactionNote: optimize_1pc, no commit: txn_id: %lu log_id:%lu", state->txn_id, state->log_id());
         }
@@ -81,6 +81,9 @@ public:
 
 protected:
     int init_schema_info(RuntimeState* state);
+    // 批量写入前对全文索引字段并发切词
+    void presegment_reverse(RuntimeState* state, const std::vector<SmartRecord>& records,
+            size_t begin, size_t end);
 
     int64_t _table_id = -1; //主表的table_id,不管是二级索引表还是主表
     int64_t _region_id = -1;
@@ -74,6 +74,7 @@ public:
         for (auto e : _children) {
             e->close(state);
         }
+        memory_release(state);
     }
     virtual std::vector<ExprNode*>* mutable_conjuncts() {
         return NULL;
@@ -171,6 +172,10 @@ public:
     }
     virtual pb::LockCmdType lock_type() { return pb::LOCK_INVALID; }
 protected:
+    // 物化的行计入query内存配额, 超出时设置错误码返回-1; close时归还
+    int memory_consume(RuntimeState* state, int64_t bytes);
+    void memory_release(RuntimeState* state);
+
     int64_t _limit = -1;
     int64_t _num_rows_returned = 0;
     bool _is_explain = false;
@@ -179,6 +184,7 @@ protected:
     ExecNode* _parent = nullptr;
     pb::PlanNode _pb_node;
     std::map<int64_t, pb::RegionInfo> _region_infos;
+    int64_t _used_bytes = 0;
     
     //返回给baikaldb的结果
     std::map<int64_t, std::vector<SmartRecord>> _return_records;
@@ -53,7 +53,9 @@ public:
 
 private:
     int handle_explain(RuntimeState* state);
-    int pack_ok(int num_affected_rows, NetworkSocket* client);
+    int pack_ok(RuntimeState* state, NetworkSocket* client);
+    int pack_ok(int num_affected_rows, int64_t last_insert_id, bool more_results,
+            NetworkSocket* client);
     // 先不用，err在外部填
     int pack_err();
     int pack_head();
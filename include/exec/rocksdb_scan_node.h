@@ -108,6 +108,8 @@ private:
     // 如果用了排序列做索引，就不需要排序了
     bool _sort_use_index = false;
     bool _scan_forward = true; //scan的方向
+    // 全文索引只取__weight最大的topk行
+    int64_t _reverse_topk = 0;
     
     //被选择的索引
     std::vector<SmartRecord> _left_records;
@@ -31,14 +31,19 @@ public:
             int32_t  seq_id,
             ExecNode* commit_fetch,
             std::map<int64_t, pb::RegionInfo>& region_infos);
+    static int add_commit_log_entry(uint64_t txn_id, const pb::CachePlan& commit_plan);
 
     static int remove_commit_log_entry(uint64_t txn_id);
+    //按commit日志中的plan提交事务, 用于异步提交和baikaldb重启后的事务恢复
+    static int exec_commit_plan(uint64_t txn_id, const pb::CachePlan& commit_plan);
     void set_op_type(pb::OpType op_type) {
         _op_type = op_type;
     }
     virtual int exec_begin_node(RuntimeState* state, ExecNode* begin_node);
     virtual int exec_prepared_node(RuntimeState* state, ExecNode* prepared_node, int64_t start_seq_id);
     virtual int exec_commit_node(RuntimeState* state, ExecNode* commit_node);
+    //开启async_commit时写完commit日志即返回, commit在后台完成
+    virtual int exec_async_commit_node(RuntimeState* state, ExecNode* commit_node);
     virtual int exec_rollback_node(RuntimeState* state, ExecNode* rollback_node);
 
 protected:
@@ -0,0 +1,79 @@
+// Copyright (c) 2018-present Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace baikaldb {
+
+// LIKE模式的编译结果, 替代逐行的boost::regex匹配
+// 常见模式走专用路径:
+//   'abc'   => LIKE_EXACT    长度比较 + memcmp
+//   'abc%'  => LIKE_PREFIX   memcmp
+//   '%abc'  => LIKE_SUFFIX   memcmp
+//   '%abc%' => LIKE_CONTAINS SIMD子串查找
+// 其余(含'_'或多个'%')走LIKE_GENERAL, 用回溯通配符匹配, 代价O(n*m)
+// 匹配按字节进行, '_'匹配单个字节, 与原先的regex语义一致
+class LikeMatcher {
+public:
+    enum MatchType {
+        LIKE_EXACT,
+        LIKE_PREFIX,
+        LIKE_SUFFIX,
+        LIKE_CONTAINS,
+        LIKE_GENERAL
+    };
+
+    // exact_like: FT_EXACT_LIKE语义, 大小写不敏感, 未转义的'|'分隔多个子模式
+    void compile(const std::string& pattern, char escape_char, bool exact_like);
+    bool match(const char* str, size_t len) const;
+    bool match(const std::string& str) const {
+        return match(str.data(), str.size());
+    }
+    // 每个子模式的类型, 用于测试和explain
+    std::vector<MatchType> match_types() const {
+        std::vector<MatchType> types;
+        for (auto& alt : _alternatives) {
+            types.push_back(alt.type);
+        }
+        return types;
+    }
+
+private:
+    // '|'分隔出的一个子模式
+    struct Alternative {
+        MatchType type = LIKE_GENERAL;
+        std::string literal;           // 非GENERAL时去掉'%'后的字面量
+        std::string pattern;           // GENERAL时的完整模式
+        std::vector<bool> is_wildcard; // pattern中的'%'/'_'是否为未转义的通配符
+    };
+    void add_alternative(const std::string& pattern, const std::vector<bool>& is_wildcard);
+    bool match_alternative(const Alternative& alt, const char* str, size_t len) const;
+    bool match_general(const Alternative& alt, const char* str, size_t len) const;
+    bool equal(const char* str, const char* literal, size_t len) const;
+
+    std::vector<Alternative> _alternatives;
+    bool _icase = false;
+};
+
+// 子串查找, 返回第一次出现的位置, 找不到返回nullptr
+// icase时needle需要已经是小写
+const char* like_find(const char* haystack, size_t haystack_len,
+        const char* needle, size_t needle_len, bool icase);
+}
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 */
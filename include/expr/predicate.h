@@ -18,6 +18,7 @@
 #include <boost/regex.hpp>
 #include "expr_value.h"
 #include "scalar_fn_call.h"
+#include "like_matcher.h"
 
 namespace baikaldb {
 class NotPredicate : public ScalarFnCall {
@@ -128,12 +129,14 @@ class LikePredicate : public ScalarFnCall {
 public:
     //todo liguoqiang
     virtual int open();
+    // 转换为等价的正则, 匹配已改用LikeMatcher, 仅用于对照测试
     void covent_pattern(const std::string& pattern);
     void covent_exact_pattern(const std::string& pattern);
     void hit_index(bool* is_eq, bool* is_prefix, std::string* prefix_value);
     virtual ExprValue get_value(MemRow* row);
 
 private:
+    LikeMatcher _matcher;
     boost::regex _regex;
     std::string _regex_pattern;
     char _escape_char = '\\';
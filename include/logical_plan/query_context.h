@@ -202,6 +202,16 @@ public:
     // user can enable 2pc by comments /*{"enable_2pc":1}*/ preceding a DML statement
     bool                enable_2pc = false;
     bool                is_cancelled = false;
+    // row count of each INSERT statement of a multi-stmt query merged into this plan
+    // (see FLAGS_batch_multi_insert), empty if not merged
+    std::vector<int>    batched_stmt_rows;
+    // first auto increment id of each merged statement, filled by AutoInc
+    std::vector<int64_t> batched_insert_ids;
+    // user can serve a SELECT from baikaldb result cache by comments
+    // /*{"result_cache":1}*/ preceding the statement (see FLAGS_result_cache_bytes)
+    bool                use_result_cache = false;
+    // NOW()/RAND()等结果随执行变化的函数, 此类查询不走结果缓存
+    bool                has_nondeterministic_fn = false;
     std::shared_ptr<QueryContext> kill_ctx;
 
 private:
@@ -53,6 +53,17 @@ public:
         }
     }
 
+    // 估算占用的内存, 用于query内存配额
+    int64_t used_size() const {
+        int64_t size = sizeof(MemRow);
+        for (auto& t : _tuples) {
+            if (t != nullptr) {
+                size += t->ByteSize();
+            }
+        }
+        return size;
+    }
+
     std::string* mutable_string(int32_t tuple_id, int32_t slot_id);
     // slot start with 1
     ExprValue get_value(int32_t tuple_id, int32_t slot_id);
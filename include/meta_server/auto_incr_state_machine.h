@@ -14,6 +14,7 @@
 
 #pragma once
 
+#include <mutex>
 #include <unordered_map>
 #include "common_state_machine.h"
 
@@ -40,16 +41,29 @@ public:
     bool have_data() {
         return _have_data;
     }
+    // 通过baikal心跳下发自增id租约的epoch
+    void process_baikal_heartbeat(pb::BaikalHeartBeatResponse* response);
 private:
+    // 已租出的id段可能与显式插入的id冲突或不符合修改后的自增值, epoch取当前日志的index
+    void bump_lease_epoch(int64_t table_id);
+    uint64_t get_lease_epoch(int64_t table_id);
+    void save_lease_epoch(std::string& epoch_string);
+    int load_lease_epoch(const std::string& epoch_file);
+
     void save_auto_increment(std::string& max_id_string);
     void save_snapshot(braft::Closure* done, 
                         braft::SnapshotWriter* writer,
-                        std::string max_id_string);
+                        std::string max_id_string,
+                        std::string epoch_string);
 
     int load_auto_increment(const std::string& max_id_file);
     int parse_json_string(const std::string& json_string);
 
     std::unordered_map<int64_t, uint64_t>               _auto_increment_map;
+    // 心跳线程读取, 需要加锁
+    std::mutex                                          _epoch_mutex;
+    std::unordered_map<int64_t, uint64_t>               _lease_epoch_map;
+    int64_t _apply_index = 0;
     bool _have_data = false;
 };
 
@@ -30,10 +30,24 @@ struct RegionStateInfo {
     pb::Status status; //实例状态
 }; 
 typedef std::shared_ptr<RegionStateInfo> SmartRegionStateInfo;
+//按table_id哈希分片的实例region信息, 每个分片单独加锁, 不同表的心跳、均衡和巡检互不阻塞
+struct RegionShard {
+    RegionShard() {
+        bthread_mutex_init(&mutex, NULL);
+    }
+    ~RegionShard() {
+        bthread_mutex_destroy(&mutex);
+    }
+    bthread_mutex_t mutex;
+    //实例和region_id的映射关系，在需要主动发送迁移实例请求时需要
+    std::unordered_map<std::string, std::unordered_map<int64_t, std::set<int64_t>>> instance_region_map;
+    //实例上每个表的leader数量, 只在meta_server的leader中内存保存
+    std::unordered_map<std::string, std::unordered_map<int64_t, int64_t>> instance_leader_count;
+};
 class RegionManager {
 public:
+    static const int REGION_SHARD_COUNT = 16;
     ~RegionManager() {
-        bthread_mutex_destroy(&_instance_region_mutex);
         bthread_mutex_destroy(&_count_mutex);
         bthread_mutex_destroy(&_resource_tag_mutex);
         bthread_mutex_destroy(&_log_entry_mutex);
@@ -93,6 +107,10 @@ public:
                     bool load_balance,
                     const pb::StoreHeartBeatRequest* request,
                     pb::StoreHeartBeatResponse* response);
+
+    //一个实例上有多个热点leader时, 将多余的热点leader迁到热点leader最少的peer
+    void hot_leader_balance(const pb::StoreHeartBeatRequest* request,
+                    pb::StoreHeartBeatResponse* response);
     
     void peer_load_balance(const std::unordered_map<int64_t, int64_t>& add_peer_counts,
                 std::unordered_map<int64_t, std::vector<int64_t>>& instance_regions,
@@ -109,8 +127,12 @@ public:
     void clear() {
         _region_info_map.clear();
         _region_state_map.clear();
-        _instance_region_map.clear();
-        _instance_leader_count.clear();
+        for (auto& shard : _shards) {
+            BAIDU_SCOPED_LOCK(shard.mutex);
+            shard.instance_region_map.clear();
+            shard.instance_leader_count.clear();
+        }
+        _instance_hot_leader_count.clear();
         RegionIncrementalMap* background = _incremental_regioninfo_map.read_background();
         background->clear();
         RegionIncrementalMap* frontground = _incremental_regioninfo_map.read();
@@ -133,22 +155,32 @@ public:
         }
     }
     void get_region_ids(const std::string& instance, std::vector<int64_t>& region_ids) {
-        BAIDU_SCOPED_LOCK(_instance_region_mutex);
-        if (_instance_region_map.find(instance) ==  _instance_region_map.end()) {
-            return;
-        }
-        for (auto& table_ids : _instance_region_map[instance]) {
+        std::unordered_map<int64_t, std::set<int64_t>> table_region_ids;
+        get_table_region_ids(instance, table_region_ids);
+        for (auto& table_ids : table_region_ids) {
             for (auto& region_id : table_ids.second) {
                 region_ids.push_back(region_id);
             }
         }
     }
-    void print_region_ids(const std::string& instance) {
-        BAIDU_SCOPED_LOCK(_instance_region_mutex);
-        if (_instance_region_map.find(instance) ==  _instance_region_map.end()) {
-            return;
+    //汇总所有分片中该实例上的region, key: table_id
+    void get_table_region_ids(const std::string& instance, 
+            std::unordered_map<int64_t, std::set<int64_t>>& table_region_ids) {
+        for (auto& shard : _shards) {
+            BAIDU_SCOPED_LOCK(shard.mutex);
+            auto iter = shard.instance_region_map.find(instance);
+            if (iter == shard.instance_region_map.end()) {
+                continue;
+            }
+            for (auto& table_ids : iter->second) {
+                table_region_ids[table_ids.first] = table_ids.second;
+            }
         }
-        for (auto& table_id : _instance_region_map[instance]) {
+    }
+    void print_region_ids(const std::string& instance) {
+        std::unordered_map<int64_t, std::set<int64_t>> table_region_ids;
+        get_table_region_ids(instance, table_region_ids);
+        for (auto& table_id : table_region_ids) {
             for (auto& region_id : table_id.second) {
                 DB_WARNING("table_id: %ld, region_id: %ld in store: %s", 
                         table_id.first, region_id, instance.c_str());
@@ -197,20 +229,22 @@ public:
         int64_t region_id = region_info.region_id();
         SmartRegionInfo region_ptr = _region_info_map.get(region_id);
         {
-            BAIDU_SCOPED_LOCK(_instance_region_mutex);
+            RegionShard& shard = get_shard(table_id);
+            BAIDU_SCOPED_LOCK(shard.mutex);
+            auto& instance_region_map = shard.instance_region_map;
             if (region_ptr != nullptr) {
                 for (auto& peer : region_ptr->peers()) {
-                    _instance_region_map[peer][table_id].erase(region_id);
+                    instance_region_map[peer][table_id].erase(region_id);
                 }
             }
             for (auto& peer : region_info.peers()) {
-                _instance_region_map[peer][table_id].insert(region_id);
+                instance_region_map[peer][table_id].insert(region_id);
             }
             //如果原peer下已不存在region，则erase这个table_id
             if (region_ptr != nullptr) {
                 for (auto& peer : region_ptr->peers()) {
-                    if (_instance_region_map[peer][table_id].size() <= 0) {
-                        _instance_region_map[peer].erase(table_id);
+                    if (instance_region_map[peer][table_id].size() <= 0) {
+                        instance_region_map[peer].erase(table_id);
                     } 
                 }
             }
@@ -266,21 +300,70 @@ public:
     }
    
     void set_instance_leader_count(const std::string& instance, const std::unordered_map<int64_t, int64_t>& table_leader_count) {
-        BAIDU_SCOPED_LOCK(_count_mutex);
-        _instance_leader_count[instance] = table_leader_count;
+        std::unordered_map<int64_t, int64_t> shard_leader_counts[REGION_SHARD_COUNT];
+        for (auto& table_count : table_leader_count) {
+            shard_leader_counts[shard_idx(table_count.first)].insert(table_count);
+        }
+        for (int i = 0; i < REGION_SHARD_COUNT; ++i) {
+            BAIDU_SCOPED_LOCK(_shards[i].mutex);
+            if (shard_leader_counts[i].empty()) {
+                _shards[i].instance_leader_count.erase(instance);
+            } else {
+                _shards[i].instance_leader_count[instance].swap(shard_leader_counts[i]);
+            }
+        }
     }
 
     int64_t get_leader_count(const std::string& instance, int64_t table_id) {
-        BAIDU_SCOPED_LOCK(_count_mutex);
-        if (_instance_leader_count.find(instance) == _instance_leader_count.end()
-                || _instance_leader_count[instance].find(table_id) == _instance_leader_count[instance].end()) {
+        RegionShard& shard = get_shard(table_id);
+        BAIDU_SCOPED_LOCK(shard.mutex);
+        auto iter = shard.instance_leader_count.find(instance);
+        if (iter == shard.instance_leader_count.end()
+                || iter->second.find(table_id) == iter->second.end()) {
             return 0;
         }
-        return _instance_leader_count[instance][table_id];
+        return iter->second[table_id];
+    }
+    int64_t get_leader_count(const std::string& instance) {
+        int64_t leader_count = 0;
+        for (auto& shard : _shards) {
+            BAIDU_SCOPED_LOCK(shard.mutex);
+            auto iter = shard.instance_leader_count.find(instance);
+            if (iter == shard.instance_leader_count.end()) {
+                continue;
+            }
+            for (auto& table_leader : iter->second) {
+                leader_count += table_leader.second;
+            }
+        }
+        return leader_count;
     }
     void add_leader_count(const std::string& instance, int64_t table_id) {
+        RegionShard& shard = get_shard(table_id);
+        BAIDU_SCOPED_LOCK(shard.mutex);
+        shard.instance_leader_count[instance][table_id]++;
+    }
+    void set_hot_leader_count(const std::string& instance, int64_t count) {
+        BAIDU_SCOPED_LOCK(_count_mutex);
+        _instance_hot_leader_count[instance] = count;
+    }
+    int64_t get_hot_leader_count(const std::string& instance) {
         BAIDU_SCOPED_LOCK(_count_mutex);
-        _instance_leader_count[instance][table_id]++;
+        auto iter = _instance_hot_leader_count.find(instance);
+        if (iter == _instance_hot_leader_count.end()) {
+            return 0;
+        }
+        return iter->second;
+    }
+    //增量心跳只带有变化的leader, 需要先收到一次全量心跳, 内存中的leader、used_size等信息才完整
+    //返回false表示该实例需要补一次全量心跳(如meta切主后)
+    bool check_full_heartbeat(const std::string& instance, bool delta_heartbeat) {
+        BAIDU_SCOPED_LOCK(_count_mutex);
+        if (!delta_heartbeat) {
+            _full_heartbeat_instances.insert(instance);
+            return true;
+        }
+        return _full_heartbeat_instances.count(instance) > 0;
     }
     std::string construct_region_key(int64_t region_id) {
         std::string region_key = MetaServer::SCHEMA_IDENTIFY + MetaServer::REGION_SCHEMA_IDENTIFY;
@@ -306,8 +389,13 @@ public:
                          pb::BaikalHeartBeatResponse* response, int64_t applied_index); 
     
 private:
+    static uint32_t shard_idx(int64_t table_id) {
+        return (uint64_t)table_id % REGION_SHARD_COUNT;
+    }
+    RegionShard& get_shard(int64_t table_id) {
+        return _shards[shard_idx(table_id)];
+    }
     RegionManager(): _max_region_id(0) {
-        bthread_mutex_init(&_instance_region_mutex, NULL);
         bthread_mutex_init(&_count_mutex, NULL);
         bthread_mutex_init(&_resource_tag_mutex, NULL);
         bthread_mutex_init(&_log_entry_mutex, NULL);
@@ -319,14 +407,15 @@ private:
     //region_id 与table_id的映射关系, key:region_id, value:table_id
     ThreadSafeMap<int64_t, SmartRegionInfo>             _region_info_map;
     
-    bthread_mutex_t                                     _instance_region_mutex;
-    //实例和region_id的映射关系，在需要主动发送迁移实例请求时需要
-    std::unordered_map<std::string, std::unordered_map<int64_t, std::set<int64_t>>>  _instance_region_map;
+    //实例region映射和leader数量按table_id分片
+    RegionShard                                         _shards[REGION_SHARD_COUNT];
 
     ThreadSafeMap<int64_t, RegionStateInfo>        _region_state_map;
     //该信息只在meta_server的leader中内存保存, 该map可以单用一个锁
     bthread_mutex_t                                     _count_mutex;
-    std::unordered_map<std::string, std::unordered_map<int64_t, int64_t>> _instance_leader_count;
+    std::unordered_map<std::string, int64_t>            _instance_hot_leader_count;
+    //成为leader后收到过全量心跳的实例
+    std::set<std::string>                               _full_heartbeat_instances;
     //临时方案，为了安全，每个resource_tag只控制单实例迁移
     bthread_mutex_t                                     _resource_tag_mutex;
     std::map<std::string, std::string>                         _resource_tag_delete_region_map;
@@ -14,10 +14,50 @@
 
 #pragma once
 
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
 #include "query_context.h"
 #include "meta_server_interact.hpp"
 namespace baikaldb {
 DECLARE_string(meta_server_bns);
+// db节点从meta租用的一段自增id, 在本地分配, 剩余不足时异步预取下一段
+// id段由meta的raft状态机分配并持久化, meta切主后已租出的段不会被重复分配
+// 段长按消耗速度自适应: 一段用得太快则翻倍, 太慢则减半
+// 显式插入id或修改自增值时meta上该表的epoch增大, 随心跳下发, 之前租用的段全部作废
+class AutoIncrLease {
+public:
+    typedef std::function<int(int64_t count, pb::MetaManagerResponse& response)> FetchFunc;
+    explicit AutoIncrLease(int64_t table_id);
+    AutoIncrLease(int64_t table_id, const FetchFunc& fetch_func);
+    ~AutoIncrLease() {
+        bthread_mutex_destroy(&_mutex);
+    }
+    // 分配count个连续的id, 起始id写入start_id
+    int alloc(int64_t count, int64_t* start_id);
+    void update_epoch(uint64_t epoch);
+
+private:
+    // 从meta获取至少count个id, 不持有_mutex
+    int fetch(int64_t count, int64_t* start_id, int64_t* end_id, uint64_t* epoch);
+    // 以下调用时持有_mutex
+    // 段在更新的epoch之前租用时返回false
+    bool check_epoch(uint64_t epoch);
+    void adjust_step();
+    void prefetch();
+
+    int64_t _table_id;
+    FetchFunc _fetch_func;
+    bthread_mutex_t _mutex;
+    std::deque<std::pair<int64_t, int64_t>> _segments; // 已租用未分配的[start, end)
+    uint64_t _epoch = 0;
+    int64_t _step;
+    bool _fetching = false;
+    TimeCost _step_time;   // 距上次租用的时间
+};
+
 class AutoInc {
 public:
     static MetaServerInteract auto_incr_meta_inter;
@@ -28,6 +68,13 @@ public:
     static int init_meta_inter() {
         return auto_incr_meta_inter.init_internal(FLAGS_meta_server_bns);
     }
+    static AutoIncrLease* get_lease(int64_t table_id);
+    // 心跳下发的epoch, 只更新已存在的租约
+    static void update_lease_epoch(int64_t table_id, uint64_t epoch);
+
+private:
+    static std::mutex _lease_mutex;
+    static std::unordered_map<int64_t, std::unique_ptr<AutoIncrLease>> _leases;
 };
 }
 
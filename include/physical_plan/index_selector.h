@@ -70,6 +70,15 @@ private:
             int32_t tuple_id, int32_t slot_id,
             const IndexInfo& index_info, int field_cnt, std::vector<ExprValue>* values);
 
+    //全文索引能否只取__weight最大的topk行, 不能返回0
+    int64_t reverse_topk(const std::function<int32_t(int32_t, int32_t)>& get_slot_id,
+                         QueryContext* ctx,
+                         SortNode* sort_node,
+                         std::vector<ExprNode*>* conjuncts,
+                         int64_t table_id,
+                         int32_t tuple_id,
+                         int64_t index_id);
+
     //检查order by是否可以使用索引
     bool check_sort_use_index(const std::function<int(int, int)>& get_slot_id, 
                               IndexInfo& index_info, 
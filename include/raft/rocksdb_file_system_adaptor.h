@@ -15,6 +15,7 @@
 #pragma once
 
 #include <map>
+#include <deque>
 #ifdef BAIDU_INTERNAL
 #include <raft/file_system_adaptor.h>
 #else
@@ -32,6 +33,72 @@ const std::string SNAPSHOT_META_FILE_WITH_SLASH = "/" + SNAPSHOT_META_FILE;
 
 class RocksdbFileSystemAdaptor;
 
+// 数据文件按采样key切分为多个区间, 每个区间一个bthread预读成内存块, 取数据时按区间顺序取出
+// 拼接结果与单个迭代器顺序读取一致, 块的边界只依赖快照数据, braft重试时可以重放
+class ParallelSnapshotReader {
+public:
+    // boundaries: [start, k1, k2, ..., end], 相邻两个key组成一个区间
+    ParallelSnapshotReader(int64_t region_id, const rocksdb::Snapshot* snapshot,
+            const std::vector<std::string>& boundaries);
+    ~ParallelSnapshotReader();
+    void start();
+    void stop();
+    // 按顺序取出整块数据, 直到不少于size字节或读完; out为nullptr时丢弃
+    // 返回取出的字节数, 出错返回-1
+    int64_t read(butil::IOBuf* out, size_t size);
+    bool done();
+    size_t range_count() const {
+        return _ranges.size();
+    }
+private:
+    struct RangeContext {
+        std::string start;
+        std::string end;
+        rocksdb::Slice end_slice;
+        std::unique_ptr<rocksdb::Iterator> iter;
+        std::deque<butil::IOBuf> blocks;
+        int64_t buffered_bytes = 0;
+        bool done = false;
+        Bthread bth;
+    };
+    void produce(RangeContext* range);
+
+    int64_t _region_id;
+    const rocksdb::Snapshot* _snapshot;
+    std::vector<std::unique_ptr<RangeContext>> _ranges;
+    size_t _consume_idx = 0;
+    bool _running = false;
+    bool _error = false;
+    bthread_mutex_t _mutex;
+    bthread_cond_t _cond;
+};
+
+// 本store正在发送的snapshot进度, 通过bvar snapshot_transfer_progress查看
+// total取region的used_size, 只是估算
+class SnapshotTransferStat {
+public:
+    static SnapshotTransferStat* get_instance() {
+        static SnapshotTransferStat _instance;
+        return &_instance;
+    }
+    void start(int64_t region_id, int64_t total_bytes);
+    void add(int64_t region_id, int64_t bytes);
+    void finish(int64_t region_id);
+    std::string dump();
+private:
+    SnapshotTransferStat();
+    struct Progress {
+        int64_t total_bytes = 0;
+        int64_t sent_bytes = 0;
+        TimeCost cost;
+    };
+    bthread_mutex_t _mutex;
+    std::map<int64_t, Progress> _progress;
+    bvar::Adder<int64_t> _send_bytes;
+    bvar::PerSecond<bvar::Adder<int64_t>> _send_bytes_per_second;
+    bvar::PassiveStatus<std::string> _progress_status;
+};
+
 struct IteratorContext {
     bool reading = false;
     std::unique_ptr<rocksdb::Iterator> iter;
@@ -41,12 +108,17 @@ struct IteratorContext {
     bool is_meta_sst = false;
     int64_t offset = 0;
     bool done = false;
+    // 数据文件使用并发预读, 重试时按boundaries重建
+    std::vector<std::string> boundaries;
+    std::unique_ptr<ParallelSnapshotReader> parallel_reader;
 };
 
 struct SnapshotContext {
-    SnapshotContext()
-        : snapshot(RocksWrapper::get_instance()->get_snapshot()) {}
+    explicit SnapshotContext(int64_t region_id)
+        : region_id(region_id),
+          snapshot(RocksWrapper::get_instance()->get_snapshot()) {}
     ~SnapshotContext() {
+        SnapshotTransferStat::get_instance()->finish(region_id);
         if (data_context != nullptr) {
             delete data_context;
         }
@@ -57,6 +129,7 @@ struct SnapshotContext {
             RocksWrapper::get_instance()->relase_snapshot(snapshot);
         }
     }
+    int64_t region_id = 0;
     const rocksdb::Snapshot* snapshot = nullptr;
     IteratorContext* data_context = nullptr;
     IteratorContext* meta_context = nullptr;
@@ -113,6 +186,7 @@ protected:
                         bool is_meta_reader);
 
 private:
+    ssize_t read_data(butil::IOPortal* portal, off_t offset, size_t size);
     //把rocksdb的key 和 value 串行化到iobuf中，通过rpc发送到接受peer
     int64_t serialize_to_iobuf(butil::IOPortal* portal, const rocksdb::Slice& key) {
         if (portal != nullptr) {
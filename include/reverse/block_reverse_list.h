@@ -0,0 +1,328 @@
+// Copyright (c) 2018-present Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <gflags/gflags.h>
+#include "reverse_common.h"
+#include "proto/reverse.pb.h"
+
+namespace baikaldb {
+DECLARE_bool(reverse_block_posting_list);
+DECLARE_int32(reverse_posting_block_size);
+
+// 第三层倒排链表的分块压缩格式
+// value = 0xFF + BlockReverseList, pb格式的ReverseList首字节为0x0A或为空, 可据此区分
+// 主键是memcomparable的字节序列, 块内key相对前一个key做前缀压缩:
+//   varint(shared) + varint(unshared) + suffix + varint(node_len) + 去掉key的节点pb
+// 检索时只解析块的跳表(first_key), advance时按跳表定位, 只解码命中的块
+const char BLOCK_REVERSE_LIST_FLAG = '\xFF';
+
+inline bool is_block_reverse_list(const std::string& value) {
+    return !value.empty() && value[0] == BLOCK_REVERSE_LIST_FLAG;
+}
+
+inline void put_block_varint(std::string* out, uint64_t value) {
+    while (value >= 0x80) {
+        out->append(1, (char)(value | 0x80));
+        value >>= 7;
+    }
+    out->append(1, (char)value);
+}
+
+inline bool get_block_varint(const char*& ptr, const char* end, uint64_t* value) {
+    uint64_t result = 0;
+    for (int shift = 0; shift <= 63 && ptr < end; shift += 7) {
+        uint64_t byte = (uint8_t)*ptr++;
+        result |= (byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            *value = result;
+            return true;
+        }
+    }
+    return false;
+}
+
+template<typename ReverseNode, typename ReverseList>
+int encode_block_reverse_list(const ReverseList& list, std::string* value) {
+    int block_size = std::max(FLAGS_reverse_posting_block_size, 1);
+    pb::BlockReverseList block_list;
+    block_list.set_node_count(list.reverse_nodes_size());
+    pb::ReverseBlock* block = nullptr;
+    std::string last_key;
+    std::string node_value;
+    ReverseNode node;
+    for (int i = 0; i < list.reverse_nodes_size(); ++i) {
+        const ReverseNode& origin = list.reverse_nodes(i);
+        const std::string& key = origin.key();
+        if (i % block_size == 0) {
+            block = block_list.add_blocks();
+            block->set_first_key(key);
+            block->set_node_count(0);
+            last_key.clear();
+        }
+        size_t shared = 0;
+        size_t max_shared = std::min(last_key.size(), key.size());
+        while (shared < max_shared && last_key[shared] == key[shared]) {
+            ++shared;
+        }
+        node = origin;
+        node.clear_key();
+        node_value.clear();
+        if (!node.SerializeToString(&node_value)) {
+            DB_WARNING("serialize reverse node failed");
+            return -1;
+        }
+        std::string* data = block->mutable_data();
+        put_block_varint(data, shared);
+        put_block_varint(data, key.size() - shared);
+        data->append(key.data() + shared, key.size() - shared);
+        put_block_varint(data, node_value.size());
+        data->append(node_value);
+        block->set_node_count(block->node_count() + 1);
+        last_key = key;
+    }
+    value->clear();
+    value->append(1, BLOCK_REVERSE_LIST_FLAG);
+    if (!block_list.AppendToString(value)) {
+        DB_WARNING("serialize block reverse list failed");
+        return -1;
+    }
+    return 0;
+}
+
+// 解码一个块, 追加到list
+template<typename ReverseNode, typename ReverseList>
+int decode_reverse_block(const pb::ReverseBlock& block, ReverseList* list) {
+    const char* ptr = block.data().data();
+    const char* end = ptr + block.data().size();
+    std::string key;
+    for (uint32_t i = 0; i < block.node_count(); ++i) {
+        uint64_t shared = 0;
+        uint64_t unshared = 0;
+        uint64_t node_len = 0;
+        if (!get_block_varint(ptr, end, &shared) || !get_block_varint(ptr, end, &unshared)
+                || shared > key.size() || unshared > (uint64_t)(end - ptr)) {
+            DB_FATAL("decode reverse block key failed");
+            return -1;
+        }
+        key.resize(shared);
+        key.append(ptr, unshared);
+        ptr += unshared;
+        if (!get_block_varint(ptr, end, &node_len) || node_len > (uint64_t)(end - ptr)) {
+            DB_FATAL("decode reverse block node failed");
+            return -1;
+        }
+        ReverseNode* node = list->add_reverse_nodes();
+        if (!node->ParseFromArray(ptr, node_len)) {
+            DB_FATAL("parse reverse node from block failed");
+            return -1;
+        }
+        ptr += node_len;
+        node->set_key(key);
+    }
+    return 0;
+}
+
+// 按value的格式解析为ReverseList或BlockReverseList
+template<typename ReverseList>
+int parse_reverse_list(const std::string& value, MessageSP& list_ptr) {
+    if (is_block_reverse_list(value)) {
+        MessageSP tmp_ptr(new pb::BlockReverseList());
+        if (!tmp_ptr->ParseFromArray(value.data() + 1, value.size() - 1)) {
+            return -1;
+        }
+        list_ptr = tmp_ptr;
+        return 0;
+    }
+    MessageSP tmp_ptr(new ReverseList());
+    if (!tmp_ptr->ParseFromString(value)) {
+        return -1;
+    }
+    list_ptr = tmp_ptr;
+    return 0;
+}
+
+template<typename ReverseList>
+int reverse_list_size(const google::protobuf::Message* list) {
+    if (list == nullptr) {
+        return 0;
+    }
+    auto block_list = dynamic_cast<const pb::BlockReverseList*>(list);
+    if (block_list != nullptr) {
+        return block_list->node_count();
+    }
+    return ((const ReverseList*)list)->reverse_nodes_size();
+}
+
+// merge需要完整的ReverseList, 分块格式在此全部解码
+template<typename ReverseNode, typename ReverseList>
+int to_reverse_list(MessageSP& list_ptr) {
+    auto block_list = dynamic_cast<pb::BlockReverseList*>(list_ptr.get());
+    if (block_list == nullptr) {
+        return 0;
+    }
+    MessageSP tmp_ptr(new ReverseList());
+    ReverseList* list = (ReverseList*)tmp_ptr.get();
+    list->mutable_reverse_nodes()->Reserve(block_list->node_count());
+    for (auto& block : block_list->blocks()) {
+        if (decode_reverse_block<ReverseNode, ReverseList>(block, list) != 0) {
+            return -1;
+        }
+    }
+    list_ptr = tmp_ptr;
+    return 0;
+}
+
+// 按序号访问两种格式的倒排链表
+// 分块格式只保留当前块的解码结果, node()返回的指针在切换到其他块后失效
+template<typename ReverseNode, typename ReverseList>
+class ReverseListCursor {
+public:
+    void init(google::protobuf::Message* list) {
+        _list = nullptr;
+        _block_list = dynamic_cast<pb::BlockReverseList*>(list);
+        _block_start.clear();
+        _curr_block = -1;
+        if (_block_list == nullptr) {
+            _list = (ReverseList*)list;
+            return;
+        }
+        uint32_t start = 0;
+        for (auto& block : _block_list->blocks()) {
+            _block_start.push_back(start);
+            start += block.node_count();
+        }
+    }
+    int32_t size() const {
+        if (_block_list != nullptr) {
+            return _block_list->node_count();
+        }
+        return _list != nullptr ? _list->reverse_nodes_size() : 0;
+    }
+    ReverseNode* node(int32_t ix) {
+        if (_list != nullptr) {
+            return _list->mutable_reverse_nodes(ix);
+        }
+        int32_t block_ix = _curr_block;
+        if (block_ix < 0 || ix < (int32_t)_block_start[block_ix]
+                || ix >= (int32_t)(_block_start[block_ix] + _block_nodes.reverse_nodes_size())) {
+            block_ix = std::upper_bound(_block_start.begin(), _block_start.end(), (uint32_t)ix)
+                - _block_start.begin() - 1;
+            if (load_block(block_ix) != 0) {
+                return nullptr;
+            }
+        }
+        return _block_nodes.mutable_reverse_nodes(ix - _block_start[block_ix]);
+    }
+    // [first, size)中第一个key >= target_id的序号, 不存在返回-1
+    int32_t lower_bound(int32_t first, const std::string& target_id) {
+        int32_t count = size();
+        if (first < 0 || first >= count) {
+            return -1;
+        }
+        if (_list != nullptr) {
+            return list_lower_bound(first, count - 1, target_id);
+        }
+        return block_lower_bound(first, target_id);
+    }
+
+private:
+    int load_block(int32_t block_ix) {
+        _block_nodes.Clear();
+        _curr_block = -1;
+        if (decode_reverse_block<ReverseNode, ReverseList>(
+                    _block_list->blocks(block_ix), &_block_nodes) != 0) {
+            return -1;
+        }
+        _curr_block = block_ix;
+        return 0;
+    }
+    //针对倒排链表特征的优化，先倍增缩小区间再二分查找
+    int32_t list_lower_bound(int32_t first, int32_t last, const std::string& target_id) {
+        int32_t j = 1;
+        int32_t node_count_off = last - first;
+        while (j <= node_count_off
+                && target_id.compare(_list->reverse_nodes(first + j).key()) > 0) {
+            j <<= 1;
+        }
+        last = first + std::min(j, node_count_off);
+        first = first + (j >> 1);
+        if (target_id.compare(_list->reverse_nodes(last).key()) > 0) {
+            return -1;
+        }
+        while (first < last) {
+            int32_t mid = first + ((last - first) >> 1);
+            int res = target_id.compare(_list->reverse_nodes(mid).key());
+            if (res < 0) {
+                last = mid;
+            } else if (res > 0) {
+                first = mid + 1;
+            } else {
+                return mid;
+            }
+        }
+        return first;
+    }
+    // 先在跳表上倍增+二分找到最后一个first_key <= target_id的块, 只解码这一个块
+    int32_t block_lower_bound(int32_t first, const std::string& target_id) {
+        int32_t block_count = _block_list->blocks_size();
+        int32_t lo = std::upper_bound(_block_start.begin(), _block_start.end(), (uint32_t)first)
+            - _block_start.begin() - 1;
+        int32_t step = 1;
+        while (lo + step < block_count
+                && target_id.compare(_block_list->blocks(lo + step).first_key()) >= 0) {
+            lo += step;
+            step <<= 1;
+        }
+        int32_t hi = std::min(lo + step, block_count);
+        while (lo + 1 < hi) {
+            int32_t mid = lo + ((hi - lo) >> 1);
+            if (target_id.compare(_block_list->blocks(mid).first_key()) >= 0) {
+                lo = mid;
+            } else {
+                hi = mid;
+            }
+        }
+        if (_curr_block != lo && load_block(lo) != 0) {
+            return -1;
+        }
+        int32_t begin = std::max(first, (int32_t)_block_start[lo]) - _block_start[lo];
+        int32_t end = _block_nodes.reverse_nodes_size();
+        while (begin < end) {
+            int32_t mid = begin + ((end - begin) >> 1);
+            if (_block_nodes.reverse_nodes(mid).key().compare(target_id) < 0) {
+                begin = mid + 1;
+            } else {
+                end = mid;
+            }
+        }
+        if (begin < _block_nodes.reverse_nodes_size()) {
+            return _block_start[lo] + begin;
+        }
+        // 当前块都小于target_id, 下一块的first_key一定大于target_id
+        return lo + 1 < block_count ? (int32_t)_block_start[lo + 1] : -1;
+    }
+
+    ReverseList* _list = nullptr;
+    pb::BlockReverseList* _block_list = nullptr;
+    std::vector<uint32_t> _block_start;   //每个块第一个节点的序号
+    int32_t _curr_block = -1;
+    ReverseList _block_nodes;
+};
+}
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
@@ -225,6 +225,38 @@ private:
     BooleanExecutor<Schema>* _op_executor;
 };
 
+// top-k节点, 只保留分数(weight)最高的k个结果
+// 每个子节点带一个分数上界, 按WAND算法: 子节点按当前id排序后累加上界,
+// 累加值超过当前第k大分数的位置为pivot, pivot之前的子节点直接advance到pivot的id,
+// 跳过不可能进入top-k的文档
+// 结果按id有序输出, 可以继续作为其他节点的子节点
+template <typename Schema>
+class WandBooleanExecutor : public OperatorBooleanExecutor<Schema> {
+public:
+    typedef typename Schema::PostingNodeT PostingNodeT;
+    typedef typename Schema::PrimaryIdT PrimaryIdT;
+
+    explicit WandBooleanExecutor(
+                    int64_t topk,
+                    bool_executor_type type = NODE_NOT_COPY, 
+                    BoolArg* arg = nullptr);
+    virtual ~WandBooleanExecutor();
+
+    virtual const PostingNodeT* current_node();
+    virtual const PrimaryIdT* current_id();
+    virtual const PostingNodeT* next();
+    virtual const PostingNodeT* advance(const PrimaryIdT& target_id);
+
+    void add_scored(BooleanExecutor<Schema>* executor, float upper_bound);
+
+private:
+    void collect_topk();
+    int64_t _topk;
+    std::vector<float> _upper_bounds;
+    std::vector<PostingNodeT> _results;
+    size_t _result_idx = 0;
+};
+
 }  // namespace boolean_engine
 
 #include "boolean_executor.hpp"
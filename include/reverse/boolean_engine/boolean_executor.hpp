@@ -14,6 +14,7 @@
 
 #include <functional>
 #include <algorithm>
+#include <queue>
 #include "proto/reverse.pb.h"
 
 namespace baikaldb {
@@ -477,6 +478,153 @@ void WeightedBooleanExecutor<Schema>::add_weight() {
         }
     }
 }
+
+// WandBooleanExecutor
+// -------------------
+template <typename Schema>
+WandBooleanExecutor<Schema>::WandBooleanExecutor(
+        int64_t topk, bool_executor_type type, BoolArg* arg) : _topk(topk) {
+    this->_is_null_flag = false;
+    this->set_merge_func(Schema::merge_or);
+    this->_type = type;
+    this->_arg = arg;
+}
+
+template <typename Schema>
+WandBooleanExecutor<Schema>::~WandBooleanExecutor() {
+    delete this->_arg;
+}
+
+template <typename Schema>
+void WandBooleanExecutor<Schema>::add_scored(
+        BooleanExecutor<Schema>* executor, float upper_bound) {
+    this->add(executor);
+    _upper_bounds.push_back(upper_bound);
+}
+
+template <typename Schema>
+const typename Schema::PostingNodeT* WandBooleanExecutor<Schema>::current_node() {
+    if (_result_idx >= _results.size()) {
+        return NULL;
+    }
+    return &_results[_result_idx];
+}
+
+template <typename Schema>
+const typename Schema::PrimaryIdT* WandBooleanExecutor<Schema>::current_id() {
+    if (_result_idx >= _results.size()) {
+        return NULL;
+    }
+    return &_results[_result_idx].key();
+}
+
+template <typename Schema>
+const typename Schema::PostingNodeT* WandBooleanExecutor<Schema>::next() {
+    if (this->_init_flag) {
+        this->_init_flag = false;
+        collect_topk();
+    } else if (_result_idx < _results.size()) {
+        ++_result_idx;
+    }
+    return current_node();
+}
+
+template <typename Schema>
+const typename Schema::PostingNodeT* WandBooleanExecutor<Schema>::advance(
+        const PrimaryIdT& target_id) {
+    if (this->_init_flag) {
+        this->_init_flag = false;
+        collect_topk();
+    }
+    auto iter = std::lower_bound(_results.begin() + _result_idx, _results.end(), target_id,
+            [](const PostingNodeT& node, const PrimaryIdT& id) {
+                return Schema::compare_id_func(node.key(), id) < 0;
+            });
+    _result_idx = iter - _results.begin();
+    return current_node();
+}
+
+template <typename Schema>
+void WandBooleanExecutor<Schema>::collect_topk() {
+    std::vector<BooleanExecutor<Schema>*>& clauses = this->_sub_clauses;
+    typedef std::pair<float, PostingNodeT> ScoredNode;
+    auto score_greater = [](const ScoredNode& l, const ScoredNode& r) {
+        return l.first > r.first;
+    };
+    //小顶堆, 堆顶是当前第k大的分数
+    std::priority_queue<ScoredNode, std::vector<ScoredNode>, decltype(score_greater)>
+        heap(score_greater);
+    std::vector<size_t> order(clauses.size());
+    for (size_t i = 0; i < clauses.size(); ++i) {
+        clauses[i]->next();
+        order[i] = i;
+    }
+    CompareAsc<Schema> id_less;
+    float threshold = 0;
+    bool is_full = false;
+    while (_topk > 0) {
+        std::sort(order.begin(), order.end(), [&clauses, &id_less](size_t l, size_t r) {
+            return id_less(clauses[l], clauses[r]);
+        });
+        //上界累加超过阈值的第一个子节点作为pivot
+        int pivot = -1;
+        float bound_sum = 0;
+        for (size_t i = 0; i < order.size(); ++i) {
+            if (clauses[order[i]]->current_id() == NULL) {
+                break;
+            }
+            bound_sum += _upper_bounds[order[i]];
+            if (!is_full || bound_sum > threshold) {
+                pivot = i;
+                break;
+            }
+        }
+        if (pivot < 0) {
+            break;
+        }
+        PrimaryIdT pivot_id = *clauses[order[pivot]]->current_id();
+        if (Schema::compare_id_func(*clauses[order[0]]->current_id(), pivot_id) != 0) {
+            //pivot之前的文档上界之和不够进入top-k, 直接跳过
+            for (int i = 0; i < pivot; ++i) {
+                clauses[order[i]]->advance(pivot_id);
+            }
+            continue;
+        }
+        PostingNodeT node = *clauses[order[0]]->current_node();
+        size_t matched = 1;
+        for (; matched < order.size(); ++matched) {
+            const PrimaryIdT* id = clauses[order[matched]]->current_id();
+            if (id == NULL || Schema::compare_id_func(*id, pivot_id) != 0) {
+                break;
+            }
+            this->_merge_func(node, *clauses[order[matched]]->current_node(), this->_arg);
+        }
+        float score = node.weight();
+        if (node.flag() == pb::REVERSE_NODE_NORMAL && (!is_full || score > threshold)) {
+            heap.emplace(score, node);
+            if ((int64_t)heap.size() > _topk) {
+                heap.pop();
+            }
+            is_full = ((int64_t)heap.size() >= _topk);
+            if (is_full) {
+                threshold = heap.top().first;
+            }
+        }
+        for (size_t i = 0; i < matched; ++i) {
+            clauses[order[i]]->next();
+        }
+    }
+    _results.clear();
+    _results.reserve(heap.size());
+    while (!heap.empty()) {
+        _results.push_back(heap.top().second);
+        heap.pop();
+    }
+    std::sort(_results.begin(), _results.end(), [](const PostingNodeT& l, const PostingNodeT& r) {
+        return Schema::compare_id_func(l.key(), r.key()) < 0;
+    });
+    _result_idx = 0;
+}
 }  // namespace boolean_engine
 
 // vim: set expandtab ts=4 sw=4 sts=4 tw=100: 
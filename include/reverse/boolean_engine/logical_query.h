@@ -15,6 +15,7 @@
 #pragma once
 #include <string>
 #include <vector>
+#include <cfloat>
 #include "boolean_executor.h"
 
 namespace baikaldb {
@@ -23,7 +24,8 @@ enum NodeType {
     AND = 1,
     OR,
     WEIGHT,
-    TERM
+    TERM,
+    WAND
 };
 
 template <typename Schema>
@@ -39,11 +41,13 @@ public:
         }
     }
     NodeType _type;
-    MergeFuncT _merge_func;
+    MergeFuncT _merge_func = nullptr;
     std::string _term;
     BoolArg *_arg = nullptr;//用在TermNode，传递给parser，由parser释放 
                //用在OperatorNode，传递给OperatorNode，由node释放
     std::vector<ExecutorNode<Schema>*> _sub_nodes;
+    float _upper_bound = FLT_MAX;  //作为WAND子节点时的分数上界
+    int64_t _topk = 0;             //用在WandNode
 };
 
 template <typename Schema>
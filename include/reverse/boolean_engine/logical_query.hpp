@@ -28,6 +28,7 @@ BooleanExecutor<Schema>* LogicalQuery<Schema>::parse_executor_node(
         case AND    :
         case OR     :
         case WEIGHT :
+        case WAND   :
             return parse_op_node(executor_node);
         default     :
             DB_WARNING("boolean executor type (%d) is invalid", executor_node._type);
@@ -70,6 +71,19 @@ BooleanExecutor<Schema>* LogicalQuery<Schema>::parse_op_node(
                 weight_add_subnode(node, result);
                 break;
             }
+            case WAND : {
+                auto wand_result = new WandBooleanExecutor<Schema>(
+                        node._topk, _schema->executor_type, node._arg);
+                wand_result->set_merge_func(node._merge_func);
+                for (auto sub_node : node._sub_nodes) {
+                    BooleanExecutor<Schema>* tmp = parse_executor_node(*sub_node);
+                    if (tmp) {
+                        wand_result->add_scored(tmp, sub_node->_upper_bound);
+                    }
+                }
+                result = wand_result;
+                break;
+            }
             default : {
                 DB_WARNING("Executor type[%d] error", node._type);
                 return NULL;
@@ -0,0 +1,116 @@
+// Copyright (c) 2018-present Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+namespace baikaldb {
+// 切词结果缓冲, 线程内复用
+// term的字节连续追加在arena中, terms记录(offset, len), 同一term可出现多次
+// 一篇文档切完后只在to_term_map时生成一次term_map
+struct TermBuffer {
+    std::string text;   // 切词过程中的归一化文本
+    std::string arena;
+    std::vector<std::pair<uint32_t, uint32_t>> terms;
+
+    void clear() {
+        text.clear();
+        arena.clear();
+        terms.clear();
+    }
+    void add(const char* term, size_t len) {
+        terms.emplace_back(arena.size(), len);
+        arena.append(term, len);
+    }
+    // term_map的value累加term出现的次数
+    void to_term_map(std::map<std::string, float>& term_map) const;
+};
+
+// 全角转半角表, key为gbk双字节编码, value为半角字符, 空串映射为'\0'
+typedef std::unordered_map<uint16_t, char> Q2bGbkMap;
+
+inline uint16_t gbk_code(const char* ptr) {
+    return ((uint8_t)ptr[0] << 8) | (uint8_t)ptr[1];
+}
+
+// 本地切词接口, 不依赖外部服务, 实现需要线程安全
+class LocalTokenizer {
+public:
+    virtual ~LocalTokenizer() {}
+    virtual int tokenize(const std::string& word, TermBuffer& buf) = 0;
+};
+
+// 单字/双字切词, 与Tokenizer::simple_seg_gbk的历史结果保持一致(已有索引依赖切词结果)
+class NgramTokenizer : public LocalTokenizer {
+public:
+    NgramTokenizer(uint32_t word_count, const bool* punctuation) :
+        _word_count(word_count), _punctuation(punctuation) {}
+    virtual int tokenize(const std::string& word, TermBuffer& buf);
+private:
+    bool is_punctuation(const char* term, size_t len) const {
+        return len == 1 && _punctuation[(uint8_t)term[0]];
+    }
+    uint32_t _word_count;
+    const bool* _punctuation;
+};
+
+// 模拟es standard切词: 英文单词和数字整体成词, 汉字单字成词
+class EsStandardTokenizer : public LocalTokenizer {
+public:
+    explicit EsStandardTokenizer(const Q2bGbkMap* q2b) : _q2b(q2b) {}
+    virtual int tokenize(const std::string& word, TermBuffer& buf);
+private:
+    const Q2bGbkMap* _q2b;
+};
+
+// 基于词典的中文切词, gbk编码
+// 词典每行: 词\t词频, 加载到trie; 连续汉字按最大概率路径切分(DAG + 动态规划),
+// 词典外的汉字单字成词; 英文和数字整体成词, 其余半角字符丢弃
+class DictTokenizer : public LocalTokenizer {
+public:
+    explicit DictTokenizer(const Q2bGbkMap* q2b) : _q2b(q2b) {
+        _nodes.emplace_back();
+    }
+    int load(const std::string& path);
+    virtual int tokenize(const std::string& word, TermBuffer& buf);
+    size_t word_count() const {
+        return _word_count;
+    }
+private:
+    struct TrieNode {
+        bool is_word = false;
+        float log_prob = 0;
+    };
+    void add_word(const std::string& word, double log_prob);
+    int32_t child(int32_t node, uint16_t code) const {
+        auto iter = _children.find(((uint64_t)node << 16) | code);
+        return iter == _children.end() ? -1 : iter->second;
+    }
+    void segment_cjk(const char* text, const std::vector<uint32_t>& char_pos,
+            TermBuffer& buf);
+
+    const Q2bGbkMap* _q2b;
+    std::vector<TrieNode> _nodes;
+    std::unordered_map<uint64_t, int32_t> _children; // (node << 16 | gbk_code) => child
+    size_t _word_count = 0;
+    uint32_t _max_word_chars = 1;
+    float _min_log_prob = -20;
+};
+}
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
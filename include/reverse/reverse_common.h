@@ -14,12 +14,15 @@
 
 #pragma once
 #include <map>
+#include <memory>
 #include <unordered_map>
 #include <unordered_set>
 #include "proto/reverse.pb.h"
+#include "proto/meta.interface.pb.h"
 #include "rocks_wrapper.h"
 #include "key_encoder.h"
 #include "lru_cache.h"
+#include "local_tokenizer.h"
 #ifdef BAIDU_INTERNAL
 #include <nlpc/ver_1_0_0/wordseg_input.h>
 #include <nlpc/ver_1_0_0/wordrank_output.h>
@@ -55,16 +58,37 @@ public:
     int wordseg_basic(std::string word, std::map<std::string, float>& term_map);
 #endif
     int q2b_tolower_gbk(std::string& word);
-    int es_standard_gbk(std::string word, std::map<std::string, float>& term_map);
-    int simple_seg_gbk(std::string word, uint32_t word_count, std::map<std::string, float>& term_map);
+    //本地切词的term_map value为term在word中出现的次数
+    int es_standard_gbk(const std::string& word, std::map<std::string, float>& term_map);
+    int simple_seg_gbk(const std::string& word, uint32_t word_count, std::map<std::string, float>& term_map);
     void split_str_gbk(const std::string& word, std::vector<std::string>& split_word, char delim);
+
+    //按切词类型切词, 本地切词的value为词频, 远程切词的value为term权重
+    int segment(const std::string& word, pb::SegmentType segment_type,
+            std::map<std::string, float>& term_map);
+    //query切词, 结果按(segment_type, word)缓存
+    int segment_query(const std::string& word, pb::SegmentType segment_type,
+            std::map<std::string, float>& term_map);
+    //不依赖外部服务的切词类型
+    bool is_local_segment(pb::SegmentType segment_type);
 private:
-    Tokenizer() {};
+    Tokenizer();
+    int local_segment(LocalTokenizer* tokenizer, const std::string& word,
+            std::map<std::string, float>& term_map);
+    LocalTokenizer* get_local_tokenizer(pb::SegmentType segment_type);
     void normalization_gbk(std::string& word);
     void normalization_utf8(std::string& word);
     std::unordered_set<std::string> _punctuation_blank;
+    bool _punctuation_table[256];
     std::unordered_map<std::string, std::string> _q2b_gbk;
     std::unordered_map<std::string, std::string> _q2b_utf8;
+    Q2bGbkMap _q2b_gbk_code;
+    std::unique_ptr<NgramTokenizer> _unigram;
+    std::unique_ptr<NgramTokenizer> _bigram;
+    std::unique_ptr<EsStandardTokenizer> _es_standard;
+    std::unique_ptr<DictTokenizer> _dict;
+    bool _dict_loaded = false;
+    Cache<uint64_t, std::shared_ptr<std::map<std::string, float>>> _query_seg_cache;
 };
 
 //自动管理原子对象
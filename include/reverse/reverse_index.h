@@ -20,6 +20,7 @@
 #include "transaction.h"
 #include "boolean_executor.h"
 #include "reverse_common.h"
+#include "block_reverse_list.h"
 #include "schema_factory.h"
 #include "expr_node.h"
 #include <atomic>
@@ -27,6 +28,7 @@
 #include "proto/store.interface.pb.h"
 
 namespace baikaldb {
+DECLARE_int32(reverse_segment_concurrency);
 
 class ReverseIndexBase {
 public:
@@ -49,17 +51,21 @@ public:
                        const std::string& pk,
                        SmartRecord record) = 0;
     //单索引检索接口，fast为true，性能会提高，但会出现ms级别的不一致性
+    //topk大于0时只返回__weight最大的topk个结果
     virtual int search(
                        rocksdb::Transaction* txn,
                        const IndexInfo& index_info,
                        const TableInfo& table_info,
                        const std::string& search_data,
                        std::vector<ExprNode*> conjuncts, 
-                       bool is_fast = false) = 0;
+                       bool is_fast = false,
+                       int64_t topk = 0) = 0;
     virtual bool valid() = 0;
     virtual void clear() = 0;
     virtual int get_next(SmartRecord record) = 0;
     virtual void sync(AtomicManager<std::atomic<long>>& am) = 0;
+    //批量写入前并发切词, 结果放入切词缓存, 随后的insert_reverse直接命中
+    virtual void presegment(const std::vector<std::string>& words) = 0;
 
     //获取1、2level倒排集合和3level倒排，用于Parser获取底层数据
     virtual int get_reverse_list_two(
@@ -76,12 +82,17 @@ public:
                     const std::string& search_data,
                     std::vector<ExprNode*> conjuncts, 
                     BooleanExecutorBase*& exe,
-                    bool is_fast = false) = 0;
+                    bool is_fast = false,
+                    int64_t topk = 0) = 0;
     virtual void set_second_level_length(int length) = 0;
     virtual void set_cache_size(int size) = 0;
     virtual void set_cached_list_length(int length) = 0;
     virtual void print_reverse_statistic_log() = 0;
     virtual void add_field(const std::string& name, int32_t field_id) = 0;
+    //BM25使用的文档数和平均文档长度
+    virtual void get_doc_stat(int64_t* doc_count, float* avg_doc_len) = 0;
+    //上次merge后写入1级倒排的节点数, 用于merge调度的优先级
+    virtual int64_t level_1_backlog() = 0;
 };
 
 template<typename ReverseNode, typename ReverseList>
@@ -91,12 +102,14 @@ public:
     SchemaBase() {
     }
     void init(ReverseIndexBase *reverse, rocksdb::Transaction *txn, 
-            const KeyRange& key_range, std::vector<ExprNode*> conjuncts, bool is_fast) {
+            const KeyRange& key_range, std::vector<ExprNode*> conjuncts, bool is_fast,
+            int64_t topk = 0) {
         _reverse = reverse;
         _txn = txn;
         _key_range = key_range;
         _conjuncts = conjuncts;
         _is_fast = is_fast;
+        _topk = topk;
     }
     static int compare_id_func(const PrimaryIdT& id1, const PrimaryIdT& id2) {
         return id1.compare(id2);
@@ -164,6 +177,7 @@ protected:
     rocksdb::Transaction *_txn;//读取时用的transaction，由调用者释放
     KeyRange _key_range;
     bool _is_fast = false;
+    int64_t _topk = 0;
     IndexInfo _index_info;
     TableInfo _table_info;
     ReverseSearchStatistic _statistic;
@@ -225,7 +239,8 @@ public:
                        const TableInfo& table_info,
                        const std::string& search_data,
                        std::vector<ExprNode*> conjuncts, 
-                       bool is_fast = false); 
+                       bool is_fast = false,
+                       int64_t topk = 0); 
     virtual bool valid() {
         return _schema->valid();
     }
@@ -252,7 +267,8 @@ public:
                     const std::string& search_data,
                     std::vector<ExprNode*> conjuncts, 
                     BooleanExecutorBase*& exe,
-                    bool is_fast = false);
+                    bool is_fast = false,
+                    int64_t topk = 0);
     //读写和merge同步
     void sync(AtomicManager<std::atomic<long>>& am) {
         if (_reverse_prefix == 0) {
@@ -261,6 +277,7 @@ public:
             am.set(&_sync_prefix_1);
         }
     }
+    virtual void presegment(const std::vector<std::string>& words);
     void set_second_level_length(int length) {
         _second_level_length = length;
     }
@@ -276,6 +293,16 @@ public:
     virtual void add_field(const std::string& name, int32_t field_id) {
         _name_field_id_map[name] = field_id;
     }
+    // 文档数取merge时region的行数, 平均长度按本进程写入的文档统计, 没有统计时返回0
+    virtual void get_doc_stat(int64_t* doc_count, float* avg_doc_len) {
+        *doc_count = _doc_count;
+        int64_t insert_count = _insert_doc_count;
+        *avg_doc_len = insert_count > 0 ? (float)_insert_doc_len / insert_count : 0;
+    }
+    // 只统计本进程的写入, 重启前残留的1级倒排不计入
+    virtual int64_t level_1_backlog() {
+        return _level_1_backlog;
+    }
 private:
     //0:success    -1:fail
     int handle_reverse(
@@ -331,6 +358,11 @@ private:
     std::vector<std::string> _cache_keys;
     // 存储额外字段时需要
     std::map<std::string, int32_t> _name_field_id_map;
+    // BM25统计
+    std::atomic<int64_t> _doc_count{0};
+    std::atomic<int64_t> _insert_doc_count{0};
+    std::atomic<int64_t> _insert_doc_len{0};
+    std::atomic<int64_t> _level_1_backlog{0};
 };
 template<typename Schema>
 thread_local SchemaBase<typename Schema::ReverseNode, 
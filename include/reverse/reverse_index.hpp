@@ -16,6 +16,9 @@ namespace baikaldb {
 template <typename Schema>
 int ReverseIndex<Schema>::reverse_merge_func(pb::RegionInfo info) {
     _key_range = KeyRange(info.start_key(), info.end_key());
+    _doc_count = info.num_table_lines();
+    // merge期间的新写入留到下一轮计数
+    int64_t backlog = _level_1_backlog;
     int8_t status;
     TimeCost timer;
 
@@ -47,6 +50,7 @@ int ReverseIndex<Schema>::reverse_merge_func(pb::RegionInfo info) {
         if (prefix == 0) {
             _prefix_0_succ = true;
         }
+        _level_1_backlog -= backlog;
         return 0;
     }
     while (true) {
@@ -69,6 +73,7 @@ int ReverseIndex<Schema>::reverse_merge_func(pb::RegionInfo info) {
     if (prefix == 0) {
         _prefix_0_succ = true;
     }
+    _level_1_backlog -= backlog;
 
     //DB_WARNING("merge dowith time %lu, region_id:%ld", timer.get_time(), _region_id);
     SELF_TRACE("merge dowith time %lu, region_id:%ld, cache:%s, seg_cache:%s, prefix:%d", 
@@ -106,6 +111,11 @@ int ReverseIndex<Schema>::handle_reverse(
     } else {
         Schema::segment(word, pk, record, _segment_type, _name_field_id_map, flag, *seg_res);
     }
+    if (flag == pb::REVERSE_NODE_NORMAL) {
+        _insert_doc_count += 1;
+        _insert_doc_len += seg_res->size();
+    }
+    _level_1_backlog += seg_res->size();
     auto map_it = seg_res->begin();
     while (map_it != seg_res->end()) {
         status = _insert_one_reverse_node(txn, req, map_it->first, &map_it->second);
@@ -117,6 +127,36 @@ int ReverseIndex<Schema>::handle_reverse(
     return 0;
 }
 
+// 只对本地切词做, 远程切词是rpc, 并发收益有限
+template <typename Schema>
+void ReverseIndex<Schema>::presegment(const std::vector<std::string>& words) {
+    if (!_is_seg_cache || words.size() <= 1
+            || !Tokenizer::get_instance()->is_local_segment(_segment_type)) {
+        return;
+    }
+    int concurrency = std::max(FLAGS_reverse_segment_concurrency, 1);
+    size_t step = (words.size() + concurrency - 1) / concurrency;
+    ConcurrencyBthread seg_bth(concurrency);
+    for (size_t begin = 0; begin < words.size(); begin += step) {
+        size_t end = std::min(begin + step, words.size());
+        seg_bth.run([this, &words, begin, end]() {
+            for (size_t i = begin; i < end; ++i) {
+                uint64_t key = make_sign(words[i]);
+                if (words[i].empty() || _seg_cache.check(key) == 0) {
+                    continue;
+                }
+                std::shared_ptr<std::map<std::string, ReverseNode>> seg_res =
+                    std::make_shared<std::map<std::string, ReverseNode>>();
+                if (Schema::segment(words[i], "", nullptr, _segment_type, _name_field_id_map, 
+                            pb::REVERSE_NODE_NORMAL, *seg_res) == 0) {
+                    _seg_cache.add(key, seg_res);
+                }
+            }
+        });
+    }
+    seg_bth.join();
+}
+
 template <typename Schema>
 int ReverseIndex<Schema>::insert_reverse(
                                     rocksdb::Transaction* txn,
@@ -144,10 +184,12 @@ int ReverseIndex<Schema>::search(
                        const TableInfo& table_info,
                        const std::string& search_data,
                        std::vector<ExprNode*> conjuncts, 
-                       bool is_fast) {
+                       bool is_fast,
+                       int64_t topk) {
     BooleanExecutorBase* exe = nullptr;
     TimeCost time;
-    int ret = create_executor(txn, index_info, table_info, search_data, conjuncts, exe, is_fast);
+    int ret = create_executor(txn, index_info, table_info, search_data, conjuncts, exe,
+            is_fast, topk);
     if (ret < 0) {
         return -1;
     }
@@ -179,6 +221,7 @@ int ReverseIndex<Schema>::get_reverse_list_two(
     TimeCost timer_tmp;
     if (is_fast) {
         _get_level_reverse_list(txn, 2, term, list_new_ptr, true);
+        to_reverse_list<ReverseNode, ReverseList>(list_new_ptr);
         item_statistic.is_fast = true;
         item_statistic.get_new += timer_tmp.get_time();
         timer_tmp.reset();
@@ -198,6 +241,7 @@ int ReverseIndex<Schema>::get_reverse_list_two(
         
         MessageSP second_list(new ReverseList()); 
         _get_level_reverse_list(txn, 2, term, second_list, true);
+        to_reverse_list<ReverseNode, ReverseList>(second_list);
         SecondLevelMSIterator<ReverseNode, ReverseList> iter_second(
                                                             (ReverseList&)*second_list, 
                                                             _key_range);
@@ -212,17 +256,10 @@ int ReverseIndex<Schema>::get_reverse_list_two(
         timer_tmp.reset();
     }
 
+    //第三层保持分块格式, 由Parser按需解码
     _get_level_reverse_list(txn, 3, term, list_old_ptr, true, true);
-    ReverseList* tmp = nullptr;
-    tmp = (ReverseList*)list_new_ptr.get();
-    if (tmp != nullptr) {
-        item_statistic.second_length = tmp->reverse_nodes_size();
-    }
-    tmp = nullptr;
-    tmp = (ReverseList*)list_old_ptr.get();
-    if (tmp != nullptr) { 
-        item_statistic.third_length = tmp->reverse_nodes_size();
-    }
+    item_statistic.second_length = reverse_list_size<ReverseList>(list_new_ptr.get());
+    item_statistic.third_length = reverse_list_size<ReverseList>(list_old_ptr.get());
     item_statistic.get_three += timer_tmp.get_time();
     item_statistic.get_list += timer.get_time();
     return 0;
@@ -236,10 +273,11 @@ int ReverseIndex<Schema>::create_executor(
                             const std::string& search_data, 
                             std::vector<ExprNode*> conjuncts, 
                             BooleanExecutorBase*& exe,
-                            bool is_fast) {
+                            bool is_fast,
+                            int64_t topk) {
     TimeCost timer;
     _schema = new Schema();
-    _schema->init(this, txn, _key_range, conjuncts, is_fast);
+    _schema->init(this, txn, _key_range, conjuncts, is_fast, topk);
     timer.reset();
     _schema->set_index_info(index_info);
     _schema->set_table_info(table_info);
@@ -296,6 +334,9 @@ int ReverseIndex<Schema>::_reverse_merge_to_second_level(
     std::string value;
     MessageSP second_level_list(new ReverseList());
     status = _get_level_reverse_list(txn->get_txn(), 2, merge_term, second_level_list);
+    if (status == 0) {
+        status = to_reverse_list<ReverseNode, ReverseList>(second_level_list);
+    }
     if (status != 0) {
         DB_WARNING("get second level list failed");
         return -1;
@@ -336,6 +377,10 @@ int ReverseIndex<Schema>::_reverse_merge_to_second_level(
         if (status != 0) {
             return -1;
         }
+        if (to_reverse_list<ReverseNode, ReverseList>(third_level_list) != 0) {
+            DB_WARNING("decode third level list failed, term:%s", merge_term.c_str());
+            return -1;
+        }
         SecondLevelMSIterator<ReverseNode, ReverseList> 
                         third_iter((ReverseList&)*third_level_list, _key_range);
         SecondLevelMSIterator<ReverseNode, ReverseList> second_iter(
@@ -348,7 +393,12 @@ int ReverseIndex<Schema>::_reverse_merge_to_second_level(
             DB_WARNING("merge 2 and 3 failed");
             return -1;
         }   
-        if (!new_third_level_list->SerializeToString(&value)) {
+        if (FLAGS_reverse_block_posting_list) {
+            if (encode_block_reverse_list<ReverseNode, ReverseList>(
+                        *new_third_level_list, &value) != 0) {
+                return -1;
+            }
+        } else if (!new_third_level_list->SerializeToString(&value)) {
             DB_WARNING("serialize failed");
             return -1;
         }
@@ -419,9 +469,9 @@ int ReverseIndex<Schema>::_get_level_reverse_list(
     time.reset();
     if (get_res.ok()) {
         //deserialize
-        MessageSP tmp_ptr(new ReverseList());
-        if (!tmp_ptr->ParseFromString(value)) {
-            DB_FATAL("parse second level list from pb failed");
+        MessageSP tmp_ptr;
+        if (parse_reverse_list<ReverseList>(value, tmp_ptr) != 0) {
+            DB_FATAL("parse level %d reverse list failed", level);
             return -1;
         }
         if (item_statistic) {
@@ -430,7 +480,7 @@ int ReverseIndex<Schema>::_get_level_reverse_list(
         list_ptr = tmp_ptr;
         if (_is_over_cache) {
             if (is_over_cache) {
-                if (((ReverseList*)tmp_ptr.get())->reverse_nodes_size() >= _cached_list_length) {
+                if (reverse_list_size<ReverseList>(tmp_ptr.get()) >= _cached_list_length) {
                     _cache.add(key, tmp_ptr);
                 }
             }
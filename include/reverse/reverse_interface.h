@@ -14,13 +14,18 @@
 
 #pragma once
 #include "reverse_index.h"
+#include "block_reverse_list.h"
 #include "proto/reverse.pb.h"
 #include "boolean_executor.h"
 #include "logical_query.h"
 #include "schema_factory.h"
 #include <map>
+#include <memory>
 
 namespace baikaldb {
+DECLARE_bool(reverse_bm25_weight);
+DECLARE_double(reverse_bm25_k1);
+DECLARE_double(reverse_bm25_b);
 
 //获取链表的接口
 //如果链表底层的数据不够用，可以在这一层修改，比如xbs的query_id
@@ -44,20 +49,21 @@ public:
     //只进不退
     const ReverseNode* next();
     const ReverseNode* advance(const std::string& target_id);
+    //两层链表的节点数之和, 作为BM25的文档频率
+    int64_t list_size() const {
+        return (int64_t)_list_size_new + _list_size_old;
+    }
 private:
-    //二分查找，大于或等于
-    uint32_t binary_search(uint32_t first, 
-                           uint32_t last, 
-                           const std::string& target_id, 
-                           ReverseList* list);
+    //根据两个链表的当前位置选择当前节点
+    const ReverseNode* choose_node();
     MessageSP _new_list_ptr;
     MessageSP _old_list_ptr;
-    ReverseList* _new_list;
-    ReverseList* _old_list;
+    ReverseListCursor<ReverseNode, ReverseList> _new_list;
+    ReverseListCursor<ReverseNode, ReverseList> _old_list;//第三层可能是分块格式
     int32_t _curr_ix_new;//-1表示链表遍历结束，大于等于0表示链表当前节点
     int32_t _curr_ix_old;
-    uint32_t _list_size_new;//链表的长度
-    uint32_t _list_size_old;
+    int32_t _list_size_new;//链表的长度
+    int32_t _list_size_old;
     PrimaryIdT* _curr_id_new;//
     PrimaryIdT* _curr_id_old;
     int _cmp_res;//确定当前使用的node
@@ -66,6 +72,31 @@ private:
 };
 
 //--common
+//BM25打分参数, 每个term一个, 由TermBooleanExecutor释放
+class Bm25Arg : public BoolArg {
+public:
+    Bm25Arg(float idf, float avg_doc_len) : _idf(idf), _avg_doc_len(avg_doc_len) {
+    }
+    //tf和doc_len为0表示旧数据没有记录, 按1和平均长度处理
+    float score(uint32_t tf, uint32_t doc_len) const {
+        float k1 = FLAGS_reverse_bm25_k1;
+        float b = FLAGS_reverse_bm25_b;
+        float freq = tf > 0 ? tf : 1;
+        float norm = 1.0;
+        if (doc_len > 0 && _avg_doc_len > 0) {
+            norm = 1 - b + b * doc_len / _avg_doc_len;
+        }
+        return _idf * freq * (k1 + 1) / (freq + k1 * norm);
+    }
+    //tf趋于无穷时的分数, 作为WAND的上界
+    float upper_bound() const {
+        return _idf * (FLAGS_reverse_bm25_k1 + 1);
+    }
+private:
+    float _idf;
+    float _avg_doc_len;
+};
+
 class CommonSchema : public SchemaBase<pb::CommonReverseNode, pb::CommonReverseList> {
 public:
     typedef pb::CommonReverseNode ReverseNode;
@@ -102,6 +133,12 @@ public:
                     BoolArg* arg) {
         return 0;
     }
+    //BM25模式下term节点的weight替换为该term的BM25分数
+    static void init_node(ReverseNode& node, const std::string& term, BoolArg* arg) {
+        if (arg != nullptr) {
+            node.set_weight(static_cast<Bm25Arg*>(arg)->score(node.tf(), node.doc_len()));
+        }
+    }
     //search_data 字符串格式
     //"hello world"
     int create_executor(const std::string& search_data, pb::SegmentType segment_type);
@@ -117,8 +154,16 @@ public:
         return NULL;
     }
 private:
+    //为term节点设置BM25参数, 返回子树的分数上界
+    float init_bm25(ExecutorNode<CommonSchema>* node, int64_t doc_count, float avg_doc_len);
+    //把查询树挂到WAND节点下, 只取分数最高的_topk个结果
+    void create_wand_root(ExecutorNode<CommonSchema>* root);
+    int64_t term_df(const std::string& term);
+
     int _weight_field_id = 0;
     std::map<std::string, Parser*> _temp_map;
+    //计算df时提前创建的parser, 查询树中同一term的parser会从这里拷贝
+    std::vector<std::unique_ptr<Parser>> _df_parsers;
 };
 //--xbs
 class XbsArg : public BoolArg {
@@ -45,6 +45,13 @@ public:
     bool is_full() {
         return size() >= _capacity;
     }
+    int64_t used_size() {
+        int64_t size = 0;
+        for (auto& row : _rows) {
+            size += row->used_size();
+        }
+        return size;
+    }
     bool is_traverse_over() {
         return _idx >= size();
     }
@@ -15,6 +15,7 @@
 #pragma once
 
 #include <stdint.h>
+#include <mutex>
 #include "mem_row_descriptor.h"
 #include "data_buffer.h"
 #include "proto/store.interface.pb.h"
@@ -38,6 +39,13 @@ struct RegionResource {
     DllParam* ddl_param_ptr;
 };
 
+// baikaldb端记录select读到的region状态, 用于结果缓存的失效判断
+struct RegionSnapshot {
+    int64_t version = 0;
+    int64_t applied_index = 0;
+    std::string addr;
+};
+
 class RuntimeStatePool;
 class RuntimeState {
 
@@ -120,6 +128,12 @@ public:
         _txn = SmartTransaction(new Transaction(0, _txn_pool));
         _txn->set_region_info(&(_resource->region_info));
         _txn->set_ddl_state(_resource->ddl_param_ptr);
+        if (!deadlock_detect) {
+            _txn->disable_deadlock_detect();
+        }
+        if (ttl_timestamp_us > 0) {
+            _txn->set_ttl_timestamp_us(ttl_timestamp_us);
+        }
         _txn->begin();
         _txn->_is_separate = is_separate;
         return _txn;
@@ -129,6 +143,12 @@ public:
         txn->set_region_info(&(_resource->region_info));
         txn->set_ddl_state(_resource->ddl_param_ptr);
         txn->_is_separate = is_separate;
+        if (!deadlock_detect) {
+            txn->disable_deadlock_detect();
+        }
+        if (ttl_timestamp_us > 0) {
+            txn->set_ttl_timestamp_us(ttl_timestamp_us);
+        }
         txn->begin();
         return txn;
     }
@@ -244,6 +264,48 @@ public:
         _eos = true;
     }
 
+    // baikaldb端单query内存配额, 0表示不限制
+    void set_memory_limit(int64_t limit) {
+        _memory_limit = limit;
+    }
+    int64_t memory_limit() const {
+        return _memory_limit;
+    }
+    // 超出配额返回false
+    bool memory_consume(int64_t bytes) {
+        int64_t used = _memory_used.fetch_add(bytes) + bytes;
+        return _memory_limit <= 0 || used <= _memory_limit;
+    }
+    // 持有的数据释放后归还配额
+    void memory_release(int64_t bytes) {
+        _memory_used.fetch_sub(bytes);
+    }
+    int64_t memory_used() const {
+        return _memory_used.load();
+    }
+
+    void set_record_region_snapshot(bool record) {
+        _record_region_snapshot = record;
+    }
+    bool record_region_snapshot() const {
+        return _record_region_snapshot;
+    }
+    // fetcher多线程并发写入
+    void add_region_snapshot(int64_t region_id, const RegionSnapshot& snapshot) {
+        std::lock_guard<std::mutex> lock(_snapshot_mutex);
+        _region_snapshots[region_id] = snapshot;
+    }
+    void set_region_snapshot_incomplete() {
+        std::lock_guard<std::mutex> lock(_snapshot_mutex);
+        _region_snapshot_complete = false;
+    }
+    bool region_snapshot_complete() const {
+        return _region_snapshot_complete;
+    }
+    const std::map<int64_t, RegionSnapshot>& region_snapshots() const {
+        return _region_snapshots;
+    }
+
 public:
     uint64_t          txn_id = 0;
     int32_t           seq_id = 0;
@@ -251,6 +313,10 @@ public:
     std::ostringstream error_msg;
     bool              is_full_export = false;
     bool              is_separate = false; //是否为计算存储分离模式
+    bool              deadlock_detect = true; //raft apply中执行时关闭死锁检测
+    int64_t           ttl_timestamp_us = 0; //leader写入请求的时间, ttl表各副本判断过期一致
+    std::vector<int>  batched_stmt_rows; //合并的多语句insert每条语句的行数, 按语句返回OK包
+    std::vector<int64_t> batched_insert_ids; //合并的每条语句的第一个自增id
     BthreadCond       txn_cond;
     std::function<void(RuntimeState* state, SmartTransaction txn)> raft_func;
     bool              is_fail = false;
@@ -287,6 +353,12 @@ private:
     std::vector<int64_t> _scan_indices;
     size_t _row_batch_capacity = ROW_BATCH_CAPACITY;
     int _multiple = 1;
+    int64_t _memory_limit = 0;
+    std::atomic<int64_t> _memory_used{0};
+    bool _record_region_snapshot = false;
+    bool _region_snapshot_complete = true;
+    std::mutex _snapshot_mutex;
+    std::map<int64_t, RegionSnapshot> _region_snapshots;
     RuntimeStatePool* _pool = nullptr;
 };
 typedef std::shared_ptr<RuntimeState> SmartState;
@@ -108,6 +108,7 @@ struct NetworkSocket {
     int             is_auth_result_send_partly;     // Auth result is sended partly,
                                                     // need to go on sending.
     int64_t         last_insert_id;
+    uint32_t        client_capability;              // Capability flags of handshake response.
     // Socket status.
     std::string     current_db;                     // Current use database.
     int             charset_num;                    // Client charset number.
@@ -99,4 +99,15 @@ struct Dml1pcClosure : public braft::Closure {
     TimeCost cost;
 };
 
+// 合并为一条raft日志的多个1pc dml请求, 执行结果分发给各自的closure
+struct DMLBatchClosure : public DMLClosure {
+    DMLBatchClosure() {
+        response = &batch_response;
+    }
+    virtual void Run();
+
+    pb::StoreRes batch_response;
+    std::vector<DMLClosure*> closures;
+};
+
 } // end of namespace
@@ -0,0 +1,63 @@
+// Copyright (c) 2018-present Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace baikaldb {
+// on_apply并行窗口内的日志分组
+// footprints[i]为第i条日志写入的主键和唯一索引key, nullptr表示该日志只能串行apply(屏障)
+// groups按日志顺序输出[begin, end), 首尾相接覆盖全部日志:
+// 屏障单独成组; 其余为连续且key互不相交的日志, 遇到相交的key时切分
+// 每组执行完再执行下一组, 组内按日志顺序提交, 因此applied_index连续推进
+inline void split_parallel_apply_groups(
+        const std::vector<const std::vector<std::string>*>& footprints,
+        std::vector<std::pair<size_t, size_t>>& groups) {
+    groups.clear();
+    std::unordered_set<std::string> group_keys;
+    size_t begin = 0;
+    for (size_t i = 0; i < footprints.size(); ++i) {
+        const std::vector<std::string>* keys = footprints[i];
+        bool conflict = (keys == nullptr);
+        if (keys != nullptr) {
+            for (auto& key : *keys) {
+                if (group_keys.count(key) == 1) {
+                    conflict = true;
+                    break;
+                }
+            }
+        }
+        if (conflict && begin < i) {
+            groups.emplace_back(begin, i);
+            begin = i;
+            group_keys.clear();
+        }
+        if (keys == nullptr) {
+            groups.emplace_back(i, i + 1);
+            begin = i + 1;
+            continue;
+        }
+        group_keys.insert(keys->begin(), keys->end());
+    }
+    if (begin < footprints.size()) {
+        groups.emplace_back(begin, footprints.size());
+    }
+}
+}
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
@@ -17,6 +17,7 @@
 #include <stdint.h>
 #include <fstream>
 #include <atomic>
+#include <unordered_set>
 #include <boost/lexical_cast.hpp>
 #ifdef BAIDU_INTERNAL
 #include <base/iobuf.h>
@@ -37,6 +38,7 @@
 #include "schema_factory.h"
 #include "table_key.h"
 #include "mut_table_key.h"
+#include "key_layout.h"
 #include "rocks_wrapper.h"
 #include "split_compaction_filter.h"
 #include "proto/common.pb.h"
@@ -50,6 +52,7 @@
 #include "rapidjson/document.h"
 #include "rocksdb_file_system_adaptor.h"
 #include "region_control.h"
+#include "region_load_stat.h"
 #include "meta_writer.h"
 #include "rpc_sender.h"
 #include "ddl_common.h"
@@ -88,6 +91,12 @@ private:
     Region* _region;
 };
 class TransactionPool;
+struct DMLClosure;
+// 等待合并提案的1pc dml请求, request的生命周期由closure中的done保证
+struct DMLBatchTask {
+    const pb::StoreReq* request = nullptr;
+    DMLClosure* closure = nullptr;
+};
 typedef std::shared_ptr<Region> SmartRegion;
 class Region : public braft::StateMachine {
 friend class RegionControl;
@@ -107,12 +116,18 @@ public:
     void shutdown() {
         bool expected_status = false;
         if (_shutdown.compare_exchange_strong(expected_status, true)) {
+            if (_dml_batch_queue_started) {
+                bthread::execution_queue_stop(_dml_batch_queue_id);
+            }
             _node.shutdown(NULL);
             DB_WARNING("raft node was shutdown, region_id: %ld", _region_id);
         }
     }
 
     void join() {
+        if (_dml_batch_queue_started) {
+            bthread::execution_queue_join(_dml_batch_queue_id);
+        }
         _node.join();
         DB_WARNING("raft node join completely, region_id: %ld", _region_id);
         _multi_thread_cond.wait();
@@ -186,6 +201,12 @@ public:
             int64_t applied_index,
             int64_t term);
 
+    // 在同一个rocksdb事务中执行OP_DML_BATCH中的所有请求
+    void apply_dml_batch(const pb::StoreReq& request, 
+            braft::Closure* done,
+            int64_t applied_index,
+            int64_t term);
+
     void select(const pb::StoreReq& request, pb::StoreRes& response);
     void select(const pb::StoreReq& request, 
             const pb::Plan& plan,
@@ -211,12 +232,17 @@ public:
     virtual void on_configuration_committed(const ::braft::Configuration& conf, int64_t index);
 
     void snapshot(braft::Closure* done);
+    bool need_postpone_snapshot();
     void on_snapshot_load_for_restart(braft::SnapshotReader* reader,
             std::map<int64_t, std::string>& prepared_log_entrys);
 
+    //delta为true时, 上次上报后没有变化的leader只上报region_id和table_id
     void construct_heart_beat_request(pb::StoreHeartBeatRequest& request, bool need_peer_balance, 
-        std::set<int64_t>& ddl_wait_doing_table_ids); 
+        std::set<int64_t>& ddl_wait_doing_table_ids, bool delta); 
     
+    //增量心跳中上次上报后没有变化的leader只上报id, 返回true; 否则记录本次上报的信息, 返回false
+    bool report_unchanged_leader(pb::StoreHeartBeatRequest& request,
+            const std::vector<braft::PeerId>& peers, bool delta);
     void set_can_add_peer();
     
     //leader收到从metaServer心跳包中的解析出来的add_peer请求
@@ -253,6 +279,8 @@ public:
     int ingest_sst(const std::string& data_sst_file, const std::string& meta_sst_file); 
     // other thread
     void reverse_merge();
+    // 各倒排索引1级倒排的积压量之和, 没有倒排索引时返回-1
+    int64_t reverse_merge_backlog();
 
     // dump the the tuples in this region in format {{k1:v1},{k2:v2},{k3,v3}...}
     // used for debug
@@ -286,6 +314,8 @@ public:
     
     //split第二步，发送迭代器数据
     void write_local_rocksdb_for_split();
+    void copy_data_for_split(TimeCost& write_sst_time_cost);
+    void estimate_lines_for_split();
 
     int replay_txn_for_recovery(
             const std::unordered_map<uint64_t, pb::TransactionInfo>& prepared_txn);
@@ -309,6 +339,26 @@ public:
             int64_t& split_end_index);
     
     int get_split_key(std::string& split_key);
+    // 根据sst中的采样key选取分裂点, 采样不足时返回-1
+    int get_split_key_from_sst(std::string& split_key);
+    // 读取[start_key, end_key)区间内sst中的采样主键(不含前缀), 已排序
+    void get_sst_sample_keys(int64_t index_id, const std::string& start_key,
+            const std::string& end_key, std::vector<std::string>& samples);
+    // 按sst采样把[start, end)(完整的rocksdb key)切成count段, 输出count-1个有序的分段点
+    // 采样不足时不输出, 用于snapshot并发读
+    void get_snapshot_range_keys(int count, const std::string& start,
+            const std::string& end, std::vector<std::string>& keys);
+    // 按访问负载选取分裂点, 用于热点region分裂
+    int get_load_split_key(std::string& split_key);
+    // ttl表(全局索引region除外)的value带过期时间
+    bool use_ttl() {
+        return !_is_global_index && _factory->use_ttl_value(get_table_id());
+    }
+    // 过期的行在compaction删除前仍计入行数, 按未过期的行估算行数, 只用于leader判断分裂
+    int64_t estimate_ttl_live_lines();
+    bool is_hot() {
+        return _load_stat.is_hot();
+    }
     
     int64_t get_region_id() {
         return _region_id;
@@ -356,6 +406,10 @@ public:
     }
     void get_region_info(pb::RegionInfo& region_info) {
         region_info = _region_info;
+    }
+    // data cf中key的前8字节, 索引布局时为分区前缀
+    int64_t get_key_prefix() const {
+        return data_key_prefix(_region_info);
     }    
     std::string get_start_key() {
         return _region_info.start_key();
@@ -564,6 +618,10 @@ public:
     }
 
 private:
+    // 读取(start, end)区间内sst中的采样key(完整的rocksdb key), 已排序
+    void get_sst_samples(const std::string& start, const std::string& end,
+            std::vector<std::string>& samples);
+
     struct SplitParam {
         int64_t split_start_index = INT_FAST64_MAX;
         int64_t split_end_index = 0;
@@ -606,6 +664,32 @@ private:
                                   int64_t index, int64_t term);
     void apply_kv_split(const pb::StoreReq& request, braft::Closure* done, 
                                 int64_t index, int64_t term);
+    // 执行dml计划, 失败时设置response并返回-1, 成功返回影响行数
+    int exec_dml_plan(RuntimeState& state, const pb::Plan& plan, 
+                      pb::StoreRes& response, int64_t applied_index);
+    // 提交1pc dml的事务并持久化applied_index和num_table_lines, 失败返回-1, 由调用方回滚
+    int commit_dml_txn(SmartTransaction txn, uint64_t txn_id, int64_t num_table_lines, 
+                       int64_t num_increase_rows, int64_t applied_index);
+    static int dml_batch_propose(void* meta, bthread::TaskIterator<DMLBatchTask>& iter);
+    void propose_dml_batch(std::vector<DMLBatchTask>& tasks);
+
+    // on_apply并行模式下解析后的日志
+    struct ApplyEntry {
+        butil::IOBuf data;
+        braft::Closure* done = nullptr;
+        int64_t index = 0;
+        int64_t term = 0;
+        pb::StoreReq request;
+        bool parsed = false;
+    };
+    void apply_parse_fail(braft::Closure* done);
+    void apply_log_entry(const pb::StoreReq& request, braft::Closure* done, 
+                         int64_t index, int64_t term);
+    void on_apply_parallel(braft::Iterator& iter);
+    // 可以并行apply的日志返回true, keys为其主键和唯一索引key
+    bool get_apply_footprint(const pb::StoreReq& request, std::vector<std::string>& keys);
+    // 组内日志key互不相交, 并行执行后按日志顺序提交
+    void apply_parallel_group(const std::vector<ApplyEntry*>& group);
     bool validate_version(const pb::StoreReq* request, pb::StoreRes* response);
 
     void set_region(const pb::RegionInfo& region_info) {
@@ -663,6 +747,9 @@ private:
     // todo 是否可以改成无锁的
     BthreadCond _disable_write_cond;
     BthreadCond _real_writing_cond;
+    // leader上并发的1pc dml合并提案
+    bthread::ExecutionQueueId<DMLBatchTask> _dml_batch_queue_id = {0};
+    bool _dml_batch_queue_started = false;
     SplitParam _split_param;
     DllParam _ddl_param;
 
@@ -687,6 +774,10 @@ private:
     int64_t                             _applied_index_lastcycle = 0;  
 
     bool                                _report_peer_info = false;
+    //上次心跳上报给meta的leader信息(version/conf_version/status/peers)和大小, 不是leader时清空
+    std::string                         _reported_leader_state;
+    int64_t                             _reported_num_table_lines = 0;
+    int64_t                             _reported_used_size = 0;
     std::atomic<bool>                   _shutdown;
     bool                                _init_success = false;
 
@@ -706,6 +797,7 @@ private:
     std::shared_ptr<RegionResource>     _resource;
 
     RegionControl                           _region_control;
+    RegionLoadStat                          _load_stat;
     MetaWriter*                             _meta_writer = nullptr;
     bthread_mutex_t                         _commit_meta_mutex;
     scoped_refptr<braft::FileSystemAdaptor>  _snapshot_adaptor = nullptr;
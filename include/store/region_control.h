@@ -24,12 +24,15 @@ class RegionControl {
 typedef std::shared_ptr<Region> SmartRegion;
 public:
     static int remove_data(int64_t drop_region_id);
+    static int remove_data(const pb::RegionInfo& region_info);
+    static int remove_key_range(const pb::RegionInfo& region_info);
     static void compact_data(int64_t region_id);
     static void compact_data_in_queue(int64_t region_id);
     static int remove_log_entry(int64_t drop_region_id);
     static int remove_meta(int64_t drop_region_id);
     static int remove_snapshot_path(int64_t drop_region_id);
     static int clear_all_infos_for_region(int64_t drop_region_id);
+    static int clear_all_infos_for_region(const pb::RegionInfo& region_info);
     static int ingest_data_sst(const std::string& data_sst_file, int64_t region_id);
     static int ingest_meta_sst(const std::string& meta_sst_file, int64_t region_id);
 
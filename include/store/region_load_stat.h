@@ -0,0 +1,80 @@
+// Copyright (c) 2018-present Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "common.h"
+
+namespace baikaldb {
+DECLARE_int32(hot_region_periods);
+
+// region的读写负载统计, 用于按负载分裂和热点leader打散
+// 计数为原子变量, 在请求路径上累加; update在心跳时调用, 计算上一周期的qps
+// 同时对访问的主键做蓄水池采样(先按load_sample_rate抽样), 分裂时按访问量取中位点
+class RegionLoadStat {
+public:
+    void add_read(int64_t cost_us) {
+        _read_count.fetch_add(1, std::memory_order_relaxed);
+        _cpu_time_us.fetch_add(cost_us, std::memory_order_relaxed);
+    }
+    void add_write(int64_t cost_us) {
+        _write_count.fetch_add(1, std::memory_order_relaxed);
+        _cpu_time_us.fetch_add(cost_us, std::memory_order_relaxed);
+    }
+    // key为不带region_id/index_id前缀的主键
+    void sample_key(const std::string& key);
+
+    void update();
+
+    int64_t read_qps() const {
+        return _read_qps.load(std::memory_order_relaxed);
+    }
+    int64_t write_qps() const {
+        return _write_qps.load(std::memory_order_relaxed);
+    }
+    int64_t cpu_time_us() const {
+        return _cpu_time_per_second.load(std::memory_order_relaxed);
+    }
+    // 连续若干周期超过阈值才认为是热点, 避免毛刺触发分裂
+    bool is_hot() const {
+        return _hot_periods.load(std::memory_order_relaxed) >= FLAGS_hot_region_periods;
+    }
+    // 根据上一周期的采样选取使两侧访问量最接近的分裂点
+    // 采样不足或单个key占绝大部分访问时返回-1
+    int get_split_key(const std::string& start_key, const std::string& end_key,
+            std::string& split_key);
+
+private:
+    std::atomic<int64_t> _read_count{0};
+    std::atomic<int64_t> _write_count{0};
+    std::atomic<int64_t> _cpu_time_us{0};
+    // 心跳线程写, split线程读
+    std::atomic<int64_t> _read_qps{0};
+    std::atomic<int64_t> _write_qps{0};
+    std::atomic<int64_t> _cpu_time_per_second{0};
+    std::atomic<int> _hot_periods{0};
+    TimeCost _last_update;
+
+    std::mutex _sample_mutex;
+    int64_t _sample_seen = 0;
+    std::vector<std::string> _samples;
+    std::vector<std::string> _last_samples;
+};
+}
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
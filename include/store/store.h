@@ -35,6 +35,7 @@
 #include "region.h"
 #include "schema_factory.h"
 #include "rocks_wrapper.h"
+#include "key_layout.h"
 #include "table_record.h"
 #include "meta_server_interact.hpp"
 namespace baikaldb {
@@ -169,6 +170,22 @@ public:
     void erase_region(int64_t region_id) {
         _region_mapping.erase(region_id);
     }
+    // 本store上是否有其他索引布局的region与region_info的key区间重叠
+    // 分裂过程中新老region共享区间, 此时不能按区间删除数据
+    bool has_overlapped_region(const pb::RegionInfo& region_info) {
+        bool overlapped = false;
+        traverse_copy_region_map([&region_info, &overlapped](SmartRegion& region) {
+            if (overlapped || region->get_region_id() == region_info.region_id()) {
+                return;
+            }
+            pb::RegionInfo other;
+            region->get_region_info(other);
+            if (region_data_overlap(region_info, other)) {
+                overlapped = true;
+            }
+        });
+        return overlapped;
+    }
     void traverse_region_map(const std::function<void(SmartRegion& region)>& call) {
         _region_mapping.traverse(call);
     }
@@ -215,7 +232,14 @@ private:
              _disk_total("disk_total", 0),
              _disk_used("disk_used", 0),
              dml_time_cost("dml_time_cost"),
-             select_time_cost("select_time_cost") {}
+             select_time_cost("select_time_cost"),
+             split_copy_lines("split_copy_lines"),
+             split_copy_bytes("split_copy_bytes"),
+             reverse_merge_backlog("reverse_merge_backlog", 0),
+             reverse_merge_time_cost("reverse_merge_time_cost"),
+             reverse_merge_deferred("reverse_merge_deferred") {
+        bthread_mutex_init(&_heart_beat_mutex, NULL);
+    }
     
     int drop_region_from_store(int64_t drop_region_id);
 
@@ -250,6 +274,12 @@ private:
 
     //发送心跳的线程
     Bthread _heart_beat_bth;
+    //分裂完成时也会发心跳, 串行构造和发送, 保证增量心跳的上报状态一致
+    bthread_mutex_t _heart_beat_mutex;
+    //发送失败或meta要求时, 下次心跳上报全量leader region
+    bool _need_full_heartbeat = true;
+    //老版本meta不支持增量心跳, 收到meta的确认之前只发全量心跳
+    bool _meta_support_delta_heartbeat = false;
     //判断是否需要分裂的线程
     Bthread _split_check_bth;
     //全文索引定时merge线程
@@ -290,5 +320,12 @@ public:
     std::set<int64_t>   doing_snapshot_regions;
     bvar::LatencyRecorder dml_time_cost;
     bvar::LatencyRecorder select_time_cost;
+    //分裂时拷贝到新region的行数和字节数
+    bvar::Adder<int64_t> split_copy_lines;
+    bvar::Adder<int64_t> split_copy_bytes;
+    //全文索引1级倒排积压量, 单个region的merge耗时, 因限速推迟merge的region数
+    bvar::Status<int64_t> reverse_merge_backlog;
+    bvar::LatencyRecorder reverse_merge_time_cost;
+    bvar::Adder<int64_t> reverse_merge_deferred;
 };
 }
@@ -14,6 +14,8 @@
 
 #include "fetcher_store.h"
 #include <gflags/gflags.h>
+#include <atomic>
+#include <cmath>
 #ifdef BAIDU_INTERNAL
 #include <baidu/rpc/channel.h>
 #else
@@ -21,6 +23,7 @@
 #endif
 #include "network_socket.h"
 #include "dml_node.h"
+#include "result_cache.h"
 
 namespace baikaldb {
 
@@ -32,6 +35,108 @@ DEFINE_int32(fetcher_request_timeout, 100000,
                     "store as server request timeout, default:10000ms");
 DEFINE_int32(fetcher_connect_timeout, 1000,
                     "store as server connect timeout, default:1000ms");
+DEFINE_bool(fetcher_adaptive_concurrency, false, "adjust single store concurrency by latency");
+DEFINE_int32(min_single_store_concurrency, 2, "lower bound of adaptive single store concurrency");
+DEFINE_int32(max_single_store_concurrency, 40, "upper bound of adaptive single store concurrency");
+DEFINE_int64(store_concurrency_update_interval_us, 100 * 1000LL, "adaptive concurrency update interval");
+DEFINE_int64(store_min_latency_reset_us, 60 * 1000 * 1000LL, "reset min latency of store periodically");
+DEFINE_bool(fetcher_hedge_request, false, "send backup select to another peer after p99 latency");
+DEFINE_int64(fetcher_hedge_min_delay_us, 5000, "min delay before sending a hedged request");
+
+StoreLatencyStat::StoreLatencyStat(const std::string& addr) :
+        _concurrency(FLAGS_single_store_concurrency) {
+    _latency.expose("baikaldb_store_latency", addr);
+    _concurrency_status.expose("baikaldb_store_concurrency", addr);
+    _concurrency_status.set_value(_concurrency);
+}
+
+int StoreLatencyStat::concurrency() {
+    if (!FLAGS_fetcher_adaptive_concurrency) {
+        return FLAGS_single_store_concurrency;
+    }
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_last_update.get_time() < FLAGS_store_concurrency_update_interval_us) {
+        return _concurrency;
+    }
+    _last_update.reset();
+    int64_t avg_latency = _latency.latency(1);
+    if (avg_latency <= 0) {
+        return _concurrency;
+    }
+    // 定期重置最小延迟, 适应store负载的长期变化
+    if (_min_latency_us <= 0 || avg_latency < _min_latency_us
+            || _last_min_reset.get_time() > FLAGS_store_min_latency_reset_us) {
+        _min_latency_us = avg_latency;
+        _last_min_reset.reset();
+    }
+    double gradient = std::max(0.5, std::min(1.0, (double)_min_latency_us / avg_latency));
+    int limit = _concurrency * gradient + sqrt(_concurrency);
+    _concurrency = std::max(FLAGS_min_single_store_concurrency,
+            std::min(FLAGS_max_single_store_concurrency, limit));
+    _concurrency_status.set_value(_concurrency);
+    return _concurrency;
+}
+
+int64_t StoreLatencyStat::hedge_delay_us() {
+    return std::max(FLAGS_fetcher_hedge_min_delay_us, _latency.latency_percentile(0.99));
+}
+
+// 对冲请求的回调, 记录先返回的一方
+class HedgeClosure : public google::protobuf::Closure {
+public:
+    HedgeClosure(BthreadCond* cond, std::atomic<int>* first_done, int idx) :
+        _cond(cond), _first_done(first_done), _idx(idx) {}
+    virtual void Run() {
+        int expect = -1;
+        _first_done->compare_exchange_strong(expect, _idx);
+        _cond->decrease_signal();
+    }
+private:
+    BthreadCond* _cond;
+    std::atomic<int>* _first_done;
+    int _idx;
+};
+
+// 主请求超过p99未返回时向另一副本发送相同请求, 取先成功的一方, 另一方取消
+// 返回结果所在的controller, res中为对应的结果
+static brpc::Controller* hedged_query(brpc::Channel& channel, const std::string& addr,
+        const std::string& backup_addr, const brpc::ChannelOptions& option,
+        const pb::StoreReq& req, brpc::Controller& cntl, pb::StoreRes& res,
+        brpc::Controller& backup_cntl, int64_t region_id, uint64_t log_id) {
+    int64_t delay_us = StoreLatencyManager::get_instance()->get(addr)->hedge_delay_us();
+    BthreadCond cond;
+    std::atomic<int> first_done(-1);
+    HedgeClosure primary_done(&cond, &first_done, 0);
+    HedgeClosure backup_done(&cond, &first_done, 1);
+    cond.increase();
+    pb::StoreService_Stub(&channel).query(&cntl, &req, &res, &primary_done);
+    if (cond.timed_wait(delay_us) == 0) {
+        return &cntl;
+    }
+    brpc::Channel backup_channel;
+    if (backup_channel.Init(backup_addr.c_str(), &option) != 0) {
+        cond.wait();
+        return &cntl;
+    }
+    DB_WARNING("send hedged request, region_id: %ld, addr: %s, backup_addr: %s, delay: %ld, log_id: %lu",
+            region_id, addr.c_str(), backup_addr.c_str(), delay_us, log_id);
+    pb::StoreRes backup_res;
+    backup_cntl.set_log_id(log_id);
+    cond.increase();
+    pb::StoreService_Stub(&backup_channel).query(&backup_cntl, &req, &backup_res, &backup_done);
+    cond.wait(1);
+    brpc::Controller* first = (first_done == 0) ? &cntl : &backup_cntl;
+    brpc::Controller* second = (first_done == 0) ? &backup_cntl : &cntl;
+    if (!first->Failed()) {
+        brpc::StartCancel(second->call_id());
+    }
+    cond.wait();
+    brpc::Controller* result = (!first->Failed() || second->Failed()) ? first : second;
+    if (result == &backup_cntl) {
+        res.Swap(&backup_res);
+    }
+    return result;
+}
                     
 ErrorType FetcherStore::send_request(
         RuntimeState* state,
@@ -189,7 +294,28 @@ ErrorType FetcherStore::send_request(
     }
     int64_t entry_ms5 = butil::gettimeofday_ms() % 1000;
     TimeCost query_time;
-    pb::StoreService_Stub(&channel).query(&cntl, &req, &res, NULL);
+    int64_t query_start_us = butil::gettimeofday_us();
+    brpc::Controller backup_cntl;
+    brpc::Controller* result_cntl = &cntl;
+    std::string backup_addr;
+    // 只对事务外的只读请求做对冲
+    if (FLAGS_fetcher_hedge_request && op_type == pb::OP_SELECT && state->txn_id == 0
+            && retry_times == 0 && choose_backup_instance(info, addr, backup_addr)) {
+        result_cntl = hedged_query(channel, addr, backup_addr, option, req, cntl, res,
+                backup_cntl, region_id, log_id);
+    } else {
+        pb::StoreService_Stub(&channel).query(&cntl, &req, &res, NULL);
+    }
+    auto result_cache = ResultCache::get_instance();
+    if (op_type != pb::OP_SELECT && result_cache->enabled()) {
+        // 经本db写入的region, 缓存的结果立即失效
+        result_cache->invalidate_region(region_id);
+    }
+    // 对冲时结果可能来自backup副本
+    std::string result_addr = (result_cntl == &cntl) ? addr : backup_addr;
+    if (!result_cntl->Failed()) {
+        StoreLatencyManager::get_instance()->get(result_addr)->record(query_time.get_time());
+    }
 
     //DB_WARNING("fetch store req: %s", req.DebugString().c_str());
     //DB_WARNING("fetch store res: %s", res.DebugString().c_str());
@@ -197,11 +323,11 @@ ErrorType FetcherStore::send_request(
         DB_WARNING("entry_ms:%d, %d, %d, %d, %d, lock:%ld, wait region_id: %ld version:%ld time:%ld rpc_time: %ld log_id:%lu txn_id: %lu, ip:%s", 
                 entry_ms, entry_ms2, entry_ms3, entry_ms4, entry_ms5, client_lock_tm, region_id, 
                 info.version(), cost.get_time(), query_time.get_time(), log_id, state->txn_id,
-                butil::endpoint2str(cntl.remote_side()).c_str());
+                butil::endpoint2str(result_cntl->remote_side()).c_str());
     }
-    if (cntl.Failed()) {
+    if (result_cntl->Failed()) {
         DB_WARNING("call failed region_id: %ld, error:%s, log_id:%lu", 
-                region_id, cntl.ErrorText().c_str(), log_id);
+                region_id, result_cntl->ErrorText().c_str(), log_id);
         other_peer_to_leader_func(info);
         //schema_factory->update_leader(info);
         bthread_usleep(retry_times * FLAGS_retry_interval_us);
@@ -360,6 +486,20 @@ ErrorType FetcherStore::send_request(
         affected_rows += res.affected_rows();
         return E_OK;
     }
+    if (res.has_applied_index() && result_cache->enabled()) {
+        result_cache->update_region(region_id, result_addr, res.applied_index(), query_start_us);
+    }
+    if (state->record_region_snapshot()) {
+        if (res.has_applied_index()) {
+            RegionSnapshot snapshot;
+            snapshot.version = info.version();
+            snapshot.applied_index = res.applied_index();
+            snapshot.addr = result_addr;
+            state->add_region_snapshot(region_id, snapshot);
+        } else {
+            state->set_region_snapshot_incomplete();
+        }
+    }
     if (res.leader() != "0.0.0.0:0" && res.leader() != "" && res.leader() != info.leader()) {
         info.set_leader(res.leader());
         schema_factory->update_leader(info);
@@ -369,6 +509,13 @@ ErrorType FetcherStore::send_request(
         }
     }
     cost.reset();
+    int64_t res_size = res.ByteSize();
+    memory_consumed += res_size;
+    if (!state->memory_consume(res_size)) {
+        DB_WARNING("query exceed memory quota, used:%ld, limit:%ld, region_id:%ld, log_id:%lu",
+                state->memory_used(), state->memory_limit(), region_id, log_id);
+        return E_MEM_QUOTA;
+    }
     std::shared_ptr<RowBatch> batch = std::make_shared<RowBatch>();
     for (auto& pb_row : *res.mutable_row_values()) {
         std::unique_ptr<MemRow> row = state->mem_row_desc()->fetch_mem_row();
@@ -399,6 +546,21 @@ ErrorType FetcherStore::send_request(
     return E_OK;
 }
 
+bool FetcherStore::choose_backup_instance(const pb::RegionInfo& info, const std::string& addr,
+        std::string& backup_addr) {
+    std::vector<std::string> candicate_peers;
+    for (auto& peer : info.peers()) {
+        if (peer != addr) {
+            candicate_peers.push_back(peer);
+        }
+    }
+    if (candicate_peers.empty()) {
+        return false;
+    }
+    backup_addr = candicate_peers[butil::fast_rand() % candicate_peers.size()];
+    return true;
+}
+
 void FetcherStore::choose_opt_instance(pb::RegionInfo& info, std::string& addr) {
     SchemaFactory* schema_factory = SchemaFactory::get_instance();
     std::string baikaldb_logical_room = schema_factory->get_logical_room();
@@ -430,6 +592,8 @@ int FetcherStore::run(RuntimeState* state,
                     pb::OpType op_type) {
     //DB_WARNING("start_seq_id: %d, current_seq_id: %d op_type: %s", start_seq_id,
     //        current_seq_id, pb::OpType_Name(op_type).c_str());
+    // 上一轮的结果已经被取走, 归还其占用的配额
+    state->memory_release(memory_consumed.exchange(0));
     region_batch.clear();
     index_records.clear();
     start_key_sort.clear();
@@ -449,7 +613,9 @@ int FetcherStore::run(RuntimeState* state,
         auto store_thread = [this, state, store_request, pair, log_id, start_seq_id, current_seq_id,
                               &region_infos, &store_cond, op_type]() {
             ON_SCOPE_EXIT([&store_cond]{store_cond.decrease_signal();});
-            BthreadCond cond(-FLAGS_single_store_concurrency); // 单store内并发数
+            // 单store内并发数, 开启自适应时按该store的延迟调整
+            int concurrency = StoreLatencyManager::get_instance()->get(pair.first)->concurrency();
+            BthreadCond cond(-concurrency);
             for (auto region_id : pair.second) {
                 // 这两个资源后续不会分配新的，因此不需要加锁
                 pb::RegionInfo* info = nullptr;
@@ -474,7 +640,7 @@ int FetcherStore::run(RuntimeState* state,
                 Bthread bth(&BTHREAD_ATTR_SMALL);
                 bth.run(req_thread);
             }
-            cond.wait(-FLAGS_single_store_concurrency);
+            cond.wait(-concurrency);
         };
         Bthread bth(&BTHREAD_ATTR_SMALL);
         bth.run(store_thread);
@@ -482,12 +648,16 @@ int FetcherStore::run(RuntimeState* state,
     store_cond.wait();
     if (error != E_OK) {
         if (error == E_FATAL
-                || error == E_BIG_SQL) {
+                || error == E_BIG_SQL
+                || error == E_MEM_QUOTA) {
             DB_FATAL("fetcher node open fail, log_id:%lu, txn_id: %lu, seq_id: %d op_type: %s", 
                     log_id, state->txn_id, current_seq_id, pb::OpType_Name(op_type).c_str());
             if (error == E_BIG_SQL) {
                 state->error_code = ER_SQL_TOO_BIG;
                 state->error_msg.str("sql too big");
+            } else if (error == E_MEM_QUOTA) {
+                state->error_code = ER_QUERY_EXCEED_QUOTA;
+                state->error_msg.str("query exceed memory quota");
             }
         } else {
             DB_WARNING("fetcher node open fail, log_id:%lu, txn_id: %lu, seq_id: %d op_type: %s", 
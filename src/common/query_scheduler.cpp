@@ -0,0 +1,96 @@
+// Copyright (c) 2018-present Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "query_scheduler.h"
+
+namespace baikaldb {
+DEFINE_bool(enable_query_scheduler, false, "enable admission control of queries on baikaldb");
+DEFINE_int64(long_query_region_threshold, 10, "query touching more regions is a long query");
+DEFINE_int32(short_query_concurrency, 1000, "max concurrent short queries");
+DEFINE_int32(long_query_concurrency, 40, "max concurrent long queries");
+DEFINE_int32(long_query_concurrency_per_user, 10, "max concurrent long queries per user");
+DEFINE_int32(long_query_concurrency_per_table, 10, "max concurrent long queries per table");
+DEFINE_int64(query_queue_timeout_us, 10 * 1000 * 1000LL, "max time a query waits in queue");
+
+QueryScheduler::QueryScheduler() {
+    _class_groups[QC_SHORT].reset(new ResourceGroup(FLAGS_short_query_concurrency));
+    _class_groups[QC_LONG].reset(new ResourceGroup(FLAGS_long_query_concurrency));
+    _queued_count[QC_SHORT].expose("baikaldb_short_query_queued");
+    _queued_count[QC_LONG].expose("baikaldb_long_query_queued");
+    _rejected_count.expose("baikaldb_query_rejected");
+    _queue_time[QC_SHORT].expose("baikaldb_short_query_queue_time");
+    _queue_time[QC_LONG].expose("baikaldb_long_query_queue_time");
+}
+
+SmartResourceGroup QueryScheduler::get_group(
+        std::unordered_map<std::string, SmartResourceGroup>& groups,
+        const std::string& key, int concurrency) {
+    std::lock_guard<std::mutex> guard(_group_mutex);
+    auto iter = groups.find(key);
+    if (iter != groups.end()) {
+        return iter->second;
+    }
+    SmartResourceGroup group(new ResourceGroup(concurrency));
+    groups[key] = group;
+    return group;
+}
+
+int QueryScheduler::enter(QueryTicket* ticket, SmartResourceGroup group, int64_t timeout_us) {
+    if (timeout_us <= 0) {
+        return -1;
+    }
+    // increase_timed_wait超时也会计数, 需要自己归还
+    int ret = group->cond.increase_timed_wait(timeout_us);
+    if (ret != 0) {
+        group->cond.decrease_signal();
+        return -1;
+    }
+    ticket->_groups.push_back(group);
+    return 0;
+}
+
+int QueryScheduler::acquire(QueryTicket* ticket, const std::string& user,
+        const std::string& table, int64_t cost) {
+    QueryClass query_class = classify(cost);
+    ticket->_class = query_class;
+    TimeCost time_cost;
+    _queued_count[query_class] << 1;
+    ON_SCOPE_EXIT([this, query_class, &time_cost]() {
+        _queued_count[query_class] << -1;
+        _queue_time[query_class] << time_cost.get_time();
+    });
+    // 先占资源组再占队列, 避免被限流的用户占着全局名额
+    std::vector<SmartResourceGroup> groups;
+    if (query_class == QC_LONG) {
+        groups.push_back(get_group(_user_groups, user, FLAGS_long_query_concurrency_per_user));
+        if (!table.empty()) {
+            groups.push_back(get_group(_table_groups, table,
+                        FLAGS_long_query_concurrency_per_table));
+        }
+    }
+    groups.push_back(_class_groups[query_class]);
+    for (auto& group : groups) {
+        if (enter(ticket, group, FLAGS_query_queue_timeout_us - time_cost.get_time()) != 0) {
+            ticket->release();
+            _rejected_count << 1;
+            DB_WARNING("query queue timeout, user:%s, table:%s, cost:%ld, class:%d",
+                    user.c_str(), table.c_str(), cost, query_class);
+            return -1;
+        }
+    }
+    return 0;
+}
+}
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 */
@@ -0,0 +1,213 @@
+// Copyright (c) 2018-present Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "result_cache.h"
+#include <atomic>
+#include <unordered_set>
+#ifdef BAIDU_INTERNAL
+#include <baidu/rpc/channel.h>
+#else
+#include <brpc/channel.h>
+#endif
+#include "proto/store.interface.pb.h"
+
+namespace baikaldb {
+DEFINE_int64(result_cache_bytes, 0, "max bytes of baikaldb result cache, 0 means disabled");
+DEFINE_int64(result_cache_max_items, 100000, "max items of baikaldb result cache");
+DEFINE_int64(result_cache_max_item_bytes, 1024 * 1024LL, "result larger than this is not cached");
+DEFINE_int32(result_cache_check_timeout_ms, 100, "timeout of applied_index check for result cache");
+DEFINE_int32(result_cache_check_interval_ms, 0, "applied_index of a peer known within this "
+        "interval is trusted without rpc, writes from other baikaldb may be invisible for this long, "
+        "0 means check on every hit");
+
+ResultCache::ResultCache() {
+    _cache.init(FLAGS_result_cache_max_items, FLAGS_result_cache_bytes);
+    _hit_count.expose("baikaldb_result_cache_hit");
+    _miss_count.expose("baikaldb_result_cache_miss");
+    _invalid_count.expose("baikaldb_result_cache_invalid");
+}
+
+std::string ResultCache::make_key(const std::string& sql, const std::string& db,
+        const std::string& charset) {
+    std::string key;
+    key.reserve(sql.size() + db.size() + charset.size() + 2);
+    key.append(db).append(1, '\0').append(charset).append(1, '\0');
+    // 引号内的空白保持原样
+    char quote = 0;
+    bool last_space = false;
+    for (size_t i = 0; i < sql.size(); ++i) {
+        char c = sql[i];
+        if (quote != 0) {
+            key.append(1, c);
+            if (c == '\\' && i + 1 < sql.size()) {
+                key.append(1, sql[++i]);
+            } else if (c == quote) {
+                quote = 0;
+            }
+            continue;
+        }
+        if (c == '\'' || c == '"' || c == '`') {
+            quote = c;
+        }
+        if (isspace(c)) {
+            if (!last_space) {
+                key.append(1, ' ');
+            }
+            last_space = true;
+            continue;
+        }
+        last_space = false;
+        key.append(1, c);
+    }
+    return key;
+}
+
+int ResultCache::find(const std::string& key, const std::map<int64_t, int64_t>& region_versions,
+        SmartCachedResult* result) {
+    SmartCachedResult cached;
+    if (_cache.find(key, &cached) != 0) {
+        _miss_count << 1;
+        return -1;
+    }
+    // 分裂/合并后db侧的region路由已经变化
+    bool same_regions = region_versions.size() == cached->regions.size();
+    for (auto& pair : region_versions) {
+        if (!same_regions) {
+            break;
+        }
+        auto iter = cached->regions.find(pair.first);
+        same_regions = (iter != cached->regions.end() && iter->second.version == pair.second);
+    }
+    if (!same_regions || !validate(*cached)) {
+        _cache.del(key);
+        _invalid_count << 1;
+        return -1;
+    }
+    _hit_count << 1;
+    *result = cached;
+    return 0;
+}
+
+void ResultCache::add(const std::string& key, SmartCachedResult result) {
+    if (result->regions.empty()) {
+        return;
+    }
+    int64_t size = key.size() + result->packets.size()
+        + result->regions.size() * sizeof(RegionSnapshot);
+    if (size > FLAGS_result_cache_max_item_bytes) {
+        return;
+    }
+    _cache.add(key, result, size);
+}
+
+bool ResultCache::is_nondeterministic_fn(const std::string& fn_name, size_t num_args) {
+    static const std::unordered_set<std::string> fns = {
+        "now", "sysdate", "curdate", "curtime", "current_date", "current_time",
+        "current_timestamp", "localtime", "localtimestamp", "utc_date", "utc_time",
+        "utc_timestamp", "rand", "uuid", "uuid_short", "connection_id", "last_insert_id"
+    };
+    // unix_timestamp(expr)是确定的
+    if (fn_name == "unix_timestamp") {
+        return num_args == 0;
+    }
+    return fns.count(fn_name) == 1;
+}
+
+void ResultCache::update_region(int64_t region_id, const std::string& addr,
+        int64_t applied_index, int64_t request_start_us) {
+    if (FLAGS_result_cache_check_interval_ms <= 0) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(_region_mutex);
+    auto& state = _region_states[region_id];
+    if (request_start_us <= state.invalid_time_us) {
+        return;
+    }
+    state.addr = addr;
+    state.applied_index = applied_index;
+    state.update_time_us = butil::gettimeofday_us();
+}
+
+void ResultCache::invalidate_region(int64_t region_id) {
+    std::lock_guard<std::mutex> lock(_region_mutex);
+    auto& state = _region_states[region_id];
+    state.update_time_us = 0;
+    state.invalid_time_us = butil::gettimeofday_us();
+}
+
+// 读取时的peer在check_interval内返回过applied_index时直接比较, 否则向该peer查询,
+// 全部未变化才算有效
+bool ResultCache::validate(const CachedResult& result) {
+    int64_t now = butil::gettimeofday_us();
+    std::map<int64_t, const RegionSnapshot*> check_regions;
+    {
+        std::lock_guard<std::mutex> lock(_region_mutex);
+        for (auto& pair : result.regions) {
+            auto iter = _region_states.find(pair.first);
+            if (FLAGS_result_cache_check_interval_ms > 0
+                    && iter != _region_states.end() && iter->second.update_time_us > 0
+                    && iter->second.addr == pair.second.addr
+                    && now - iter->second.update_time_us
+                    < FLAGS_result_cache_check_interval_ms * 1000LL) {
+                if (iter->second.applied_index != pair.second.applied_index) {
+                    return false;
+                }
+                continue;
+            }
+            check_regions[pair.first] = &pair.second;
+        }
+    }
+    if (check_regions.empty()) {
+        return true;
+    }
+    std::atomic<bool> valid(true);
+    BthreadCond cond;
+    for (auto& pair : check_regions) {
+        int64_t region_id = pair.first;
+        const RegionSnapshot* snapshot = pair.second;
+        cond.increase();
+        auto check_func = [this, region_id, snapshot, now, &valid, &cond]() {
+            ON_SCOPE_EXIT([&cond]{cond.decrease_signal();});
+            brpc::Channel channel;
+            brpc::ChannelOptions option;
+            option.max_retry = 1;
+            option.connect_timeout_ms = FLAGS_result_cache_check_timeout_ms;
+            option.timeout_ms = FLAGS_result_cache_check_timeout_ms;
+            if (channel.Init(snapshot->addr.c_str(), &option) != 0) {
+                valid = false;
+                return;
+            }
+            brpc::Controller cntl;
+            pb::GetAppliedIndex req;
+            pb::StoreRes res;
+            req.set_region_id(region_id);
+            pb::StoreService_Stub(&channel).get_applied_index(&cntl, &req, &res, NULL);
+            if (cntl.Failed() || res.errcode() != pb::SUCCESS) {
+                valid = false;
+                return;
+            }
+            update_region(region_id, snapshot->addr, res.applied_index(), now);
+            if (res.applied_index() != snapshot->applied_index) {
+                valid = false;
+            }
+        };
+        Bthread bth(&BTHREAD_ATTR_SMALL);
+        bth.run(check_func);
+    }
+    cond.wait();
+    return valid.load();
+}
+}
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 */
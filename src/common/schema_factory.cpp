@@ -334,6 +334,7 @@ int SchemaFactory::update_table_internal(SchemaMapping& background, const pb::Sc
     if (table.has_ttl_duration()) {
         tbl_info.ttl_duration = table.ttl_duration();
     }
+    tbl_info.ttl_format_version = table.ttl_format_version();
     for (auto& dist : table.dists()) {
         DistInfo dist_info;
         dist_info.logical_room = dist.logical_room();
@@ -1249,6 +1250,19 @@ int64_t SchemaFactory::get_ttl_duration(int64_t table_id) {
     return _table_info_mapping.at(table_id)->ttl_duration;
 }
 
+bool SchemaFactory::use_ttl_value(int64_t table_id) {
+    DoubleBufferedTable::ScopedPtr table_ptr;
+    if (_double_buffer_table.Read(&table_ptr) != 0) {
+        DB_WARNING("read double_buffer_table error.");
+        return false;
+    }
+    auto& _table_info_mapping = table_ptr->table_info_mapping;
+    if (_table_info_mapping.count(table_id) == 0) {
+        return false;
+    }
+    return _table_info_mapping.at(table_id)->use_ttl_value();
+}
+
 int SchemaFactory::get_database_id(const std::string& db_name, int64_t& db_id) {
     DoubleBufferedTable::ScopedPtr table_ptr;
     if (_double_buffer_table.Read(&table_ptr) != 0) {
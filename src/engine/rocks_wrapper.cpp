@@ -21,6 +21,7 @@
 #include "table_key.h"
 #include "raft_log_compaction_filter.h"
 #include "split_compaction_filter.h"
+#include "split_key_collector.h"
 namespace baikaldb {
 
 DEFINE_int32(rocks_transaction_lock_timeout_ms, 30000, "rocksdb transaction_lock_timeout(ms)");
@@ -31,10 +32,20 @@ DEFINE_int32(rocks_max_open_files, 1024, "rocksdb max_open_files, default: 1024"
 DEFINE_int32(stop_write_sst_cnt, 40, "level0_stop_writes_trigger");
 DEFINE_bool(rocks_data_dynamic_level_bytes, true, 
         "rocksdb level_compaction_dynamic_level_bytes for data column_family, default true");
+DEFINE_int32(split_sample_interval, 4096, "sample one key every N keys per region in sst properties");
+// 采样间隔作为除数, 必须大于0
+static bool validate_split_sample_interval(const char* flagname, int32_t value) {
+    return value > 0;
+}
+static const bool split_sample_interval_validated = google::RegisterFlagValidator(
+        &FLAGS_split_sample_interval, validate_split_sample_interval);
+DEFINE_int64(ttl_compaction_grace_s, 3600, "compaction removes ttl rows expired longer than "
+        "this, covers raft apply lag of replicas");
 
 const std::string RocksWrapper::RAFT_LOG_CF = "raft_log";
 const std::string RocksWrapper::DATA_CF = "data";
 const std::string RocksWrapper::METAINFO_CF = "meta_info";
+const std::string SplitKeyCollector::SAMPLES_PROPERTY = "baikaldb.split_samples";
 
 RocksWrapper::RocksWrapper() : _is_init(false), _txn_db(nullptr) {}
 int32_t RocksWrapper::init(const std::string& path) {
@@ -87,7 +98,9 @@ int32_t RocksWrapper::init(const std::string& path) {
             rocksdb::NewFixedPrefixTransform(sizeof(int64_t) * 2));
     _data_cf_option.OptimizeLevelStyleCompaction();
     _data_cf_option.compaction_pri = rocksdb::kByCompensatedSize;
-    _data_cf_option.compaction_filter = SplitCompactionFilter::get_instance();
+    _data_cf_option.compaction_filter_factory = std::make_shared<SplitCompactionFilterFactory>();
+    _data_cf_option.table_properties_collector_factories.emplace_back(
+            std::make_shared<SplitKeyCollectorFactory>());
     _data_cf_option.table_factory.reset(rocksdb::NewBlockBasedTableFactory(table_options));
     //data_cf_option.compression = rocksdb::kLZ4Compression;
     _data_cf_option.compaction_style = rocksdb::kCompactionStyleLevel;
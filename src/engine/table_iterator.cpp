@@ -15,6 +15,8 @@
 #include "table_iterator.h"
 #include "transaction.h"
 #include "tuple_record.h"
+#include "key_layout.h"
+#include "ttl_value.h"
 
 namespace baikaldb {
 
@@ -65,6 +67,11 @@ int Iterator::open(const IndexRange& range, std::map<int32_t, FieldInfo*>& field
     _pri_info    = range.pri_info;
     _region_info = range.region_info;
     _region      = range.region_info->region_id();
+    _key_prefix  = data_key_prefix(*range.region_info);
+    if (range.region_info->index_key_layout()) {
+        // 索引布局的key空间与同分区的其他region共享, 必须按region区间截断
+        _need_check_region = true;
+    }
     _txn         = txn ? txn->get_txn() : nullptr;
     _fields      = fields;
     bool like_prefix = range.like_prefix;
@@ -86,9 +93,15 @@ int Iterator::open(const IndexRange& range, std::map<int32_t, FieldInfo*>& field
         DB_WARNING("get schema factory failed");
         return -1;
     }
+    // 全局索引和列存的value不带过期时间
+    if (!_index_info->is_global && !is_cstore() && _schema->use_ttl_value(_pri_info->id)) {
+        _use_ttl = true;
+        // 事务内的扫描与事务的写入使用同一时间判断过期
+        _ttl_now_us = txn != nullptr ? txn->ttl_timestamp_us() : butil::gettimeofday_us();
+    }
 
-    _start.append_i64(_region).append_i64(index_id);
-    _end.append_i64(_region).append_i64(index_id);
+    _start.append_i64(_key_prefix).append_i64(index_id);
+    _end.append_i64(_key_prefix).append_i64(index_id);
 
     int col_cnt = _index_info->fields.size();
     int left_secondary_field_cnt = std::min(col_cnt, range.left_field_cnt);
@@ -218,8 +231,8 @@ int Iterator::open(const IndexRange& range, std::map<int32_t, FieldInfo*>& field
             _upper_is_end = true;
         }
 
-        _lower_bound.append_i64(_region).append_i64(index_id).append_index(lower_bound);
-        _upper_bound.append_i64(_region).append_i64(index_id).append_index(upper_bound);
+        _lower_bound.append_i64(_key_prefix).append_i64(index_id).append_index(lower_bound);
+        _upper_bound.append_i64(_key_prefix).append_i64(index_id).append_index(upper_bound);
     } else {
         _lower_bound.append_index(_start);
         _upper_bound.append_index(_end);
@@ -377,17 +390,25 @@ bool Iterator::_fits_left_bound() {
 }
 
 //仅用于二级索引判断，主键region在open中判断
-bool Iterator::_fits_region() {
+bool Iterator::_fits_region(const rocksdb::Slice& value) {
     if (!_need_check_region) {
         return true;
     }
     //check range end_key
     rocksdb::Slice key(_iter->key().data() + _prefix_len, _iter->key().size() - _prefix_len);
-    bool ret = Transaction::fits_region_range(key, _iter->value(), nullptr, 
+    bool ret = Transaction::fits_region_range(key, value, nullptr, 
         &_region_info->end_key(), *_pri_info, *_index_info);
     return ret;
 }
 
+bool Iterator::_get_value(rocksdb::Slice* value) {
+    *value = _iter->value();
+    if (!_use_ttl) {
+        return true;
+    }
+    return !ttl_expired(ttl_decode(value), _ttl_now_us);
+}
+
 bool Iterator::_fits_right_bound() {
     //check range end_key
     rocksdb::Slice key = _iter->key();
@@ -415,7 +436,7 @@ bool Iterator::_fits_right_bound() {
 }
 bool Iterator::_fits_prefix(rocksdb::Iterator* iter, int32_t field_id) {
     MutTableKey  prefix_key;
-    prefix_key.append_i64(_region);
+    prefix_key.append_i64(_key_prefix);
     if (field_id) {
         prefix_key.append_i32(_index_info->id);
         prefix_key.append_i32(field_id);
@@ -433,50 +454,61 @@ bool Iterator::is_cstore() {
 }
 
 int TableIterator::get_next(SmartRecord record) {
-    if (!_valid) {
-        return -1;
-    }
-    if ((_forward && !_fits_right_bound()) || (!_forward && !_fits_left_bound())) {
-        _valid = false;
-        return -1;
-    }
-    //create a record and parse key and value
-    if (VAL_ONLY == _mode || KEY_VAL == _mode) {
-        if (!is_cstore()) {
-            TupleRecord tuple_record(_iter->value());
-            // only decode the required field (field_ids stored in fields)
-            if (0 != tuple_record.decode_fields(_fields, record)) {
-                DB_WARNING("decode value failed: %ld", _index_info->id);
-                _valid = false;
-                return -1;
+    while (_valid) {
+        if ((_forward && !_fits_right_bound()) || (!_forward && !_fits_left_bound())) {
+            _valid = false;
+            return -1;
+        }
+        rocksdb::Slice value;
+        if (!_get_value(&value)) {
+            // 过期的行等compaction删除, 读取时跳过
+            if (_forward) {
+                _iter->Next();
+            } else {
+                _iter->Prev();
             }
-        } else {
-            // for cstore, column value may be null.
-            if (0 != get_next_columns(record)) {
-                DB_WARNING("get non-pk cloumn value failed table_id: %ld", _index_info->id);
+            _valid = _valid && _iter->Valid();
+            continue;
+        }
+        //create a record and parse key and value
+        if (VAL_ONLY == _mode || KEY_VAL == _mode) {
+            if (!is_cstore()) {
+                TupleRecord tuple_record(value);
+                // only decode the required field (field_ids stored in fields)
+                if (0 != tuple_record.decode_fields(_fields, record)) {
+                    DB_WARNING("decode value failed: %ld", _index_info->id);
+                    _valid = false;
+                    return -1;
+                }
+            } else {
+                // for cstore, column value may be null.
+                if (0 != get_next_columns(record)) {
+                    DB_WARNING("get non-pk cloumn value failed table_id: %ld", _index_info->id);
+                    _valid = false;
+                    return -1;
+                }
+            }
+        }
+        if (KEY_ONLY == _mode || KEY_VAL == _mode) {
+            int pos = _prefix_len;
+            TableKey key(_iter->key(), true);
+            if (0 != record->decode_key(*_index_info, key, pos)) {
+                DB_WARNING("decode key failed: %ld", _index_info->id);
                 _valid = false;
                 return -1;
             }
         }
-    }
-    if (KEY_ONLY == _mode || KEY_VAL == _mode) {
-        int pos = _prefix_len;
-        TableKey key(_iter->key(), true);
-        if (0 != record->decode_key(*_index_info, key, pos)) {
-            DB_WARNING("decode key failed: %ld", _index_info->id);
-            _valid = false;
-            return -1;
+        if (_forward) {
+            _iter->Next();
+        } else {
+            _iter->Prev();
         }
+        
+        //DB_WARNING("parse:%ld add_batch:%ld nexttime:%ld", parse, add_batch,next_time);
+        _valid = _valid && _iter->Valid();
+        return 0;
     }
-    if (_forward) {
-        _iter->Next();
-    } else {
-        _iter->Prev();
-    }
-    
-    //DB_WARNING("parse:%ld add_batch:%ld nexttime:%ld", parse, add_batch,next_time);
-    _valid = _valid && _iter->Valid();
-    return 0;
+    return -1;
 }
 
 // for cstore only
@@ -554,7 +586,8 @@ int IndexIterator::get_next(SmartRecord index) {
             //    index->debug_string().c_str());
             return -1;
         }
-        if (!_fits_region()) {
+        rocksdb::Slice value;
+        if (!_get_value(&value) || !_fits_region(value)) {
             if (_forward) {
                 _iter->Next();
             } else {
@@ -579,7 +612,7 @@ int IndexIterator::get_next(SmartRecord index) {
             return -1;
         }
         if (_idx_type == pb::I_UNIQ) {
-            TableKey pkey(_iter->value(), true);
+            TableKey pkey(value, true);
             pos = 0;
             if (0 != index->decode_primary_key(*_index_info, pkey, pos)) {
                 DB_WARNING("decode primary index failed: %ld", _index_info->pk);
@@ -15,14 +15,44 @@
 #include "transaction.h"
 #include "transaction_pool.h"
 #include "tuple_record.h"
+#include <mutex>
+#include <unordered_map>
 #include <boost/scoped_array.hpp>
 #include <gflags/gflags.h>
+#include <bvar/bvar.h>
 
 namespace baikaldb {
 DEFINE_bool(disable_wal, false, "disable rocksdb interanal WAL log, only use raft log");
+// 只检测单个store内的等锁环; 跨region/跨store的死锁仍依赖等锁超时,
+// 上报txn_id到baikaldb做全局检测留作后续工作
+DEFINE_bool(rocks_deadlock_detect, true, "detect deadlock by rocksdb wait-for graph when lock wait");
+DEFINE_int64(rocks_deadlock_detect_depth, 50, "max depth of rocksdb wait-for graph search");
+DEFINE_int64(lock_wait_stat_threshold_us, 1000, "lock wait longer than this is recorded per table");
 // DEFINE_int32(rocks_transaction_expiration_ms, 600 * 1000, 
 //         "rocksdb transaction_expiration timeout(us)");
 
+static bvar::LatencyRecorder g_lock_wait_cost("rocks_lock_wait_cost");
+static bvar::Adder<int64_t> g_deadlock_count("rocks_deadlock_count");
+
+// 按表统计的行锁等待耗时和死锁次数, bvar创建后不回收
+struct TableLockStat {
+    bvar::LatencyRecorder* lock_wait = nullptr;
+    bvar::Adder<int64_t>* deadlock = nullptr;
+};
+static std::mutex g_table_lock_stat_mutex;
+static std::unordered_map<int64_t, TableLockStat> g_table_lock_stat;
+
+static TableLockStat& get_table_lock_stat(int64_t table_id) {
+    std::lock_guard<std::mutex> lock(g_table_lock_stat_mutex);
+    TableLockStat& stat = g_table_lock_stat[table_id];
+    if (stat.lock_wait == nullptr) {
+        std::string prefix = "table_" + std::to_string(table_id);
+        stat.lock_wait = new bvar::LatencyRecorder(prefix + "_lock_wait");
+        stat.deadlock = new bvar::Adder<int64_t>(prefix + "_deadlock");
+    }
+    return stat;
+}
+
 int Transaction::begin() {
     rocksdb::TransactionOptions txn_opt;
     return begin(txn_opt);
@@ -42,6 +72,9 @@ int Transaction::begin(rocksdb::TransactionOptions txn_opt) {
         return -1;
     }
     _txn_opt = txn_opt;
+    // 等锁时在wait-for图上检测环, 成环则当前事务立即失败, 不必等到锁超时
+    _txn_opt.deadlock_detect = _deadlock_detect && FLAGS_rocks_deadlock_detect;
+    _txn_opt.deadlock_detect_depth = FLAGS_rocks_deadlock_detect_depth;
     if (nullptr == (_txn = _db->begin_transaction(_write_opt, _txn_opt))) {
         DB_WARNING("start_trananction failed");
         return -1;
@@ -278,12 +311,15 @@ int Transaction::put_primary(int64_t region, IndexInfo& pk_index, SmartRecord re
     last_active_time = butil::gettimeofday_us();
     MutTableKey key;
     int ret = -1;
-    key.append_i64(region).append_i64(pk_index.id);
+    key.append_i64(key_prefix(region)).append_i64(pk_index.id);
     //encode key (not allowing prefix, do post field_clear)
     if (0 != key.append_index(pk_index, record.get(), -1, true)) {
         DB_FATAL("Fail to append_index, reg=%ld, tab=%ld", region, pk_index.id);
         return -1;
     }
+    if (first_primary_key.empty()) {
+        first_primary_key = key.data().substr(sizeof(int64_t) * 2);
+    }
     std::string value;
     if (!is_cstore()) {
         ret = record->encode(value);
@@ -291,6 +327,7 @@ int Transaction::put_primary(int64_t region, IndexInfo& pk_index, SmartRecord re
             DB_WARNING("encode record failed: reg=%ld, tab=%ld", region, pk_index.id);
             return -1;
         }
+        ttl_encode_value(&value);
     } else {
         value = "";
     }
@@ -322,7 +359,7 @@ int Transaction::put_secondary(int64_t region, IndexInfo& index, SmartRecord rec
         return -1;
     }
     MutTableKey key;
-    key.append_i64(region).append_i64(index.id);
+    key.append_i64(key_prefix(region)).append_i64(index.id);
 
     //encode key (not allowing prefix, no clear)
     if(0 != key.append_index(index, record.get(), -1, false)) {
@@ -331,17 +368,18 @@ int Transaction::put_secondary(int64_t region, IndexInfo& index, SmartRecord rec
     }
     rocksdb::Status res;
     MutTableKey pk;
+    std::string value;
     if (index.type == pb::I_KEY) {
         if (0 != record->encode_primary_key(index, key, -1)) {
             DB_FATAL("Fail to append_index, reg:%ld, tab:%ld", region, index.pk);
             return -1;
         }
+        ttl_encode_value(&value);
         if (_is_separate) {
-            std::string value = "";
             add_kvop_put(key.data(), value);
             return 0;
         }
-        res = _txn->Put(_data_cf, key.data(), "");
+        res = _txn->Put(_data_cf, key.data(), value);
         //DB_FATAL("data:%s", str_to_hex(key.data()).c_str());
     } else if (index.type == pb::I_UNIQ) {
         //MutTableKey pk;
@@ -349,11 +387,13 @@ int Transaction::put_secondary(int64_t region, IndexInfo& index, SmartRecord rec
             DB_FATAL("Fail to append_index, reg:%ld, tab:%ld", region, index.pk);
             return -1;
         }
+        value = pk.data();
+        ttl_encode_value(&value);
         if (_is_separate) {
-            add_kvop_put(key.data(), pk.data());
+            add_kvop_put(key.data(), value);
             return 0;
         }
-        res = _txn->Put(_data_cf, key.data(), pk.data());
+        res = _txn->Put(_data_cf, key.data(), value);
     }
     if (!res.ok()) {
         DB_FATAL("put secondary fail, error: %s", res.ToString().c_str());
@@ -364,10 +404,42 @@ int Transaction::put_secondary(int64_t region, IndexInfo& index, SmartRecord rec
     return 0;
 }
 
-int Transaction::get_for_update(const std::string& key, std::string* value) {
-    BAIDU_SCOPED_LOCK(_txn_mutex);
+rocksdb::Status Transaction::lock_for_update(int64_t table_id, 
+        const std::string& key, std::string* value) {
     rocksdb::ReadOptions read_opt;
+    TimeCost cost;
     auto res = _txn->GetForUpdate(read_opt, _data_cf, key, value);
+    int64_t lock_cost = cost.get_time();
+    g_lock_wait_cost << lock_cost;
+    bool deadlock = res.IsBusy() && res.subcode() == rocksdb::Status::kDeadlock;
+    if (lock_cost < FLAGS_lock_wait_stat_threshold_us && !deadlock) {
+        return res;
+    }
+    TableLockStat& stat = get_table_lock_stat(table_id);
+    *stat.lock_wait << lock_cost;
+    if (deadlock) {
+        // 当前事务作为victim, 语句失败后由客户端回滚重试
+        _is_deadlock = true;
+        *stat.deadlock << 1;
+        g_deadlock_count << 1;
+        auto deadlock_paths = _db->get_db()->GetDeadlockInfoBuffer();
+        if (!deadlock_paths.empty()) {
+            for (auto& info : deadlock_paths.back().path) {
+                DB_WARNING("deadlock path, rocks_txn_id: %lu, exclusive: %d, waiting_key: %s",
+                        info.m_txn_id, info.m_exclusive, 
+                        rocksdb::Slice(info.m_waiting_key).ToString(true).c_str());
+            }
+        }
+        DB_WARNING("deadlock found, txn_id: %lu, rocks_txn_id: %lu, table_id: %ld, cost: %ld",
+                _txn_id, _txn->GetID(), table_id, lock_cost);
+    }
+    return res;
+}
+
+int Transaction::get_for_update(const std::string& key, std::string* value) {
+    BAIDU_SCOPED_LOCK(_txn_mutex);
+    int64_t table_id = _region_info != nullptr ? _region_info->table_id() : 0;
+    auto res = lock_for_update(table_id, key, value);
     if (res.ok()) {
         return 0;
     } else if (res.IsNotFound()) {
@@ -480,12 +552,16 @@ int Transaction::get_update_primary(
             return -3;
         }
     }
+    if (first_primary_key.empty()) {
+        first_primary_key = key.data().ToString();
+    }
     MutTableKey _key;
-    _key.append_i64(region).append_i64(pk_index.id).append_index(key);
+    _key.append_i64(key_prefix(region)).append_i64(pk_index.id).append_index(key);
 
     std::string _value;
     std::string* val_ptr = nullptr;
-    if (mode == GET_ONLY || mode == GET_LOCK) {
+    // ttl表需要读value判断是否过期
+    if (mode == GET_ONLY || mode == GET_LOCK || use_ttl()) {
         val_ptr = &_value;
     }
     rocksdb::Status res;
@@ -496,8 +572,7 @@ int Transaction::get_update_primary(
         res = _txn->Get(read_opt, _data_cf, _key.data(), val_ptr);
         //DB_NOTICE("txn get time:%ld", cost.get_time());
     } else if (mode == LOCK_ONLY || mode == GET_LOCK) {
-        rocksdb::ReadOptions read_opt;
-        res = _txn->GetForUpdate(read_opt, _data_cf, _key.data(), val_ptr);
+        res = lock_for_update(pk_index.id, _key.data(), val_ptr);
         //DB_WARNING("data: %s %d", _value.c_str(), _value.size());
     } else {
         DB_WARNING("invalid GetMode: %d", mode);
@@ -506,10 +581,15 @@ int Transaction::get_update_primary(
 
     if (res.ok()) {
         DB_DEBUG("lock ok and key exist");
+        rocksdb::Slice value_slice(_value);
+        if (use_ttl() && ttl_expired(ttl_decode(&value_slice), ttl_timestamp_us())) {
+            // 过期的行视为不存在, 锁已加上, 可以直接覆盖写
+            return -2;
+        }
         if (mode == GET_ONLY || mode == GET_LOCK) {
             //TimeCost cost;
             if (!is_cstore()) {
-                TupleRecord tuple_record(_value);
+                TupleRecord tuple_record(value_slice);
                 // only decode the required field (field_ids stored in fields)
                 if (0 != tuple_record.decode_fields(fields, val)) {
                     DB_WARNING("decode value failed: %d", pk_index.id);
@@ -543,7 +623,7 @@ int Transaction::get_update_primary(
         DB_DEBUG("lock ok but key not exist");
         return -2;
     } else if (res.IsBusy()) {
-        DB_WARNING("lock failed, busy: %s", res.ToString().c_str());
+        DB_WARNING("lock failed, busy: %s, txn_id: %lu", res.ToString().c_str(), _txn_id);
         return -1;
     } else if (res.IsTimedOut()) {
         uint32_t cf_id = _data_cf->GetID();
@@ -610,7 +690,7 @@ int Transaction::get_update_secondary(
         return -2;
     }
     MutTableKey _key;
-    _key.append_i64(region).append_i64(index.id);
+    _key.append_i64(key_prefix(region)).append_i64(index.id);
 
     //full key, no prefix allowed
     if (0 != _key.append_index(index, key.get(), -1, false)) {
@@ -624,7 +704,7 @@ int Transaction::get_update_secondary(
     //     }
     // }
     std::string* val_ptr = nullptr;
-    if (mode == GET_ONLY || mode == GET_LOCK) {
+    if (mode == GET_ONLY || mode == GET_LOCK || use_ttl()) {
         val_ptr = &pk_val;
     }
     rocksdb::Status res;
@@ -633,8 +713,7 @@ int Transaction::get_update_secondary(
         read_opt.snapshot = _snapshot;
         res = _txn->Get(read_opt, _data_cf, _key.data(), &pk_val);
     } else if (mode == LOCK_ONLY || mode == GET_LOCK) {
-        rocksdb::ReadOptions read_opt;
-        res = _txn->GetForUpdate(read_opt, _data_cf, _key.data(), val_ptr);
+        res = lock_for_update(pk_index.id, _key.data(), val_ptr);
     } else {
         DB_WARNING("invalid GetMode: %d", mode);
         return -1;
@@ -645,7 +724,7 @@ int Transaction::get_update_secondary(
         DB_DEBUG("lock ok but key not exist");
         return -2;
     } else if (res.IsBusy()) {
-        DB_WARNING("lock failed, busy: %s", res.ToString().c_str());
+        DB_WARNING("lock failed, busy: %s, txn_id: %lu", res.ToString().c_str(), _txn_id);
         return -1;
     } else if (res.IsTimedOut()) {
         DB_WARNING("lock failed, timedout: %s", res.ToString().c_str());
@@ -654,6 +733,14 @@ int Transaction::get_update_secondary(
         DB_WARNING("unknown error: %d, %s", res.code(), res.ToString().c_str());
         return -1;
     }
+    if (use_ttl()) {
+        rocksdb::Slice value_slice(pk_val);
+        if (ttl_expired(ttl_decode(&value_slice), ttl_timestamp_us())) {
+            return -2;
+        }
+        // 只保留主键
+        pk_val.erase(0, pk_val.size() - value_slice.size());
+    }
 
     if (/*_need_check_region &&*/check_region && (mode == GET_ONLY || mode == GET_LOCK)) {
         rocksdb::Slice pure_key(_key.data());
@@ -672,7 +759,7 @@ int Transaction::remove(int64_t region, IndexInfo& index, /*IndexInfo& pk_index,
     BAIDU_SCOPED_LOCK(_txn_mutex);
     MutTableKey _key;
     last_active_time = butil::gettimeofday_us();
-    _key.append_i64(region).append_i64(index.id);
+    _key.append_i64(key_prefix(region)).append_i64(index.id);
     if (0 != _key.append_index(index, key.get(), -1, false)) {
         DB_FATAL("Fail to append_index, reg:%ld,tab:%ld", region, index.id);
         return -1;
@@ -705,7 +792,7 @@ int Transaction::remove(int64_t region, IndexInfo& index, const TableKey& key) {
     BAIDU_SCOPED_LOCK(_txn_mutex);
     last_active_time = butil::gettimeofday_us();
     MutTableKey _key;
-    _key.append_i64(region).append_i64(index.id).append_index(key);
+    _key.append_i64(key_prefix(region)).append_i64(index.id).append_index(key);
     if (index.type == pb::I_KEY) {
         // cannot append primary index
         DB_WARNING("cannot delete type KEY index");
@@ -795,6 +882,8 @@ rocksdb::Status Transaction::rollback() {
 int Transaction::set_save_point() {
     BAIDU_SCOPED_LOCK(_txn_mutex);
     last_active_time = butil::gettimeofday_us();
+    // 死锁标记只对当前语句有效
+    _is_deadlock = false;
     //if (_save_point_seq.empty()) {
     //    DB_WARNING("txn:%s seq_id:%d top_seq:%d",_txn->GetName().c_str(),  _seq_id, -1);
     //} else {
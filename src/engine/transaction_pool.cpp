@@ -29,11 +29,12 @@ int TransactionPool::init(int64_t region_id) {
 }
 
 // -1 means insert error (already exists)
-int TransactionPool::begin_txn(uint64_t txn_id, SmartTransaction& txn) {
+int TransactionPool::begin_txn(uint64_t txn_id, SmartTransaction& txn, bool deadlock_detect) {
     //int64_t region_id = _region->get_region_id();
     std::string txn_name = std::to_string(_region_id) + "_" + std::to_string(txn_id);
-    std::unique_lock<std::mutex> lock(_map_mutex);
-    if (_txn_map.count(txn_id) != 0) {
+    TxnMapShard& shard = get_shard(txn_id);
+    std::unique_lock<std::mutex> lock(shard.mutex);
+    if (shard.txn_map.count(txn_id) != 0) {
         DB_FATAL("txn already exists, txn_id: %lu", txn_id);
         return -1;
     }
@@ -42,6 +43,9 @@ int TransactionPool::begin_txn(uint64_t txn_id, SmartTransaction& txn) {
         DB_FATAL("new txn failed, txn_id: %lu", txn_id);
         return -1;
     }
+    if (!deadlock_detect) {
+        txn->disable_deadlock_detect();
+    }
     auto ret = txn->begin();
     if (ret != 0) {
         DB_FATAL("begin txn failed, txn_id: %lu", txn_id);
@@ -53,34 +57,45 @@ int TransactionPool::begin_txn(uint64_t txn_id, SmartTransaction& txn) {
         DB_WARNING("unknown error: %d, %s", res.code(), res.ToString().c_str());
     }
     //DB_WARNING("txn_begin: %p, %s", txn->get_txn(), txn_name.c_str());
-    _txn_map.insert(std::make_pair(txn_id, txn));
+    shard.txn_map.insert(std::make_pair(txn_id, txn));
     _txn_count++;
     return 0;
 }
 
 void TransactionPool::remove_txn(uint64_t txn_id) {
-    std::unique_lock<std::mutex> lock(_map_mutex);
-    if (_txn_map.count(txn_id) == 0) {
+    TxnMapShard& shard = get_shard(txn_id);
+    std::unique_lock<std::mutex> lock(shard.mutex);
+    auto iter = shard.txn_map.find(txn_id);
+    if (iter == shard.txn_map.end()) {
         return;
     }
-    (*_finished_txn_map.read())[txn_id] = _txn_map[txn_id]->dml_num_affected_rows;
+    (*shard.finished_txn_map.read())[txn_id] = iter->second->dml_num_affected_rows;
     //DB_WARNING("txn_removed: %p, %lu", txn, txn->GetName().c_str());
-    _txn_map.erase(txn_id);
+    shard.txn_map.erase(iter);
     _txn_count--;
 }
 
 // 清理僵尸事务：包括长时间（clear_delay_ms）未更新的事务
 void TransactionPool::clear_transactions(int32_t clear_delay_ms) {
-    std::unique_lock<std::mutex> lock(_map_mutex);
     // 10分钟清理过期幂等事务id
+    bool clean_finished = false;
     if (_clean_finished_txn_cost.get_time() > FLAGS_clean_finished_txn_interval_us) {
-        _finished_txn_map.read_background()->clear();
-        _finished_txn_map.swap();
+        clean_finished = true;
         _clean_finished_txn_cost.reset();
     }
+    for (auto& shard : _shards) {
+        std::unique_lock<std::mutex> lock(shard.mutex);
+        if (clean_finished) {
+            shard.finished_txn_map.read_background()->clear();
+            shard.finished_txn_map.swap();
+        }
+        clear_transactions(shard, clear_delay_ms);
+    }
+}
 
-    auto iter = _txn_map.begin();
-    while (iter != _txn_map.end()) {
+void TransactionPool::clear_transactions(TxnMapShard& shard, int32_t clear_delay_ms) {
+    auto iter = shard.txn_map.begin();
+    while (iter != shard.txn_map.end()) {
         auto txn = iter->second;
         bool clear = false;
         auto cur_time = butil::gettimeofday_us();
@@ -95,7 +110,7 @@ void TransactionPool::clear_transactions(int32_t clear_delay_ms) {
                 cur_time - txn->last_active_time,
                 clear_delay_ms);
             txn->rollback();
-            iter = _txn_map.erase(iter);
+            iter = shard.txn_map.erase(iter);
             _txn_count--;
             clear = true;
         }
@@ -108,33 +123,37 @@ void TransactionPool::clear_transactions(int32_t clear_delay_ms) {
 
 // rollback ALL un-prepared transactions when raft on_leader_stop callback is called
 void TransactionPool::on_leader_stop_rollback() {
-    std::unique_lock<std::mutex> lock(_map_mutex);
-    auto iter = _txn_map.begin();
-    while (iter != _txn_map.end()) {
-        auto& txn = iter->second;
-        if (!txn->is_prepared() && !txn->prepare_apply()) {
-            DB_WARNING("TransactionNote: txn %s is rollback due to leader stop", 
-                txn->get_txn()->GetName().c_str());
-            txn->rollback();
-            iter = _txn_map.erase(iter);
-            _txn_count--;
-        } else {
-            iter++;
+    for (auto& shard : _shards) {
+        std::unique_lock<std::mutex> lock(shard.mutex);
+        auto iter = shard.txn_map.begin();
+        while (iter != shard.txn_map.end()) {
+            auto& txn = iter->second;
+            if (!txn->is_prepared() && !txn->prepare_apply()) {
+                DB_WARNING("TransactionNote: txn %s is rollback due to leader stop", 
+                    txn->get_txn()->GetName().c_str());
+                txn->rollback();
+                iter = shard.txn_map.erase(iter);
+                _txn_count--;
+            } else {
+                iter++;
+            }
         }
     }
 }
 
 // rollback specific transaction when PREPARE apply failed due to leader stop
 void TransactionPool::on_leader_stop_rollback(uint64_t txn_id) {
-    std::unique_lock<std::mutex> lock(_map_mutex);
-    if (_txn_map.count(txn_id) == 0) {
+    TxnMapShard& shard = get_shard(txn_id);
+    std::unique_lock<std::mutex> lock(shard.mutex);
+    auto iter = shard.txn_map.find(txn_id);
+    if (iter == shard.txn_map.end()) {
         return;
     }
-    if (!_txn_map[txn_id]->is_prepared()) {
+    if (!iter->second->is_prepared()) {
         DB_WARNING("TransactionNote: txn %s is rollback due to leader stop", 
-            _txn_map[txn_id]->get_txn()->GetName().c_str());
-        _txn_map[txn_id]->rollback();
-        _txn_map.erase(txn_id);
+            iter->second->get_txn()->GetName().c_str());
+        iter->second->rollback();
+        shard.txn_map.erase(iter);
         _txn_count--;
     }
 }
@@ -144,7 +163,6 @@ int TransactionPool::on_shutdown_recovery(
         std::unordered_map<uint64_t, pb::TransactionInfo>& prepared_txn) {
 
     std::string region_prefix = std::to_string(_region_id);
-    //std::unique_lock<std::mutex> lock(_map_mutex);
     auto iter = recovered_txns.begin();
     while (iter != recovered_txns.end()) {
         if ((*iter) == nullptr) {
@@ -180,7 +198,11 @@ int TransactionPool::on_shutdown_recovery(
         for (auto& plan : txn_info.cache_plans()) {
             txn->cache_plan_map().insert({plan.seq_id(), plan});
         }
-        _txn_map.insert(std::make_pair(txn_id, SmartTransaction(txn)));
+        {
+            TxnMapShard& shard = get_shard(txn_id);
+            std::unique_lock<std::mutex> lock(shard.mutex);
+            shard.txn_map.insert(std::make_pair(txn_id, SmartTransaction(txn)));
+        }
         _txn_count++;
         iter = recovered_txns.erase(iter);
         DB_WARNING("region_id: %ld, txn_id: %lu, txn_name: %s, num_rows: %ld, seq_id: %d, txn recovered", 
@@ -202,50 +224,56 @@ int TransactionPool::on_shutdown_recovery(
 void TransactionPool::get_prepared_txn_info(
         std::unordered_map<uint64_t, pb::TransactionInfo>& prepared_txn,
         bool graceful_shutdown) {
-    std::unique_lock<std::mutex> lock(_map_mutex);
-    for (auto& pair : _txn_map) {
-        auto txn = pair.second;
-        if (!txn->is_prepared() || !txn->has_write()) {
-            continue;
-        }
-        pb::TransactionInfo txn_info;
-        txn_info.set_txn_id(pair.first);
-        txn_info.set_seq_id(txn->seq_id());
-        txn_info.set_start_seq_id(1);
-        txn_info.set_optimize_1pc(false);
-        CachePlanMap& cache_plan_map = txn->cache_plan_map();
-        for (auto& cache_plan : cache_plan_map) {
-            txn_info.add_cache_plans()->CopyFrom(cache_plan.second);
+    for (auto& shard : _shards) {
+        std::unique_lock<std::mutex> lock(shard.mutex);
+        for (auto& pair : shard.txn_map) {
+            auto txn = pair.second;
+            if (!txn->is_prepared() || !txn->has_write()) {
+                continue;
+            }
+            pb::TransactionInfo txn_info;
+            txn_info.set_txn_id(pair.first);
+            txn_info.set_seq_id(txn->seq_id());
+            txn_info.set_start_seq_id(1);
+            txn_info.set_optimize_1pc(false);
+            CachePlanMap& cache_plan_map = txn->cache_plan_map();
+            for (auto& cache_plan : cache_plan_map) {
+                txn_info.add_cache_plans()->CopyFrom(cache_plan.second);
+            }
+            txn_info.set_num_rows(txn->num_increase_rows);
+            DB_WARNING("region_id: %ld, txn_id: %lu, num_rows: %ld", 
+                _region_id, pair.first, txn->num_increase_rows);
+            prepared_txn.insert({pair.first, txn_info});
         }
-        txn_info.set_num_rows(txn->num_increase_rows);
-        DB_WARNING("region_id: %ld, txn_id: %lu, num_rows: %ld", 
-            _region_id, pair.first, txn->num_increase_rows);
-        prepared_txn.insert({pair.first, txn_info});
     }
     return;
 }
 
 void TransactionPool::update_txn_num_rows_after_split(const pb::TransactionInfo& txn_info) {
     uint64_t txn_id = txn_info.txn_id();
-    if (_txn_map.count(txn_id) == 0) {
+    TxnMapShard& shard = get_shard(txn_id);
+    std::unique_lock<std::mutex> lock(shard.mutex);
+    auto iter = shard.txn_map.find(txn_id);
+    if (iter == shard.txn_map.end()) {
         return;
     }
     DB_WARNING("TransactionNote: region_id: %ld, txn_id: %lu, old_lines: %ld, dec_lines: %ld",
         _region_id, 
         txn_id, 
-        _txn_map[txn_id]->num_increase_rows, 
+        iter->second->num_increase_rows, 
         txn_info.num_rows());
-    _txn_map[txn_id]->num_increase_rows -= txn_info.num_rows();
+    iter->second->num_increase_rows -= txn_info.num_rows();
 }
 void TransactionPool::clear() {
-    std::unique_lock<std::mutex> lock(_map_mutex);
-    auto iter = _txn_map.begin();
-    for (auto& txn : _txn_map) {
-        DB_WARNING("TransactionNote: txn %s is rollback due to leader stop", 
-            txn.second->get_txn()->GetName().c_str());
-        txn.second->rollback();
+    for (auto& shard : _shards) {
+        std::unique_lock<std::mutex> lock(shard.mutex);
+        for (auto& txn : shard.txn_map) {
+            DB_WARNING("TransactionNote: txn %s is rollback due to leader stop", 
+                txn.second->get_txn()->GetName().c_str());
+            txn.second->rollback();
+        }
+        shard.txn_map.clear();
     }
-    _txn_map.clear();
     _txn_count = 0;
 }
 }
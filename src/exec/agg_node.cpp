@@ -142,8 +142,12 @@ int AggNode::open(RuntimeState* state) {
             }
             scan_time += cost.get_time();
             cost.reset();
-            process_row_batch(batch);
+            int64_t new_group_bytes = 0;
+            process_row_batch(batch, new_group_bytes);
             agg_time += cost.get_time();
+            if (memory_consume(state, new_group_bytes) < 0) {
+                return -1;
+            }
             row_cnt += batch.size();
             // 对于用order by分组的特殊优化
             //if (_agg_tuple_id == -1 && _limit != -1 && (int64_t)_hash_map.size() >= _limit) {
@@ -181,7 +185,7 @@ void AggNode::encode_agg_key(MemRow* row, MutTableKey& key) {
     key.replace_u8(null_flag, 0);
 }
 
-void AggNode::process_row_batch(RowBatch& batch) {
+void AggNode::process_row_batch(RowBatch& batch, int64_t& new_group_bytes) {
     for (batch.reset(); !batch.is_traverse_over(); batch.next()) {
         std::unique_ptr<MemRow>& row = batch.get_row();
         MutTableKey key;
@@ -191,6 +195,7 @@ void AggNode::process_row_batch(RowBatch& batch) {
         if (agg_row == nullptr) { //不存在则新建
             cur_row = row.release();
             agg_row = &cur_row;
+            new_group_bytes += cur_row->used_size();
             AggFnCall::initialize_all(_agg_fn_calls, *agg_row);
             // 可能会rehash
             _hash_map.insert(key.data(), *agg_row);
@@ -19,6 +19,8 @@ namespace baikaldb {
 
 DEFINE_bool(disable_writebatch_index, false,
     "disable the indexing of transaction writebatch, if true the uncommitted data cannot be read");
+DEFINE_int32(reverse_segment_batch_size, 128, 
+    "batch size of fulltext segment in batch insert, should be less than seg cache size");
 
 int DMLNode::expr_optimize(std::vector<pb::TupleDescriptor>* tuple_descs) {
     int ret = 0;
@@ -102,6 +104,36 @@ int DMLNode::init_schema_info(RuntimeState* state) {
     return 0;
 }
 
+void DMLNode::presegment_reverse(RuntimeState* state, const std::vector<SmartRecord>& records,
+        size_t begin, size_t end) {
+    auto& reverse_index_map = state->reverse_index_map();
+    if (reverse_index_map.empty() || end - begin <= 1) {
+        return;
+    }
+    for (auto& index_id : _affected_index_ids) {
+        if (reverse_index_map.count(index_id) == 0) {
+            continue;
+        }
+        auto info_ptr = SchemaFactory::get_instance()->get_index_info_ptr(index_id);
+        if (info_ptr == nullptr || info_ptr->fields.size() != 1) {
+            continue;
+        }
+        std::vector<std::string> words;
+        words.reserve(end - begin);
+        for (size_t i = begin; i < end; ++i) {
+            auto field = records[i]->get_field_by_tag(info_ptr->fields[0].id);
+            if (records[i]->is_null(field)) {
+                continue;
+            }
+            std::string word;
+            if (records[i]->get_reverse_word(*info_ptr, word) == 0) {
+                words.push_back(word);
+            }
+        }
+        reverse_index_map[index_id]->presegment(words);
+    }
+}
+
 int DMLNode::insert_row(RuntimeState* state, SmartRecord record, bool is_update) {
     //DB_WARNING_STATE(state, "insert record: %s", record->debug_string().c_str());
     int ret = 0;
@@ -154,6 +154,25 @@ int ExecNode::open(RuntimeState* state) {
     return num_affected_rows;
 }
 
+int ExecNode::memory_consume(RuntimeState* state, int64_t bytes) {
+    _used_bytes += bytes;
+    if (!state->memory_consume(bytes)) {
+        DB_WARNING_STATE(state, "query exceed memory quota, used:%ld, limit:%ld, node_type:%d",
+                state->memory_used(), state->memory_limit(), _node_type);
+        state->error_code = ER_QUERY_EXCEED_QUOTA;
+        state->error_msg.str("query exceed memory quota");
+        return -1;
+    }
+    return 0;
+}
+
+void ExecNode::memory_release(RuntimeState* state) {
+    if (_used_bytes != 0) {
+        state->memory_release(_used_bytes);
+        _used_bytes = 0;
+    }
+}
+
 void ExecNode::transfer_pb(int64_t region_id, pb::PlanNode* pb_node) {
     _pb_node.set_node_type(_node_type);
     _pb_node.set_limit(_limit);
@@ -15,9 +15,11 @@
 #include "insert_node.h"
 #include "runtime_state.h"
 #include <unordered_set>
+#include <algorithm>
 
 namespace baikaldb {
 DECLARE_bool(disable_writebatch_index);
+DECLARE_int32(reverse_segment_batch_size);
 int InsertNode::init(const pb::PlanNode& node) {
     int ret = 0;
     ret = ExecNode::init(node);
@@ -107,13 +109,19 @@ int InsertNode::open(RuntimeState* state) {
         pair.second->sync(ams[i]);
         i++;
     }
-    for (auto& record : _records) {
-        ret = insert_row(state, record);
-        if (ret < 0) {
-            DB_WARNING_STATE(state, "insert_row fail");
-            return -1;
+    // 分批切词, 每批不超过切词缓存大小, 保证insert_row时仍能命中
+    size_t batch_size = std::max(FLAGS_reverse_segment_batch_size, 1);
+    for (size_t begin = 0; begin < _records.size(); begin += batch_size) {
+        size_t end = std::min(begin + batch_size, _records.size());
+        presegment_reverse(state, _records, begin, end);
+        for (size_t j = begin; j < end; ++j) {
+            ret = insert_row(state, _records[j]);
+            if (ret < 0) {
+                DB_WARNING_STATE(state, "insert_row fail");
+                return -1;
+            }
+            num_affected_rows += ret;
         }
-        num_affected_rows += ret;
     }
     // auto_rollback.release();
     // txn->commit();
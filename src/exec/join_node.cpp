@@ -502,9 +502,14 @@ int JoinNode::_fetcher_join_table(RuntimeState* state, ExecNode* child_node,
             DB_WARNING("children:get_next fail:%d", ret);
             return ret;
         }
+        int64_t batch_bytes = batch.used_size();
         for (batch.reset(); !batch.is_traverse_over(); batch.next()) {
             tuple_data.push_back(batch.get_row().release());
         }
+        // 行已转入tuple_data, 超出配额时由close释放
+        if (memory_consume(state, batch_bytes) < 0) {
+            return -1;
+        }
     } while (!eos);
     return 0;
 }
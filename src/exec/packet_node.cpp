@@ -118,7 +118,7 @@ int PacketNode::open(RuntimeState* state) {
     }
     state->set_num_affected_rows(ret);
     if (op_type() != pb::OP_SELECT) {
-        pack_ok(state->num_affected_rows(), _client);
+        pack_ok(state, _client);
         return 0;
     }
     for (auto expr : _projections) {
@@ -214,12 +214,39 @@ void PacketNode::close(RuntimeState* state) {
     }
 }
 
-int PacketNode::pack_ok(int num_affected_rows, NetworkSocket* client) {
+int PacketNode::pack_ok(RuntimeState* state, NetworkSocket* client) {
     if (_send_buf->_size > 0) {
         _send_buf->byte_array_clear();
     }
+    int num_affected_rows = state->num_affected_rows();
     int64_t last_insert_id = (op_type() == pb::OP_INSERT)? client->last_insert_id : 0;
+    // 合并的多语句insert每条语句返回一个OK包, 除最后一个外都带SERVER_MORE_RESULTS_EXISTS
+    auto& stmt_rows = state->batched_stmt_rows;
+    if (op_type() == pb::OP_INSERT && stmt_rows.size() > 1) {
+        int total_rows = 0;
+        for (auto rows : stmt_rows) {
+            total_rows += rows;
+        }
+        if (total_rows == num_affected_rows) {
+            auto& insert_ids = state->batched_insert_ids;
+            for (size_t i = 0; i < stmt_rows.size(); ++i) {
+                int64_t insert_id = (insert_ids.size() == stmt_rows.size()) ?
+                        insert_ids[i] : last_insert_id;
+                if (pack_ok(stmt_rows[i], insert_id, i + 1 < stmt_rows.size(), client) != 0) {
+                    DB_WARNING("pack ok packet failed, stmt_idx: %lu", i);
+                    return -1;
+                }
+            }
+            return 0;
+        }
+        DB_WARNING("batched insert affected rows: %d not equal to rows: %d",
+                num_affected_rows, total_rows);
+    }
+    return pack_ok(num_affected_rows, last_insert_id, false, client);
+}
 
+int PacketNode::pack_ok(int num_affected_rows, int64_t last_insert_id, bool more_results,
+        NetworkSocket* client) {
     DataBuffer tmp_buf;
     tmp_buf.byte_array_append_length_coded_binary(0);
     tmp_buf.byte_array_append_length_coded_binary(num_affected_rows);
@@ -233,6 +260,9 @@ int PacketNode::pack_ok(int num_affected_rows, NetworkSocket* client) {
     if (client->autocommit) {
         status_flag |= 0x0002;
     }
+    if (more_results) {
+        status_flag |= MYSQL_SERVER_MORE_RESULTS_EXISTS;
+    }
     uint8_t bytes[2];
     bytes[0] = (status_flag & 0xff);
     bytes[1] = (status_flag >> 8) & 0xff;
@@ -242,7 +272,11 @@ int PacketNode::pack_ok(int num_affected_rows, NetworkSocket* client) {
     bytes[1] = (0 >> 8) & 0xff;
     tmp_buf.byte_array_append_len(bytes, 2);
 
-    return _send_buf->network_queue_send_append(tmp_buf._data, tmp_buf._size, ++client->packet_id, 0);
+    if (!_send_buf->network_queue_send_append(tmp_buf._data, tmp_buf._size, ++client->packet_id, 0)) {
+        DB_FATAL("network_queue_send_append failed.");
+        return -1;
+    }
+    return 0;
 }
 
 int PacketNode::pack_err() {
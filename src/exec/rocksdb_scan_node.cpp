@@ -164,6 +164,7 @@ int RocksdbScanNode::choose_index(RuntimeState* state) {
         return 0;
     }
     _index_ids.push_back(_index_id);
+    _reverse_topk = pos_index.reverse_topk();
     if (pos_index.ranges_size() == 0) {
         return 0;
     }
@@ -453,7 +454,7 @@ int RocksdbScanNode::open(RuntimeState* state) {
         // seek性能太差了，倒排索引都不做seek
         bool dont_seek = true;
         ret = _reverse_index->search(txn->get_txn(), *_pri_info, *_table_info, 
-                word, _index_conjuncts, dont_seek);
+                word, _index_conjuncts, dont_seek, _reverse_topk);
         if (ret < 0) {
             return ret;
         }
@@ -167,6 +167,9 @@ int SortNode::open(RuntimeState* state) {
         }
         count += batch->size();
         fill_tuple(batch.get());
+        if (memory_consume(state, batch->used_size()) < 0) {
+            return -1;
+        }
         _sorter->add_batch(batch);
     } while (!eos);
     //DB_WARNING_STATE(state, "sort_size:%d", count);
@@ -19,7 +19,10 @@
 
 namespace baikaldb {
 DECLARE_int32(retry_interval_us);
+DECLARE_bool(fetch_instance_id);
 DEFINE_int32(wait_after_prepare_us, 0, "wait time after prepare(us)");
+DEFINE_bool(async_commit, false, "ack explicit multi-region commit after all prepares and "
+        "commit log are durable, commit in background. need fetch_instance_id for recovery");
 
 int TransactionManagerNode::add_commit_log_entry(
         uint64_t txn_id,
@@ -35,6 +38,10 @@ int TransactionManagerNode::add_commit_log_entry(
     for (auto& pair : region_infos) {
         commit_plan.add_regions()->CopyFrom(pair.second);
     }
+    return add_commit_log_entry(txn_id, commit_plan);
+}
+
+int TransactionManagerNode::add_commit_log_entry(uint64_t txn_id, const pb::CachePlan& commit_plan) {
     auto meta_db = RocksWrapper::get_instance();
     MutTableKey txn_key;
     txn_key.append_u8(NetworkServer::transaction_prefix);
@@ -76,13 +83,33 @@ int TransactionManagerNode::remove_commit_log_entry(uint64_t txn_id) {
     return 0;
 }
 
+int TransactionManagerNode::exec_commit_plan(uint64_t txn_id, const pb::CachePlan& commit_plan) {
+    SmartSocket dummy_client = SmartSocket(new (std::nothrow)NetworkSocket);
+    dummy_client->txn_id = txn_id;
+    dummy_client->seq_id = commit_plan.seq_id();
+    for (auto& region_info : commit_plan.regions()) {
+        dummy_client->region_infos[region_info.region_id()] = region_info;
+    }
+    RuntimeState state;
+    state.set_client_conn(dummy_client.get());
+    state.txn_id = txn_id;
+    ExecNode* commit_root = nullptr;
+    ExecNode::create_tree(commit_plan.plan(), &commit_root);
+    TransactionManagerNode commit_manager_node;
+    commit_manager_node.set_op_type(pb::OP_COMMIT);
+    int ret = commit_manager_node.exec_commit_node(&state, commit_root);
+    delete commit_root;
+    return ret;
+}
+
 int TransactionManagerNode::exec_begin_node(RuntimeState* state, ExecNode* begin_node) {
     return push_cmd_to_cache(state, pb::OP_BEGIN, begin_node);
 }
 int TransactionManagerNode::exec_prepared_node(RuntimeState* state, ExecNode* prepared_node, int64_t start_seq_id) {
     uint64_t log_id = state->log_id();
     auto client_conn = state->client_conn();
-    if (client_conn->region_infos.size() <= 1) {
+    // 只涉及一个region或者没有写的事务, prepare时直接提交
+    if (client_conn->region_infos.size() <= 1 || !client_conn->transaction_has_write()) {
         state->set_optimize_1pc(true);
         DB_WARNING("enable optimize_1pc: txn_id: %lu, seq_id: %d, log_id: %lu", 
                 state->txn_id, client_conn->seq_id, log_id);
@@ -135,6 +162,41 @@ int TransactionManagerNode::exec_commit_node(RuntimeState* state, ExecNode* comm
      }
     return ret;
 }
+int TransactionManagerNode::exec_async_commit_node(RuntimeState* state, ExecNode* commit_node) {
+    auto client_conn = state->client_conn();
+    if (client_conn == nullptr) {
+        DB_WARNING("connection is nullptr: %lu", state->txn_id);
+        return -1;
+    }
+    // 重启后只有instance_id变化才会恢复上一个实例遗留的commit日志
+    if (!FLAGS_async_commit || !FLAGS_fetch_instance_id) {
+        return exec_commit_node(state, commit_node);
+    }
+    pb::CachePlan commit_plan;
+    commit_plan.set_op_type(pb::OP_COMMIT);
+    commit_plan.set_seq_id(client_conn->seq_id);
+    ExecNode::create_pb_plan(0, commit_plan.mutable_plan(), commit_node);
+    for (auto& pair : client_conn->region_infos) {
+        commit_plan.add_regions()->CopyFrom(pair.second);
+    }
+    if (0 != add_commit_log_entry(state->txn_id, commit_plan)) {
+        DB_WARNING("TransactionError: add_commit_log_entry failed: %lu log_id:%lu ", state->txn_id, state->log_id());
+        return -1;
+    }
+    // 所有region已prepare且commit日志已落盘, 事务结果已确定, 后台提交直到成功
+    // baikaldb在提交完成前退出时, 由recovery_transactions继续提交
+    uint64_t txn_id = state->txn_id;
+    Bthread bth(&BTHREAD_ATTR_SMALL);
+    bth.run([txn_id, commit_plan]() {
+        int ret = exec_commit_plan(txn_id, commit_plan);
+        if (ret < 0) {
+            DB_FATAL("TransactionError: async commit failed, txn_id: %lu", txn_id);
+        }
+    });
+    DB_DEBUG("TransactionNote: async commit, txn_id: %lu log_id:%lu", txn_id, state->log_id());
+    return 0;
+}
+
 int TransactionManagerNode::exec_rollback_node(RuntimeState* state, ExecNode* rollback_node) {
     //DB_WARNING("rollback for single-sql trnsaction with optimize_1pc");
     auto client_conn = state->client_conn();
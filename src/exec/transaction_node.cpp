@@ -69,11 +69,14 @@ int TransactionNode::open(RuntimeState* state) {
         return ret;
     } else if (_txn_cmd == pb::TXN_BEGIN_STORE) {
         SmartTransaction txn;
-        int ret = txn_pool->begin_txn(state->txn_id, txn);
+        int ret = txn_pool->begin_txn(state->txn_id, txn, state->deadlock_detect);
         if (ret != 0) {
             DB_WARNING_STATE(state, "create txn failed: %lu:%d", state->txn_id, state->seq_id);
             return -1;
         }
+        if (state->ttl_timestamp_us > 0) {
+            txn->set_ttl_timestamp_us(state->ttl_timestamp_us);
+        }
         state->set_txn(txn);
         return 0;
     } else if (_txn_cmd == pb::TXN_COMMIT_STORE) {
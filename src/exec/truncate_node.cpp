@@ -14,6 +14,7 @@
 
 #include "runtime_state.h"
 #include "truncate_node.h"
+#include "key_layout.h"
 
 namespace baikaldb {
 int TruncateNode::init(const pb::PlanNode& node) { 
@@ -46,16 +47,15 @@ int TruncateNode::open(RuntimeState* state) {
     }
     _region_id = state->region_id();
 
-    MutTableKey region_start;
-    MutTableKey region_end;
-    region_start.append_i64(_region_id);
-    region_end.append_i64(_region_id).append_u64(0xFFFFFFFFFFFFFFFF);
+    std::string region_start;
+    std::string region_end;
+    region_data_range(state->resource()->region_info, &region_start, &region_end);
 
     rocksdb::WriteOptions write_options;
     //write_options.disableWAL = true;
 
-    rocksdb::Slice begin(region_start.data());
-    rocksdb::Slice end(region_end.data());
+    rocksdb::Slice begin(region_start);
+    rocksdb::Slice end(region_end);
     auto res = _db->remove_range(write_options, _data_cf, begin, end);
     if (!res.ok()) {
         DB_WARNING_STATE(state, "truncate table failed: table:%ld, region:%ld, code=%d, msg=%s", 
@@ -91,7 +91,8 @@ int UpdateNode::open(RuntimeState* state) {
         }
     }
     // 如果更新主键，那么影响了全部索引
-    if (!_affect_primary) {
+    // ttl表更新时重写全部索引, 索引的过期时间与主键保持一致
+    if (!_affect_primary && !_table_info->use_ttl_value()) {
         _affected_index_ids.swap(affected_indices);
         // cstore下只更新涉及列
         if (_table_info->engine == pb::ROCKSDB_CSTORE) {
@@ -0,0 +1,232 @@
+// Copyright (c) 2018-present Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "like_matcher.h"
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace baikaldb {
+
+static inline char ascii_lower(char c) {
+    return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+static inline char ascii_upper(char c) {
+    return (c >= 'a' && c <= 'z') ? c - ('a' - 'A') : c;
+}
+
+static inline bool equal_bytes(const char* str, const char* literal, size_t len, bool icase) {
+    if (!icase) {
+        return memcmp(str, literal, len) == 0;
+    }
+    for (size_t i = 0; i < len; ++i) {
+        if (ascii_lower(str[i]) != literal[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+const char* like_find(const char* haystack, size_t haystack_len,
+        const char* needle, size_t needle_len, bool icase) {
+    if (needle_len == 0) {
+        return haystack;
+    }
+    if (needle_len > haystack_len) {
+        return nullptr;
+    }
+    size_t i = 0;
+#ifdef __SSE2__
+    // 同时比较首尾字节, 过滤掉绝大部分候选位置后再逐个校验
+    const __m128i first_lower = _mm_set1_epi8(needle[0]);
+    const __m128i first_upper = _mm_set1_epi8(icase ? ascii_upper(needle[0]) : needle[0]);
+    const __m128i last_lower = _mm_set1_epi8(needle[needle_len - 1]);
+    const __m128i last_upper = _mm_set1_epi8(
+            icase ? ascii_upper(needle[needle_len - 1]) : needle[needle_len - 1]);
+    for (; i + 16 + needle_len - 1 <= haystack_len; i += 16) {
+        const __m128i block_first = _mm_loadu_si128((const __m128i*)(haystack + i));
+        const __m128i block_last = _mm_loadu_si128(
+                (const __m128i*)(haystack + i + needle_len - 1));
+        const __m128i eq_first = _mm_or_si128(_mm_cmpeq_epi8(block_first, first_lower),
+                _mm_cmpeq_epi8(block_first, first_upper));
+        const __m128i eq_last = _mm_or_si128(_mm_cmpeq_epi8(block_last, last_lower),
+                _mm_cmpeq_epi8(block_last, last_upper));
+        uint32_t mask = _mm_movemask_epi8(_mm_and_si128(eq_first, eq_last));
+        while (mask != 0) {
+            size_t pos = i + __builtin_ctz(mask);
+            if (needle_len <= 2 || equal_bytes(haystack + pos + 1, needle + 1, needle_len - 2, icase)) {
+                return haystack + pos;
+            }
+            mask &= mask - 1;
+        }
+    }
+#else
+    if (!icase) {
+        return (const char*)memmem(haystack, haystack_len, needle, needle_len);
+    }
+#endif
+    for (; i + needle_len <= haystack_len; ++i) {
+        if (equal_bytes(haystack + i, needle, needle_len, icase)) {
+            return haystack + i;
+        }
+    }
+    return nullptr;
+}
+
+void LikeMatcher::compile(const std::string& pattern, char escape_char, bool exact_like) {
+    _alternatives.clear();
+    _icase = exact_like;
+    std::vector<std::string> patterns(1);
+    std::vector<std::vector<bool>> wildcards(1);
+    bool is_escaped = false;
+    for (size_t i = 0; i < pattern.size(); ++i) {
+        char c = pattern[i];
+        if (!is_escaped && c == escape_char) {
+            is_escaped = true;
+            continue;
+        }
+        if (!is_escaped && exact_like && c == '|') {
+            patterns.emplace_back();
+            wildcards.emplace_back();
+            continue;
+        }
+        bool wildcard = !is_escaped && (c == '%' || c == '_');
+        patterns.back().append(1, _icase && !wildcard ? ascii_lower(c) : c);
+        wildcards.back().push_back(wildcard);
+        is_escaped = false;
+    }
+    // 与原regex转换一致: 'a|b' => 'a.*|.*b'
+    for (size_t i = 0; i < patterns.size(); ++i) {
+        if (i != 0) {
+            patterns[i].insert(0, 1, '%');
+            wildcards[i].insert(wildcards[i].begin(), true);
+        }
+        if (i != patterns.size() - 1) {
+            patterns[i].append(1, '%');
+            wildcards[i].push_back(true);
+        }
+        add_alternative(patterns[i], wildcards[i]);
+    }
+}
+
+void LikeMatcher::add_alternative(const std::string& pattern, const std::vector<bool>& is_wildcard) {
+    Alternative alt;
+    // 连续的'%'等价于一个
+    bool has_underscore = false;
+    std::vector<size_t> percent_pos;
+    for (size_t i = 0; i < pattern.size(); ++i) {
+        bool is_percent = is_wildcard[i] && pattern[i] == '%';
+        if (is_percent && !alt.pattern.empty() && alt.is_wildcard.back()
+                && alt.pattern.back() == '%') {
+            continue;
+        }
+        if (is_percent) {
+            percent_pos.push_back(alt.pattern.size());
+        } else if (is_wildcard[i]) {
+            has_underscore = true;
+        } else {
+            alt.literal.append(1, pattern[i]);
+        }
+        alt.pattern.append(1, pattern[i]);
+        alt.is_wildcard.push_back(is_wildcard[i]);
+    }
+    size_t size = alt.pattern.size();
+    bool leading = !percent_pos.empty() && percent_pos.front() == 0;
+    bool trailing = !percent_pos.empty() && percent_pos.back() == size - 1;
+    if (has_underscore || percent_pos.size() > 2) {
+        alt.type = LIKE_GENERAL;
+    } else if (percent_pos.empty()) {
+        alt.type = LIKE_EXACT;
+    } else if (size == 1 || (percent_pos.size() == 2 && leading && trailing)) {
+        alt.type = LIKE_CONTAINS;
+    } else if (percent_pos.size() == 1 && trailing) {
+        alt.type = LIKE_PREFIX;
+    } else if (percent_pos.size() == 1 && leading) {
+        alt.type = LIKE_SUFFIX;
+    } else {
+        alt.type = LIKE_GENERAL;
+    }
+    if (alt.type != LIKE_GENERAL) {
+        alt.pattern.clear();
+        alt.is_wildcard.clear();
+    } else {
+        alt.literal.clear();
+    }
+    _alternatives.push_back(alt);
+}
+
+bool LikeMatcher::equal(const char* str, const char* literal, size_t len) const {
+    return equal_bytes(str, literal, len, _icase);
+}
+
+bool LikeMatcher::match(const char* str, size_t len) const {
+    for (auto& alt : _alternatives) {
+        if (match_alternative(alt, str, len)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool LikeMatcher::match_alternative(const Alternative& alt, const char* str, size_t len) const {
+    const std::string& literal = alt.literal;
+    switch (alt.type) {
+        case LIKE_EXACT:
+            return len == literal.size() && equal(str, literal.data(), len);
+        case LIKE_PREFIX:
+            return len >= literal.size() && equal(str, literal.data(), literal.size());
+        case LIKE_SUFFIX:
+            return len >= literal.size()
+                && equal(str + len - literal.size(), literal.data(), literal.size());
+        case LIKE_CONTAINS:
+            return like_find(str, len, literal.data(), literal.size(), _icase) != nullptr;
+        default:
+            return match_general(alt, str, len);
+    }
+}
+
+// 通配符匹配: 遇到'%'记录回溯点, 失配时从最近的'%'后一位重新开始
+bool LikeMatcher::match_general(const Alternative& alt, const char* str, size_t len) const {
+    const std::string& pattern = alt.pattern;
+    const std::vector<bool>& is_wildcard = alt.is_wildcard;
+    size_t plen = pattern.size();
+    size_t s = 0;
+    size_t p = 0;
+    size_t star = std::string::npos;
+    size_t mark = 0;
+    while (s < len) {
+        if (p < plen && is_wildcard[p] && pattern[p] == '%') {
+            star = p++;
+            mark = s;
+        } else if (p < plen && (is_wildcard[p]
+                    || (_icase ? ascii_lower(str[s]) : str[s]) == pattern[p])) {
+            ++s;
+            ++p;
+        } else if (star != std::string::npos) {
+            p = star + 1;
+            s = ++mark;
+        } else {
+            return false;
+        }
+    }
+    while (p < plen && is_wildcard[p] && pattern[p] == '%') {
+        ++p;
+    }
+    return p == plen;
+}
+}
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 */
@@ -196,19 +196,7 @@ int LikePredicate::open() {
         return -1;
     }
     std::string like_pattern = children(1)->get_value(nullptr).get_string();
-    try {
-        if (_fn.fn_op() == parser::FT_EXACT_LIKE) {
-            covent_exact_pattern(like_pattern);
-            _regex.assign(_regex_pattern, boost::regex::icase);
-        } else {
-            covent_pattern(like_pattern);
-            _regex.assign(_regex_pattern);
-        }
-    } catch (boost::regex_error& e) {
-        DB_FATAL("regex error:%d|%s, like_pattern:%s, _regex_pattern:%ss", 
-                e.code(), e.what(), like_pattern.c_str(), _regex_pattern.c_str());
-        return -1;
-    }
+    _matcher.compile(like_pattern, _escape_char, _fn.fn_op() == parser::FT_EXACT_LIKE);
     return 0;
 }
 
@@ -294,21 +282,7 @@ ExprValue LikePredicate::get_value(MemRow* row) {
     ExprValue value = children(0)->get_value(row);
     value.cast_to(pb::STRING);
     ExprValue ret(pb::BOOL);
-    try {
-        ret._u.bool_val = boost::regex_match(value.str_val, _regex);
-    } catch (boost::regex_error& e) {
-        DB_FATAL("regex error:%d|%s, _regex_pattern:%ss", 
-                e.code(), e.what(), _regex_pattern.c_str());
-        ret._u.bool_val = false;
-    } catch (std::exception& e) {
-        DB_FATAL("regex error:%s, _regex_pattern:%ss", 
-                e.what(), _regex_pattern.c_str());
-        ret._u.bool_val = false;
-    } catch (...) {
-        DB_FATAL("regex unknown error: _regex_pattern:%ss", 
-                 _regex_pattern.c_str());
-        ret._u.bool_val = false;
-    }
+    ret._u.bool_val = _matcher.match(value.str_val);
     return ret;
 }
 
@@ -287,6 +287,12 @@ int DDLPlanner::parse_create_table(pb::SchemaInfo& table) {
                     table.set_region_split_lines(region_split_lines);
                     DB_WARNING("region_split_lines: %ld", region_split_lines);
                 }
+                json_iter = root.FindMember("ttl_duration");
+                if (json_iter != root.MemberEnd()) {
+                    int64_t ttl_duration = json_iter->value.GetInt64();
+                    table.set_ttl_duration(ttl_duration);
+                    DB_WARNING("ttl_duration: %ld", ttl_duration);
+                }
                 json_iter = root.FindMember("storage_compute_separate");
                 if (json_iter != root.MemberEnd()) {
                     int64_t separate = json_iter->value.GetInt64();
@@ -30,6 +30,7 @@
 #include "predicate.h"
 #include "network_socket.h"
 #include "parser.h"
+#include "result_cache.h"
 
 namespace bthread {
 DECLARE_int32(bthread_concurrency); //bthread.cpp
@@ -37,6 +38,7 @@ DECLARE_int32(bthread_concurrency); //bthread.cpp
 
 namespace baikaldb {
 DECLARE_string(log_plat_name);
+DEFINE_bool(batch_multi_insert, false, "merge consecutive INSERTs of one multi-stmt query into one insert plan");
 
 std::atomic<uint64_t> LogicalPlanner::_txn_id_counter(1);
 
@@ -132,6 +134,69 @@ int LogicalPlanner::create_in_predicate(const parser::FuncExpr* func_item,
     return 0;
 }
 
+static bool same_str(const parser::String& left, const parser::String& right) {
+    if (left.empty() || right.empty()) {
+        return left.empty() && right.empty();
+    }
+    return strcasecmp(left.c_str(), right.c_str()) == 0;
+}
+
+// INSERT INTO t(a,b) VALUES (1,2); INSERT INTO t(a,b) VALUES (3,4);
+// ==> INSERT INTO t(a,b) VALUES (1,2),(3,4);
+// so that the whole packet goes through one InsertManagerNode,
+// one store request and one raft proposal per region.
+// Only plain inserts (no IGNORE/REPLACE/ON DUPLICATE KEY UPDATE) with the same
+// table and columns are merged: each row then affects exactly one row, so every
+// statement still gets its own OK packet with its row count (see PacketNode::pack_ok).
+// The merged packet succeeds or fails as a whole; on failure the client gets
+// one ERR packet and none of the statements is applied.
+// stmt_rows returns the row count of each merged statement.
+static int merge_multi_insert(parser::SqlParser& parser, std::vector<int>& stmt_rows) {
+    if (parser.result.size() < 2) {
+        return -1;
+    }
+    for (auto stmt : parser.result) {
+        if (stmt == nullptr || stmt->node_type != parser::NT_INSERT) {
+            return -1;
+        }
+    }
+    parser::InsertStmt* first = static_cast<parser::InsertStmt*>(parser.result[0]);
+    if (first->table_name == nullptr || first->on_duplicate.size() != 0
+            || first->is_replace || first->is_ignore) {
+        return -1;
+    }
+    for (size_t idx = 1; idx < parser.result.size(); ++idx) {
+        parser::InsertStmt* next = static_cast<parser::InsertStmt*>(parser.result[idx]);
+        if (next->table_name == nullptr
+                || next->is_replace
+                || next->is_ignore
+                || next->priority != first->priority
+                || next->on_duplicate.size() != 0
+                || !same_str(next->table_name->db, first->table_name->db)
+                || !same_str(next->table_name->table, first->table_name->table)
+                || next->columns.size() != first->columns.size()) {
+            return -1;
+        }
+        for (int col_idx = 0; col_idx < first->columns.size(); ++col_idx) {
+            if (!same_str(next->columns[col_idx]->name, first->columns[col_idx]->name)) {
+                return -1;
+            }
+        }
+    }
+    int batch_size = parser.result.size();
+    stmt_rows.clear();
+    stmt_rows.push_back(first->lists.size());
+    for (int idx = 1; idx < batch_size; ++idx) {
+        parser::InsertStmt* next = static_cast<parser::InsertStmt*>(parser.result[idx]);
+        for (int row_idx = 0; row_idx < next->lists.size(); ++row_idx) {
+            first->lists.push_back(next->lists[row_idx], parser.arena);
+        }
+        stmt_rows.push_back(next->lists.size());
+    }
+    parser.result.resize(1);
+    return batch_size;
+}
+
 // TODO move to a caller
 // static, planner entrance 
 int LogicalPlanner::analyze(QueryContext* ctx) {
@@ -171,6 +236,12 @@ int LogicalPlanner::analyze(QueryContext* ctx) {
             ctx->sql.c_str());
         return -1;
     }
+    // 客户端声明了CLIENT_MULTI_STATEMENTS才能按语句返回多个结果
+    auto client = ctx->runtime_state.client_conn();
+    if (parser.result.size() > 1 && FLAGS_batch_multi_insert && client != nullptr
+            && (client->client_capability & MYSQL_CLIENT_MULTI_STATEMENTS)) {
+        merge_multi_insert(parser, ctx->batched_stmt_rows);
+    }
     if (parser.result.size() != 1) {
         DB_WARNING("multi-stmt is not supported, sql: %s", ctx->sql.c_str());
         return -1;
@@ -244,6 +315,9 @@ int LogicalPlanner::analyze(QueryContext* ctx) {
         stat_info->sample_sql << "family=[" << stat_info->family << "] table=["
             << stat_info->table <<"] op_type=[" << op_type << "] plat=[" 
             << FLAGS_log_plat_name << "] sql=[" << ctx->stmt << "]";
+        if (ctx->batched_stmt_rows.size() > 1) {
+            stat_info->sample_sql << " batched_stmt_count=[" << ctx->batched_stmt_rows.size() << "]";
+        }
     }
     return 0;
 }
@@ -897,6 +971,9 @@ int LogicalPlanner::create_scala_func_expr(const parser::FuncExpr* item,
     }
     func->set_name(item->fn_name.to_lower());
     func->set_fn_op(op);
+    if (ResultCache::is_nondeterministic_fn(func->name(), item->children.size())) {
+        _ctx->has_nondeterministic_fn = true;
+    }
 
     // between => (>= && <=)
     if (item->func_type == parser::FT_BETWEEN && item->children.size() == 3) {
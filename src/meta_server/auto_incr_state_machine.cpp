@@ -54,6 +54,7 @@ void AutoIncrStateMachine::on_apply(braft::Iterator& iter) {
         if (done && ((MetaServerClosure*)done)->response) {
             ((MetaServerClosure*)done)->response->set_op_type(request.op_type());
         }
+        _apply_index = iter.index();
         DB_NOTICE("on applye, term:%ld, index:%ld, request op_type:%s", 
                     iter.term(), iter.index(), 
                     pb::OpType_Name(request.op_type()).c_str());
@@ -114,6 +115,10 @@ void AutoIncrStateMachine::drop_table_id(const pb::MetaManagerRequest& request,
         return;
     }
     _auto_increment_map.erase(table_id);
+    {
+        std::lock_guard<std::mutex> lock(_epoch_mutex);
+        _lease_epoch_map.erase(table_id);
+    }
     if (done && ((MetaServerClosure*)done)->response) { 
         ((MetaServerClosure*)done)->response->set_errcode(pb::SUCCESS);
         ((MetaServerClosure*)done)->response->set_op_type(request.op_type());
@@ -135,12 +140,17 @@ void AutoIncrStateMachine::gen_id(const pb::MetaManagerRequest& request,
     if (increment_info.has_start_id() && old_start_id < increment_info.start_id() + 1) { 
         old_start_id = increment_info.start_id() + 1; 
     }    
+    // 显式插入的id可能落在db节点已租用未分配的段内
+    if (increment_info.start_id() > 0) {
+        bump_lease_epoch(table_id);
+    }
     _auto_increment_map[table_id] = old_start_id + increment_info.count();
     if (done && ((MetaServerClosure*)done)->response) {
         ((MetaServerClosure*)done)->response->set_errcode(pb::SUCCESS);
         ((MetaServerClosure*)done)->response->set_op_type(request.op_type());
         ((MetaServerClosure*)done)->response->set_start_id(old_start_id);
         ((MetaServerClosure*)done)->response->set_end_id(_auto_increment_map[table_id]);
+        ((MetaServerClosure*)done)->response->set_auto_incr_epoch(get_lease_epoch(table_id));
         ((MetaServerClosure*)done)->response->set_errmsg("SUCCESS");
     }
     DB_NOTICE("gen_id for auto_increment success, request:%s", 
@@ -181,23 +191,52 @@ void AutoIncrStateMachine::update(const pb::MetaManagerRequest& request,
     } else {
         _auto_increment_map[table_id] += increment_info.increment_id();
     }
+    bump_lease_epoch(table_id);
     if (done && ((MetaServerClosure*)done)->response) {
         ((MetaServerClosure*)done)->response->set_errcode(pb::SUCCESS);
         ((MetaServerClosure*)done)->response->set_op_type(request.op_type());
         ((MetaServerClosure*)done)->response->set_start_id(_auto_increment_map[table_id]);
+        ((MetaServerClosure*)done)->response->set_auto_incr_epoch(get_lease_epoch(table_id));
         ((MetaServerClosure*)done)->response->set_errmsg("SUCCESS");
     }
     DB_NOTICE("update start_id for auto_increment success, request:%s", 
                 request.ShortDebugString().c_str());
 }
 
+void AutoIncrStateMachine::bump_lease_epoch(int64_t table_id) {
+    std::lock_guard<std::mutex> lock(_epoch_mutex);
+    _lease_epoch_map[table_id] = _apply_index;
+    DB_NOTICE("bump auto increment lease epoch, table_id:%ld, epoch:%ld", table_id, _apply_index);
+}
+
+uint64_t AutoIncrStateMachine::get_lease_epoch(int64_t table_id) {
+    std::lock_guard<std::mutex> lock(_epoch_mutex);
+    auto iter = _lease_epoch_map.find(table_id);
+    if (iter == _lease_epoch_map.end()) {
+        return 0;
+    }
+    return iter->second;
+}
+
+void AutoIncrStateMachine::process_baikal_heartbeat(pb::BaikalHeartBeatResponse* response) {
+    std::lock_guard<std::mutex> lock(_epoch_mutex);
+    for (auto& epoch_pair : _lease_epoch_map) {
+        auto epoch = response->add_auto_incr_epochs();
+        epoch->set_table_id(epoch_pair.first);
+        epoch->set_epoch(epoch_pair.second);
+    }
+}
+
 void AutoIncrStateMachine::on_snapshot_save(braft::SnapshotWriter* writer, braft::Closure* done) {
     DB_WARNING("start on shnapshot save");
     std::string max_id_string;
     save_auto_increment(max_id_string);
+    std::string epoch_string;
+    save_lease_epoch(epoch_string);
     Bthread bth(&BTHREAD_ATTR_SMALL);
-    std::function<void()> save_snapshot_function = [this, done, writer, max_id_string]() {
-            save_snapshot(done, writer, max_id_string);
+    std::function<void()> save_snapshot_function = 
+        [this, done, writer, max_id_string, epoch_string]() {
+            save_snapshot(done, writer, max_id_string, epoch_string);
         };
     bth.run(save_snapshot_function);
 }
@@ -206,6 +245,11 @@ int AutoIncrStateMachine::on_snapshot_load(braft::SnapshotReader* reader) {
     DB_WARNING("start on shnapshot load");
     std::vector<std::string> files;
     reader->list_files(&files);
+    {
+        // 旧版本的snapshot没有epoch文件
+        std::lock_guard<std::mutex> lock(_epoch_mutex);
+        _lease_epoch_map.clear();
+    }
     for (auto& file : files) {
         DB_WARNING("snapshot load file:%s", file.c_str());
         if (file == "/max_id.json") {
@@ -215,16 +259,23 @@ int AutoIncrStateMachine::on_snapshot_load(braft::SnapshotReader* reader) {
                 return -1;
             }
         }
+        if (file == "/lease_epoch.json") {
+            if (load_lease_epoch(reader->get_path() + "/lease_epoch.json") != 0) {
+                DB_WARNING("load auto increment lease epoch fail");
+                return -1;
+            }
+        }
     }
     _have_data = true;
     return 0;
 }
 
-void AutoIncrStateMachine::save_auto_increment(std::string& max_id_string) {
+static void id_map_to_json(const std::unordered_map<int64_t, uint64_t>& id_map,
+        std::string& json_string) {
     rapidjson::Document root;
     root.SetObject();
     rapidjson::Document::AllocatorType& alloc = root.GetAllocator();
-    for (auto& max_id_pair : _auto_increment_map) {
+    for (auto& max_id_pair : id_map) {
         std::string table_id_string = std::to_string(max_id_pair.first);
         rapidjson::Value table_id_val(rapidjson::kStringType);
         table_id_val.SetString(table_id_string.c_str(), table_id_string.size(), alloc);
@@ -237,13 +288,54 @@ void AutoIncrStateMachine::save_auto_increment(std::string& max_id_string) {
     rapidjson::StringBuffer buffer;
     rapidjson::Writer<rapidjson::StringBuffer> json_writer(buffer);
     root.Accept(json_writer);
-    max_id_string = buffer.GetString();
+    json_string = buffer.GetString();
+}
+
+static int json_to_id_map(const std::string& json_string,
+        std::unordered_map<int64_t, uint64_t>& id_map) {
+    rapidjson::Document root;
+    try {
+        root.Parse<0>(json_string.c_str());
+        if (root.HasParseError()) {
+            rapidjson::ParseErrorCode code = root.GetParseError();
+            DB_WARNING("parse extra file error [code:%d][%s]", code, json_string.c_str());
+            return -1;
+         }    
+    } catch (...) {
+        DB_WARNING("parse extra file error [%s]", json_string.c_str());
+        return -1;
+    } 
+    for (auto json_iter = root.MemberBegin(); json_iter != root.MemberEnd(); ++json_iter) {
+        int64_t table_id = boost::lexical_cast<int64_t>(json_iter->name.GetString());
+        uint64_t id = json_iter->value.GetUint64();
+        DB_WARNING("load auto increment, table_id:%ld, id:%lu", table_id, id);
+        id_map[table_id] = id;  
+    }    
+    return 0;
+}
+
+void AutoIncrStateMachine::save_auto_increment(std::string& max_id_string) {
+    id_map_to_json(_auto_increment_map, max_id_string);
     DB_WARNING("max id string:%s when snapshot", max_id_string.c_str());
 }
 
+void AutoIncrStateMachine::save_lease_epoch(std::string& epoch_string) {
+    std::lock_guard<std::mutex> lock(_epoch_mutex);
+    id_map_to_json(_lease_epoch_map, epoch_string);
+}
+
+int AutoIncrStateMachine::load_lease_epoch(const std::string& epoch_file) {
+    std::ifstream extra_fs(epoch_file);
+    std::string extra((std::istreambuf_iterator<char>(extra_fs)),
+            std::istreambuf_iterator<char>());
+    std::lock_guard<std::mutex> lock(_epoch_mutex);
+    return json_to_id_map(extra, _lease_epoch_map);
+}
+
 void AutoIncrStateMachine::save_snapshot(braft::Closure* done,
                                     braft::SnapshotWriter* writer,
-                                    std::string max_id_string) {
+                                    std::string max_id_string,
+                                    std::string epoch_string) {
     brpc::ClosureGuard done_guard(done);
     std::string snapshot_path = writer->get_path();
     std::string max_id_path = snapshot_path + "/max_id.json";
@@ -256,6 +348,15 @@ void AutoIncrStateMachine::save_snapshot(braft::Closure* done,
         DB_WARNING("Error while adding file to writer");
         return;
     }
+    std::ofstream epoch_fs(snapshot_path + "/lease_epoch.json",
+            std::ofstream::out | std::ofstream::trunc);
+    epoch_fs.write(epoch_string.data(), epoch_string.size());
+    epoch_fs.close();
+    if (writer->add_file("/lease_epoch.json") != 0) {
+        done->status().set_error(EINVAL, "Fail to add file");
+        DB_WARNING("Error while adding file to writer");
+        return;
+    }
 }
 
 int AutoIncrStateMachine::load_auto_increment(const std::string& max_id_file) {
@@ -267,25 +368,7 @@ int AutoIncrStateMachine::load_auto_increment(const std::string& max_id_file) {
 }
 
 int AutoIncrStateMachine::parse_json_string(const std::string& json_string) {
-    rapidjson::Document root;
-    try {
-        root.Parse<0>(json_string.c_str());
-        if (root.HasParseError()) {
-            rapidjson::ParseErrorCode code = root.GetParseError();
-            DB_WARNING("parse extra file error [code:%d][%s]", code, json_string.c_str());
-            return -1;
-         }    
-    } catch (...) {
-        DB_WARNING("parse extra file error [%s]", json_string.c_str());
-        return -1;
-    } 
-    for (auto json_iter = root.MemberBegin(); json_iter != root.MemberEnd(); ++json_iter) {
-        int64_t table_id = boost::lexical_cast<int64_t>(json_iter->name.GetString());
-        uint64_t max_id = json_iter->value.GetUint64();
-        DB_WARNING("load auto increment, table_id:%ld, max_id:%lu", table_id, max_id);
-        _auto_increment_map[table_id] = max_id;  
-    }    
-    return 0;
+    return json_to_id_map(json_string, _auto_increment_map);
 }
 }//namespace
 /* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
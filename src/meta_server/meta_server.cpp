@@ -433,6 +433,9 @@ void MetaServer::baikal_heartbeat(google::protobuf::RpcController* controller,
         log_id = cntl->log_id();
     }
     RETURN_IF_NOT_INIT(_init_success, response, log_id);
+    if (_auto_incr_state_machine != nullptr) {
+        _auto_incr_state_machine->process_baikal_heartbeat(response);
+    }
     if (_meta_state_machine != nullptr) {
         _meta_state_machine->baikal_heartbeat(controller, request, response, done_guard.release());
     }
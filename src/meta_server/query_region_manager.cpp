@@ -217,14 +217,7 @@ void QueryRegionManager::get_region_info_per_instance(const std::string& instanc
                                                  pb::QueryResponse* response) {
     RegionManager* manager = RegionManager::get_instance();
     std::unordered_map<int64_t, std::set<int64_t>> table_region_map;
-    {
-        BAIDU_SCOPED_LOCK(manager->_instance_region_mutex);
-        auto iter = manager->_instance_region_map.find(instance); 
-        if (iter == manager->_instance_region_map.end()) {
-            return;
-        }
-        table_region_map = iter->second;
-    }
+    manager->get_table_region_ids(instance, table_region_map);
     for (auto& table_region_ids : table_region_map) {
         for (auto& region_id : table_region_ids.second) {
             SmartRegionInfo region_ptr = manager->_region_info_map.get(region_id);
@@ -240,36 +233,19 @@ void QueryRegionManager::get_region_count_per_instance(
             int64_t& region_count,
             int64_t& region_leader_count) {
     RegionManager* manager = RegionManager::get_instance();
-    {
-        BAIDU_SCOPED_LOCK(manager->_instance_region_mutex);
-        if (manager->_instance_region_map.find(instance) != manager->_instance_region_map.end()) {
-            for (auto& table_region_ids : manager->_instance_region_map[instance]) {
-                region_count += table_region_ids.second.size();
-            }
-        }
-    }
-    {
-        BAIDU_SCOPED_LOCK(manager->_count_mutex);
-        if (manager->_instance_leader_count.find(instance) != manager->_instance_leader_count.end()) {
-            for (auto& table_leader : manager->_instance_leader_count[instance]) {
-                region_leader_count += table_leader.second;
-            }
-        }
+    std::unordered_map<int64_t, std::set<int64_t>> table_region_map;
+    manager->get_table_region_ids(instance, table_region_map);
+    for (auto& table_region_ids : table_region_map) {
+        region_count += table_region_ids.second.size();
     }
+    region_leader_count += manager->get_leader_count(instance);
 }
 void QueryRegionManager::get_peer_ids_per_instance(
             const std::string& instance,
             std::set<int64_t>& peer_ids) {
     RegionManager* manager = RegionManager::get_instance();
     std::unordered_map<int64_t, std::set<int64_t>> table_region_map;
-    {
-        BAIDU_SCOPED_LOCK(manager->_instance_region_mutex);
-        auto iter = manager->_instance_region_map.find(instance);
-        if (iter == manager->_instance_region_map.end()) {
-            return;
-        }
-        table_region_map = iter->second;
-    }
+    manager->get_table_region_ids(instance, table_region_map);
 
     for (auto& table_region_ids : table_region_map) {
         for (auto& region_id : table_region_ids.second) {
@@ -13,6 +13,7 @@
 // limitations under the License.
 
 #include "region_manager.h"
+#include <algorithm>
 #include <boost/lexical_cast.hpp>
 #include "cluster_manager.h"
 #include "common.h"
@@ -27,6 +28,10 @@ DECLARE_int32(concurrency_num);
 DECLARE_int32(store_heart_beat_interval_us);
 DECLARE_int32(region_faulty_interval_times);
 DECLARE_int64(incremental_info_gc_time);
+DEFINE_int64(hot_leader_qps, 5000, "leader with read+write qps above this is hot");
+DEFINE_int64(hot_leader_cpu_time_us, 500 * 1000LL, "leader with exec time per second above this is hot");
+DEFINE_int32(leader_heartbeat_concurrency, 4, "concurrency of tables when process leader heartbeat");
+DEFINE_int32(region_shard_check_concurrency, 4, "concurrency of region shards when healthy check");
 //增加或者更新region信息
 //如果是增加，则需要更新表信息, 只有leader的上报会调用该接口
 void RegionManager::update_region(const pb::MetaManagerRequest& request,
@@ -611,7 +616,14 @@ void RegionManager::leader_load_balance(bool whether_can_decide,
         int64_t table_id = leader_region.region().table_id();
         table_leader_counts[table_id]++;
     }
+    for (auto& leader_region : request->unchanged_leader_regions()) {
+        table_leader_counts[leader_region.table_id()]++;
+    }
     set_instance_leader_count(instance, table_leader_counts);
+    //增量心跳没有全部leader的负载, 热点均衡只在全量心跳时做
+    if (whether_can_decide && load_balance && !request->delta_heartbeat()) {
+        hot_leader_balance(request, response);
+    }
   
     if (!request->need_leader_balance()) {
         return;
@@ -708,6 +720,63 @@ void RegionManager::leader_load_balance(bool whether_can_decide,
         } 
     }
 }
+void RegionManager::hot_leader_balance(const pb::StoreHeartBeatRequest* request,
+            pb::StoreHeartBeatResponse* response) {
+    std::string instance = request->instance_info().address();
+    std::vector<const pb::LeaderHeartBeat*> hot_leaders;
+    for (auto& leader_region : request->leader_regions()) {
+        if (leader_region.read_qps() + leader_region.write_qps() >= FLAGS_hot_leader_qps
+                || leader_region.cpu_time_us() >= FLAGS_hot_leader_cpu_time_us) {
+            hot_leaders.push_back(&leader_region);
+        }
+    }
+    int64_t hot_count = hot_leaders.size();
+    set_hot_leader_count(instance, hot_count);
+    if (hot_count <= 1) {
+        return;
+    }
+    // 最热的留在本实例, 每个心跳周期最多迁移一个, 避免来回迁移
+    std::sort(hot_leaders.begin(), hot_leaders.end(),
+            [](const pb::LeaderHeartBeat* l, const pb::LeaderHeartBeat* r) {
+                return l->read_qps() + l->write_qps() > r->read_qps() + r->write_qps();
+            });
+    for (size_t i = 1; i < hot_leaders.size(); ++i) {
+        const pb::LeaderHeartBeat* leader_region = hot_leaders[i];
+        if (leader_region->status() != pb::IDLE) {
+            continue;
+        }
+        int64_t min_hot_count = hot_count - 1;
+        std::string transfer_to_peer;
+        for (auto& peer : leader_region->region().peers()) {
+            if (peer == instance) {
+                continue;
+            }
+            int64_t peer_hot_count = get_hot_leader_count(peer);
+            if (peer_hot_count < min_hot_count) {
+                min_hot_count = peer_hot_count;
+                transfer_to_peer = peer;
+            }
+        }
+        if (transfer_to_peer.empty()) {
+            continue;
+        }
+        // 不带table_id, store端不受按表leader数的迁移配额限制
+        pb::TransLeaderRequest transfer_request;
+        transfer_request.set_region_id(leader_region->region().region_id());
+        transfer_request.set_old_leader(instance);
+        transfer_request.set_new_leader(transfer_to_peer);
+        *(response->add_trans_leader()) = transfer_request;
+        set_hot_leader_count(transfer_to_peer, min_hot_count + 1);
+        set_hot_leader_count(instance, hot_count - 1);
+        DB_WARNING("transfer hot leader, region_id: %ld, read_qps: %ld, write_qps: %ld, "
+                "instance: %s, hot_count: %ld, new_leader: %s, peer_hot_count: %ld",
+                leader_region->region().region_id(), leader_region->read_qps(),
+                leader_region->write_qps(), instance.c_str(), hot_count,
+                transfer_to_peer.c_str(), min_hot_count);
+        return;
+    }
+}
+
 // add_peer_count: 每个表需要add_peer的region数量, key: table_id
 // instance_regions： add_peer的region从这个候选集中选择, key: table_id
 void RegionManager::peer_load_balance(const std::unordered_map<int64_t, int64_t>& add_peer_counts,
@@ -804,13 +873,20 @@ void RegionManager::peer_load_balance(const std::unordered_map<int64_t, int64_t>
 }
 
 void RegionManager::update_leader_status(const pb::StoreHeartBeatRequest* request) {
+    int64_t timestamp = butil::gettimeofday_us();
     for (auto& leader_region : request->leader_regions()) {
         int64_t region_id = leader_region.region().region_id();
         RegionStateInfo region_state;
-        region_state.timestamp = butil::gettimeofday_us();
+        region_state.timestamp = timestamp;
         region_state.status = pb::NORMAL;
         _region_state_map.set(region_id, region_state);
     }
+    for (auto& leader_region : request->unchanged_leader_regions()) {
+        RegionStateInfo region_state;
+        region_state.timestamp = timestamp;
+        region_state.status = pb::NORMAL;
+        _region_state_map.set(leader_region.region_id(), region_state);
+    }
 }
 
 void RegionManager::put_incremental_regioninfo(const int64_t apply_index, std::vector<pb::RegionInfo>& region_infos) {
@@ -944,72 +1020,161 @@ void RegionManager::leader_heartbeat_for_region(const pb::StoreHeartBeatRequest*
     int64_t pre_time_cost = step_time_cost.get_time();
     step_time_cost.reset();
 
+    //按表分组, 不同表的region并发处理, 同一个表的region顺序处理(分裂的region需要按表整体更新)
+    struct TableLeaderRegions {
+        std::vector<const pb::LeaderHeartBeat*> changed;
+        std::vector<const pb::LeaderRegionBrief*> unchanged;
+    };
+    std::map<int64_t, TableLeaderRegions> table_leader_regions;
+    for (auto& leader_region : request->leader_regions()) {
+        table_leader_regions[leader_region.region().table_id()].changed.push_back(&leader_region);
+    }
+    for (auto& leader_region : request->unchanged_leader_regions()) {
+        table_leader_regions[leader_region.table_id()].unchanged.push_back(&leader_region);
+    }
     int64_t get_region_cost = 0;
     int64_t update_region_cost = 0;
     int64_t peer_count_cost = 0;
-    for (auto& leader_region : request->leader_regions()) {
-        const pb::RegionInfo& leader_region_info = leader_region.region();
-        int64_t region_id = leader_region_info.region_id();
-        TimeCost sub_step_time_cost;
-        auto master_region_info = get_region_info(region_id);
-        get_region_cost += sub_step_time_cost.get_time();
-        sub_step_time_cost.reset();
-        //新增region, 在meta_server中不存在，加入临时map等待分裂region整体更新
-        if (master_region_info == nullptr) {
-            if (leader_region_info.start_key().empty() && 
-               leader_region_info.end_key().empty()) {
-                //该region为第一个region直接添加
-                DB_WARNING("region_info: %s is new ", leader_region_info.ShortDebugString().c_str());
-                pb::MetaManagerRequest request;
-                request.set_op_type(pb::OP_UPDATE_REGION);
-                *(request.add_region_infos()) = leader_region_info;
-                SchemaManager::get_instance()->process_schema_info(NULL, &request, NULL, NULL);
-            } else if (true == add_region_is_exist(leader_region_info.table_id(),
-                                                   leader_region_info.start_key(), 
-                                                   leader_region_info.end_key())) {
-                DB_WARNING("region_info: %s is exist ", leader_region_info.ShortDebugString().c_str());
-                pb::MetaManagerRequest request;
-                request.set_op_type(pb::OP_UPDATE_REGION);
-                request.set_add_delete_region(true);
-                *(request.add_region_infos()) = leader_region_info;
-                SchemaManager::get_instance()->process_schema_info(NULL, &request, NULL, NULL);
-            } else {
-                DB_WARNING("region_info: %s is new ", 
-                           leader_region_info.ShortDebugString().c_str());
-                TableManager::get_instance()->add_new_region(leader_region_info);
+    bthread_mutex_t merge_mutex;
+    bthread_mutex_init(&merge_mutex, NULL);
+    auto process_table = [&](const TableLeaderRegions& table_regions) {
+        const std::vector<const pb::LeaderHeartBeat*>& leader_regions = table_regions.changed;
+        //check_peer_count会修改这些map, 每个分组使用自己的副本
+        std::unordered_map<int64_t, int64_t> replica_nums = table_replica_nums;
+        std::unordered_map<int64_t, std::string> resource_tags = table_resource_tags;
+        std::unordered_map<int64_t, std::unordered_map<std::string, int64_t>> replica_dists_maps = 
+            table_replica_dists_maps;
+        std::unordered_map<std::string, std::string> peer_tags = peer_resource_tags;
+        std::vector<std::pair<std::string, pb::RaftControlRequest>> table_remove_peer_requests;
+        pb::StoreHeartBeatResponse table_response;
+        int64_t table_get_region_cost = 0;
+        int64_t table_update_region_cost = 0;
+        int64_t table_peer_count_cost = 0;
+        for (auto leader_region_ptr : leader_regions) {
+            const pb::LeaderHeartBeat& leader_region = *leader_region_ptr;
+            const pb::RegionInfo& leader_region_info = leader_region.region();
+            int64_t region_id = leader_region_info.region_id();
+            TimeCost sub_step_time_cost;
+            auto master_region_info = get_region_info(region_id);
+            table_get_region_cost += sub_step_time_cost.get_time();
+            sub_step_time_cost.reset();
+            //新增region, 在meta_server中不存在，加入临时map等待分裂region整体更新
+            if (master_region_info == nullptr) {
+                if (leader_region_info.start_key().empty() && 
+                   leader_region_info.end_key().empty()) {
+                    //该region为第一个region直接添加
+                    DB_WARNING("region_info: %s is new ", leader_region_info.ShortDebugString().c_str());
+                    pb::MetaManagerRequest request;
+                    request.set_op_type(pb::OP_UPDATE_REGION);
+                    *(request.add_region_infos()) = leader_region_info;
+                    SchemaManager::get_instance()->process_schema_info(NULL, &request, NULL, NULL);
+                } else if (true == add_region_is_exist(leader_region_info.table_id(),
+                                                       leader_region_info.start_key(), 
+                                                       leader_region_info.end_key())) {
+                    DB_WARNING("region_info: %s is exist ", leader_region_info.ShortDebugString().c_str());
+                    pb::MetaManagerRequest request;
+                    request.set_op_type(pb::OP_UPDATE_REGION);
+                    request.set_add_delete_region(true);
+                    *(request.add_region_infos()) = leader_region_info;
+                    SchemaManager::get_instance()->process_schema_info(NULL, &request, NULL, NULL);
+                } else {
+                    DB_WARNING("region_info: %s is new ", 
+                               leader_region_info.ShortDebugString().c_str());
+                    TableManager::get_instance()->add_new_region(leader_region_info);
+                }
+                continue;
             }
-            continue;
+            std::set<std::string> peers_in_heart;
+            for (auto& peer : leader_region_info.peers()) {
+                peers_in_heart.insert(peer);
+            }
+            std::set<std::string> peers_in_master;
+            for (auto& peer: master_region_info->peers()) {
+                peers_in_master.insert(peer);
+            }
+            check_whether_update_region(region_id, leader_region, master_region_info, peers_in_heart, peers_in_master);
+            table_update_region_cost += sub_step_time_cost.get_time();
+            sub_step_time_cost.reset();
+            check_peer_count(region_id, 
+                            instance_resource_tag, 
+                            leader_region,
+                            peers_in_heart,
+                            peers_in_master,
+                            replica_nums,
+                            resource_tags,
+                            replica_dists_maps,
+                            peer_tags,
+                            table_remove_peer_requests, 
+                            &table_response);
+            table_peer_count_cost += sub_step_time_cost.get_time();
         }
-        std::set<std::string> peers_in_heart;
-        for (auto& peer : leader_region_info.peers()) {
-            peers_in_heart.insert(peer);
+        //没有变化的region, peer列表与上次上报的一致, 用meta中的信息补副本数检查
+        for (auto brief_ptr : table_regions.unchanged) {
+            if (!brief_ptr->has_status()) {
+                continue;
+            }
+            int64_t region_id = brief_ptr->region_id();
+            TimeCost sub_step_time_cost;
+            auto master_region_info = get_region_info(region_id);
+            table_get_region_cost += sub_step_time_cost.get_time();
+            sub_step_time_cost.reset();
+            if (master_region_info == nullptr) {
+                continue;
+            }
+            pb::LeaderHeartBeat leader_region;
+            *leader_region.mutable_region() = *master_region_info;
+            leader_region.set_status(brief_ptr->status());
+            std::set<std::string> peers_in_master;
+            for (auto& peer: master_region_info->peers()) {
+                peers_in_master.insert(peer);
+            }
+            check_peer_count(region_id, 
+                            instance_resource_tag, 
+                            leader_region,
+                            peers_in_master,
+                            peers_in_master,
+                            replica_nums,
+                            resource_tags,
+                            replica_dists_maps,
+                            peer_tags,
+                            table_remove_peer_requests, 
+                            &table_response);
+            table_peer_count_cost += sub_step_time_cost.get_time();
+        }
+        BAIDU_SCOPED_LOCK(merge_mutex);
+        get_region_cost += table_get_region_cost;
+        update_region_cost += table_update_region_cost;
+        peer_count_cost += table_peer_count_cost;
+        remove_peer_requests.insert(remove_peer_requests.end(), 
+                table_remove_peer_requests.begin(), table_remove_peer_requests.end());
+        for (auto& add_peer : table_response.add_peers()) {
+            *(response->add_add_peers()) = add_peer;
+        }
+    };
+    if (table_leader_regions.size() == 1 || FLAGS_leader_heartbeat_concurrency <= 1) {
+        for (auto& table_regions : table_leader_regions) {
+            process_table(table_regions.second);
         }
-        std::set<std::string> peers_in_master;
-        for (auto& peer: master_region_info->peers()) {
-            peers_in_master.insert(peer);
+    } else {
+        ConcurrencyBthread table_bths(FLAGS_leader_heartbeat_concurrency, &BTHREAD_ATTR_SMALL);
+        for (auto& table_regions : table_leader_regions) {
+            auto* regions = &table_regions.second;
+            table_bths.run([&process_table, regions]() {
+                process_table(*regions);
+            });
         }
-        check_whether_update_region(region_id, leader_region, master_region_info, peers_in_heart, peers_in_master);
-        update_region_cost += sub_step_time_cost.get_time();
-        sub_step_time_cost.reset();
-        check_peer_count(region_id, 
-                        instance_resource_tag, 
-                        leader_region,
-                        peers_in_heart,
-                        peers_in_master,
-                        table_replica_nums,
-                        table_resource_tags,
-                        table_replica_dists_maps,
-                        peer_resource_tags,
-                        remove_peer_requests, 
-                        response);
-        peer_count_cost = sub_step_time_cost.get_time();
+        table_bths.join();
     }
+    bthread_mutex_destroy(&merge_mutex);
     //回收临时map
     TableManager::get_instance()->recycle_update_region();
     int64_t check_leader_time = step_time_cost.get_time();
     DB_NOTICE("store: %s leader heartbeat for region, pre_time_cost: %ld, check_leader_time: %ld, "
-                "get_region_cost: %ld, update_region_cost: %ld, peer_count_cost: %ld",
-                instance.c_str(), pre_time_cost, check_leader_time, get_region_cost, update_region_cost, peer_count_cost);
+                "get_region_cost: %ld, update_region_cost: %ld, peer_count_cost: %ld, "
+                "leader_regions: %d, unchanged_leader_regions: %d, tables: %lu",
+                instance.c_str(), pre_time_cost, check_leader_time, get_region_cost, update_region_cost, 
+                peer_count_cost, request->leader_regions_size(), 
+                request->unchanged_leader_regions_size(), table_leader_regions.size());
     if (remove_peer_requests.size() == 0) {
         return;
     }
@@ -1384,8 +1549,9 @@ void RegionManager::migirate_region_for_store(const std::string& instance) {
 //报警，需要人工处理
 void RegionManager::region_healthy_check_function() {
     std::vector<int64_t> region_ids;
-    auto check_func = [this, &region_ids](const int64_t region_id, RegionStateInfo& region_state) {
-        if (butil::gettimeofday_us() - region_state.timestamp >
+    int64_t now = butil::gettimeofday_us();
+    auto check_func = [&region_ids, now](const int64_t region_id, RegionStateInfo& region_state) {
+        if (now - region_state.timestamp >
             FLAGS_store_heart_beat_interval_us * FLAGS_region_faulty_interval_times) {
             region_ids.push_back(region_id);
             region_state.status = pb::FAULTY;
@@ -1412,21 +1578,33 @@ void RegionManager::region_healthy_check_function() {
                 region_id, region_info->table_id(), region_info->leader().c_str());
     }
     erase_region_info(drop_region_ids);
+    //各分片并发收集实例, 同时清理已经没有region的实例
     std::map<std::string, int64_t> uniq_instance;
-    {
-        BAIDU_SCOPED_LOCK(_instance_region_mutex);
-        auto iter = _instance_region_map.begin();
-        while (iter != _instance_region_map.end()) {
-            std::string peer = iter->first;
-            if (iter->second.size() >0) {
-                int64_t table_id = iter->second.begin()->first;
-                uniq_instance[peer] = table_id;
-                ++iter; 
-            } else {
-                iter = _instance_region_map.erase(iter);
+    bthread_mutex_t uniq_mutex;
+    bthread_mutex_init(&uniq_mutex, NULL);
+    ConcurrencyBthread shard_bths(FLAGS_region_shard_check_concurrency, &BTHREAD_ATTR_SMALL);
+    for (auto& shard : _shards) {
+        RegionShard* shard_ptr = &shard;
+        shard_bths.run([shard_ptr, &uniq_instance, &uniq_mutex]() {
+            std::map<std::string, int64_t> shard_instance;
+            {
+                BAIDU_SCOPED_LOCK(shard_ptr->mutex);
+                auto iter = shard_ptr->instance_region_map.begin();
+                while (iter != shard_ptr->instance_region_map.end()) {
+                    if (iter->second.size() > 0) {
+                        shard_instance[iter->first] = iter->second.begin()->first;
+                        ++iter; 
+                    } else {
+                        iter = shard_ptr->instance_region_map.erase(iter);
+                    }
+                }
             }
-        }
+            BAIDU_SCOPED_LOCK(uniq_mutex);
+            uniq_instance.insert(shard_instance.begin(), shard_instance.end());
+        });
     }
+    shard_bths.join();
+    bthread_mutex_destroy(&uniq_mutex);
     whether_add_instance(uniq_instance);
 }
 void RegionManager::reset_region_status() {
@@ -1435,8 +1613,12 @@ void RegionManager::reset_region_status() {
         region_state.status = pb::NORMAL;        
     };
     _region_state_map.traverse(reset_func);
+    for (auto& shard : _shards) {
+        BAIDU_SCOPED_LOCK(shard.mutex);
+        shard.instance_leader_count.clear();
+    }
     BAIDU_SCOPED_LOCK(_count_mutex);
-    _instance_leader_count.clear();
+    _full_heartbeat_instances.clear();
 }
 
 SmartRegionInfo RegionManager::get_region_info(int64_t region_id) {
@@ -1474,17 +1656,19 @@ void RegionManager::erase_region_info(const std::vector<int64_t>& drop_region_id
         result_table_ids.push_back(table_id);
         result_start_keys.push_back(region_ptr->start_key());
         result_end_keys.push_back(region_ptr->end_key());
+        RegionShard& shard = get_shard(table_id);
         for (auto peer : region_ptr->peers()) {
             {
-                BAIDU_SCOPED_LOCK(_instance_region_mutex);
-                if (_instance_region_map.find(peer) != _instance_region_map.end()
-                        && _instance_region_map[peer].find(table_id) != _instance_region_map[peer].end()) {
-                    _instance_region_map[peer][table_id].erase(drop_region_id);
-                    if (_instance_region_map[peer][table_id].size() == 0) {
-                        _instance_region_map[peer].erase(table_id);
+                BAIDU_SCOPED_LOCK(shard.mutex);
+                auto& instance_region_map = shard.instance_region_map;
+                if (instance_region_map.find(peer) != instance_region_map.end()
+                        && instance_region_map[peer].find(table_id) != instance_region_map[peer].end()) {
+                    instance_region_map[peer][table_id].erase(drop_region_id);
+                    if (instance_region_map[peer][table_id].size() == 0) {
+                        instance_region_map[peer].erase(table_id);
                     }
-                    if (_instance_region_map[peer].size() == 0) {
-                        _instance_region_map.erase(peer);
+                    if (instance_region_map[peer].size() == 0) {
+                        instance_region_map.erase(peer);
                     }
                 }
             }
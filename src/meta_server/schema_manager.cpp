@@ -23,6 +23,8 @@
 #include "rocks_wrapper.h"
 
 namespace baikaldb {
+DEFINE_bool(enable_index_key_layout, false, "allow creating tables with index_key_layout, "
+            "experimental: existing tables can not be migrated to this layout yet");
 
 const std::string SchemaManager::MAX_NAMESPACE_ID_KEY = "max_namespace_id";
 const std::string SchemaManager::MAX_DATABASE_ID_KEY = "max_database_id";
@@ -134,6 +136,20 @@ void SchemaManager::process_schema_info(google::protobuf::RpcController* control
                     "no new table name", request->op_type(), log_id);
             return;
         } 
+        // 索引布局在迁移工具完成前只对新建表开放, 由leader在提交raft前检查
+        if (request->op_type() == pb::OP_CREATE_TABLE
+                && request->table_info().schema_conf().index_key_layout()
+                && !FLAGS_enable_index_key_layout) {
+            ERROR_SET_RESPONSE(response, pb::INPUT_PARAM_ERROR,
+                    "index_key_layout is disabled", request->op_type(), log_id);
+            return;
+        }
+        if (request->op_type() == pb::OP_UPDATE_SCHEMA_CONF
+                && request->table_info().schema_conf().has_index_key_layout()) {
+            ERROR_SET_RESPONSE(response, pb::INPUT_PARAM_ERROR,
+                    "index_key_layout can only be set when creating table", request->op_type(), log_id);
+            return;
+        }
         if (request->op_type() == pb::OP_CREATE_TABLE
                 && !request->table_info().has_upper_table_name()) {
             auto ret = pre_process_for_create_table(request, response, log_id);
@@ -258,6 +274,11 @@ void SchemaManager::process_leader_heartbeat_for_store(const pb::StoreHeartBeatR
         return;
     }
     TimeCost step_time_cost;
+    response->set_support_delta_heartbeat(true);
+    if (!RegionManager::get_instance()->check_full_heartbeat(request->instance_info().address(),
+                request->delta_heartbeat())) {
+        response->set_need_full_heartbeat(true);
+    }
     RegionManager::get_instance()->update_leader_status(request);
     int64_t update_status_time = step_time_cost.get_time();
     step_time_cost.reset();
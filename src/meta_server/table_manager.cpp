@@ -352,6 +352,42 @@ void TableManager::create_table(const pb::MetaManagerRequest& request, const int
            table_info.set_replica_num(FLAGS_region_replica_num);
         }
     }
+    // 索引布局要求每个region只有一个有序索引, 局部二级索引和列存不支持
+    if (table_info.schema_conf().index_key_layout()) {
+        if (table_info.engine() != pb::ROCKSDB) {
+            DB_WARNING("table:%s index_key_layout only support rocksdb engine", table_name.c_str());
+            IF_DONE_SET_RESPONSE(done, pb::INPUT_PARAM_ERROR, "index_key_layout only support rocksdb");
+            return;
+        }
+        for (auto& index_info : table_info.indexs()) {
+            if (index_info.index_type() != pb::I_PRIMARY && !is_global_index(index_info)) {
+                DB_WARNING("table:%s index_key_layout not support local index:%s",
+                        table_name.c_str(), index_info.index_name().c_str());
+                IF_DONE_SET_RESPONSE(done, pb::INPUT_PARAM_ERROR,
+                        "index_key_layout not support local index");
+                return;
+            }
+        }
+    }
+    // ttl表的value带过期时间, 由主键和局部索引一起写入, 全局索引和全文索引不支持
+    // 之前建的ttl表ttl_format_version为0, value不带过期时间, 不受影响
+    if (table_info.ttl_duration() > 0) {
+        if (table_info.engine() != pb::ROCKSDB) {
+            DB_WARNING("table:%s ttl only support rocksdb engine", table_name.c_str());
+            IF_DONE_SET_RESPONSE(done, pb::INPUT_PARAM_ERROR, "ttl only support rocksdb");
+            return;
+        }
+        for (auto& index_info : table_info.indexs()) {
+            if (is_global_index(index_info) || index_info.index_type() == pb::I_FULLTEXT) {
+                DB_WARNING("table:%s ttl not support index:%s",
+                        table_name.c_str(), index_info.index_name().c_str());
+                IF_DONE_SET_RESPONSE(done, pb::INPUT_PARAM_ERROR,
+                        "ttl not support global or fulltext index");
+                return;
+            }
+        }
+        table_info.set_ttl_format_version(1);
+    }
     //分配field_id
     bool has_auto_increment = false;
     auto ret = alloc_field_id(table_info, has_auto_increment, table_mem);
@@ -1088,6 +1124,7 @@ int TableManager::write_schema_for_not_level(TableMem& table_mem,
                 region_info->set_table_name(table_mem.schema_pb.table_name());
                 construct_common_region(region_info, table_mem.schema_pb.replica_num());
                 region_info->set_partition_id(i);
+                region_info->set_index_key_layout(table_mem.schema_pb.schema_conf().index_key_layout());
                 region_info->add_peers(table_mem.schema_pb.init_store(instance_count));
                 region_info->set_leader(table_mem.schema_pb.init_store(instance_count));
                 if (j != 0) {
@@ -1116,6 +1153,7 @@ int TableManager::write_schema_for_not_level(TableMem& table_mem,
             region_info->set_table_name(table_mem.schema_pb.table_name());
             construct_common_region(region_info, table_mem.schema_pb.replica_num());
             region_info->set_partition_id(i);
+            region_info->set_index_key_layout(table_mem.schema_pb.schema_conf().index_key_layout());
             region_info->add_peers(table_mem.schema_pb.init_store(instance_count));
             region_info->set_leader(table_mem.schema_pb.init_store(instance_count));
             *(init_region_request.mutable_schema_info()) = simple_table_info;
@@ -2381,6 +2419,22 @@ void TableManager::add_index(const pb::MetaManagerRequest& request,
         IF_DONE_SET_RESPONSE(done, pb::INPUT_PARAM_ERROR, "table not in table_info_map");
         return;
     }
+    if (_table_info_map[table_id].schema_pb.schema_conf().index_key_layout()
+            && !is_global_index(request.table_info().indexs(0))) {
+        DB_WARNING("DDL_LOG[add_index] index_key_layout table not support local index, request:%s",
+                request.ShortDebugString().c_str());
+        IF_DONE_SET_RESPONSE(done, pb::INPUT_PARAM_ERROR, "index_key_layout not support local index");
+        return;
+    }
+
+    if (_table_info_map[table_id].schema_pb.ttl_format_version() > 0
+            && (is_global_index(request.table_info().indexs(0))
+                || request.table_info().indexs(0).index_type() == pb::I_FULLTEXT)) {
+        DB_WARNING("DDL_LOG[add_index] ttl table not support global or fulltext index, request:%s",
+                request.ShortDebugString().c_str());
+        IF_DONE_SET_RESPONSE(done, pb::INPUT_PARAM_ERROR, "ttl not support global or fulltext index");
+        return;
+    }
 
     int64_t index_id;
     int index_ret = check_index(request.table_info().indexs(0), 
@@ -21,7 +21,174 @@
 #include "meta_server_interact.hpp"
 
 namespace baikaldb {
+DEFINE_bool(auto_incr_lease, false, "lease auto increment id segments from meta and allocate locally");
+DEFINE_int64(auto_incr_lease_min_step, 100, "min ids of a leased auto increment segment");
+DEFINE_int64(auto_incr_lease_max_step, 100000, "max ids of a leased auto increment segment");
+DEFINE_int32(auto_incr_lease_target_s, 10, "expected seconds a leased segment lasts, "
+        "segment size adapts to insert rate");
+DEFINE_int32(auto_incr_prefetch_percent, 30, "prefetch next segment when remaining ids "
+        "drop below this percent of segment size");
+
 MetaServerInteract AutoInc::auto_incr_meta_inter;
+std::mutex AutoInc::_lease_mutex;
+std::unordered_map<int64_t, std::unique_ptr<AutoIncrLease>> AutoInc::_leases;
+
+static int gen_id_from_meta(int64_t table_id, int64_t count, int64_t max_id,
+        pb::MetaManagerResponse& response) {
+    pb::MetaManagerRequest request;
+    request.set_op_type(pb::OP_GEN_ID_FOR_AUTO_INCREMENT);
+    auto auto_increment_ptr = request.mutable_auto_increment();
+    auto_increment_ptr->set_table_id(table_id);
+    auto_increment_ptr->set_count(count);
+    auto_increment_ptr->set_start_id(max_id);
+    return AutoInc::auto_incr_meta_inter.send_request("meta_manager", request, response);
+}
+
+AutoIncrLease::AutoIncrLease(int64_t table_id) : 
+        AutoIncrLease(table_id, [table_id](int64_t count, pb::MetaManagerResponse& response) {
+            return gen_id_from_meta(table_id, count, 0, response);
+        }) {}
+
+AutoIncrLease::AutoIncrLease(int64_t table_id, const FetchFunc& fetch_func) : 
+        _table_id(table_id), _fetch_func(fetch_func) {
+    bthread_mutex_init(&_mutex, NULL);
+    _step = FLAGS_auto_incr_lease_min_step;
+}
+
+int AutoIncrLease::fetch(int64_t count, int64_t* start_id, int64_t* end_id, uint64_t* epoch) {
+    pb::MetaManagerResponse response;
+    if (_fetch_func(count, response) != 0) {
+        DB_WARNING("lease auto increment id fail, table_id:%ld, count:%ld", _table_id, count);
+        return -1;
+    }
+    *start_id = response.start_id();
+    *end_id = response.end_id();
+    *epoch = response.auto_incr_epoch();
+    if (*end_id - *start_id < count) {
+        DB_FATAL("lease auto increment id count not match, table_id:%ld, count:%ld, "
+                "start_id:%ld, end_id:%ld", _table_id, count, *start_id, *end_id);
+        return -1;
+    }
+    return 0;
+}
+
+bool AutoIncrLease::check_epoch(uint64_t epoch) {
+    if (epoch > _epoch) {
+        if (!_segments.empty()) {
+            DB_WARNING("auto increment lease expired, table_id:%ld, epoch:%lu, new_epoch:%lu",
+                    _table_id, _epoch, epoch);
+        }
+        _segments.clear();
+        _epoch = epoch;
+    }
+    return epoch == _epoch;
+}
+
+void AutoIncrLease::update_epoch(uint64_t epoch) {
+    BAIDU_SCOPED_LOCK(_mutex);
+    check_epoch(epoch);
+}
+
+void AutoIncrLease::adjust_step() {
+    int64_t target_us = FLAGS_auto_incr_lease_target_s * 1000000LL;
+    int64_t cost = _step_time.get_time();
+    if (cost < target_us / 2) {
+        _step = std::min(_step * 2, FLAGS_auto_incr_lease_max_step);
+    } else if (cost > target_us * 2) {
+        _step = std::max(_step / 2, FLAGS_auto_incr_lease_min_step);
+    }
+    _step = std::max(std::min(_step, FLAGS_auto_incr_lease_max_step),
+            FLAGS_auto_incr_lease_min_step);
+    _step_time.reset();
+}
+
+void AutoIncrLease::prefetch() {
+    int64_t remain = 0;
+    for (auto& seg : _segments) {
+        remain += seg.second - seg.first;
+    }
+    if (_fetching || remain * 100 >= _step * FLAGS_auto_incr_prefetch_percent) {
+        return;
+    }
+    _fetching = true;
+    adjust_step();
+    int64_t count = _step;
+    Bthread bth(&BTHREAD_ATTR_SMALL);
+    bth.run([this, count]() {
+        int64_t start_id = 0;
+        int64_t end_id = 0;
+        uint64_t epoch = 0;
+        int ret = fetch(count, &start_id, &end_id, &epoch);
+        BAIDU_SCOPED_LOCK(_mutex);
+        // 失败时等当前段用完再同步获取
+        if (ret == 0 && check_epoch(epoch)) {
+            _segments.emplace_back(start_id, end_id);
+        }
+        _fetching = false;
+    });
+}
+
+int AutoIncrLease::alloc(int64_t count, int64_t* start_id) {
+    // 同步获取时不持有锁, 获取期间epoch更新则重新获取
+    for (int retry = 0; retry < 3; ++retry) {
+        int64_t fetch_count = 0;
+        {
+            BAIDU_SCOPED_LOCK(_mutex);
+            // 同一条语句的id需要连续, 剩余不够时丢弃
+            while (!_segments.empty() && 
+                    _segments.front().second - _segments.front().first < count) {
+                _segments.pop_front();
+            }
+            if (!_segments.empty()) {
+                *start_id = _segments.front().first;
+                _segments.front().first += count;
+                prefetch();
+                return 0;
+            }
+            adjust_step();
+            fetch_count = std::max(count, _step);
+        }
+        int64_t end_id = 0;
+        uint64_t epoch = 0;
+        if (fetch(fetch_count, start_id, &end_id, &epoch) != 0) {
+            return -1;
+        }
+        BAIDU_SCOPED_LOCK(_mutex);
+        if (!check_epoch(epoch)) {
+            continue;
+        }
+        if (*start_id + count < end_id) {
+            _segments.emplace_back(*start_id + count, end_id);
+        }
+        return 0;
+    }
+    DB_WARNING("auto increment lease epoch keeps changing, table_id:%ld", _table_id);
+    return -1;
+}
+
+AutoIncrLease* AutoInc::get_lease(int64_t table_id) {
+    std::lock_guard<std::mutex> lock(_lease_mutex);
+    auto& lease = _leases[table_id];
+    if (lease == nullptr) {
+        lease.reset(new AutoIncrLease(table_id));
+    }
+    return lease.get();
+}
+
+void AutoInc::update_lease_epoch(int64_t table_id, uint64_t epoch) {
+    AutoIncrLease* lease = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(_lease_mutex);
+        auto iter = _leases.find(table_id);
+        if (iter == _leases.end()) {
+            return;
+        }
+        lease = iter->second.get();
+    }
+    // 租约创建后不会删除
+    lease->update_epoch(epoch);
+}
+
 int AutoInc::analyze(QueryContext* ctx) {
     ExecNode* plan = ctx->root;
     if (ctx->insert_records.size() == 0) {
@@ -55,37 +222,76 @@ int AutoInc::analyze(QueryContext* ctx) {
     if (auto_id_count == 0 && max_id == 0) {
         return 0;
     }
-    // 请求meta来获取自增id
-    pb::MetaManagerRequest request;
-    pb::MetaManagerResponse response;
-    request.set_op_type(pb::OP_GEN_ID_FOR_AUTO_INCREMENT);
-    auto auto_increment_ptr = request.mutable_auto_increment();
-    auto_increment_ptr->set_table_id(table_id);
-    auto_increment_ptr->set_count(auto_id_count);
-    auto_increment_ptr->set_start_id(max_id);
-    if (AutoInc::auto_incr_meta_inter.send_request("meta_manager", 
-                                                          request, 
-                                                          response) != 0) {
-        DB_FATAL("gen id from meta_server fail, sql:%s", ctx->sql.c_str());
-        return -1; 
+    int64_t start_id = 0;
+    int64_t end_id = 0;
+    if (FLAGS_auto_incr_lease && max_id == 0) {
+        // 只需要自增id时从本地租用的段中分配
+        if (get_lease(table_id)->alloc(auto_id_count, &start_id) != 0) {
+            DB_FATAL("alloc id from auto increment lease fail, sql:%s", ctx->sql.c_str());
+            return -1;
+        }
+        end_id = start_id + auto_id_count;
+    } else {
+        // 有显式id时请求meta推进全局的自增值, meta增大epoch使所有db节点的租约作废
+        // 本节点立即生效, 其他节点在下次心跳时生效
+        pb::MetaManagerResponse response;
+        if (gen_id_from_meta(table_id, auto_id_count, max_id, response) != 0) {
+            DB_FATAL("gen id from meta_server fail, sql:%s", ctx->sql.c_str());
+            return -1; 
+        }
+        if (FLAGS_auto_incr_lease) {
+            get_lease(table_id)->update_epoch(response.auto_incr_epoch());
+        }
+        start_id = response.start_id();
+        end_id = response.end_id();
     }
     
     if (auto_id_count == 0) {
         return 0;
     }
-    int64_t start_id = response.start_id();
     auto client = ctx->runtime_state.client_conn();
+    // 合并的多语句insert按语句记录第一个自增id, 没有自增id的语句沿用上一条语句的值
+    auto& stmt_rows = ctx->batched_stmt_rows;
+    bool record_stmt_ids = stmt_rows.size() > 1;
+    size_t total_rows = 0;
+    for (auto rows : stmt_rows) {
+        if (rows <= 0) {
+            record_stmt_ids = false;
+        }
+        total_rows += rows;
+    }
+    if (total_rows != ctx->insert_records.size()) {
+        record_stmt_ids = false;
+    }
+    int64_t stmt_insert_id = client->last_insert_id;
+    bool stmt_has_id = false;
+    size_t stmt_idx = 0;
+    int stmt_row_idx = 0;
     client->last_insert_id = start_id;
     for (auto& record : ctx->insert_records) {
         auto field = record->get_field_by_tag(table_info_ptr->auto_inc_field_id);
         ExprValue value = record->get_value(field);
         if (value.is_null() || value.get_numberic<int64_t>() == 0) {
+            if (record_stmt_ids && !stmt_has_id) {
+                stmt_insert_id = start_id;
+                stmt_has_id = true;
+            }
             value.type = pb::INT64;
             value._u.int64_val = start_id++;
             record->set_value(field, value);
         }
+        if (record_stmt_ids && ++stmt_row_idx == stmt_rows[stmt_idx]) {
+            ctx->batched_insert_ids.push_back(stmt_insert_id);
+            stmt_has_id = false;
+            stmt_row_idx = 0;
+            ++stmt_idx;
+        }
+    }
+    if (record_stmt_ids) {
+        // 与mysql一致, LAST_INSERT_ID()为最后一条语句的值
+        client->last_insert_id = ctx->batched_insert_ids.back();
     }
-    if (start_id != (int64_t)response.end_id()) {
+    if (start_id != end_id) {
         DB_FATAL("gen id count not equal to request id count, sql:%s", ctx->sql.c_str());
         return -1;
     }
@@ -18,6 +18,7 @@
 #include "predicate.h"
 #include "join_node.h"
 #include "agg_node.h"
+#include "limit_node.h"
 #include "parser.h"
 
 namespace baikaldb {
@@ -361,6 +362,13 @@ void IndexSelector::index_selector(const std::function<int32_t(int32_t, int32_t)
             auto pos_index = pb_scan_node->add_indexes();
             pos_index->set_index_id(index_id);
             pos_index->set_bool_and(bool_and);
+            if (index_type == pb::I_FULLTEXT) {
+                int64_t topk = reverse_topk(get_slot_id, ctx, sort_node, conjuncts,
+                        table_id, tuple_id, index_id);
+                if (topk > 0) {
+                    pos_index->set_reverse_topk(topk);
+                }
+            }
             for (auto record : in_records) {
                 std::string str;
                 record->encode(str);
@@ -451,6 +459,47 @@ void IndexSelector::index_selector(const std::function<int32_t(int32_t, int32_t)
     //DB_WARNING("pb_scan_node: %s", pb_scan_node->DebugString().c_str());
 }
 
+// 只有ORDER BY __weight DESC LIMIT k, 且过滤条件全部由该全文索引处理时,
+// 布尔引擎的top-k结果才与store上先过滤再排序的结果一致
+int64_t IndexSelector::reverse_topk(const std::function<int32_t(int32_t, int32_t)>& get_slot_id,
+        QueryContext* ctx,
+        SortNode* sort_node,
+        std::vector<ExprNode*>* conjuncts,
+        int64_t table_id,
+        int32_t tuple_id,
+        int64_t index_id) {
+    if (sort_node == nullptr) {
+        return 0;
+    }
+    LimitNode* limit_node = static_cast<LimitNode*>(ctx->root->get_node(pb::LIMIT_NODE));
+    if (limit_node == nullptr || limit_node->other_limit() <= 0) {
+        return 0;
+    }
+    const std::vector<ExprNode*>& order_exprs = sort_node->slot_order_exprs();
+    if (order_exprs.size() != 1 || sort_node->is_asc()[0] || !order_exprs[0]->is_slot_ref()) {
+        return 0;
+    }
+    auto table_info = SchemaFactory::get_instance()->get_table_info_ptr(table_id);
+    if (table_info == nullptr) {
+        return 0;
+    }
+    int32_t weight_field_id = get_field_id_by_name(table_info->fields, "__weight");
+    SlotRef* slot_ref = static_cast<SlotRef*>(order_exprs[0]);
+    if (weight_field_id == 0 || slot_ref->tuple_id() != tuple_id
+            || slot_ref->slot_id() != get_slot_id(tuple_id, weight_field_id)) {
+        return 0;
+    }
+    if (conjuncts != nullptr) {
+        std::vector<int64_t> index_ids = {index_id};
+        for (auto expr : *conjuncts) {
+            if (!expr->contained_by_index(index_ids)) {
+                return 0;
+            }
+        }
+    }
+    return limit_node->other_limit();
+}
+
 bool IndexSelector::check_sort_use_index(const std::function<int32_t(int32_t, int32_t)>& get_slot_id, 
         IndexInfo& index_info, 
         const std::vector<ExprNode*>& order_exprs, 
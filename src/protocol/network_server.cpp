@@ -15,6 +15,7 @@
 #include "network_server.h"
 #include "physical_planner.h"
 #include "transaction_manager_node.h"
+#include "auto_inc.h"
 #include "log.h"
 #include <gflags/gflags.h>
 
@@ -84,21 +85,7 @@ void NetworkServer::recovery_transactions() {
             continue;
         }
         TransactionManagerNode::remove_commit_log_entry(txn_id);
-        SmartSocket dummy_client = SmartSocket(new (std::nothrow)NetworkSocket);
-        dummy_client->txn_id = txn_id;
-        dummy_client->seq_id = commit_plan.seq_id();
-        for (auto& region_info : commit_plan.regions()) {
-            dummy_client->region_infos[region_info.region_id()] = region_info;
-        }
-        RuntimeState state;
-        state.set_client_conn(dummy_client.get());
-        state.txn_id = txn_id;
-        ExecNode* commit_root = nullptr;
-        ExecNode::create_tree(commit_plan.plan(), &commit_root);
-        TransactionManagerNode commit_manager_node;
-        commit_manager_node.set_op_type(pb::OP_COMMIT);
-        int ret = commit_manager_node.exec_commit_node(&state, commit_root);
-        delete commit_root;
+        int ret = TransactionManagerNode::exec_commit_plan(txn_id, commit_plan);
         if (ret < 0) {
             DB_FATAL("TransactionError: execute recovery plan failed, txn_id: %lu", txn_id);
             continue;
@@ -261,6 +248,9 @@ void NetworkServer::process_heart_beat_response(const pb::BaikalHeartBeatRespons
     for (auto& info : response.db_info()) {
         factory->update_show_db(info);
     }
+    for (auto& info : response.auto_incr_epochs()) {
+        AutoInc::update_lease_epoch(info.table_id(), info.epoch());
+    }
     if (response.has_last_updated_index() && 
         response.last_updated_index() > factory->last_updated_index()) {
         factory->set_last_updated_index(response.last_updated_index());
@@ -281,6 +271,9 @@ void NetworkServer::process_heart_beat_response_sync(const pb::BaikalHeartBeatRe
     for (auto& info : response.db_info()) {
         factory->update_show_db(info);
     }
+    for (auto& info : response.auto_incr_epochs()) {
+        AutoInc::update_lease_epoch(info.table_id(), info.epoch());
+    }
 
     factory->update_regions_double_buffer_sync(response.region_change_info());
     if (response.has_last_updated_index() && 
@@ -16,6 +16,8 @@
 #include <boost/algorithm/string.hpp>
 #include "network_server.h"
 #include "query_context.h"
+#include "query_scheduler.h"
+#include "result_cache.h"
 #include <rapidjson/reader.h>
 #include <rapidjson/document.h>
 #include <boost/algorithm/string/join.hpp>
@@ -435,9 +437,18 @@ int StateMachine::_auth_read(SmartSocket sock) {
         DB_DEBUG_CLIENT(sock, "Failed to read packet");
         return ret;
     }
-    // Get charset.
+    // Get client capability flags.
     uint8_t *packet = sock->self_buf->_data;
-    uint32_t off = PACKET_HEADER_LEN + 8;
+    uint32_t off = PACKET_HEADER_LEN;
+    uint64_t capability = 0;
+    if (RET_SUCCESS != _wrapper->protocol_get_length_fixed_int(packet,
+            sock->packet_len + PACKET_HEADER_LEN, off, 4, capability)) {
+        DB_FATAL_CLIENT(sock, "get capability flags failed, off=%d, len=4", off);
+        return RET_ERROR;
+    }
+    sock->client_capability = capability;
+    // Get charset.
+    off = PACKET_HEADER_LEN + 8;
     uint8_t charset_num = 0;
     if (RET_SUCCESS != _wrapper->protocol_get_char(packet, sock->packet_len + PACKET_HEADER_LEN, off, &charset_num)) {
         DB_FATAL_CLIENT(sock, "get charset_num failed, off=%d, len=1", off);
@@ -1034,6 +1045,10 @@ int StateMachine::_get_json_attributes(std::shared_ptr<QueryContext> ctx) {
                 ctx->enable_2pc = json_iter->value.GetInt64();
                 DB_WARNING("enable_2pc: %ld", ctx->enable_2pc);
             }
+            json_iter = root.FindMember("result_cache");
+            if (json_iter != root.MemberEnd()) {
+                ctx->use_result_cache = json_iter->value.GetInt64();
+            }
             json_iter = root.FindMember("full_export");
             if (json_iter != root.MemberEnd()) {
                 ctx->is_full_export = json_iter->value.GetBool();
@@ -2669,6 +2684,30 @@ int StateMachine::_get_query_type(std::shared_ptr<QueryContext> ctx) {
     return SQL_WRITE_NUM;
 }
 
+// 以需要访问的region数作为query代价的估算
+static int64_t estimate_query_cost(ExecNode* node) {
+    if (node == nullptr) {
+        return 0;
+    }
+    int64_t cost = node->region_infos().size();
+    for (size_t idx = 0; idx < node->children_size(); ++idx) {
+        cost += estimate_query_cost(node->children(idx));
+    }
+    return cost;
+}
+
+static void collect_region_versions(ExecNode* node, std::map<int64_t, int64_t>& region_versions) {
+    if (node == nullptr) {
+        return;
+    }
+    for (auto& pair : node->region_infos()) {
+        region_versions[pair.first] = pair.second.version();
+    }
+    for (size_t idx = 0; idx < node->children_size(); ++idx) {
+        collect_region_versions(node->children(idx), region_versions);
+    }
+}
+
 bool StateMachine::_handle_client_query_common_query(SmartSocket client) {
     if (client == nullptr) {
         DB_FATAL("param invalid: socket==NULL");
@@ -2780,6 +2819,56 @@ bool StateMachine::_handle_client_query_common_query(SmartSocket client) {
         return true;
     }
    
+    // 结果缓存只用于事务外的普通select, 命中时不占用调度队列
+    std::string cache_key;
+    size_t send_buf_start = client->send_buf->_size;
+    auto cache = ResultCache::get_instance();
+    if (client->query_ctx->use_result_cache
+            && cache->enabled()
+            && client->query_ctx->type == SQL_SELECT_NUM
+            && client->query_ctx->root != nullptr
+            && client->txn_id == 0
+            && !client->query_ctx->is_explain
+            && !client->query_ctx->is_full_export
+            && !client->query_ctx->has_nondeterministic_fn) {
+        std::map<int64_t, int64_t> region_versions;
+        collect_region_versions(client->query_ctx->root, region_versions);
+        if (!region_versions.empty()) {
+            cache_key = ResultCache::make_key(client->query_ctx->sql,
+                    client->user_info->namespace_ + "." + client->current_db,
+                    client->charset_name);
+            SmartCachedResult cached;
+            if (cache->find(cache_key, region_versions, &cached) == 0) {
+                client->send_buf->byte_array_append_len(
+                        (const uint8_t*)cached->packets.data(), cached->packets.size());
+                client->packet_id = cached->packet_id;
+                client->query_ctx->stat_info.hit_cache = true;
+                client->query_ctx->stat_info.num_returned_rows = cached->num_returned_rows;
+                client->query_ctx->stat_info.query_exec_time = cost.get_time();
+                client->query_ctx->stat_info.send_buf_size = client->send_buf->_size;
+                return true;
+            }
+            client->query_ctx->runtime_state.set_record_region_snapshot(true);
+        }
+    }
+    // 显式事务内的语句不排队, 避免持锁等待; 全量导出跨多次请求, 也不参与调度
+    QueryTicket ticket;
+    if (FLAGS_enable_query_scheduler
+            && client->query_ctx->runtime_state.single_sql_autocommit()
+            && !client->query_ctx->is_full_export) {
+        int64_t cost = estimate_query_cost(client->query_ctx->root);
+        std::string table;
+        if (!client->query_ctx->stat_info.table.empty()) {
+            table = client->query_ctx->stat_info.family + "." + client->query_ctx->stat_info.table;
+        }
+        ret = QueryScheduler::get_instance()->acquire(&ticket, client->username, table, cost);
+        if (ret < 0) {
+            client->on_commit_rollback();
+            _wrapper->make_err_packet(client, ER_QUERY_EXCEED_QUOTA, "%s",
+                "query exceed quota(queue timeout)");
+            return false;
+        }
+    }
     //DB_WARNING("client: %ld ,seq_id: %d", client.get(), client->seq_id);
     // 不会有fether那一层，重构
     if (!client->query_ctx->is_full_export) {
@@ -2812,6 +2901,17 @@ bool StateMachine::_handle_client_query_common_query(SmartSocket client) {
             client->query_ctx->stat_info.error_msg.str().c_str());
         return false;
     }
+    auto& state = client->query_ctx->runtime_state;
+    if (!cache_key.empty() && state.region_snapshot_complete()
+            && client->send_buf->_size > send_buf_start) {
+        SmartCachedResult cached(new CachedResult);
+        cached->packets.assign((const char*)client->send_buf->_data + send_buf_start,
+                client->send_buf->_size - send_buf_start);
+        cached->packet_id = client->packet_id;
+        cached->num_returned_rows = client->query_ctx->stat_info.num_returned_rows;
+        cached->regions = state.region_snapshots();
+        cache->add(cache_key, cached);
+    }
     return true;
 }
 } // namespace baikal
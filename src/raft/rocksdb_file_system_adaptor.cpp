@@ -13,13 +13,27 @@
 // limitations under the License.
 
 #include "rocksdb_file_system_adaptor.h"
+#include <sstream>
 #include "mut_table_key.h"
+#include "key_layout.h"
 #include "sst_file_writer.h"
 #include "meta_writer.h"
 #include "store.h"
 #include "log_entry_reader.h"
 
 namespace baikaldb {
+DEFINE_int64(snapshot_max_bytes_per_second, 0,
+        "snapshot send and receive bytes per second of this store, 0 means no limit");
+DEFINE_int32(snapshot_read_parallel, 4, "range count to prefetch snapshot data concurrently");
+DEFINE_int64(snapshot_block_bytes, 64 * 1024LL, "snapshot prefetch block bytes");
+DEFINE_int64(snapshot_prefetch_bytes, 4 * 1024 * 1024LL,
+        "max prefetched snapshot bytes in memory per range");
+
+// 本store所有region的snapshot收发共用一个限速器
+static TokenBucket* snapshot_rate_limiter() {
+    static TokenBucket limiter;
+    return &limiter;
+}
 
 bool inline is_snapshot_data_file(const std::string& path) {
     butil::StringPiece sp(path);
@@ -51,6 +65,192 @@ const char* PosixDirReader::name() const {
     return _dir_reader.name();
 }
 
+ParallelSnapshotReader::ParallelSnapshotReader(int64_t region_id,
+        const rocksdb::Snapshot* snapshot, const std::vector<std::string>& boundaries) :
+            _region_id(region_id), _snapshot(snapshot) {
+    bthread_mutex_init(&_mutex, NULL);
+    bthread_cond_init(&_cond, NULL);
+    for (size_t i = 0; i + 1 < boundaries.size(); ++i) {
+        std::unique_ptr<RangeContext> range(new RangeContext);
+        range->start = boundaries[i];
+        range->end = boundaries[i + 1];
+        range->end_slice = range->end;
+        _ranges.push_back(std::move(range));
+    }
+}
+
+ParallelSnapshotReader::~ParallelSnapshotReader() {
+    stop();
+    bthread_cond_destroy(&_cond);
+    bthread_mutex_destroy(&_mutex);
+}
+
+void ParallelSnapshotReader::start() {
+    rocksdb::ColumnFamilyHandle* column_family = RocksWrapper::get_instance()->get_data_handle();
+    _running = true;
+    for (auto& range : _ranges) {
+        rocksdb::ReadOptions read_options;
+        read_options.snapshot = _snapshot;
+        read_options.total_order_seek = true;
+        read_options.fill_cache = false;
+        read_options.iterate_upper_bound = &range->end_slice;
+        range->iter.reset(RocksWrapper::get_instance()->new_iterator(read_options, column_family));
+        range->iter->Seek(range->start);
+        RangeContext* ctx = range.get();
+        range->bth.run([this, ctx]() {
+            produce(ctx);
+        });
+    }
+}
+
+void ParallelSnapshotReader::stop() {
+    bthread_mutex_lock(&_mutex);
+    bool running = _running;
+    _running = false;
+    bthread_cond_broadcast(&_cond);
+    bthread_mutex_unlock(&_mutex);
+    if (!running) {
+        return;
+    }
+    for (auto& range : _ranges) {
+        range->bth.join();
+    }
+}
+
+void ParallelSnapshotReader::produce(RangeContext* range) {
+    rocksdb::Iterator* iter = range->iter.get();
+    butil::IOBuf block;
+    while (true) {
+        bthread_mutex_lock(&_mutex);
+        while (_running && range->buffered_bytes >= FLAGS_snapshot_prefetch_bytes) {
+            bthread_cond_wait(&_cond, &_mutex);
+        }
+        bool running = _running;
+        bthread_mutex_unlock(&_mutex);
+        if (!running) {
+            return;
+        }
+        // 格式与RocksdbReaderAdaptor::serialize_to_iobuf一致, 块内只有完整的kv
+        block.clear();
+        while (iter->Valid() && (int64_t)block.size() < FLAGS_snapshot_block_bytes) {
+            rocksdb::Slice key = iter->key();
+            rocksdb::Slice value = iter->value();
+            block.append((void*)&key.size_, sizeof(size_t));
+            block.append((void*)key.data_, key.size_);
+            block.append((void*)&value.size_, sizeof(size_t));
+            block.append((void*)value.data_, value.size_);
+            iter->Next();
+        }
+        bool done = !iter->Valid();
+        bool error = done && !iter->status().ok();
+        if (error) {
+            DB_FATAL("snapshot iterator fail, err: %s, region_id: %ld",
+                    iter->status().ToString().c_str(), _region_id);
+        }
+        bthread_mutex_lock(&_mutex);
+        if (!block.empty()) {
+            range->buffered_bytes += block.size();
+            range->blocks.push_back(block);
+        }
+        range->done = done;
+        _error = _error || error;
+        bthread_cond_broadcast(&_cond);
+        bthread_mutex_unlock(&_mutex);
+        if (done) {
+            return;
+        }
+    }
+}
+
+int64_t ParallelSnapshotReader::read(butil::IOBuf* out, size_t size) {
+    int64_t count = 0;
+    bthread_mutex_lock(&_mutex);
+    while ((size_t)count < size && _consume_idx < _ranges.size() && !_error) {
+        RangeContext* range = _ranges[_consume_idx].get();
+        if (!range->blocks.empty()) {
+            butil::IOBuf& block = range->blocks.front();
+            count += block.size();
+            range->buffered_bytes -= block.size();
+            if (out != nullptr) {
+                out->append(block);
+            }
+            range->blocks.pop_front();
+            bthread_cond_broadcast(&_cond);
+            continue;
+        }
+        if (range->done) {
+            ++_consume_idx;
+            continue;
+        }
+        bthread_cond_wait(&_cond, &_mutex);
+    }
+    bool error = _error;
+    bthread_mutex_unlock(&_mutex);
+    return error ? -1 : count;
+}
+
+bool ParallelSnapshotReader::done() {
+    BAIDU_SCOPED_LOCK(_mutex);
+    while (_consume_idx < _ranges.size() && _ranges[_consume_idx]->done
+            && _ranges[_consume_idx]->blocks.empty()) {
+        ++_consume_idx;
+    }
+    return _consume_idx >= _ranges.size();
+}
+
+static std::string dump_snapshot_transfer_progress(void*) {
+    return SnapshotTransferStat::get_instance()->dump();
+}
+
+SnapshotTransferStat::SnapshotTransferStat() :
+        _send_bytes("snapshot_send_bytes"),
+        _send_bytes_per_second("snapshot_send_bytes_second", &_send_bytes),
+        _progress_status("snapshot_transfer_progress", dump_snapshot_transfer_progress, nullptr) {
+    bthread_mutex_init(&_mutex, NULL);
+}
+
+void SnapshotTransferStat::start(int64_t region_id, int64_t total_bytes) {
+    BAIDU_SCOPED_LOCK(_mutex);
+    Progress& progress = _progress[region_id];
+    progress.total_bytes = total_bytes;
+    progress.sent_bytes = 0;
+    progress.cost.reset();
+}
+
+void SnapshotTransferStat::add(int64_t region_id, int64_t bytes) {
+    _send_bytes << bytes;
+    BAIDU_SCOPED_LOCK(_mutex);
+    auto iter = _progress.find(region_id);
+    if (iter != _progress.end()) {
+        iter->second.sent_bytes += bytes;
+    }
+}
+
+void SnapshotTransferStat::finish(int64_t region_id) {
+    BAIDU_SCOPED_LOCK(_mutex);
+    _progress.erase(region_id);
+}
+
+std::string SnapshotTransferStat::dump() {
+    std::ostringstream os;
+    BAIDU_SCOPED_LOCK(_mutex);
+    for (auto& pair : _progress) {
+        const Progress& progress = pair.second;
+        int64_t cost_us = std::max(progress.cost.get_time(), (int64_t)1);
+        int64_t bytes_per_second = progress.sent_bytes * 1000000 / cost_us;
+        // used_size是估算值, 发送量超过后不再给出剩余时间
+        int64_t remain = progress.total_bytes - progress.sent_bytes;
+        int64_t eta_s = -1;
+        if (remain >= 0 && bytes_per_second > 0) {
+            eta_s = remain / bytes_per_second;
+        }
+        os << "region_id:" << pair.first << " sent:" << progress.sent_bytes
+           << " total:" << progress.total_bytes << " bytes_per_second:" << bytes_per_second
+           << " eta_s:" << eta_s << "\n";
+    }
+    return os.str();
+}
+
 RocksdbReaderAdaptor::RocksdbReaderAdaptor(int64_t region_id,
                                             const std::string& path,
                                             RocksdbFileSystemAdaptor* rs,
@@ -78,11 +278,11 @@ ssize_t RocksdbReaderAdaptor::read(butil::IOPortal* portal, off_t offset, size_t
         return -1;
     }
 
+    if (!_is_meta_reader) {
+        return read_data(portal, offset, size);
+    }
     TimeCost time_cost;
-    IteratorContext* iter_context = _context->data_context;
-    if (_is_meta_reader) {
-        iter_context = _context->meta_context;
-    } 
+    IteratorContext* iter_context = _context->meta_context;
     if (offset < iter_context->offset) {
         iter_context->offset = 0;
         iter_context->iter->Seek(iter_context->prefix);
@@ -152,6 +352,50 @@ ssize_t RocksdbReaderAdaptor::read(butil::IOPortal* portal, off_t offset, size_t
     return count;
 }
 
+ssize_t RocksdbReaderAdaptor::read_data(butil::IOPortal* portal, off_t offset, size_t size) {
+    TimeCost time_cost;
+    IteratorContext* iter_context = _context->data_context;
+    // braft重试时从头重放, 块的切分是确定的, 跳过已发送的块即可对齐offset
+    if (offset < iter_context->offset || iter_context->parallel_reader == nullptr) {
+        iter_context->parallel_reader.reset(new ParallelSnapshotReader(
+                    _region_id, _context->snapshot, iter_context->boundaries));
+        iter_context->parallel_reader->start();
+        iter_context->offset = 0;
+        iter_context->done = false;
+    }
+    ParallelSnapshotReader* reader = iter_context->parallel_reader.get();
+    while (iter_context->offset < offset) {
+        int64_t skip = reader->read(nullptr, offset - iter_context->offset);
+        if (skip <= 0) {
+            DB_FATAL("region_id: %ld skip snapshot data fail, offset: %ld, ctx offset: %ld",
+                    _region_id, offset, iter_context->offset);
+            return -1;
+        }
+        iter_context->offset += skip;
+    }
+    if (iter_context->offset != offset) {
+        DB_FATAL("region_id: %ld snapshot offset not aligned, offset: %ld, ctx offset: %ld",
+                _region_id, offset, iter_context->offset);
+        return -1;
+    }
+    int64_t count = reader->read(portal, size);
+    if (count < 0) {
+        return -1;
+    }
+    iter_context->offset += count;
+    SnapshotTransferStat::get_instance()->add(_region_id, count);
+    if (reader->done()) {
+        iter_context->done = true;
+        SnapshotTransferStat::get_instance()->finish(_region_id);
+        DB_WARNING("region_id: %ld snapshot read over, total size: %ld",
+                _region_id, iter_context->offset);
+    }
+    snapshot_rate_limiter()->consume(count, FLAGS_snapshot_max_bytes_per_second);
+    DB_WARNING("region_id: %ld read done. count: %ld, ranges: %lu, time_cost: %ld",
+            _region_id, count, reader->range_count(), time_cost.get_time());
+    return count;
+}
+
 bool RocksdbReaderAdaptor::close() {
     if (_closed) {
         DB_WARNING("file has been closed, path: %s", _path.c_str());
@@ -226,6 +470,7 @@ ssize_t SstWriterAdaptor::write(const butil::IOBuf& data, off_t offset) {
         }
         _count++;
     }
+    snapshot_rate_limiter()->consume(data.size(), FLAGS_snapshot_max_bytes_per_second);
     DB_WARNING("rocksdb sst write, region_id: %ld, path: %s, offset: %lu, data.size: %ld,"
                 " keys size: %ld, total_count: %ld", _region_id, _path.c_str(), offset, data.size(),
                     keys.size(), _count);
@@ -393,6 +638,15 @@ braft::FileAdaptor* RocksdbFileSystemAdaptor::open_reader_adaptor(const std::str
         prefix = key.data();
         key.append_u64(UINT64_MAX);
         upper_bound = key.data();
+        // 索引布局的数据不在region_id前缀下, 按region区间发送
+        auto region = Store::get_instance()->get_region(_region_id);
+        if (region != nullptr) {
+            pb::RegionInfo region_info;
+            region->get_region_info(region_info);
+            if (region_info.index_key_layout()) {
+                region_data_range(region_info, &prefix, &upper_bound);
+            }
+        }
 
     } else {
         len -= SNAPSHOT_META_FILE.size();
@@ -420,13 +674,15 @@ braft::FileAdaptor* RocksdbFileSystemAdaptor::open_reader_adaptor(const std::str
             iter_context->is_meta_sst = false;
             iter_context->upper_bound = upper_bound;
             iter_context->upper_bound_slice = iter_context->upper_bound;
-            rocksdb::ReadOptions read_options;
-            read_options.snapshot = sc->snapshot;
-            read_options.total_order_seek = true;
-            read_options.iterate_upper_bound = &iter_context->upper_bound_slice;
-            rocksdb::ColumnFamilyHandle* column_family = RocksWrapper::get_instance()->get_data_handle();
-            iter_context->iter.reset(RocksWrapper::get_instance()->new_iterator(read_options, column_family));
-            iter_context->iter->Seek(prefix);
+            // 按sst采样切分区间, 由ParallelSnapshotReader在首次read时并发预读
+            iter_context->boundaries.push_back(prefix);
+            auto region = Store::get_instance()->get_region(_region_id);
+            if (region != nullptr) {
+                region->get_snapshot_range_keys(FLAGS_snapshot_read_parallel,
+                        prefix, upper_bound, iter_context->boundaries);
+                SnapshotTransferStat::get_instance()->start(_region_id, region->get_used_size());
+            }
+            iter_context->boundaries.push_back(upper_bound);
             sc->data_context = iter_context;
         }
     }
@@ -512,7 +768,7 @@ bool RocksdbFileSystemAdaptor::open_snapshot(const std::string& path) {
     DB_WARNING("region_id: %ld get region success", _region_id);
     region->lock_commit_meta_mutex();
     DB_WARNING("region_id: %ld get lock before open snapshot", _region_id);
-    _snapshots[path].first.reset(new SnapshotContext());
+    _snapshots[path].first.reset(new SnapshotContext(_region_id));
     region = Store::get_instance()->get_region(_region_id);
     region->unlock_commit_meta_mutex();
     DB_WARNING("region_id: %ld relase lock before open snapshot", _region_id);
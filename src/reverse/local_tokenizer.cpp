@@ -0,0 +1,296 @@
+// Copyright (c) 2018-present Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "local_tokenizer.h"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include "common.h"
+
+namespace baikaldb {
+
+void TermBuffer::to_term_map(std::map<std::string, float>& term_map) const {
+    for (auto& term : terms) {
+        term_map[std::string(arena.data() + term.first, term.second)] += 1;
+    }
+}
+
+int NgramTokenizer::tokenize(const std::string& word, TermBuffer& buf) {
+    if (word.empty()) {
+        return 0;
+    }
+    std::string& text = buf.text;
+    text.assign(word);
+    uint32_t size = text.size();
+    uint32_t slow_pos = 0;
+    uint32_t fast_pos = 0;
+    uint32_t i = 0;
+    for (uint32_t j = 0; i < size && j < _word_count; i++, j++) {
+        if ((text[i] & 0x80) != 0) {
+            i++;
+        } else {
+            text[i] = ::tolower(text[i]);
+        }
+    }
+    if (i >= size) {
+        buf.add(text.data(), size);
+        return 0;
+    }
+    fast_pos = i;
+    if (!is_punctuation(text.data(), fast_pos)) {
+        buf.add(text.data(), fast_pos);
+    }
+    while (fast_pos < size) {
+        if ((text[slow_pos] & 0x80) != 0) {
+            slow_pos++;
+        } else {
+            text[slow_pos] = ::tolower(text[slow_pos]);
+        }
+        slow_pos++;
+        // 历史实现此处转换的是slow_pos处的字符, 保持一致
+        if ((text[fast_pos] & 0x80) != 0) {
+            fast_pos++;
+        } else {
+            text[slow_pos] = ::tolower(text[slow_pos]);
+        }
+        fast_pos++;
+        uint32_t len = std::min(fast_pos, size) - slow_pos;
+        if (is_punctuation(text.data() + slow_pos, len)) {
+            continue;
+        }
+        buf.add(text.data() + slow_pos, len);
+    }
+    return 0;
+}
+
+int EsStandardTokenizer::tokenize(const std::string& word, TermBuffer& buf) {
+    if (word.empty()) {
+        return 0;
+    }
+    std::string& term = buf.text;
+    term.clear();
+    bool is_word = false;
+    bool is_num = false;
+    bool has_point = false;
+    for (size_t i = 0; i < word.size(); i++) {
+        char now = 0;
+        if ((word[i] & 0x80) != 0) {
+            auto iter = _q2b->end();
+            if (i + 1 < word.size()) {
+                iter = _q2b->find(gbk_code(word.data() + i));
+            }
+            if (iter == _q2b->end()) {
+                // 汉字单字成词, 同时结束当前的英文或数字
+                buf.add(word.data() + i, std::min<size_t>(2, word.size() - i));
+                i++;
+                if (!term.empty()) {
+                    buf.add(term.data(), term.size());
+                    term.clear();
+                }
+                is_word = false;
+                is_num = false;
+                has_point = false;
+                continue;
+            }
+            i++;
+            now = iter->second;
+        } else {
+            now = ::tolower(word[i]);
+        }
+        if (!term.empty()) {
+            if (is_word && islower(now)) {
+                term += now;
+            } else if (is_num && isdigit(now)) {
+                term += now;
+            } else if (is_num && !has_point && now == '.') {
+                term += now;
+                has_point = true;
+            } else {
+                buf.add(term.data(), term.size());
+                is_word = false;
+                is_num = false;
+                has_point = false;
+                term.clear();
+            }
+        }
+        if (term.empty()) {
+            if (islower(now)) {
+                term += now;
+                is_word = true;
+            } else if (isdigit(now)) {
+                term += now;
+                is_num = true;
+            }
+        }
+    }
+    if (!term.empty()) {
+        buf.add(term.data(), term.size());
+    }
+    return 0;
+}
+
+int DictTokenizer::load(const std::string& path) {
+    std::ifstream fp(path);
+    if (!fp.is_open()) {
+        DB_WARNING("open dict:%s failed", path.c_str());
+        return -1;
+    }
+    std::vector<std::pair<std::string, double>> words;
+    double total = 0;
+    double min_freq = 0;
+    while (fp.good()) {
+        std::string line;
+        std::getline(fp, line);
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        auto pos = line.find_first_of("\t ");
+        std::string word = line.substr(0, pos);
+        if (word.empty()) {
+            continue;
+        }
+        double freq = 1;
+        if (pos != std::string::npos) {
+            freq = strtod(line.c_str() + pos + 1, nullptr);
+        }
+        if (freq <= 0) {
+            freq = 1;
+        }
+        total += freq;
+        if (min_freq == 0 || freq < min_freq) {
+            min_freq = freq;
+        }
+        words.emplace_back(word, freq);
+    }
+    if (words.empty()) {
+        DB_WARNING("dict:%s is empty", path.c_str());
+        return -1;
+    }
+    for (auto& pair : words) {
+        add_word(pair.first, log(pair.second / total));
+    }
+    // 词典外的单字按最低词频计
+    _min_log_prob = log(min_freq / total);
+    DB_WARNING("load dict:%s success, word count:%lu, max word chars:%u",
+            path.c_str(), _word_count, _max_word_chars);
+    return 0;
+}
+
+void DictTokenizer::add_word(const std::string& word, double log_prob) {
+    // 词典只收录汉字词, 英文和数字在切词时整体成词
+    if (word.size() % 2 != 0) {
+        return;
+    }
+    for (size_t i = 0; i < word.size(); i += 2) {
+        if ((word[i] & 0x80) == 0) {
+            return;
+        }
+    }
+    int32_t node = 0;
+    for (size_t i = 0; i < word.size(); i += 2) {
+        uint64_t key = ((uint64_t)node << 16) | gbk_code(word.data() + i);
+        auto iter = _children.find(key);
+        if (iter == _children.end()) {
+            _nodes.emplace_back();
+            iter = _children.emplace(key, _nodes.size() - 1).first;
+        }
+        node = iter->second;
+    }
+    if (!_nodes[node].is_word) {
+        ++_word_count;
+    }
+    _nodes[node].is_word = true;
+    _nodes[node].log_prob = log_prob;
+    _max_word_chars = std::max(_max_word_chars, (uint32_t)word.size() / 2);
+}
+
+// 从后向前计算每个位置到结尾的最大对数概率, 再从前向后输出
+void DictTokenizer::segment_cjk(const char* text, const std::vector<uint32_t>& char_pos,
+        TermBuffer& buf) {
+    static thread_local std::vector<float> route;
+    static thread_local std::vector<uint32_t> next;
+    uint32_t char_count = char_pos.size() - 1;
+    route.resize(char_count + 1);
+    next.resize(char_count + 1);
+    route[char_count] = 0;
+    for (int64_t i = char_count - 1; i >= 0; --i) {
+        float best = _min_log_prob + route[i + 1];
+        uint32_t best_end = i + 1;
+        int32_t node = 0;
+        for (uint32_t j = i; j < char_count && j - i < _max_word_chars; ++j) {
+            node = child(node, gbk_code(text + char_pos[j]));
+            if (node < 0) {
+                break;
+            }
+            if (_nodes[node].is_word && _nodes[node].log_prob + route[j + 1] > best) {
+                best = _nodes[node].log_prob + route[j + 1];
+                best_end = j + 1;
+            }
+        }
+        route[i] = best;
+        next[i] = best_end;
+    }
+    for (uint32_t i = 0; i < char_count; i = next[i]) {
+        buf.add(text + char_pos[i], char_pos[next[i]] - char_pos[i]);
+    }
+}
+
+int DictTokenizer::tokenize(const std::string& word, TermBuffer& buf) {
+    if (word.empty()) {
+        return 0;
+    }
+    // 全角转半角, 转小写
+    std::string& text = buf.text;
+    text.clear();
+    for (size_t i = 0; i < word.size(); i++) {
+        if ((word[i] & 0x80) != 0 && i + 1 < word.size()) {
+            auto iter = _q2b->find(gbk_code(word.data() + i));
+            if (iter == _q2b->end()) {
+                text.append(word, i, 2);
+            } else if (iter->second != 0) {
+                text.append(1, ::tolower(iter->second));
+            }
+            i++;
+        } else if ((word[i] & 0x80) == 0) {
+            text.append(1, ::tolower(word[i]));
+        }
+    }
+    static thread_local std::vector<uint32_t> char_pos;
+    size_t i = 0;
+    while (i < text.size()) {
+        if ((text[i] & 0x80) != 0) {
+            char_pos.clear();
+            while (i < text.size() && (text[i] & 0x80) != 0) {
+                char_pos.push_back(i);
+                i += 2;
+            }
+            char_pos.push_back(i);
+            segment_cjk(text.data(), char_pos, buf);
+        } else if (isalnum(text[i])) {
+            size_t start = i;
+            while (i < text.size() && (text[i] & 0x80) == 0 && isalnum(text[i])) {
+                ++i;
+            }
+            buf.add(text.data() + start, i - start);
+        } else {
+            ++i;
+        }
+    }
+    return 0;
+}
+}
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
@@ -14,6 +14,7 @@
 
 #include "reverse_common.h"
 #include <cctype>
+#include <cstring>
 #include <fstream>
 #include <gflags/gflags.h>
 #include "proto/reverse.pb.h"
@@ -21,9 +22,26 @@ namespace baikaldb {
 DEFINE_string(q2b_utf8_path, "./conf/q2b_utf8.dic", "q2b_utf8_path");
 DEFINE_string(q2b_gbk_path, "./conf/q2b_gbk.dic", "q2b_gbk_path");
 DEFINE_string(punctuation_path, "./conf/punctuation.dic", "punctuation_path");
+DEFINE_bool(reverse_block_posting_list, false,
+        "write third level reverse list in block compressed format, "
+        "enable after all stores support reading it");
+DEFINE_int32(reverse_posting_block_size, 128, "node count of one reverse list block");
+DEFINE_string(local_seg_dict_path, "./conf/local_seg_gbk.dic", "dict of local cjk segmenter");
+DEFINE_bool(reverse_local_wordseg, false,
+        "segment wordrank/wordseg fulltext index by local dict segmenter instead of nlpc");
+DEFINE_int32(reverse_query_seg_cache_size, 10000, "query segment lru cache size");
+DEFINE_int32(reverse_segment_concurrency, 4, "segment concurrency of batch insert");
 
 std::atomic_long g_statistic_insert_key_num = {0};
 std::atomic_long g_statistic_delete_key_num = {0};
+Tokenizer::Tokenizer() {
+    memset(_punctuation_table, 0, sizeof(_punctuation_table));
+    _unigram.reset(new NgramTokenizer(1, _punctuation_table));
+    _bigram.reset(new NgramTokenizer(2, _punctuation_table));
+    _es_standard.reset(new EsStandardTokenizer(&_q2b_gbk_code));
+    _dict.reset(new DictTokenizer(&_q2b_gbk_code));
+}
+
 int Tokenizer::init() {
     {
         std::ifstream fp(FLAGS_punctuation_path);
@@ -50,6 +68,12 @@ int Tokenizer::init() {
             }
             _q2b_gbk[line.substr(0, pos)] = line.substr(pos + 1, 1);
         }
+        for (auto& pair : _q2b_gbk) {
+            if (pair.first.size() == 2) {
+                _q2b_gbk_code[gbk_code(pair.first.data())] = 
+                    pair.second.empty() ? 0 : pair.second[0];
+            }
+        }
     }
     {
         std::ifstream fp(FLAGS_q2b_utf8_path);
@@ -63,6 +87,19 @@ int Tokenizer::init() {
             _q2b_utf8[line.substr(0, pos)] = line.substr(pos + 1, 1);
         }
     }
+    for (auto& punctuation : _punctuation_blank) {
+        if (punctuation.size() == 1) {
+            _punctuation_table[(uint8_t)punctuation[0]] = true;
+        }
+    }
+    // 词典加载失败时不提供词典切词, 避免按单字切分写入与词典切词不一致的索引
+    if (_dict->load(FLAGS_local_seg_dict_path) == 0) {
+        _dict_loaded = true;
+    } else {
+        DB_WARNING("load local seg dict:%s fail, dict tokenizer disabled",
+                FLAGS_local_seg_dict_path.c_str());
+    }
+    _query_seg_cache.init(FLAGS_reverse_query_seg_cache_size);
     return 0;
 }
 
@@ -161,127 +198,107 @@ int Tokenizer::q2b_tolower_gbk(std::string& word) {
     return 0;
 }
 
-int Tokenizer::simple_seg_gbk(std::string word, uint32_t word_count, std::map<std::string, float>& term_map) {
-    if (word.empty()) {
-        return 0;
+int Tokenizer::local_segment(LocalTokenizer* tokenizer, const std::string& word,
+        std::map<std::string, float>& term_map) {
+    // tokenize不会切换bthread, 可以使用thread_local
+    static thread_local TermBuffer buf;
+    buf.clear();
+    int ret = tokenizer->tokenize(word, buf);
+    if (ret < 0) {
+        return ret;
     }
-    uint32_t slow_pos = 0;
-    uint32_t fast_pos = 0;
-    uint32_t i = 0;
-    for (uint32_t j = 0; i < word.size() && j < word_count; i++, j++) {
-        if ((word[i] & 0x80) != 0) {
-            i++;
-        } else {
-            if (isupper(word[i])) {
-                word[i] = ::tolower(word[i]);
+    buf.to_term_map(term_map);
+    return 0;
+}
+
+int Tokenizer::simple_seg_gbk(const std::string& word, uint32_t word_count, 
+        std::map<std::string, float>& term_map) {
+    if (word_count == 1) {
+        return local_segment(_unigram.get(), word, term_map);
+    } else if (word_count == 2) {
+        return local_segment(_bigram.get(), word, term_map);
+    }
+    NgramTokenizer tokenizer(word_count, _punctuation_table);
+    return local_segment(&tokenizer, word, term_map);
+}
+
+int Tokenizer::es_standard_gbk(const std::string& word, std::map<std::string, float>& term_map) {
+    return local_segment(_es_standard.get(), word, term_map);
+}
+
+LocalTokenizer* Tokenizer::get_local_tokenizer(pb::SegmentType segment_type) {
+    switch (segment_type) {
+        case pb::S_UNIGRAMS:
+            return _unigram.get();
+        case pb::S_BIGRAMS:
+            return _bigram.get();
+        case pb::S_ES_STANDARD:
+            return _es_standard.get();
+        case pb::S_WORDRANK:
+        case pb::S_WORDRANK_Q2B_ICASE:
+        case pb::S_WORDSEG_BASIC:
+#ifdef BAIDU_INTERNAL
+            if (!FLAGS_reverse_local_wordseg) {
+                return nullptr;
             }
-        }
+#endif
+            if (!_dict_loaded) {
+                return nullptr;
+            }
+            return _dict.get();
+        default:
+            return nullptr;
     }
-    if (i >= word.size()) {
+}
+
+bool Tokenizer::is_local_segment(pb::SegmentType segment_type) {
+    return get_local_tokenizer(segment_type) != nullptr;
+}
+
+int Tokenizer::segment(const std::string& word, pb::SegmentType segment_type,
+        std::map<std::string, float>& term_map) {
+    if (segment_type == pb::S_NO_SEGMENT) {
         term_map[word] = 0;
         return 0;
-    } else {
-        fast_pos = i;
-        std::string term = word.substr(slow_pos, fast_pos - slow_pos);
-        if (!_punctuation_blank.count(term) == 1) {
-            term_map[term] = 0;
-        }
     }
-    while (fast_pos < word.size()) {
-        if ((word[slow_pos] & 0x80) != 0) {
-            slow_pos++;
-        } else {
-            if (isupper(word[slow_pos])) {
-                word[slow_pos] = ::tolower(word[slow_pos]);
-            }
-        }
-        slow_pos++;
-        if ((word[fast_pos] & 0x80) != 0) {
-            fast_pos++;
-        } else {
-            if (isupper(word[slow_pos])) {
-                word[slow_pos] = ::tolower(word[slow_pos]);
-            }
-        }
-        fast_pos++;
-
-        std::string term = word.substr(slow_pos, fast_pos - slow_pos);
-        if (_punctuation_blank.count(term) == 1) {
-            continue;
-        }
-        auto it = term_map.find(term);
-        if (it == term_map.end()) {
-            term_map[term] = 0;
-        } 
+    LocalTokenizer* tokenizer = get_local_tokenizer(segment_type);
+    if (tokenizer != nullptr) {
+        return local_segment(tokenizer, word, term_map);
+    }
+    switch (segment_type) {
+#ifdef BAIDU_INTERNAL
+        case pb::S_WORDRANK: 
+            return wordrank(word, term_map);
+        case pb::S_WORDRANK_Q2B_ICASE: 
+            return wordrank_q2b_icase(word, term_map);
+        case pb::S_WORDSEG_BASIC: 
+            return wordseg_basic(word, term_map);
+#endif
+        default:
+            DB_WARNING("un-support segment:%d", segment_type);
+            return -1;
     }
-    return 0;
 }
 
-int Tokenizer::es_standard_gbk(std::string word, std::map<std::string, float>& term_map) {
-    if (word.empty()) {
+int Tokenizer::segment_query(const std::string& word, pb::SegmentType segment_type,
+        std::map<std::string, float>& term_map) {
+    std::string sign_key = word;
+    sign_key.append(1, '\0');
+    sign_key.append(std::to_string(segment_type));
+    uint64_t key = make_sign(sign_key);
+    std::shared_ptr<std::map<std::string, float>> cache_term_map;
+    if (_query_seg_cache.find(key, &cache_term_map) == 0) {
+        term_map.insert(cache_term_map->begin(), cache_term_map->end());
         return 0;
     }
-    std::string term;
-    bool is_word = false;
-    bool is_num = false;
-    bool has_point = false;
-    for (uint32_t i = 0; i < word.size(); i++) {
-        std::string now;
-        if ((word[i] & 0x80) != 0) {
-            now = word.substr(i, 2);
-            i++;
-            if (_q2b_gbk.count(now) == 1) {
-                now = _q2b_gbk[now];
-            } else {
-                term_map[now] = 0;
-                if (term.size() > 0) {
-                    term_map[term] = 0;
-                    term.clear();
-                }
-                is_word = false;
-                is_num = false;
-                has_point = false;
-                continue;
-            }
-        } else {
-            if (isupper(word[i])) {
-                word[i] = ::tolower(word[i]);
-            }
-            now = word[i];
-        }
-        if (!term.empty()) {
-            if (is_word && islower(now[0])) {
-                term += now;
-            } else if (is_num && isdigit(now[0])) {
-                term += now;
-            } else if (is_num && !has_point && now == ".") {
-                term += now;
-                has_point = true;
-            } else {
-                term_map[term] = 0;
-                is_word = false;
-                is_num = false;
-                has_point = false;
-                term.clear();
-            }
-        }
-        if (term.empty()) {
-            if (islower(now[0])) {
-                term += now;
-                is_word = true;
-            } else if (isdigit(now[0])) {
-                term += now;
-                is_num = true;
-            }
-        }
-    }
-    if (!term.empty()) {
-        term_map[term] = 0;
+    int ret = segment(word, segment_type, term_map);
+    if (ret < 0) {
+        return ret;
     }
+    _query_seg_cache.add(key, std::make_shared<std::map<std::string, float>>(term_map));
     return 0;
 }
 
-
 void Tokenizer::split_str_gbk(const std::string& word, std::vector<std::string>& split_word, char delim) {
     if (word.empty()) {
         return;
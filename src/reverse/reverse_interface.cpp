@@ -14,6 +14,7 @@
 
 #include "reverse_interface.h"
 #include <fstream>
+#include <cmath>
 #include "proto/reverse.pb.h"
 #include "table_record.h"
 #include "rapidjson/rapidjson.h"
@@ -26,6 +27,10 @@
 #include "slot_ref.h"
 
 namespace baikaldb {
+DEFINE_bool(reverse_bm25_weight, false, "fulltext __weight use bm25 score");
+DEFINE_double(reverse_bm25_k1, 1.2, "bm25 k1");
+DEFINE_double(reverse_bm25_b, 0.75, "bm25 b");
+
 //--common interface
 int CommonSchema::segment(
                     const std::string& word, 
@@ -44,50 +49,84 @@ int CommonSchema::segment(
         return 0;
     }
     std::map<std::string, float> term_map;
-    int ret = 0;
-    switch (segment_type) {
-        case pb::S_NO_SEGMENT:
-            term_map[word] = 0;
-            break;
-        case pb::S_UNIGRAMS:
-            ret = Tokenizer::get_instance()->simple_seg_gbk(word, 1, term_map);
-            break;
-        case pb::S_BIGRAMS:
-            ret = Tokenizer::get_instance()->simple_seg_gbk(word, 2, term_map);
-            break;
-        case pb::S_ES_STANDARD:
-            ret = Tokenizer::get_instance()->es_standard_gbk(word, term_map);
-            break;
-#ifdef BAIDU_INTERNAL
-        case pb::S_WORDRANK: 
-            ret = Tokenizer::get_instance()->wordrank(word, term_map);
-            break;
-        case pb::S_WORDRANK_Q2B_ICASE: 
-            ret = Tokenizer::get_instance()->wordrank_q2b_icase(word, term_map);
-            break;
-        case pb::S_WORDSEG_BASIC: 
-            ret = Tokenizer::get_instance()->wordseg_basic(word, term_map);
-            break;
-#endif
-        default:
-            DB_WARNING("un-support segment:%d", segment_type);
-            ret = -1;
-            break;
-    }
+    int ret = Tokenizer::get_instance()->segment(word, segment_type, term_map);
     if (ret < 0) {
         DB_WARNING("[word:%s]segment error %d", word.c_str(), ret);
         return -1;
     }
+    //本地切词的value是词频, 其他切词是term权重
+    bool is_local_seg = Tokenizer::get_instance()->is_local_segment(segment_type);
     for (auto& pair : term_map) {
         ReverseNode node;
         node.set_key(pk);
         node.set_flag(flag);
-        node.set_weight(pair.second);
+        if (is_local_seg) {
+            node.set_weight(0);
+            node.set_tf(pair.second);
+        } else {
+            node.set_weight(pair.second);
+            node.set_tf(1);
+        }
+        node.set_doc_len(term_map.size());
         res[pair.first] = node;
     }
     return 0;
 }
 
+int64_t CommonSchema::term_df(const std::string& term) {
+    Parser* parser = get_term(term);
+    if (parser == nullptr) {
+        parser = new Parser(this);
+        _df_parsers.emplace_back(parser);
+        parser->init(term);
+    }
+    return parser->list_size();
+}
+
+float CommonSchema::init_bm25(ExecutorNode<CommonSchema>* node, 
+        int64_t doc_count, float avg_doc_len) {
+    if (node->_type == TERM) {
+        int64_t df = term_df(node->_term);
+        double n = std::max(doc_count, df);
+        float idf = log(1 + (n - df + 0.5) / (df + 0.5));
+        Bm25Arg* arg = new Bm25Arg(idf, avg_doc_len);
+        node->_arg = arg;
+        node->_upper_bound = arg->upper_bound();
+        return node->_upper_bound;
+    }
+    // 多个term的分数累加
+    if (node->_type == OR) {
+        node->_merge_func = CommonSchema::merge_and;
+    }
+    float upper_bound = 0;
+    for (auto sub_node : node->_sub_nodes) {
+        upper_bound += init_bm25(sub_node, doc_count, avg_doc_len);
+    }
+    node->_upper_bound = upper_bound;
+    return upper_bound;
+}
+
+void CommonSchema::create_wand_root(ExecutorNode<CommonSchema>* root) {
+    std::vector<ExecutorNode<CommonSchema>*> sub_nodes;
+    if (root->_type == OR) {
+        sub_nodes.swap(root->_sub_nodes);
+    } else {
+        auto sub_node = new ExecutorNode<CommonSchema>();
+        sub_node->_type = root->_type;
+        sub_node->_term = root->_term;
+        sub_node->_merge_func = root->_merge_func;
+        sub_node->_arg = root->_arg;
+        sub_node->_upper_bound = root->_upper_bound;
+        sub_node->_sub_nodes.swap(root->_sub_nodes);
+        root->_arg = nullptr;
+        sub_nodes.push_back(sub_node);
+    }
+    root->_type = WAND;
+    root->_topk = _topk;
+    root->_merge_func = FLAGS_reverse_bm25_weight ? CommonSchema::merge_and : CommonSchema::merge_or;
+    root->_sub_nodes.swap(sub_nodes);
+}
+
 int CommonSchema::create_executor(const std::string& search_data, pb::SegmentType segment_type) {
     _weight_field_id = get_field_id_by_name(_table_info.fields, "__weight");
     //segment
@@ -113,36 +152,7 @@ int CommonSchema::create_executor(const std::string& search_data, pb::SegmentTyp
     for (auto& or_item : or_search) {
         std::map<std::string, float> term_map;
         std::vector<std::string> and_terms;
-        int ret = 0;
-        switch (segment_type) {
-            case pb::S_NO_SEGMENT:
-                term_map[or_item] = 0;
-                break;
-            case pb::S_UNIGRAMS:
-                ret = Tokenizer::get_instance()->simple_seg_gbk(or_item, 1, term_map);
-                break;
-            case pb::S_BIGRAMS:
-                ret = Tokenizer::get_instance()->simple_seg_gbk(or_item, 2, term_map);
-                break;
-            case pb::S_ES_STANDARD:
-                ret = Tokenizer::get_instance()->es_standard_gbk(or_item, term_map);
-                break;
-#ifdef BAIDU_INTERNAL
-            case pb::S_WORDRANK: 
-                ret = Tokenizer::get_instance()->wordrank(or_item, term_map);
-                break;
-            case pb::S_WORDRANK_Q2B_ICASE: 
-                ret = Tokenizer::get_instance()->wordrank_q2b_icase(or_item, term_map);
-                break;
-            case pb::S_WORDSEG_BASIC: 
-                ret = Tokenizer::get_instance()->wordseg_basic(or_item, term_map);
-                break;
-#endif
-            default:
-                DB_WARNING("un-support segment:%d", segment_type);
-                ret = -1;
-                break;
-        }
+        int ret = Tokenizer::get_instance()->segment_query(or_item, segment_type, term_map);
         if (ret < 0) {
             DB_WARNING("[word:%s]segment error %d", or_item.c_str(), ret);
             return -1;
@@ -175,6 +185,17 @@ int CommonSchema::create_executor(const std::string& search_data, pb::SegmentTyp
     }
     _statistic.segment_time += timer.get_time();
     timer.reset();
+    if (FLAGS_reverse_bm25_weight) {
+        // term节点需要拷贝后改写weight
+        executor_type = NODE_COPY;
+        int64_t doc_count = 0;
+        float avg_doc_len = 0;
+        _reverse->get_doc_stat(&doc_count, &avg_doc_len);
+        init_bm25(root, doc_count, avg_doc_len);
+    }
+    if (_topk > 0) {
+        create_wand_root(root);
+    }
     _exe = logical_query.create_executor();
     _statistic.create_exe_time += timer.get_time();
     return 0;
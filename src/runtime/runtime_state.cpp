@@ -18,6 +18,7 @@
 #include "network_socket.h"
 
 namespace baikaldb {
+DEFINE_int64(query_memory_quota, 0, "max memory(bytes) a query may hold on baikaldb, 0 means unlimited");
 
 RuntimeState::~RuntimeState() {}
 
@@ -39,6 +40,7 @@ int RuntimeState::init(const pb::StoreReq& req,
     }
     _region_id = req.region_id();
     _region_version = req.region_version();
+    ttl_timestamp_us = req.ttl_timestamp_us();
     if (req.has_not_check_region()) {
         _need_check_region = !req.not_check_region();
     }
@@ -89,6 +91,10 @@ int RuntimeState::init(QueryContext* ctx, DataBuffer* send_buf) {
     }
     txn_id = _client_conn->txn_id;
     _log_id = ctx->stat_info.log_id;
+    batched_stmt_rows = ctx->batched_stmt_rows;
+    batched_insert_ids = ctx->batched_insert_ids;
+    _memory_limit = FLAGS_query_memory_quota;
+    _memory_used = 0;
     return 0;
 }
 
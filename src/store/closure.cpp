@@ -184,4 +184,18 @@ void Dml1pcClosure::Run() {
     txn_cond.decrease_signal();
     delete this;
 }
+
+void DMLBatchClosure::Run() {
+    for (auto c : closures) {
+        if (!status().ok()) {
+            c->status() = status();
+        } else if (batch_response.has_errcode()) {
+            // 整条日志执行失败(如解析失败)
+            c->response->set_errcode(batch_response.errcode());
+            c->response->set_errmsg(batch_response.errmsg());
+        }
+        c->Run();
+    }
+    delete this;
+}
 } // end of namespace
@@ -14,6 +14,7 @@
 
 #include "region.h"
 #include <algorithm>
+#include <mutex>
 #include <boost/filesystem.hpp>
 #include "table_key.h"
 #include "runtime_state.h"
@@ -24,15 +25,25 @@
 #include "log_entry_reader.h"
 #include "raft_log_compaction_filter.h"
 #include "split_compaction_filter.h"
+#include "split_key_collector.h"
+#include "ttl_value.h"
+#include "sst_file_writer.h"
 #include "rpc_sender.h"
 #include "concurrency.h"
 #include "store.h"
 #include "closure.h"
+#include "parallel_apply.h"
 #include "rapidjson/rapidjson.h"
 
 namespace baikaldb {
 DEFINE_int32(election_timeout_ms, 1000, "raft election timeout(ms)");
 DEFINE_int32(skew, 5, "split skew, default : 45% - 55%");
+DEFINE_bool(split_key_from_sst, true, "choose split key from sst sampled keys instead of scan");
+DEFINE_int32(split_min_sample_count, 16, "min sampled keys to choose split key from sst");
+DEFINE_bool(split_copy_by_sst, true, "copy data to new region by writing and ingesting sst when split");
+DEFINE_string(split_sst_path, "./split_sst", "tmp path of sst files written when split");
+DEFINE_int32(split_copy_concurrency, 5, "concurrent copy tasks of one split");
+DEFINE_int32(split_copy_partitions, 4, "partitions of primary key range copied in parallel when split");
 DEFINE_int32(reverse_level2_len, 5000, "reverse index level2 length, default : 5000");
 DEFINE_string(log_uri, "myraftlog://my_raft_log?id=", "raft log uri");
 DEFINE_string(stable_uri, "local://./raft_data/stable", "raft stable path");
@@ -46,9 +57,23 @@ DEFINE_int32(snapshot_timed_wait, 120 * 1000 * 1000LL, "snapshot timed wait defa
 DEFINE_int64(snapshot_diff_lines, 10000, "save_snapshot when num_table_lines diff");
 DEFINE_int64(snapshot_diff_logs, 2000, "save_snapshot when log entries diff");
 DEFINE_int64(snapshot_log_exec_time_s, 60, "save_snapshot when log entries apply time");
+DEFINE_int64(snapshot_follower_lag_logs, 100000,
+        "postpone snapshot while a follower lags within this many logs, 0 means never postpone");
+DEFINE_int64(snapshot_max_postpone_s, 600, "max time(s) to postpone snapshot for lagging follower");
 //分裂判断标准，如果3600S没有收到请求，则认为分裂失败
 DEFINE_int64(split_duration_us, 3600 * 1000 * 1000LL, "split duration time : 3600s");
 DEFINE_int64(compact_delete_lines, 200000, "compact when _num_delete_lines > compact_delete_lines");
+DEFINE_int64(heartbeat_size_change_percent, 10,
+        "report leader region in delta heartbeat when lines or used size changed by this percent");
+DEFINE_int64(snapshot_load_overlap_wait_s, 60,
+        "max wait time(s) for overlapped region released when load snapshot of index key layout");
+DEFINE_bool(dml_batch_propose, false, 
+        "leader merges concurrent 1pc dml into one raft log, enable after all stores support OP_DML_BATCH");
+DEFINE_int32(dml_batch_max_size, 64, "max 1pc dml requests merged into one raft log");
+DEFINE_int32(apply_parallel_window, 0, 
+        "log entries decoded together in on_apply, disjoint inserts among them applied in parallel; "
+        "<=1 means serial apply");
+DEFINE_int32(apply_parallel_concurrency, 8, "concurrent bthreads of parallel apply in one region");
 DECLARE_int64(print_time_us);
 
 //const size_t  Region::REGION_MIN_KEY_SIZE = sizeof(int64_t) * 2 + sizeof(uint8_t);
@@ -189,6 +214,12 @@ int Region::init(bool new_region, int32_t snapshot_times) {
                                 boost::lexical_cast<std::string>(_region_id);
     options.snapshot_file_system_adaptor = &_snapshot_adaptor;
     _txn_pool.init(_region_id);
+    if (bthread::execution_queue_start(&_dml_batch_queue_id, nullptr, 
+                dml_batch_propose, (void*)this) != 0) {
+        DB_FATAL("start dml batch queue fail, region_id: %ld", _region_id);
+        return -1;
+    }
+    _dml_batch_queue_started = true;
     if (_node.init(options) != 0) {
         DB_FATAL("raft node init fail, region_id: %ld, region_info:%s", 
                  _region_id, pb2json(_region_info).c_str());
@@ -589,6 +620,11 @@ void Region::exec_in_txn_query(google::protobuf::RpcController* controller,
             pb::TransactionInfo* prepare_txn = prepare_req.mutable_txn_infos(0);
             prepare_txn->clear_cache_plans();
             prepare_txn->set_start_seq_id(1);
+            // follower重放cache plan时使用leader事务的时间判断过期
+            if (use_ttl()) {
+                prepare_req.set_ttl_timestamp_us(txn != nullptr ?
+                        txn->ttl_timestamp_us() : butil::gettimeofday_us());
+            }
 
             // packet all cmd (starting from BEGIN) of this txn and send to raft log entry
             int cur_seq_id = 0;
@@ -708,6 +744,10 @@ void Region::exec_out_txn_query(google::protobuf::RpcController* controller,
                             request->region_version(), _region_info.version());
                 return;
             }
+            // ttl表判断过期和计算过期时间使用leader的时间, 随raft日志同步到各副本
+            if (use_ttl()) {
+                const_cast<pb::StoreReq*>(request)->set_ttl_timestamp_us(butil::gettimeofday_us());
+            }
 
             if ((op_type == pb::OP_INSERT 
                     || op_type == pb::OP_DELETE
@@ -715,6 +755,25 @@ void Region::exec_out_txn_query(google::protobuf::RpcController* controller,
                     && _storage_compute_separate) {
                 //计算存储分离
                 exec_dml_out_txn_query(request, response, done_guard.release());
+            } else if (FLAGS_dml_batch_propose && op_type != pb::OP_KILL 
+                    && op_type != pb::OP_TRUNCATE_TABLE) {
+                // 并发的1pc dml由队列合并为一条raft日志
+                DMLClosure* c = new DMLClosure;
+                c->cost.reset();
+                c->op_type = op_type;
+                c->cntl = cntl;
+                c->response = response;
+                c->done = done_guard.release();
+                c->region = this;
+                c->remote_side = remote_side;
+                DMLBatchTask task;
+                task.request = request;
+                task.closure = c;
+                auto_decrease.release();
+                if (bthread::execution_queue_execute(_dml_batch_queue_id, task) != 0) {
+                    std::vector<DMLBatchTask> tasks(1, task);
+                    propose_dml_batch(tasks);
+                }
             } else {
                 butil::IOBuf data;
                 butil::IOBufAsZeroCopyOutputStream wrapper(&data);
@@ -811,6 +870,10 @@ void Region::exec_dml_out_txn_query(const pb::StoreReq* request,
         root->close(&state);
         ExecNode::destroy_tree(root);
         response->set_errcode(pb::EXEC_FAIL);
+        if (state.error_code == ER_ERROR_FIRST && txn != nullptr && txn->is_deadlock()) {
+            state.error_code = ER_LOCK_DEADLOCK;
+            state.error_msg << "Deadlock found when trying to get lock; try restarting transaction";
+        }
         if (state.error_code != ER_ERROR_FIRST) {
             response->set_mysql_errcode(state.error_code);
             response->set_errmsg(state.error_msg.str());
@@ -1117,6 +1180,8 @@ void Region::dml_2pc(const pb::StoreReq& request,
         DB_FATAL("RuntimeState init fail, region_id: %ld, txn_id: %lu", _region_id, txn_id);
         return;
     }
+    // follower在apply中重放cache plan, 不做死锁检测
+    state.deadlock_detect = (applied_index == 0);
     _state_pool.set(db_conn_id, state_ptr);
     ON_SCOPE_EXIT(([this, db_conn_id]() {
         _state_pool.remove(db_conn_id);
@@ -1146,6 +1211,10 @@ void Region::dml_2pc(const pb::StoreReq& request,
         if (txn != nullptr) {
             txn->err_code = pb::EXEC_FAIL;
         }
+        if (state.error_code == ER_ERROR_FIRST && txn != nullptr && txn->is_deadlock()) {
+            state.error_code = ER_LOCK_DEADLOCK;
+            state.error_msg << "Deadlock found when trying to get lock; try restarting transaction";
+        }
         if (state.error_code != ER_ERROR_FIRST) {
             response.set_mysql_errcode(state.error_code);
             response.set_errmsg(state.error_msg.str());
@@ -1259,6 +1328,10 @@ void Region::dml_2pc(const pb::StoreReq& request,
     }
     int64_t dml_cost = cost.get_time();
     Store::get_instance()->dml_time_cost << dml_cost;
+    _load_stat.add_write(dml_cost);
+    if (txn != nullptr) {
+        _load_stat.sample_key(txn->first_primary_key);
+    }
     //if (dml_cost > FLAGS_print_time_us ||
     //    op_type == pb::OP_COMMIT ||
     //    op_type == pb::OP_ROLLBACK ||
@@ -1311,6 +1384,7 @@ void Region::dml_1pc(const pb::StoreReq& request, pb::OpType op_type,
                     _region_id, applied_index);
         return;
     }
+    state.deadlock_detect = false;
     _state_pool.set(db_conn_id, state_ptr);
     ON_SCOPE_EXIT(([this, db_conn_id]() {
         _state_pool.remove(db_conn_id);
@@ -1341,46 +1415,10 @@ void Region::dml_1pc(const pb::StoreReq& request, pb::OpType op_type,
     int64_t tmp_num_table_lines = _num_table_lines;
     if (plan.nodes_size() > 0) {
         // for single-region autocommit and force-1pc cmd, exec the real dml cmd
-        {
-            BAIDU_SCOPED_LOCK(_reverse_index_map_lock);
-            state.set_reverse_index_map(_reverse_index_map);
-        }
-        ExecNode* root = nullptr;
-        ret = ExecNode::create_tree(plan, &root);
+        ret = exec_dml_plan(state, plan, response, applied_index);
         if (ret < 0) {
-            ExecNode::destroy_tree(root);
-            response.set_errcode(pb::EXEC_FAIL);
-            response.set_errmsg("create plan fail");
-            DB_FATAL("create plan fail, region_id: %ld, txn_id: %lu:%d, applied_index: %ld", 
-                _region_id, state.txn_id, state.seq_id, applied_index);
             return;
         }
-        ret = root->open(&state);
-        if (ret < 0) {
-            root->close(&state);
-            ExecNode::destroy_tree(root);
-            response.set_errcode(pb::EXEC_FAIL);
-            if (state.error_code != ER_ERROR_FIRST) {
-                response.set_mysql_errcode(state.error_code);
-                response.set_errmsg(state.error_msg.str());
-            } else {
-                response.set_errmsg("plan open fail");
-            }
-            if (state.error_code == ER_DUP_ENTRY) {
-                DB_WARNING("plan open fail, region_id: %ld, txn_id: %lu:%d, "
-                        "applied_index: %ld, error_code: %d, mysql_errcode:%d", 
-                        _region_id, state.txn_id, state.seq_id, applied_index, 
-                        state.error_code, state.error_code);
-            } else {
-                DB_FATAL("plan open fail, region_id: %ld, txn_id: %lu:%d, "
-                        "applied_index: %ld, error_code: %d, mysql_errcode:%d", 
-                        _region_id, state.txn_id, state.seq_id, applied_index, 
-                        state.error_code, state.error_code);
-            }
-            return;
-        }
-        root->close(&state);
-        ExecNode::destroy_tree(root);
     }
     if (op_type != pb::OP_TRUNCATE_TABLE) {
         txn->num_increase_rows += state.num_increase_rows();
@@ -1397,86 +1435,313 @@ void Region::dml_1pc(const pb::StoreReq& request, pb::OpType op_type,
     }
     int64_t txn_num_increase_rows = txn->num_increase_rows;
     tmp_num_table_lines += txn_num_increase_rows;
+    commit_succ = (commit_dml_txn(txn, state.txn_id, tmp_num_table_lines, 
+                txn_num_increase_rows, applied_index) == 0);
+    if (commit_succ) {
+        response.set_affected_rows(ret);
+        response.set_errcode(pb::SUCCESS);
+    } else {
+        response.set_errcode(pb::EXEC_FAIL);
+        response.set_errmsg("txn commit failed.");
+    }
+    if (state.txn_id != 0 && 
+            (op_type == pb::OP_INSERT || op_type == pb::OP_DELETE || op_type == pb::OP_UPDATE)) {
+       update_average_cost(cost.get_time());  
+    }
+    int64_t dml_cost = cost.get_time();
+    Store::get_instance()->dml_time_cost << dml_cost;
+    _load_stat.add_write(dml_cost);
+    if (txn != nullptr) {
+        _load_stat.sample_key(txn->first_primary_key);
+    }
+    if (dml_cost > FLAGS_print_time_us ||
+        op_type == pb::OP_COMMIT ||
+        op_type == pb::OP_ROLLBACK ||
+        op_type == pb::OP_PREPARE || 
+        op_type == pb::OP_PREPARE_V2) {
+        DB_NOTICE("dml type: %s, time_cost:%ld, region_id: %ld, txn_id: %lu, num_table_lines:%ld, "
+                  "affected_rows:%d, applied_index:%ld, term:%d, txn_num_rows:%ld,"
+                  " average_cost: %ld, log_id:%lu, wait_cost:%ld", 
+                pb::OpType_Name(op_type).c_str(), cost.get_time(), _region_id, 
+                state.txn_id, _num_table_lines.load(), ret, applied_index, term, 
+                txn_num_increase_rows, _average_cost.load(), state.log_id(), wait_cost);
+    }
+}
+
+// 1pc dml的执行结果写回请求的response
+static void set_dml_response(const pb::StoreRes& res, pb::StoreRes* response) {
+    response->set_errcode(res.errcode());
+    if (res.has_errmsg()) {
+        response->set_errmsg(res.errmsg());
+    }
+    if (res.has_mysql_errcode()) {
+        response->set_mysql_errcode(res.mysql_errcode());
+    }
+    if (res.has_leader()) {
+        response->set_leader(res.leader());
+    }
+    if (res.has_affected_rows()) {
+        response->set_affected_rows(res.affected_rows());
+    }
+}
+
+int Region::commit_dml_txn(SmartTransaction txn, uint64_t txn_id, int64_t num_table_lines, 
+        int64_t num_increase_rows, int64_t applied_index) {
     //老的insert update delete接口
-    if (state.txn_id == 0) {
-        txn->put_meta_info(_meta_writer->applied_index_key(_region_id), _meta_writer->encode_applied_index(applied_index));
-        txn->put_meta_info(_meta_writer->num_table_lines_key(_region_id), _meta_writer->encode_num_table_lines(tmp_num_table_lines));
-        //DB_WARNING("write meta info when dml_1pc,"
-        //            " region_id: %ld, num_table_line: %ld, applied_index: %ld", 
-        //            _region_id, tmp_num_table_lines, applied_index);
-    }
-    if (state.txn_id != 0) {
+    if (txn_id == 0) {
+        txn->put_meta_info(_meta_writer->applied_index_key(_region_id), 
+                           _meta_writer->encode_applied_index(applied_index));
+        txn->put_meta_info(_meta_writer->num_table_lines_key(_region_id), 
+                           _meta_writer->encode_num_table_lines(num_table_lines));
+    } else {
         // pre_commit 与 commit 之间不能open snapshot
         bthread_mutex_lock(&_commit_meta_mutex);
-        _meta_writer->write_pre_commit(_region_id, state.txn_id, tmp_num_table_lines, applied_index); 
-        //DB_WARNING("region_id: %ld lock and write_pre_commit success,"
-        //            " num_table_lines: %ld, applied_index: %ld , txn_id: %lu",
-        //            _region_id, tmp_num_table_lines, _applied_index, state.txn_id);
+        _meta_writer->write_pre_commit(_region_id, txn_id, num_table_lines, applied_index); 
     }
-    uint64_t txn_id = state.txn_id;
-    ON_SCOPE_EXIT(([this, txn_id, tmp_num_table_lines, applied_index]() {
+    ON_SCOPE_EXIT(([this, txn_id]() {
         if (txn_id != 0) {
-            //DB_WARNING("region_id: %ld release commit meta mutex, "
-            //    " num_table_lines: %ld, applied_index: %ld , txn_id: %lu",
-            //    _region_id, tmp_num_table_lines, applied_index, txn_id);
             bthread_mutex_unlock(&_commit_meta_mutex); 
         }        
     }));
+    bool commit_succ = false;
     auto res = txn->commit();
     if (res.ok()) {
         commit_succ = true;
     } else if (res.IsExpired()) {
         DB_WARNING("txn expired, region_id: %ld, txn_id: %lu, applied_index: %ld", 
-                    _region_id, state.txn_id, applied_index);
-        commit_succ = false;
+                    _region_id, txn_id, applied_index);
     } else {
         DB_WARNING("unknown error: region_id: %ld, txn_id: %lu, errcode:%d, msg:%s", 
-            _region_id, state.txn_id, res.code(), res.ToString().c_str());
-        commit_succ = false;
+            _region_id, txn_id, res.code(), res.ToString().c_str());
     }
     if (commit_succ) {
-        if (txn_num_increase_rows < 0) {
-            _num_delete_lines -= txn_num_increase_rows;
+        if (num_increase_rows < 0) {
+            _num_delete_lines -= num_increase_rows;
         }
-        _num_table_lines = tmp_num_table_lines;
-        response.set_affected_rows(ret);
-        response.set_errcode(pb::SUCCESS);
+        _num_table_lines = num_table_lines;
     } else {
-        response.set_errcode(pb::EXEC_FAIL);
-        response.set_errmsg("txn commit failed.");
         DB_FATAL("txn commit failed, region_id: %ld, txn_id: %lu, applied_index: %ld", 
-                    _region_id, state.txn_id, applied_index);
+                    _region_id, txn_id, applied_index);
     }
-    if (state.txn_id != 0) {
-        auto ret = _meta_writer->write_meta_after_commit(_region_id, _num_table_lines, applied_index, state.txn_id);
-        //DB_WARNING("write meta info wheen commit"
-        //            " region_id: %ld, applied_index: %ld, num_table_line: %ld, txn_id: %lu", 
-        //            _region_id, applied_index, _num_table_lines.load(), state.txn_id); 
+    if (txn_id != 0) {
+        auto ret = _meta_writer->write_meta_after_commit(_region_id, _num_table_lines, 
+                applied_index, txn_id);
         if (ret < 0) {
             DB_FATAL("Write Metainfo fail, region_id: %ld, txn_id: %lu, log_index: %ld", 
-                        _region_id, state.txn_id, applied_index);
+                        _region_id, txn_id, applied_index);
         }
     }
-    if (state.txn_id != 0 && 
-            (op_type == pb::OP_INSERT || op_type == pb::OP_DELETE || op_type == pb::OP_UPDATE)) {
-       update_average_cost(cost.get_time());  
+    return commit_succ ? 0 : -1;
+}
+
+int Region::exec_dml_plan(RuntimeState& state, const pb::Plan& plan, 
+        pb::StoreRes& response, int64_t applied_index) {
+    {
+        BAIDU_SCOPED_LOCK(_reverse_index_map_lock);
+        state.set_reverse_index_map(_reverse_index_map);
+    }
+    auto txn = state.txn();
+    ExecNode* root = nullptr;
+    int ret = ExecNode::create_tree(plan, &root);
+    if (ret < 0) {
+        ExecNode::destroy_tree(root);
+        response.set_errcode(pb::EXEC_FAIL);
+        response.set_errmsg("create plan fail");
+        DB_FATAL("create plan fail, region_id: %ld, txn_id: %lu:%d, applied_index: %ld", 
+            _region_id, state.txn_id, state.seq_id, applied_index);
+        return -1;
+    }
+    ret = root->open(&state);
+    if (ret < 0) {
+        root->close(&state);
+        ExecNode::destroy_tree(root);
+        response.set_errcode(pb::EXEC_FAIL);
+        if (state.error_code == ER_ERROR_FIRST && txn != nullptr && txn->is_deadlock()) {
+            state.error_code = ER_LOCK_DEADLOCK;
+            state.error_msg << "Deadlock found when trying to get lock; try restarting transaction";
+        }
+        if (state.error_code != ER_ERROR_FIRST) {
+            response.set_mysql_errcode(state.error_code);
+            response.set_errmsg(state.error_msg.str());
+        } else {
+            response.set_errmsg("plan open fail");
+        }
+        if (state.error_code == ER_DUP_ENTRY) {
+            DB_WARNING("plan open fail, region_id: %ld, txn_id: %lu:%d, "
+                    "applied_index: %ld, error_code: %d, mysql_errcode:%d", 
+                    _region_id, state.txn_id, state.seq_id, applied_index, 
+                    state.error_code, state.error_code);
+        } else {
+            DB_FATAL("plan open fail, region_id: %ld, txn_id: %lu:%d, "
+                    "applied_index: %ld, error_code: %d, mysql_errcode:%d", 
+                    _region_id, state.txn_id, state.seq_id, applied_index, 
+                    state.error_code, state.error_code);
+        }
+        return -1;
+    }
+    root->close(&state);
+    ExecNode::destroy_tree(root);
+    return ret;
+}
+
+void Region::apply_dml_batch(const pb::StoreReq& request, braft::Closure* done,
+        int64_t applied_index, int64_t term) {
+    TimeCost cost;
+    Concurrency::get_instance()->service_write_concurrency.increase_wait();
+    ON_SCOPE_EXIT([]() {
+        Concurrency::get_instance()->service_write_concurrency.decrease_broadcast();
+    });
+    int batch_size = request.batch_reqs_size();
+    std::vector<pb::StoreRes> responses(batch_size);
+    std::vector<int> affected_rows(batch_size, -1);
+    SmartTransaction txn = nullptr;
+    for (int i = 0; i < batch_size; ++i) {
+        const pb::StoreReq& sub_req = request.batch_reqs(i);
+        pb::StoreRes& response = responses[i];
+        SmartState state_ptr = std::make_shared<RuntimeState>();
+        RuntimeState& state = *state_ptr;
+        {
+            BAIDU_SCOPED_LOCK(_ptr_mutex);
+            state.set_resource(_resource);
+        }
+        if (state.init(sub_req, sub_req.plan(), sub_req.tuples(), &_txn_pool, false) < 0) {
+            response.set_errcode(pb::EXEC_FAIL);
+            response.set_errmsg("RuntimeState init fail");
+            DB_FATAL("RuntimeState init fail, region_id: %ld, applied_index: %ld", 
+                    _region_id, applied_index);
+            continue;
+        }
+        state.deadlock_detect = false;
+        uint64_t db_conn_id = sub_req.db_conn_id();
+        if (db_conn_id == 0) {
+            db_conn_id = butil::fast_rand();
+        }
+        // 注册到state_pool, OP_KILL可以取消执行中的请求
+        _state_pool.set(db_conn_id, state_ptr);
+        ON_SCOPE_EXIT(([this, db_conn_id]() {
+            _state_pool.remove(db_conn_id);
+        }));
+        if (txn == nullptr) {
+            txn = state.create_txn_if_null();
+        } else {
+            state.set_txn(txn);
+        }
+        // 每个请求一个save point, 失败时只回滚该请求
+        int seq_id = i + 1;
+        txn->set_seq_id(seq_id);
+        txn->set_save_point();
+        int ret = 0;
+        if (sub_req.plan().nodes_size() > 0) {
+            ret = exec_dml_plan(state, sub_req.plan(), response, applied_index);
+        }
+        if (ret < 0) {
+            txn->rollback_to_point(seq_id);
+            continue;
+        }
+        txn->num_increase_rows += state.num_increase_rows();
+        affected_rows[i] = ret;
+    }
+    bool commit_succ = false;
+    int64_t txn_num_increase_rows = 0;
+    if (txn != nullptr) {
+        txn_num_increase_rows = txn->num_increase_rows;
+        commit_succ = (commit_dml_txn(txn, 0, _num_table_lines + txn_num_increase_rows, 
+                    txn_num_increase_rows, applied_index) == 0);
+        if (!commit_succ) {
+            txn->rollback();
+        }
+    } else {
+        _meta_writer->update_apply_index(_region_id, applied_index);
+    }
+    DMLBatchClosure* batch_done = (DMLBatchClosure*)done;
+    for (int i = 0; i < batch_size; ++i) {
+        pb::StoreRes& response = responses[i];
+        if (affected_rows[i] >= 0) {
+            if (commit_succ) {
+                response.set_errcode(pb::SUCCESS);
+                response.set_affected_rows(affected_rows[i]);
+            } else {
+                response.set_errcode(pb::EXEC_FAIL);
+                response.set_errmsg("txn commit failed.");
+            }
+        }
+        if (batch_done != nullptr && i < (int)batch_done->closures.size()) {
+            set_dml_response(response, batch_done->closures[i]->response);
+        }
     }
     int64_t dml_cost = cost.get_time();
     Store::get_instance()->dml_time_cost << dml_cost;
-    if (dml_cost > FLAGS_print_time_us ||
-        op_type == pb::OP_COMMIT ||
-        op_type == pb::OP_ROLLBACK ||
-        op_type == pb::OP_PREPARE || 
-        op_type == pb::OP_PREPARE_V2) {
-        DB_NOTICE("dml type: %s, time_cost:%ld, region_id: %ld, txn_id: %lu, num_table_lines:%ld, "
-                  "affected_rows:%d, applied_index:%ld, term:%d, txn_num_rows:%ld,"
-                  " average_cost: %ld, log_id:%lu, wait_cost:%ld", 
-                pb::OpType_Name(op_type).c_str(), cost.get_time(), _region_id, 
-                state.txn_id, _num_table_lines.load(), ret, applied_index, term, 
-                txn_num_increase_rows, _average_cost.load(), state.log_id(), wait_cost);
+    _load_stat.add_write(dml_cost);
+    if (txn != nullptr) {
+        _load_stat.sample_key(txn->first_primary_key);
+    }
+    if (dml_cost > FLAGS_print_time_us) {
+        DB_NOTICE("dml batch size: %d, time_cost:%ld, region_id: %ld, num_table_lines:%ld, "
+                  "applied_index:%ld, term:%ld, txn_num_rows:%ld", 
+                batch_size, dml_cost, _region_id, _num_table_lines.load(), 
+                applied_index, term, txn_num_increase_rows);
     }
 }
 
+int Region::dml_batch_propose(void* meta, bthread::TaskIterator<DMLBatchTask>& iter) {
+    if (iter.is_queue_stopped()) {
+        return 0;
+    }
+    Region* region = (Region*)meta;
+    std::vector<DMLBatchTask> tasks;
+    for (; iter; ++iter) {
+        tasks.push_back(*iter);
+        if ((int)tasks.size() >= FLAGS_dml_batch_max_size) {
+            region->propose_dml_batch(tasks);
+            tasks.clear();
+        }
+    }
+    if (tasks.size() > 0) {
+        region->propose_dml_batch(tasks);
+    }
+    return 0;
+}
+
+void Region::propose_dml_batch(std::vector<DMLBatchTask>& tasks) {
+    butil::IOBuf data;
+    butil::IOBufAsZeroCopyOutputStream wrapper(&data);
+    braft::Task task;
+    task.data = &data;
+    // 只有一个请求时与不合并的日志格式相同
+    if (tasks.size() == 1) {
+        DMLClosure* c = tasks[0].closure;
+        if (!tasks[0].request->SerializeToZeroCopyStream(&wrapper)) {
+            c->response->set_errcode(pb::EXEC_FAIL);
+            c->response->set_errmsg("Fail to serialize request");
+            c->Run();
+            return;
+        }
+        task.done = c;
+        _node.apply(task);
+        return;
+    }
+    pb::StoreReq batch_req;
+    batch_req.set_op_type(pb::OP_DML_BATCH);
+    batch_req.set_region_id(_region_id);
+    batch_req.set_region_version(tasks[0].request->region_version());
+    DMLBatchClosure* c = new DMLBatchClosure;
+    c->cost.reset();
+    c->op_type = pb::OP_DML_BATCH;
+    for (auto& t : tasks) {
+        batch_req.add_batch_reqs()->CopyFrom(*t.request);
+        c->closures.push_back(t.closure);
+    }
+    if (!batch_req.SerializeToZeroCopyStream(&wrapper)) {
+        DB_FATAL("Fail to serialize batch request, region_id: %ld", _region_id);
+        c->batch_response.set_errcode(pb::EXEC_FAIL);
+        c->batch_response.set_errmsg("Fail to serialize request");
+        c->Run();
+        return;
+    }
+    task.done = c;
+    _node.apply(task);
+}
+
 void Region::kv_apply_raft(RuntimeState* state, SmartTransaction txn) {
     pb::StoreReq* raft_req = txn->get_raftreq(); 
     raft_req->set_op_type(pb::OP_KV_BATCH);
@@ -1503,7 +1768,11 @@ void Region::kv_apply_raft(RuntimeState* state, SmartTransaction txn) {
 
 
 void Region::select(const pb::StoreReq& request, pb::StoreRes& response) {
+    // 在读数据之前取applied_index, baikaldb据此判断结果缓存是否失效
+    response.set_applied_index(_applied_index);
+    TimeCost cost;
     select(request, request.plan(), request.tuples(), response);
+    _load_stat.add_read(cost.get_time());
 }
 
 void Region::select(const pb::StoreReq& request, 
@@ -1572,6 +1841,7 @@ void Region::select(const pb::StoreReq& request,
         txn = state.create_txn_if_null();
     }
     ScopeGuard auto_rollback([&]() {
+        _load_stat.sample_key(txn->first_primary_key);
         if (is_new_txn) {
             txn->rollback();
         }
@@ -1647,8 +1917,41 @@ void Region::select(const pb::StoreReq& request,
     }
 }
 
+//大小变化超过上次上报的heartbeat_size_change_percent%才算变化
+static bool heartbeat_size_changed(int64_t size, int64_t reported_size) {
+    int64_t diff = std::abs(size - reported_size);
+    return diff * 100 > std::abs(reported_size) * FLAGS_heartbeat_size_change_percent
+        || (reported_size == 0 && size != 0);
+}
+
+bool Region::report_unchanged_leader(pb::StoreHeartBeatRequest& request,
+        const std::vector<braft::PeerId>& peers, bool delta) {
+    std::string leader_state = std::to_string(_region_info.version()) + ":"
+        + std::to_string(_region_info.conf_version()) + ":"
+        + std::to_string(_region_control.get_status());
+    for (auto& peer : peers) {
+        leader_state += ":";
+        leader_state += butil::endpoint2str(peer.addr).c_str();
+    }
+    int64_t num_table_lines = _region_info.num_table_lines();
+    int64_t used_size = _region_info.used_size();
+    if (delta && leader_state == _reported_leader_state
+            && !heartbeat_size_changed(num_table_lines, _reported_num_table_lines)
+            && !heartbeat_size_changed(used_size, _reported_used_size)) {
+        pb::LeaderRegionBrief* brief = request.add_unchanged_leader_regions();
+        brief->set_region_id(_region_id);
+        brief->set_table_id(_region_info.table_id());
+        brief->set_status(_region_control.get_status());
+        return true;
+    }
+    _reported_leader_state = leader_state;
+    _reported_num_table_lines = num_table_lines;
+    _reported_used_size = used_size;
+    return false;
+}
+
 void Region::construct_heart_beat_request(pb::StoreHeartBeatRequest& request, bool need_peer_balance,
-    std::set<int64_t>& ddl_wait_doing_table_ids) {
+    std::set<int64_t>& ddl_wait_doing_table_ids, bool delta) {
     if (_shutdown || !_init_success) {
         return;
     }
@@ -1679,10 +1982,19 @@ void Region::construct_heart_beat_request(pb::StoreHeartBeatRequest& request, bo
         //}
     }
     //添加leader的心跳信息，同时更新状态
+    _load_stat.update();
     std::vector<braft::PeerId> peers;
-    if (is_leader() && _node.list_peers(&peers).ok()) {
+    bool leader = is_leader() && _node.list_peers(&peers).ok();
+    if (!leader) {
+        //重新成为leader时全量上报
+        _reported_leader_state.clear();
+    }
+    if (leader && !report_unchanged_leader(request, peers, delta)) {
         pb::LeaderHeartBeat* leader_heart = request.add_leader_regions();
         leader_heart->set_status(_region_control.get_status());
+        leader_heart->set_read_qps(_load_stat.read_qps());
+        leader_heart->set_write_qps(_load_stat.write_qps());
+        leader_heart->set_cpu_time_us(_load_stat.cpu_time_us());
         pb::RegionInfo* leader_region =  leader_heart->mutable_region();
         copy_region(leader_region);
         leader_region->set_status(_region_control.get_status());
@@ -1732,6 +2044,10 @@ void Region::set_can_add_peer() {
 }
 
 void Region::on_apply(braft::Iterator& iter) {
+    if (FLAGS_apply_parallel_window > 1) {
+        on_apply_parallel(iter);
+        return;
+    }
     for (; iter.valid(); iter.next()) {
         braft::Closure* done = iter.done();
         brpc::ClosureGuard done_guard(done);
@@ -1739,129 +2055,337 @@ void Region::on_apply(braft::Iterator& iter) {
         butil::IOBufAsZeroCopyInputStream wrapper(data);
         pb::StoreReq request;
         if (!request.ParseFromZeroCopyStream(&wrapper)) {
-            DB_FATAL("parse from protobuf fail, region_id: %ld", _region_id);
+            apply_parse_fail(done_guard.release());
+            continue;
+        }
+        apply_log_entry(request, done_guard.release(), iter.index(), iter.term());
+    }
+}
+
+void Region::apply_parse_fail(braft::Closure* done) {
+    DB_FATAL("parse from protobuf fail, region_id: %ld", _region_id);
+    if (done) {
+        ((DMLClosure*)done)->response->set_errcode(pb::PARSE_FROM_PB_FAIL);
+        ((DMLClosure*)done)->response->set_errmsg("parse from protobuf fail");
+        braft::run_closure_in_bthread(done);
+    }
+}
+
+void Region::apply_log_entry(const pb::StoreReq& request, braft::Closure* done, 
+        int64_t index, int64_t term) {
+    brpc::ClosureGuard done_guard(done);
+    pb::OpType op_type = request.op_type();
+    _region_info.set_log_index(index);
+    if (index <= _applied_index) {
+        //DB_WARNING("this log entry has been executed, log_index:%ld, applied_index:%ld, region_id: %ld",
+        //            index, _applied_index, _region_id);
+        return;
+    }
+    _applied_index = index;
+
+    pb::StoreRes res;
+    switch (op_type) {
+        //kv操作,存储计算分离时使用
+        case pb::OP_KV_BATCH: {
+            uint64_t txn_id = request.txn_infos_size() > 0 ? request.txn_infos(0).txn_id():0;
+            if (txn_id == 0) {
+                apply_kv_out_txn(request, done, _applied_index, term);
+            } else {
+                apply_kv_in_txn(request, done, _applied_index, term);
+            }
+            break;
+        }
+        //分裂时new region处理old region发来的raftlog
+        case pb::OP_KV_BATCH_SPLIT: {
+            apply_kv_split(request, done, _applied_index, term);
+            break;
+        }
+        case pb::OP_PREPARE_V2:
+        case pb::OP_PREPARE:
+        case pb::OP_COMMIT:
+        case pb::OP_ROLLBACK: {
+            apply_txn_request(request, done, _applied_index, term);
+            break;
+        }
+        // 兼容老版本无事务功能时的log entry, 以及强制1PC的DML query(如灌数据时使用)
+        case pb::OP_KILL:
+        case pb::OP_INSERT:
+        case pb::OP_DELETE:
+        case pb::OP_UPDATE: 
+        case pb::OP_TRUNCATE_TABLE: {
+            dml_1pc(request, request.op_type(), request.plan(), request.tuples(), 
+                res, index, term);
             if (done) {
-                ((DMLClosure*)done)->response->set_errcode(pb::PARSE_FROM_PB_FAIL);
-                ((DMLClosure*)done)->response->set_errmsg("parse from protobuf fail");
-                braft::run_closure_in_bthread(done_guard.release());
+                set_dml_response(res, ((DMLClosure*)done)->response);
             }
-            continue;
+            break;
         }
-        pb::OpType op_type = request.op_type();
-        _region_info.set_log_index(iter.index());
-        if (iter.index() <= _applied_index) {
-            //DB_WARNING("this log entry has been executed, log_index:%ld, applied_index:%ld, region_id: %ld",
-            //            iter.index(), _applied_index, _region_id);
-            continue;
+        // leader合并的1pc dml, 在一个rocksdb事务中执行
+        case pb::OP_DML_BATCH: {
+            apply_dml_batch(request, done, _applied_index, term);
+            break;
         }
-        _applied_index = iter.index();
-        int64_t term = iter.term();
-
-        pb::StoreRes res;
-        switch (op_type) {
-            //kv操作,存储计算分离时使用
-            case pb::OP_KV_BATCH: {
-                uint64_t txn_id = request.txn_infos_size() > 0 ? request.txn_infos(0).txn_id():0;
-                if (txn_id == 0) {
-                    apply_kv_out_txn(request, done, _applied_index, term);
-                } else {
-                    apply_kv_in_txn(request, done, _applied_index, term);
-                }
-                break;
+        //split的各类请求传进的来的done类型各不相同，不走下边的if(done)逻辑，直接处理完成，然后continue
+        case pb::OP_NONE: {
+            _meta_writer->update_apply_index(_region_id, _applied_index);
+            if (done) {
+                ((DMLClosure*)done)->response->set_errcode(pb::SUCCESS);
             }
-            //分裂时new region处理old region发来的raftlog
-            case pb::OP_KV_BATCH_SPLIT: {
-                apply_kv_split(request, done, _applied_index, term);
-                break;
+            DB_NOTICE("op_type=%s, region_id: %ld, applied_index:%ld, term:%d", 
+                pb::OpType_Name(request.op_type()).c_str(), _region_id, _applied_index, term);
+            break;
+        }
+        case pb::OP_START_SPLIT: {
+            start_split(done, _applied_index, term); 
+            DB_NOTICE("op_type: %s, region_id: %ld, applied_index:%ld, term:%d", 
+                pb::OpType_Name(request.op_type()).c_str(), _region_id, _applied_index, term);
+            break;
+        }
+        case pb::OP_START_SPLIT_FOR_TAIL: {
+            start_split_for_tail(done, _applied_index, term);
+            DB_NOTICE("op_type: %s, region_id: %ld, applied_index:%ld, term:%d", 
+                pb::OpType_Name(request.op_type()).c_str(), _region_id, _applied_index, term);
+            break;
+        }
+        case pb::OP_ADJUSTKEY_AND_ADD_VERSION: {
+            adjustkey_and_add_version(request, done, _applied_index, term);
+            DB_NOTICE("op_type: %s, region_id :%ld, applied_index:%ld, term:%d",
+                pb::OpType_Name(request.op_type()).c_str(), _region_id, _applied_index, term);
+            break;
+        }
+        case pb::OP_VALIDATE_AND_ADD_VERSION: {
+            validate_and_add_version(request, done, _applied_index, term);
+            DB_NOTICE("op_type: %s, region_id: %ld, applied_index:%ld, term:%d", 
+                pb::OpType_Name(request.op_type()).c_str(), _region_id, _applied_index, term);
+            break;
+        }
+        case pb::OP_ADD_VERSION_FOR_SPLIT_REGION: {
+            add_version_for_split_region(request, done, _applied_index, term); 
+            DB_NOTICE("op_type: %s, region_id: %ld, applied_index:%ld, term:%d", 
+                pb::OpType_Name(request.op_type()).c_str(), _region_id, _applied_index, term);
+            break;
+        }
+        default:
+            _meta_writer->update_apply_index(_region_id, _applied_index);
+            DB_WARNING("unsupport request type, op_type:%d, region_id: %ld", 
+                    request.op_type(), _region_id);
+            if (done) {
+                ((DMLClosure*)done)->response->set_errcode(pb::UNSUPPORT_REQ_TYPE); 
+                ((DMLClosure*)done)->response->set_errmsg("unsupport request type");
             }
-            case pb::OP_PREPARE_V2:
-            case pb::OP_PREPARE:
-            case pb::OP_COMMIT:
-            case pb::OP_ROLLBACK: {
-                apply_txn_request(request, done, _applied_index, term);
-                break;
+            DB_NOTICE("op_type: %s, region_id: %ld, applied_index:%ld, term:%d", 
+                pb::OpType_Name(request.op_type()).c_str(), _region_id, _applied_index, term);
+            break;
+    }
+    if (done) {
+        braft::run_closure_in_bthread(done_guard.release());
+    }
+}
+
+bool Region::get_apply_footprint(const pb::StoreReq& request, std::vector<std::string>& keys) {
+    if (request.op_type() != pb::OP_INSERT 
+            || (request.txn_infos_size() > 0 && request.txn_infos(0).txn_id() != 0)) {
+        return false;
+    }
+    if (_is_global_index || _storage_compute_separate) {
+        return false;
+    }
+    // 倒排索引的多个主键共享同一个词的kv
+    {
+        BAIDU_SCOPED_LOCK(_reverse_index_map_lock);
+        if (_reverse_index_map.size() > 0) {
+            return false;
+        }
+    }
+    const pb::Plan& plan = request.plan();
+    if (plan.nodes_size() != 1 || plan.nodes(0).node_type() != pb::INSERT_NODE) {
+        return false;
+    }
+    // replace和on duplicate key update会改写主键和唯一索引之外的kv
+    const pb::InsertNode& insert_node = plan.nodes(0).derive_node().insert_node();
+    if (insert_node.is_replace() || insert_node.update_slots_size() > 0 
+            || insert_node.insert_values_size() > 0 || insert_node.records_size() == 0) {
+        return false;
+    }
+    SmartTable table_info = _factory->get_table_info_ptr(insert_node.table_id());
+    if (table_info == nullptr) {
+        return false;
+    }
+    std::vector<SmartIndex> unique_indexes;
+    for (int64_t index_id : table_info->indices) {
+        SmartIndex index_info = _factory->get_index_info_ptr(index_id);
+        if (index_info == nullptr) {
+            return false;
+        }
+        if ((index_info->type == pb::I_PRIMARY || index_info->type == pb::I_UNIQ) 
+                && !index_info->is_global) {
+            unique_indexes.push_back(index_info);
+        }
+    }
+    // 非唯一索引的key包含主键, 主键不相交则不相交
+    for (auto& pb_record : insert_node.records()) {
+        SmartRecord record = _factory->new_record(*table_info);
+        if (record->decode(pb_record) != 0) {
+            return false;
+        }
+        for (auto& index_info : unique_indexes) {
+            MutTableKey key;
+            key.append_i64(index_info->id);
+            if (record->encode_key(*index_info, key, -1, false) != 0) {
+                return false;
             }
-            // 兼容老版本无事务功能时的log entry, 以及强制1PC的DML query(如灌数据时使用)
-            case pb::OP_KILL:
-            case pb::OP_INSERT:
-            case pb::OP_DELETE:
-            case pb::OP_UPDATE: 
-            case pb::OP_TRUNCATE_TABLE: {
-                dml_1pc(request, request.op_type(), request.plan(), request.tuples(), 
-                    res, iter.index(), iter.term());
-                if (done) {
-                    ((DMLClosure*)done)->response->set_errcode(res.errcode());
-                    if (res.has_errmsg()) {
-                        ((DMLClosure*)done)->response->set_errmsg(res.errmsg());
-                    }
-                      if (res.has_mysql_errcode()) {
-                            ((DMLClosure*)done)->response->set_mysql_errcode(res.mysql_errcode());
-                        }
-                    if (res.has_leader()) {
-                        ((DMLClosure*)done)->response->set_leader(res.leader());
-                    }
-                    if (res.has_affected_rows()) {
-                        ((DMLClosure*)done)->response->set_affected_rows(res.affected_rows());
-                    }
+            keys.push_back(key.data());
+        }
+    }
+    return true;
+}
+
+void Region::on_apply_parallel(braft::Iterator& iter) {
+    while (iter.valid()) {
+        std::vector<ApplyEntry> entries;
+        entries.reserve(FLAGS_apply_parallel_window);
+        for (; iter.valid() && (int)entries.size() < FLAGS_apply_parallel_window; iter.next()) {
+            entries.emplace_back();
+            ApplyEntry& entry = entries.back();
+            entry.data = iter.data();
+            entry.done = iter.done();
+            entry.index = iter.index();
+            entry.term = iter.term();
+        }
+        // 并行解析窗口内的日志
+        ConcurrencyBthread parse_bths(FLAGS_apply_parallel_concurrency);
+        for (auto& entry : entries) {
+            ApplyEntry* e = &entry;
+            parse_bths.run([e]() {
+                butil::IOBufAsZeroCopyInputStream wrapper(e->data);
+                e->parsed = e->request.ParseFromZeroCopyStream(&wrapper);
+            });
+        }
+        parse_bths.join();
+        // 连续且key不相交的insert组成一组并行执行, 其余日志作为屏障串行apply
+        // 屏障可能修改schema, 其后日志的footprint在屏障apply之后再计算
+        size_t pos = 0;
+        while (pos < entries.size()) {
+            std::vector<std::vector<std::string>> keys;
+            std::vector<const std::vector<std::string>*> footprints;
+            keys.reserve(entries.size() - pos);
+            for (size_t i = pos; i < entries.size(); ++i) {
+                ApplyEntry& entry = entries[i];
+                keys.emplace_back();
+                if (entry.parsed && entry.index > _applied_index 
+                        && get_apply_footprint(entry.request, keys.back())) {
+                    footprints.push_back(&keys.back());
+                } else {
+                    footprints.push_back(nullptr);
+                    break;
                 }
-                break;
             }
-            //split的各类请求传进的来的done类型各不相同，不走下边的if(done)逻辑，直接处理完成，然后continue
-            case pb::OP_NONE: {
-                _meta_writer->update_apply_index(_region_id, _applied_index);
-                if (done) {
-                    ((DMLClosure*)done)->response->set_errcode(pb::SUCCESS);
+            std::vector<std::pair<size_t, size_t>> groups;
+            split_parallel_apply_groups(footprints, groups);
+            for (auto& range : groups) {
+                ApplyEntry& first = entries[pos + range.first];
+                if (footprints[range.first] == nullptr) {
+                    if (!first.parsed) {
+                        apply_parse_fail(first.done);
+                    } else {
+                        apply_log_entry(first.request, first.done, first.index, first.term);
+                    }
+                    continue;
                 }
-                DB_NOTICE("op_type=%s, region_id: %ld, applied_index:%ld, term:%d", 
-                    pb::OpType_Name(request.op_type()).c_str(), _region_id, _applied_index, term);
-                break;
-            }
-            case pb::OP_START_SPLIT: {
-                start_split(done, _applied_index, term); 
-                DB_NOTICE("op_type: %s, region_id: %ld, applied_index:%ld, term:%d", 
-                    pb::OpType_Name(request.op_type()).c_str(), _region_id, _applied_index, term);
-                break;
+                std::vector<ApplyEntry*> group;
+                for (size_t i = range.first; i < range.second; ++i) {
+                    group.push_back(&entries[pos + i]);
+                }
+                apply_parallel_group(group);
             }
-            case pb::OP_START_SPLIT_FOR_TAIL: {
-                start_split_for_tail(done, _applied_index, term);
-                DB_NOTICE("op_type: %s, region_id: %ld, applied_index:%ld, term:%d", 
-                    pb::OpType_Name(request.op_type()).c_str(), _region_id, _applied_index, term);
-                break;
+            pos += footprints.size();
+        }
+    }
+}
+
+void Region::apply_parallel_group(const std::vector<ApplyEntry*>& group) {
+    if (group.size() == 1) {
+        apply_log_entry(group[0]->request, group[0]->done, group[0]->index, group[0]->term);
+        return;
+    }
+    TimeCost cost;
+    size_t group_size = group.size();
+    std::vector<SmartState> states(group_size);
+    std::vector<pb::StoreRes> responses(group_size);
+    std::vector<int> affected_rows(group_size, -1);
+    // 各自的事务中并行执行, key不相交所以结果与串行一致
+    ConcurrencyBthread exec_bths(FLAGS_apply_parallel_concurrency);
+    for (size_t i = 0; i < group_size; ++i) {
+        exec_bths.run([this, i, &group, &states, &responses, &affected_rows]() {
+            Concurrency::get_instance()->service_write_concurrency.increase_wait();
+            ON_SCOPE_EXIT([]() {
+                Concurrency::get_instance()->service_write_concurrency.decrease_broadcast();
+            });
+            ApplyEntry* entry = group[i];
+            const pb::StoreReq& request = entry->request;
+            SmartState state = std::make_shared<RuntimeState>();
+            uint64_t db_conn_id = request.db_conn_id();
+            if (db_conn_id == 0) {
+                db_conn_id = butil::fast_rand();
             }
-            case pb::OP_ADJUSTKEY_AND_ADD_VERSION: {
-                adjustkey_and_add_version(request, done, _applied_index, term);
-                DB_NOTICE("op_type: %s, region_id :%ld, applied_index:%ld, term:%d",
-                    pb::OpType_Name(request.op_type()).c_str(), _region_id, _applied_index, term);
-                break;
+            {
+                BAIDU_SCOPED_LOCK(_ptr_mutex);
+                state->set_resource(_resource);
             }
-            case pb::OP_VALIDATE_AND_ADD_VERSION: {
-                validate_and_add_version(request, done, _applied_index, term);
-                DB_NOTICE("op_type: %s, region_id: %ld, applied_index:%ld, term:%d", 
-                    pb::OpType_Name(request.op_type()).c_str(), _region_id, _applied_index, term);
-                break;
+            if (state->init(request, request.plan(), request.tuples(), &_txn_pool, false) < 0) {
+                responses[i].set_errcode(pb::EXEC_FAIL);
+                responses[i].set_errmsg("RuntimeState init fail");
+                DB_FATAL("RuntimeState init fail, region_id: %ld, applied_index: %ld", 
+                        _region_id, entry->index);
+                return;
             }
-            case pb::OP_ADD_VERSION_FOR_SPLIT_REGION: {
-                add_version_for_split_region(request, done, _applied_index, term); 
-                DB_NOTICE("op_type: %s, region_id: %ld, applied_index:%ld, term:%d", 
-                    pb::OpType_Name(request.op_type()).c_str(), _region_id, _applied_index, term);
-                break;
+            state->deadlock_detect = false;
+            state->create_txn_if_null();
+            states[i] = state;
+            _state_pool.set(db_conn_id, state);
+            ON_SCOPE_EXIT(([this, db_conn_id]() {
+                _state_pool.remove(db_conn_id);
+            }));
+            affected_rows[i] = exec_dml_plan(*state, request.plan(), responses[i], entry->index);
+        });
+    }
+    exec_bths.join();
+    int64_t exec_cost = cost.get_time();
+    // 按日志顺序提交, applied_index连续推进
+    for (size_t i = 0; i < group_size; ++i) {
+        ApplyEntry* entry = group[i];
+        _region_info.set_log_index(entry->index);
+        _applied_index = entry->index;
+        SmartTransaction txn = states[i] != nullptr ? states[i]->txn() : nullptr;
+        pb::StoreRes& response = responses[i];
+        if (affected_rows[i] >= 0) {
+            int64_t num_increase_rows = states[i]->num_increase_rows();
+            if (commit_dml_txn(txn, 0, _num_table_lines + num_increase_rows, 
+                        num_increase_rows, entry->index) == 0) {
+                response.set_affected_rows(affected_rows[i]);
+                response.set_errcode(pb::SUCCESS);
+            } else {
+                txn->rollback();
+                response.set_errcode(pb::EXEC_FAIL);
+                response.set_errmsg("txn commit failed.");
             }
-            default:
-                _meta_writer->update_apply_index(_region_id, _applied_index);
-                DB_WARNING("unsupport request type, op_type:%d, region_id: %ld", 
-                        request.op_type(), _region_id);
-                if (done) {
-                    ((DMLClosure*)done)->response->set_errcode(pb::UNSUPPORT_REQ_TYPE); 
-                    ((DMLClosure*)done)->response->set_errmsg("unsupport request type");
-                }
-                DB_NOTICE("op_type: %s, region_id: %ld, applied_index:%ld, term:%d", 
-                    pb::OpType_Name(request.op_type()).c_str(), _region_id, _applied_index, term);
-                break;
+            _load_stat.sample_key(txn->first_primary_key);
+        } else if (txn != nullptr) {
+            txn->rollback();
         }
-        if (done) {
-            braft::run_closure_in_bthread(done_guard.release());
+        if (entry->done) {
+            set_dml_response(response, ((DMLClosure*)entry->done)->response);
+            braft::run_closure_in_bthread(entry->done);
         }
     }
+    int64_t dml_cost = cost.get_time();
+    Store::get_instance()->dml_time_cost << dml_cost;
+    _load_stat.add_write(dml_cost);
+    if (dml_cost > FLAGS_print_time_us) {
+        DB_NOTICE("parallel apply size: %lu, time_cost:%ld, exec_cost:%ld, region_id: %ld, "
+                  "num_table_lines:%ld, applied_index:%ld", group_size, dml_cost, exec_cost,
+                  _region_id, _num_table_lines.load(), _applied_index);
+    }
 }
 
 void Region::apply_kv_in_txn(const pb::StoreReq& request, braft::Closure* done, 
@@ -1886,6 +2410,7 @@ void Region::apply_kv_out_txn(const pb::StoreReq& request, braft::Closure* done,
         txn = SmartTransaction(new Transaction(0, &_txn_pool));
         txn->set_region_info(&(_resource->region_info));
         txn->set_ddl_state(_resource->ddl_param_ptr);
+        txn->disable_deadlock_detect();
         txn->begin();
     }
     
@@ -1970,6 +2495,7 @@ void Region::apply_kv_split(const pb::StoreReq& request, braft::Closure* done,
     SmartTransaction txn = SmartTransaction(new Transaction(0, &_txn_pool));
     txn->set_region_info(&(_resource->region_info));
     txn->set_ddl_state(_resource->ddl_param_ptr);
+    txn->disable_deadlock_detect();
     txn->begin();
     
     bool commit_succ = false;
@@ -2011,7 +2537,11 @@ void Region::apply_kv_split(const pb::StoreReq& request, braft::Closure* done,
                 continue;
             }
         } else if (index_info.type == pb::I_UNIQ || index_info.type == pb::I_KEY) {
-            if (!Transaction::fits_region_range(key_slice, kv_op.value(),
+            rocksdb::Slice value_slice(kv_op.value());
+            if (txn->use_ttl()) {
+                ttl_decode(&value_slice);
+            }
+            if (!Transaction::fits_region_range(key_slice, value_slice,
                                                 &_region_info.start_key(), &_region_info.end_key(), 
                                                 pk_info, index_info)) {
                  DB_WARNING("skip_key: %s, start: %s, end: %s index: %ld region: %ld", 
@@ -2210,7 +2740,7 @@ void Region::start_split_for_tail(braft::Closure* done, int64_t applied_index, i
 
         MutTableKey key;
         //不够精确，但暂且可用。不允许主键是FFFFF
-        key.append_i64(_region_id).append_i64(tableid).append_u64(0xFFFFFFFFFFFFFFFF);
+        key.append_i64(get_key_prefix()).append_i64(tableid).append_u64(0xFFFFFFFFFFFFFFFF);
         iter->SeekForPrev(key.data());
         if (!iter->Valid()) {
             DB_WARNING("get split key for tail split fail, region_id: %ld, tableid:%ld, iter not valid",
@@ -2228,7 +2758,7 @@ void Region::start_split_for_tail(braft::Closure* done, int64_t applied_index, i
         TableKey table_key(iter->key());
         int64_t _region = table_key.extract_i64(0);
         int64_t _table = table_key.extract_i64(sizeof(int64_t));
-        if (tableid != _table || _region_id != _region) {
+        if (tableid != _table || get_key_prefix() != _region) {
             DB_WARNING("get split key for tail split fail, region_id: %ld:%ld, tableid:%ld:%ld,"
                     "data:%s", _region_id, _region, tableid, _table, iter->key().data());
             ((SplitClosure*)done)->ret = -1;
@@ -2371,12 +2901,18 @@ void Region::validate_and_add_version(const pb::StoreReq& request,
                 _region_info.version(), request.region_version(),
                 _num_table_lines.load(), request.reduce_num_lines(),
                 applied_index, term);
+    pb::RegionInfo split_range = _region_info;
     set_region_with_update_range(region_info_mem);
     _num_table_lines -= request.reduce_num_lines();
     batch.Put(_meta_writer->get_handle(), _meta_writer->num_table_lines_key(_region_id), _meta_writer->encode_num_table_lines(_num_table_lines));
     for (auto& txn_info : request.txn_infos()) {
         _txn_pool.update_txn_num_rows_after_split(txn_info);
     }
+    if (split_range.index_key_layout()) {
+        // 没有新region副本的store上, 分裂出去的区间已无region使用, 直接删除
+        split_range.set_start_key(request.end_key());
+        RegionControl::remove_key_range(split_range);
+    }
     // 分裂后主动执行compact
     DB_WARNING("region_id: %ld, new_region_id: %ld, split do compact in queue", 
             _region_id, _split_param.new_region_id);
@@ -2534,6 +3070,9 @@ void Region::snapshot(braft::Closure* done) {
     if (!need_snapshot) {
         return;
     }
+    if (need_postpone_snapshot()) {
+        return;
+    }
     DB_WARNING("region_id: %ld do snapshot, snapshot_num_table_lines:%ld, num_table_lines:%ld "
             "snapshot_index:%ld, applied_index:%ld, snapshot_inteval_s:%ld",
             _region_id, _snapshot_num_table_lines, _num_table_lines.load(),
@@ -2541,6 +3080,43 @@ void Region::snapshot(braft::Closure* done) {
     done_guard.release();
     _node.snapshot(done);
 }
+// snapshot完成后raft会截断上一次snapshot之前的日志
+// 有follower(如刚重启)还需要这些日志且落后不多时推迟snapshot, 让它通过日志增量追上, 避免全量安装snapshot
+bool Region::need_postpone_snapshot() {
+#ifdef BAIDU_INTERNAL
+    return false;
+#else
+    if (!is_leader() || FLAGS_snapshot_follower_lag_logs <= 0) {
+        return false;
+    }
+    if (_snapshot_time_cost.get_time() >
+            (FLAGS_snapshot_interval_s + FLAGS_snapshot_max_postpone_s) * 1000 * 1000LL) {
+        return false;
+    }
+    braft::NodeStatus status;
+    _node.get_status(&status);
+    for (auto& pair : status.stable_followers) {
+        const braft::PeerStatus& peer = pair.second;
+        if (!peer.valid || peer.installing_snapshot) {
+            continue;
+        }
+        // 需要的日志在本次snapshot后仍会保留
+        if (peer.next_index > _snapshot_index) {
+            continue;
+        }
+        // 落后太多时安装snapshot更快
+        if (status.last_index - peer.next_index > FLAGS_snapshot_follower_lag_logs) {
+            continue;
+        }
+        DB_WARNING("region_id: %ld postpone snapshot, peer:%s next_index:%ld, snapshot_index:%ld, "
+                "last_index:%ld", _region_id, pair.first.to_string().c_str(), peer.next_index,
+                _snapshot_index, status.last_index);
+        return true;
+    }
+    return false;
+#endif
+}
+
 void Region::on_snapshot_load_for_restart(braft::SnapshotReader* reader, 
         std::map<int64_t, std::string>& prepared_log_entrys) {
      //不管是哪种启动方式，prepared的但没有commit的日志都通过log_entry恢复, 所以prepared事务要回滚
@@ -2622,6 +3198,17 @@ int Region::on_snapshot_load(braft::SnapshotReader* reader) {
         _txn_pool.clear();
         //清空数据
         if (_region_info.version() != 0) {
+            // 索引布局下与本地其他region共享key区间时(分裂未完成), 等待区间释放后再清理和ingest
+            TimeCost wait_cost;
+            while (_region_info.index_key_layout()
+                    && Store::get_instance()->has_overlapped_region(_region_info)) {
+                if (wait_cost.get_time() > FLAGS_snapshot_load_overlap_wait_s * 1000 * 1000LL) {
+                    DB_FATAL("region_id: %ld overlapped with other region, snapshot load fail",
+                            _region_id);
+                    return -1;
+                }
+                bthread_usleep(100 * 1000);
+            }
             DB_WARNING("region_id: %ld, clear_data on_snapshot_load", _region_id);
             ret = clear_data();
             if (ret != 0) {
@@ -2765,7 +3352,7 @@ int Region::ingest_sst(const std::string& data_sst_file, const std::string& meta
 int Region::clear_data() {
     //删除preapred 但没有committed的事务
     _txn_pool.clear();
-    RegionControl::remove_data(_region_id);
+    RegionControl::remove_data(_region_info);
     _meta_writer->clear_meta_info(_region_id);
     // 单线程执行compact
     DB_WARNING("region_id: %ld, clear_data do compact in queue", _region_id);
@@ -2792,13 +3379,28 @@ void Region::reverse_merge() {
         reverse_merge_index_map = _reverse_index_map;   
     }
     TimeCost cost;
+    // 行数作为BM25的文档数
+    pb::RegionInfo region_info = _resource->region_info;
+    region_info.set_num_table_lines(_num_table_lines);
     for (auto& pair : reverse_merge_index_map) {
-        pair.second->reverse_merge_func(_resource->region_info);
+        pair.second->reverse_merge_func(region_info);
     }
     //DB_WARNING("region_id: %ld reverse merge:%lu", _region_id, cost.get_time());
     SELF_TRACE("region_id: %ld reverse merge:%lu", _region_id, cost.get_time());
 }
 
+int64_t Region::reverse_merge_backlog() {
+    BAIDU_SCOPED_LOCK(_reverse_index_map_lock);
+    if (_reverse_index_map.empty()) {
+        return -1;
+    }
+    int64_t backlog = 0;
+    for (auto& pair : _reverse_index_map) {
+        backlog += pair.second->level_1_backlog();
+    }
+    return backlog;
+}
+
 // dump the the tuples in this region in format {{k1:v1},{k2:v2},{k3,v3}...}
 // used for debug
 std::string Region::dump_hex() {
@@ -3199,36 +3801,80 @@ void Region::get_split_key_for_tail_split() {
                 _region_id, _split_param.new_region_id);
 }
 
-//开始发送数据
-void Region::write_local_rocksdb_for_split() {
-    if (_shutdown) {
-        return;
+// 分裂拷贝任务的写入端
+// sst_options为空时直接写rocksdb, 否则写入sst文件, 此时key需要按序写入
+class SplitCopyWriter {
+public:
+    SplitCopyWriter(RocksWrapper* rocksdb, rocksdb::ColumnFamilyHandle* cf,
+            const rocksdb::Options* sst_options, const std::string& sst_file) :
+        _rocksdb(rocksdb), _cf(cf), _sst_options(sst_options), _sst_file(sst_file) {}
+
+    int put(const rocksdb::Slice& key, const rocksdb::Slice& value) {
+        _bytes += key.size() + value.size();
+        if (_sst_options == nullptr) {
+            auto s = _rocksdb->put(rocksdb::WriteOptions(), _cf, key, value);
+            if (!s.ok()) {
+                DB_FATAL("put fail, err: %s", s.ToString().c_str());
+                return -1;
+            }
+            return 0;
+        }
+        if (_writer == nullptr) {
+            _writer.reset(new SstFileWriter(*_sst_options));
+            auto s = _writer->open(_sst_file);
+            if (!s.ok()) {
+                DB_FATAL("open sst file: %s fail, err: %s", _sst_file.c_str(), s.ToString().c_str());
+                return -1;
+            }
+        }
+        auto s = _writer->put(key, value);
+        if (!s.ok()) {
+            DB_FATAL("write sst file: %s fail, err: %s", _sst_file.c_str(), s.ToString().c_str());
+            return -1;
+        }
+        return 0;
     }
-    _multi_thread_cond.increase();
-    ON_SCOPE_EXIT([this]() {
-        _multi_thread_cond.decrease_signal();
-    });
-    _split_param.op_start_split_cost = _split_param.op_start_split.get_time();
-    ScopeProcStatus split_status(this);
 
-    _split_param.split_slow_down = true;
-    TimeCost write_sst_time_cost;
-    //uint64_t imageid = TableKey(_split_param.split_key).extract_u64(0);
+    // 有数据写入sst时通过sst_file返回文件名
+    int finish(std::string* sst_file) {
+        if (_writer == nullptr) {
+            return 0;
+        }
+        auto s = _writer->finish();
+        if (!s.ok()) {
+            DB_FATAL("finish sst file: %s fail, err: %s", _sst_file.c_str(), s.ToString().c_str());
+            return -1;
+        }
+        _finished = true;
+        *sst_file = _sst_file;
+        return 0;
+    }
 
-    DB_WARNING("split param, region_id: %ld, term:%ld, split_start_index:%ld, split_end_index:%ld,"
-                " new_region_id: %ld, split_key:%s, instance:%s",
-                _region_id,
-                _split_param.split_term,
-                _split_param.split_start_index,
-                _split_param.split_end_index,
-                _split_param.new_region_id,
-                rocksdb::Slice(_split_param.split_key).ToString(true).c_str(),
-                //imageid,
-                _split_param.instance.c_str());
-    if (!is_leader()) {
-        DB_FATAL("leader transfer when split, split fail, region_id: %ld", _region_id);
-        return;
+    int64_t bytes() const {
+        return _bytes;
+    }
+
+    ~SplitCopyWriter() {
+        // 失败退出时清理未完成的文件
+        if (_writer != nullptr && !_finished) {
+            _writer.reset();
+            boost::system::error_code ec;
+            boost::filesystem::remove(_sst_file, ec);
+        }
     }
+
+private:
+    RocksWrapper* _rocksdb;
+    rocksdb::ColumnFamilyHandle* _cf;
+    const rocksdb::Options* _sst_options;
+    std::string _sst_file;
+    std::unique_ptr<SstFileWriter> _writer;
+    bool _finished = false;
+    int64_t _bytes = 0;
+};
+
+// 把[split_key, end_key)的数据拷贝到新region_id前缀下
+void Region::copy_data_for_split(TimeCost& write_sst_time_cost) {
     //write to new sst
     MutTableKey region_prefix;
     region_prefix.append_i64(_region_id);
@@ -3250,78 +3896,156 @@ void Region::write_local_rocksdb_for_split() {
     //MutTableKey table_prefix;
     //table_prefix.append_i64(_region_id).append_i64(table_id);
     std::atomic<int64_t> write_sst_lines(0);
+    std::atomic<int64_t> write_sst_bytes(0);
+    std::atomic<int64_t> primary_lines(0);
     _split_param.reduce_num_lines = 0;
 
     IndexInfo pk_info = _factory->get_index_info(main_table_id);
 
-    ConcurrencyBthread copy_bth(5, &BTHREAD_ATTR_SMALL);
-    for (int64_t index_id : indices) {
-        auto read_and_write = [this, &pk_info, &write_sst_lines, 
-                                index_id] () {
-            MutTableKey table_prefix;
-            table_prefix.append_i64(_region_id).append_i64(index_id);
-            rocksdb::WriteOptions write_options;
-            TimeCost cost;
-            int64_t num_write_lines = 0;
-            int64_t skip_write_lines = 0;
-            rocksdb::ReadOptions read_options;
-            read_options.prefix_same_as_start = true;
-            read_options.total_order_seek = false;
-            read_options.snapshot = _split_param.snapshot;
-           
-            IndexInfo index_info = _factory->get_index_info(index_id);
-            std::unique_ptr<rocksdb::Iterator> iter(_rocksdb->new_iterator(read_options, _data_cf));
-            if (index_info.type == pb::I_PRIMARY || _is_global_index) {
-                table_prefix.append_index(_split_param.split_key);
+    // sst模式: 每个拷贝任务写一个sst文件, 全部完成后一次性ingest到新region
+    bool use_sst = FLAGS_split_copy_by_sst;
+    rocksdb::Options sst_options = _rocksdb->get_options(_data_cf);
+    std::string sst_prefix = FLAGS_split_sst_path + "/split_" + std::to_string(_region_id)
+        + "_" + std::to_string(_split_param.new_region_id) + "_";
+    if (use_sst) {
+        boost::system::error_code ec;
+        boost::filesystem::create_directories(FLAGS_split_sst_path, ec);
+    }
+    std::mutex sst_mutex;
+    std::vector<std::string> sst_files;
+    ON_SCOPE_EXIT(([&sst_files]() {
+        for (auto& file : sst_files) {
+            boost::system::error_code ec;
+            boost::filesystem::remove(file, ec);
+        }
+    }));
+    std::atomic<int> task_count(0);
+    auto new_writer = [&]() {
+        std::string sst_file = sst_prefix + std::to_string(task_count++) + ".sst";
+        return std::make_shared<SplitCopyWriter>(_rocksdb, _data_cf,
+                use_sst ? &sst_options : nullptr, sst_file);
+    };
+    auto finish_writer = [&](std::shared_ptr<SplitCopyWriter> writer) {
+        std::string sst_file;
+        if (writer->finish(&sst_file) != 0) {
+            _split_param.err_code = -1;
+            return;
+        }
+        write_sst_bytes += writer->bytes();
+        if (!sst_file.empty()) {
+            std::lock_guard<std::mutex> lock(sst_mutex);
+            sst_files.push_back(sst_file);
+        }
+    };
+
+    ConcurrencyBthread copy_bth(FLAGS_split_copy_concurrency, &BTHREAD_ATTR_SMALL);
+    // 主键或全局索引拷贝[begin_key, end_key)区间, 二级索引拷贝整个前缀并按主键过滤
+    // 过期的行不拷贝到新region, 与compaction一样过期超过grace才跳过
+    bool skip_expired = use_ttl();
+    int64_t now_us = butil::gettimeofday_us() - FLAGS_ttl_compaction_grace_s * 1000000LL;
+    auto read_and_write = [this, &pk_info, &write_sst_lines, &primary_lines,
+                            &new_writer, &finish_writer, skip_expired, now_us] (int64_t index_id,
+                            const std::string& begin_key, const std::string& end_key) {
+        MutTableKey table_prefix;
+        table_prefix.append_i64(_region_id).append_i64(index_id);
+        TimeCost cost;
+        int64_t num_write_lines = 0;
+        int64_t skip_write_lines = 0;
+        rocksdb::ReadOptions read_options;
+        read_options.prefix_same_as_start = true;
+        read_options.total_order_seek = false;
+        read_options.snapshot = _split_param.snapshot;
+       
+        IndexInfo index_info = _factory->get_index_info(index_id);
+        std::unique_ptr<rocksdb::Iterator> iter(_rocksdb->new_iterator(read_options, _data_cf));
+        bool is_primary = (index_info.type == pb::I_PRIMARY || _is_global_index);
+        if (is_primary) {
+            table_prefix.append_index(begin_key);
+        }
+        auto writer = new_writer();
+        int64_t count = 0;
+        for (iter->Seek(table_prefix.data()); iter->Valid(); iter->Next()) {
+            ++count;
+            if (count % 100 == 0 && (!is_leader() || _shutdown)) {
+                DB_WARNING("index %ld, old region_id: %ld write to new region_id: %ld failed, not leader",
+                            index_id, _region_id, _split_param.new_region_id);
+                _split_param.err_code = -1;
+                return;
             }
-            int64_t count = 0;
-            for (iter->Seek(table_prefix.data()); iter->Valid(); iter->Next()) {
-                ++count;
-                if (count % 100 == 0 && (!is_leader() || _shutdown)) {
-                    DB_WARNING("index %ld, old region_id: %ld write to new region_id: %ld failed, not leader",
-                                index_id, _region_id, _split_param.new_region_id);
-                    _split_param.err_code = -1;
-                    return;
-                }
-                //int ret1 = 0; 
-                rocksdb::Slice key_slice(iter->key());
-                key_slice.remove_prefix(2 * sizeof(int64_t));
-                if (index_info.type == pb::I_PRIMARY || _is_global_index) {
-                    // check end_key
-                    // tail split need not send rocksdb
-                    if (key_slice.compare(_region_info.end_key()) >= 0) {
-                        break;
-                    }
-                } else if (index_info.type == pb::I_UNIQ || index_info.type == pb::I_KEY) {
-                    if (!Transaction::fits_region_range(key_slice, iter->value(),
-                            &_split_param.split_key, &_region_info.end_key(), 
-                            pk_info, index_info)) {
-                        // DB_WARNING("skip_key: %s, split: %s, end: %s index: %ld region: %ld", 
-                        //     key_slice.ToString(true).c_str(), str_to_hex(_split_param.split_key).c_str(), str_to_hex(_region_info.end_key()).c_str(), index_id, _region_id);
-                        skip_write_lines++;
-                        continue;
-                    }
+            //int ret1 = 0; 
+            rocksdb::Slice key_slice(iter->key());
+            key_slice.remove_prefix(2 * sizeof(int64_t));
+            if (is_primary) {
+                // check end_key
+                // tail split need not send rocksdb
+                if (key_slice.compare(end_key) >= 0) {
+                    break;
                 }
-                MutTableKey key(iter->key());
-                key.replace_i64(_split_param.new_region_id, 0);
-                auto s = _rocksdb->put(write_options, _data_cf, key.data(), iter->value());
-                if (!s.ok()) {
-                    DB_FATAL("index %ld, old region_id: %ld write to new region_id: %ld failed, status: %s", 
-                    index_id, _region_id, _split_param.new_region_id, s.ToString().c_str());
-                    _split_param.err_code = -1;
-                    return;
+            }
+            rocksdb::Slice value_slice(iter->value());
+            if (skip_expired && index_info.type != pb::I_FULLTEXT
+                    && ttl_expired(ttl_decode(&value_slice), now_us)) {
+                skip_write_lines++;
+                continue;
+            }
+            if (!is_primary && (index_info.type == pb::I_UNIQ || index_info.type == pb::I_KEY)) {
+                if (!Transaction::fits_region_range(key_slice, value_slice,
+                        &_split_param.split_key, &_region_info.end_key(), 
+                        pk_info, index_info)) {
+                    // DB_WARNING("skip_key: %s, split: %s, end: %s index: %ld region: %ld", 
+                    //     key_slice.ToString(true).c_str(), str_to_hex(_split_param.split_key).c_str(), str_to_hex(_region_info.end_key()).c_str(), index_id, _region_id);
+                    skip_write_lines++;
+                    continue;
                 }
-                num_write_lines++;
             }
-            write_sst_lines += num_write_lines;
-            if (index_info.type == pb::I_PRIMARY || _is_global_index) {
-                _split_param.reduce_num_lines = num_write_lines;
+            MutTableKey key(iter->key());
+            key.replace_i64(_split_param.new_region_id, 0);
+            if (writer->put(key.data(), iter->value()) != 0) {
+                DB_FATAL("index %ld, old region_id: %ld write to new region_id: %ld failed",
+                        index_id, _region_id, _split_param.new_region_id);
+                _split_param.err_code = -1;
+                return;
             }
-            DB_WARNING("scan index:%ld, cost=%ld, lines=%ld, skip:%ld, region_id: %ld", 
-                        index_id, cost.get_time(), num_write_lines, skip_write_lines, _region_id);
-
-        };
-        copy_bth.run(read_and_write); 
+            num_write_lines++;
+        }
+        finish_writer(writer);
+        write_sst_lines += num_write_lines;
+        if (is_primary) {
+            primary_lines += num_write_lines;
+        }
+        DB_WARNING("scan index:%ld, cost=%ld, lines=%ld, skip:%ld, bytes:%ld, region_id: %ld", 
+                    index_id, cost.get_time(), num_write_lines, skip_write_lines,
+                    writer->bytes(), _region_id);
+    };
+    for (int64_t index_id : indices) {
+        IndexInfo index_info = _factory->get_index_info(index_id);
+        if (index_info.type != pb::I_PRIMARY && !_is_global_index) {
+            copy_bth.run([index_id, &read_and_write]() {
+                read_and_write(index_id, "", "");
+            });
+            continue;
+        }
+        // 按sst采样点把主键区间切成多段并行拷贝
+        std::vector<std::string> bounds;
+        bounds.push_back(_split_param.split_key);
+        std::vector<std::string> samples;
+        if (FLAGS_split_copy_partitions > 1) {
+            get_sst_sample_keys(index_id, _split_param.split_key, _region_info.end_key(), samples);
+        }
+        for (int i = 1; i < FLAGS_split_copy_partitions && !samples.empty(); ++i) {
+            const std::string& key = samples[samples.size() * i / FLAGS_split_copy_partitions];
+            if (key > bounds.back()) {
+                bounds.push_back(key);
+            }
+        }
+        bounds.push_back(_region_info.end_key());
+        for (size_t i = 0; i + 1 < bounds.size(); ++i) {
+            std::string begin_key = bounds[i];
+            std::string end_key = bounds[i + 1];
+            copy_bth.run([index_id, begin_key, end_key, &read_and_write]() {
+                read_and_write(index_id, begin_key, end_key);
+            });
+        }
     }
     if (!_is_global_index) {
         // write all non-pk column values to cstore
@@ -3335,12 +4059,11 @@ void Region::write_local_rocksdb_for_split() {
             if (pri_field_ids.count(field_id) != 0) {
                 continue;
             }
-            auto read_and_write_column = [this, &pk_info, &write_sst_lines,
+            auto read_and_write_column = [this, &write_sst_lines, &new_writer, &finish_writer,
                                    field_id] () {
                 MutTableKey table_prefix;
                 table_prefix.append_i64(_region_id);
                 table_prefix.append_i32(_region_info.table_id()).append_i32(field_id);
-                rocksdb::WriteOptions write_options;
                 TimeCost cost;
                 int64_t num_write_lines = 0;
                 int64_t skip_write_lines = 0;
@@ -3351,6 +4074,7 @@ void Region::write_local_rocksdb_for_split() {
 
                 std::unique_ptr<rocksdb::Iterator> iter(_rocksdb->new_iterator(read_options, _data_cf));
                 table_prefix.append_index(_split_param.split_key);
+                auto writer = new_writer();
                 int64_t count = 0;
                 for (iter->Seek(table_prefix.data()); iter->Valid(); iter->Next()) {
                     ++count;
@@ -3370,15 +4094,15 @@ void Region::write_local_rocksdb_for_split() {
                     }
                     MutTableKey key(iter->key());
                     key.replace_i64(_split_param.new_region_id, 0);
-                    auto s = _rocksdb->put(write_options, _data_cf, key.data(), iter->value());
-                    if (!s.ok()) {
-                        DB_FATAL("index %ld, old region_id: %ld write to new region_id: %ld failed, status: %s",
-                        field_id, _region_id, _split_param.new_region_id, s.ToString().c_str());
+                    if (writer->put(key.data(), iter->value()) != 0) {
+                        DB_FATAL("field %d, old region_id: %ld write to new region_id: %ld failed",
+                                field_id, _region_id, _split_param.new_region_id);
                         _split_param.err_code = -1;
                         return;
                     }
                     num_write_lines++;
                 }
+                finish_writer(writer);
                 write_sst_lines += num_write_lines;
                 DB_WARNING("scan filed:%d, cost=%ld, lines=%ld, skip:%ld, region_id: %ld",
                             field_id, cost.get_time(), num_write_lines, skip_write_lines, _region_id);
@@ -3391,6 +4115,28 @@ void Region::write_local_rocksdb_for_split() {
     if (_split_param.err_code != 0) {
         return;
     }
+    _split_param.reduce_num_lines = primary_lines.load();
+    if (use_sst && !sst_files.empty()) {
+        // 各文件key区间互不重叠, 一次ingest保证原子可见
+        TimeCost ingest_cost;
+        rocksdb::IngestExternalFileOptions ifo;
+        auto s = _rocksdb->ingest_external_file(_data_cf, sst_files, ifo);
+        if (!s.ok()) {
+            DB_FATAL("ingest split sst fail, err: %s, region_id: %ld, new_region_id: %ld",
+                    s.ToString().c_str(), _region_id, _split_param.new_region_id);
+            _split_param.err_code = -1;
+            return;
+        }
+        DB_WARNING("ingest split sst, file_num: %lu, cost: %ld, region_id: %ld, new_region_id: %ld",
+                sst_files.size(), ingest_cost.get_time(), _region_id, _split_param.new_region_id);
+    }
+    Store::get_instance()->split_copy_lines << write_sst_lines.load();
+    Store::get_instance()->split_copy_bytes << write_sst_bytes.load();
+    DB_WARNING("split copy done, region_id: %ld, new_region_id: %ld, task_num: %d, lines: %ld, "
+            "bytes: %ld, cost: %ld, throughput: %ld KB/s", _region_id, _split_param.new_region_id,
+            task_count.load(), write_sst_lines.load(), write_sst_bytes.load(),
+            write_sst_time_cost.get_time(),
+            write_sst_bytes.load() * 1000 / std::max(write_sst_time_cost.get_time(), 1L));
     DB_WARNING("region split success when write sst file to new region,"
               "region_id: %ld, new_region_id: %ld, instance:%s, write_sst_lines:%ld, time_cost:%ld",
               _region_id, 
@@ -3398,6 +4144,71 @@ void Region::write_local_rocksdb_for_split() {
               _split_param.instance.c_str(),
               write_sst_lines.load(),
               write_sst_time_cost.get_time());
+}
+
+// 索引布局新老region共享key空间, 分裂只修改元数据, 不拷贝数据
+// 新region的行数按sst采样在分裂点两侧的比例估算
+void Region::estimate_lines_for_split() {
+    std::vector<std::string> total_samples;
+    std::vector<std::string> new_samples;
+    int64_t table_id = get_table_id();
+    get_sst_sample_keys(table_id, _region_info.start_key(), _region_info.end_key(), total_samples);
+    get_sst_sample_keys(table_id, _split_param.split_key, _region_info.end_key(), new_samples);
+    int64_t num_lines = _num_table_lines.load();
+    _split_param.reduce_num_lines = 0;
+    if (!total_samples.empty()) {
+        _split_param.reduce_num_lines = num_lines * new_samples.size() / total_samples.size();
+    }
+    DB_WARNING("split by meta only, region_id: %ld, new_region_id: %ld, split_key:%s, "
+            "num_lines: %ld, reduce_num_lines: %ld", _region_id, _split_param.new_region_id,
+            rocksdb::Slice(_split_param.split_key).ToString(true).c_str(),
+            num_lines, _split_param.reduce_num_lines);
+}
+
+//开始发送数据
+void Region::write_local_rocksdb_for_split() {
+    if (_shutdown) {
+        return;
+    }
+    _multi_thread_cond.increase();
+    ON_SCOPE_EXIT([this]() {
+        _multi_thread_cond.decrease_signal();
+    });
+    _split_param.op_start_split_cost = _split_param.op_start_split.get_time();
+    ScopeProcStatus split_status(this);
+
+    _split_param.split_slow_down = true;
+    TimeCost write_sst_time_cost;
+    //uint64_t imageid = TableKey(_split_param.split_key).extract_u64(0);
+
+    DB_WARNING("split param, region_id: %ld, term:%ld, split_start_index:%ld, split_end_index:%ld,"
+                " new_region_id: %ld, split_key:%s, instance:%s",
+                _region_id,
+                _split_param.split_term,
+                _split_param.split_start_index,
+                _split_param.split_end_index,
+                _split_param.new_region_id,
+                rocksdb::Slice(_split_param.split_key).ToString(true).c_str(),
+                //imageid,
+                _split_param.instance.c_str());
+    if (!is_leader()) {
+        DB_FATAL("leader transfer when split, split fail, region_id: %ld", _region_id);
+        return;
+    }
+    if (_region_info.index_key_layout()) {
+        // 共享key空间时prepared事务的行锁仍由老region持有, 无法在新region上重放
+        if (!_split_param.prepared_txn.empty()) {
+            DB_WARNING("has prepared txn, split by meta only fail, region_id: %ld, num_prepared: %lu",
+                    _region_id, _split_param.prepared_txn.size());
+            return;
+        }
+        estimate_lines_for_split();
+    } else {
+        copy_data_for_split(write_sst_time_cost);
+        if (_split_param.err_code != 0) {
+            return;
+        }
+    }
     _split_param.write_sst_cost = write_sst_time_cost.get_time();
     SmartRegion new_region = Store::get_instance()->get_region(_split_param.new_region_id);
     if (!new_region) {
@@ -3953,7 +4764,8 @@ int Region::get_log_entry_for_split(const int64_t split_start_index,
                 && store_req.op_type() != pb::OP_PREPARE_V2
                 && store_req.op_type() != pb::OP_ROLLBACK
                 && store_req.op_type() != pb::OP_COMMIT
-                && store_req.op_type() != pb::OP_KV_BATCH) {
+                && store_req.op_type() != pb::OP_KV_BATCH
+                && store_req.op_type() != pb::OP_DML_BATCH) {
             DB_WARNING("unexpected store_req:%s, region_id: %ld", 
                      pb2json(store_req).c_str(), _region_id);
             return -1;
@@ -3961,6 +4773,16 @@ int Region::get_log_entry_for_split(const int64_t split_start_index,
         if (store_req.op_type() == pb::OP_KV_BATCH) {
             store_req.set_op_type(pb::OP_KV_BATCH_SPLIT);
         }
+        if (store_req.op_type() == pb::OP_DML_BATCH) {
+            // 合并的dml拆开发给新region
+            for (auto& sub_req : *store_req.mutable_batch_reqs()) {
+                sub_req.set_region_id(_split_param.new_region_id);
+                sub_req.set_region_version(0);
+                requests.push_back(sub_req);
+            }
+            ++start_index;
+            continue;
+        }
         store_req.set_region_id(_split_param.new_region_id);
         store_req.set_region_version(0);
         requests.push_back(store_req);
@@ -3979,9 +4801,18 @@ int Region::get_split_key(std::string& split_key) {
                     tableid, _region_id);
         return -1;
     }
+    if (FLAGS_split_key_from_sst && get_split_key_from_sst(split_key) == 0) {
+        return 0;
+    }
+    // 索引布局下同分区其他region的数据在同一前缀下, 迭代器上界取本region的end_key
+    std::string range_start;
+    std::string range_end;
+    region_data_range(_region_info, &range_start, &range_end);
+    rocksdb::Slice upper_bound(range_end);
     rocksdb::ReadOptions read_options;
     read_options.total_order_seek = false;
     read_options.prefix_same_as_start = true;
+    read_options.iterate_upper_bound = &upper_bound;
     std::unique_ptr<rocksdb::Iterator> iter(_rocksdb->new_iterator(read_options, _data_cf));
     MutTableKey key;
 
@@ -3995,7 +4826,12 @@ int Region::get_split_key(std::string& split_key) {
     //        tableid, rocksdb::Slice(split_key).ToString(true).c_str(), _region_id);
     //    return 0;
     //}
-    key.append_i64(_region_id).append_i64(tableid);
+    key.append_i64(get_key_prefix()).append_i64(tableid);
+    std::string seek_key = key.data();
+    if (_region_info.index_key_layout()) {
+        // 同分区的其他region数据在同一前缀下, 从start_key开始计数
+        seek_key += _region_info.start_key();
+    }
 
     int64_t cur_idx = 0;
     int64_t pk_cnt = _num_table_lines.load();
@@ -4011,15 +4847,24 @@ int Region::get_split_key(std::string& split_key) {
     std::string prev_key;
     std::string min_diff_key;
     uint32_t min_diff = UINT32_MAX;
+    // 过期的行不计数, 按未过期的行取中点
+    bool skip_expired = use_ttl();
+    int64_t now_us = butil::gettimeofday_us();
 
-    for (iter->Seek(key.data()); iter->Valid() 
+    for (iter->Seek(seek_key); iter->Valid() 
             && iter->key().starts_with(key.data()); iter->Next()) {
         rocksdb::Slice pk_slice(iter->key());
         pk_slice.remove_prefix(2 * sizeof(int64_t));
         // check end_key
-        if (pk_slice.compare(_region_info.end_key()) >= 0) {
+        if (!_region_info.end_key().empty() && pk_slice.compare(_region_info.end_key()) >= 0) {
             break;
         }
+        if (skip_expired) {
+            rocksdb::Slice value(iter->value());
+            if (ttl_expired(ttl_decode(&value), now_us)) {
+                continue;
+            }
+        }
 
         cur_idx++;
         if (cur_idx < lower_bound) {
@@ -4067,6 +4912,146 @@ int Region::get_split_key(std::string& split_key) {
     return 0;
 }
 
+int64_t Region::estimate_ttl_live_lines() {
+    TimeCost cost;
+    MutTableKey key;
+    key.append_i64(get_key_prefix()).append_i64(get_table_id());
+    std::string seek_key = key.data();
+    if (_region_info.index_key_layout()) {
+        seek_key += _region_info.start_key();
+    }
+    // 只在leader本地估算, 不修改也不持久化_num_table_lines, 行数仍由raft日志维护
+    int64_t num_table_lines = _num_table_lines.load();
+    std::string range_start;
+    std::string range_end;
+    region_data_range(_region_info, &range_start, &range_end);
+    rocksdb::Slice upper_bound(range_end);
+    rocksdb::ReadOptions read_options;
+    read_options.total_order_seek = false;
+    read_options.prefix_same_as_start = true;
+    read_options.fill_cache = false;
+    read_options.iterate_upper_bound = &upper_bound;
+    read_options.snapshot = _rocksdb->get_snapshot();
+    ON_SCOPE_EXIT(([this, &read_options]() {
+        _rocksdb->relase_snapshot(read_options.snapshot);
+    }));
+    std::unique_ptr<rocksdb::Iterator> iter(_rocksdb->new_iterator(read_options, _data_cf));
+    int64_t now_us = butil::gettimeofday_us();
+    int64_t live_lines = 0;
+    int64_t expired_lines = 0;
+    for (iter->Seek(seek_key); iter->Valid()
+            && iter->key().starts_with(key.data()); iter->Next()) {
+        rocksdb::Slice pk_slice(iter->key());
+        pk_slice.remove_prefix(2 * sizeof(int64_t));
+        if (!_region_info.end_key().empty() && pk_slice.compare(_region_info.end_key()) >= 0) {
+            break;
+        }
+        if ((live_lines + expired_lines) % 10000 == 0 && (_shutdown || !is_leader())) {
+            return num_table_lines;
+        }
+        rocksdb::Slice value(iter->value());
+        if (ttl_expired(ttl_decode(&value), now_us)) {
+            ++expired_lines;
+        } else {
+            ++live_lines;
+        }
+    }
+    DB_WARNING("region_id: %ld estimate ttl live lines, num_table_lines: %ld, live_lines: %ld, "
+            "expired_lines: %ld, cost: %ld", _region_id, num_table_lines,
+            live_lines, expired_lines, cost.get_time());
+    return std::min(num_table_lines, live_lines);
+}
+
+void Region::get_sst_samples(const std::string& start, const std::string& end,
+        std::vector<std::string>& samples) {
+    // 只读取与该区间有交集的sst的properties, 代价与sst个数成正比
+    rocksdb::Range range(start, end);
+    rocksdb::TablePropertiesCollection props;
+    auto s = _rocksdb->get_db()->GetPropertiesOfTablesInRange(_data_cf, &range, 1, &props);
+    if (!s.ok()) {
+        DB_WARNING("get properties of tables fail, err: %s, region_id: %ld",
+                s.ToString().c_str(), _region_id);
+        return;
+    }
+    for (auto& pair : props) {
+        auto& user_props = pair.second->user_collected_properties;
+        auto iter = user_props.find(SplitKeyCollector::SAMPLES_PROPERTY);
+        if (iter == user_props.end()) {
+            continue;
+        }
+        std::vector<std::string> keys;
+        SplitKeyCollector::parse_samples(iter->second, &keys);
+        for (auto& key : keys) {
+            if (key > start && key < end) {
+                samples.push_back(key);
+            }
+        }
+    }
+    // 各层sst中的同一key可能被重复采样, 按key数近似
+    std::sort(samples.begin(), samples.end());
+}
+
+void Region::get_sst_sample_keys(int64_t index_id, const std::string& start_key,
+        const std::string& end_key, std::vector<std::string>& samples) {
+    MutTableKey prefix;
+    prefix.append_i64(get_key_prefix()).append_i64(index_id);
+    MutTableKey next_prefix;
+    next_prefix.append_i64(get_key_prefix()).append_i64(index_id + 1);
+    std::string start = prefix.data() + start_key;
+    std::string end = end_key.empty() ? next_prefix.data() : prefix.data() + end_key;
+    get_sst_samples(start, end, samples);
+    for (auto& key : samples) {
+        key.erase(0, prefix.size());
+    }
+}
+
+void Region::get_snapshot_range_keys(int count, const std::string& start,
+        const std::string& end, std::vector<std::string>& keys) {
+    std::vector<std::string> samples;
+    get_sst_samples(start, end, samples);
+    samples.erase(std::unique(samples.begin(), samples.end()), samples.end());
+    if (count <= 1 || (int)samples.size() < count) {
+        return;
+    }
+    for (int i = 1; i < count; ++i) {
+        keys.push_back(samples[samples.size() * i / count]);
+    }
+}
+
+int Region::get_split_key_from_sst(std::string& split_key) {
+    TimeCost cost;
+    int64_t tableid = _region_info.table_id();
+    std::vector<std::string> samples;
+    get_sst_sample_keys(tableid, _region_info.start_key(), _region_info.end_key(), samples);
+    if ((int64_t)samples.size() < FLAGS_split_min_sample_count) {
+        DB_WARNING("sample count: %lu not enough, region_id: %ld",
+                samples.size(), _region_id);
+        return -1;
+    }
+    int64_t mid = samples.size() / 2;
+    int64_t skew = samples.size() * FLAGS_skew / 100;
+    if (skew > 0) {
+        mid += butil::fast_rand() % (2 * skew + 1) - skew;
+    }
+    _split_param.split_key = samples[mid];
+    split_key = _split_param.split_key;
+    DB_WARNING("table_id:%ld, split_key from sst:%s, sample_count:%lu, cost:%ld, region_id: %ld",
+            tableid, rocksdb::Slice(split_key).ToString(true).c_str(), samples.size(),
+            cost.get_time(), _region_id);
+    return 0;
+}
+
+int Region::get_load_split_key(std::string& split_key) {
+    if (_load_stat.get_split_key(_region_info.start_key(), _region_info.end_key(), split_key) != 0) {
+        return -1;
+    }
+    _split_param.split_key = split_key;
+    DB_WARNING("table_id:%ld, load split_key:%s, read_qps:%ld, write_qps:%ld, cpu_time_us:%ld, "
+            "region_id: %ld", _region_info.table_id(), rocksdb::Slice(split_key).ToString(true).c_str(),
+            _load_stat.read_qps(), _load_stat.write_qps(), _load_stat.cpu_time_us(), _region_id);
+    return 0;
+}
+
 int Region::ddlwork_process(const pb::DdlWorkInfo& store_ddl_work) {
     BAIDU_SCOPED_LOCK(_region_ddl_lock);
     //走状态流，走raft更新ddlwork状态。
@@ -4196,8 +5181,8 @@ void Region::delete_local_rocksdb_for_ddl() {
     rocksdb::WriteOptions write_options;
     MutTableKey begin_key;
     MutTableKey end_key;
-    begin_key.append_i64(_region_id).append_i64(_ddl_param.index_id);
-    end_key.append_i64(_region_id).append_i64(_ddl_param.index_id).append_u64(0xFFFFFFFFFFFFFFFF);
+    begin_key.append_i64(get_key_prefix()).append_i64(_ddl_param.index_id);
+    end_key.append_i64(get_key_prefix()).append_i64(_ddl_param.index_id).append_u64(0xFFFFFFFFFFFFFFFF);
     auto res = _rocksdb->remove_range(write_options, _data_cf, begin_key.data(), end_key.data());
     if (!res.ok()) {
         DB_FATAL("DDL_LOG remove_index error: code=%d, msg=%s, region_id: %ld", 
@@ -4260,7 +5245,7 @@ void Region::write_local_rocksdb_for_ddl() {
     read_options.snapshot = _rocksdb->get_db()->GetSnapshot();
     std::unique_ptr<rocksdb::Iterator> iter(_rocksdb->new_iterator(read_options, _data_cf));
     MutTableKey table_prefix;
-    table_prefix.append_i64(_region_id).append_i64(pk_index_id);
+    table_prefix.append_i64(get_key_prefix()).append_i64(pk_index_id);
 
     ON_SCOPE_EXIT(([this, &is_success, &all_num, &success_num](){
         //完成写入，设置work状态。不走raft，各peer进度不一样。
@@ -18,6 +18,7 @@
 #include "store.h"
 #include "concurrency.h"
 #include "region.h"
+#include "key_layout.h"
 #include "mut_table_key.h"
 #include "my_raft_log_storage.h"
 #include "closure.h"
@@ -28,15 +29,9 @@ DECLARE_string(snapshot_uri);
 DECLARE_string(stable_uri);
 DECLARE_int32(election_timeout_ms);
 DEFINE_int32(compact_interval, 1, "compact_interval xx (s)");
-int RegionControl::remove_data(int64_t drop_region_id) {
+static int remove_data_range(const std::string& start_key, const std::string& end_key,
+        int64_t drop_region_id) {
     rocksdb::WriteOptions options;
-    MutTableKey start_key;
-    MutTableKey end_key;
-    start_key.append_i64(drop_region_id);
-
-    end_key.append_i64(drop_region_id);
-    end_key.append_u64(0xFFFFFFFFFFFFFFFF);
-
     auto rocksdb = RocksWrapper::get_instance();
     auto data_cf = rocksdb->get_data_handle();
     if (data_cf == nullptr) {
@@ -44,8 +39,7 @@ int RegionControl::remove_data(int64_t drop_region_id) {
         return -1;
     }
     TimeCost cost;
-    auto res = rocksdb->remove_range(options, data_cf, 
-            start_key.data(), end_key.data());
+    auto res = rocksdb->remove_range(options, data_cf, start_key, end_key);
     if (!res.ok()) {
         DB_WARNING("remove_range error: code=%d, msg=%s, region_id: %ld", 
             res.code(), res.ToString().c_str(), drop_region_id);
@@ -55,6 +49,41 @@ int RegionControl::remove_data(int64_t drop_region_id) {
     return 0;
 }
 
+int RegionControl::remove_data(int64_t drop_region_id) {
+    MutTableKey start_key;
+    MutTableKey end_key;
+    start_key.append_i64(drop_region_id);
+
+    end_key.append_i64(drop_region_id);
+    end_key.append_u64(0xFFFFFFFFFFFFFFFF);
+    return remove_data_range(start_key.data(), end_key.data(), drop_region_id);
+}
+
+// 索引布局的数据在分区前缀下, 按region区间删除
+// 分裂未完成时新老region区间重叠, 数据仍被另一个region使用, 不能删除
+int RegionControl::remove_key_range(const pb::RegionInfo& region_info) {
+    if (!region_info.index_key_layout()) {
+        return 0;
+    }
+    if (Store::get_instance()->has_overlapped_region(region_info)) {
+        DB_WARNING("region_id: %ld overlapped with other region, skip remove data range",
+                region_info.region_id());
+        return 0;
+    }
+    std::string start_key;
+    std::string end_key;
+    region_data_range(region_info, &start_key, &end_key);
+    return remove_data_range(start_key, end_key, region_info.region_id());
+}
+
+int RegionControl::remove_data(const pb::RegionInfo& region_info) {
+    int ret = remove_data(region_info.region_id());
+    if (remove_key_range(region_info) != 0) {
+        return -1;
+    }
+    return ret;
+}
+
 void RegionControl::compact_data(int64_t region_id) {
     MutTableKey start_key;
     MutTableKey end_key;
@@ -62,6 +91,16 @@ void RegionControl::compact_data(int64_t region_id) {
 
     end_key.append_i64(region_id);
     end_key.append_u64(0xFFFFFFFFFFFFFFFF);
+    std::string start_str = start_key.data();
+    std::string end_str = end_key.data();
+    SmartRegion region = Store::get_instance()->get_region(region_id);
+    if (region != nullptr) {
+        pb::RegionInfo region_info;
+        region->get_region_info(region_info);
+        if (region_info.index_key_layout()) {
+            region_data_range(region_info, &start_str, &end_str);
+        }
+    }
 
     auto rocksdb = RocksWrapper::get_instance();
     auto data_cf = rocksdb->get_data_handle();
@@ -70,8 +109,8 @@ void RegionControl::compact_data(int64_t region_id) {
         return;
     }
     TimeCost cost;
-    rocksdb::Slice start(start_key.data());
-    rocksdb::Slice end(end_key.data());
+    rocksdb::Slice start(start_str);
+    rocksdb::Slice end(end_str);
     rocksdb::CompactRangeOptions compact_options;
     compact_options.exclusive_manual_compaction = false;
     auto res = rocksdb->compact_range(compact_options, data_cf, &start, &end);
@@ -155,6 +194,14 @@ int RegionControl::clear_all_infos_for_region(int64_t drop_region_id) {
     remove_log_entry(drop_region_id);
     return 0;
 }
+int RegionControl::clear_all_infos_for_region(const pb::RegionInfo& region_info) {
+    int64_t drop_region_id = region_info.region_id();
+    remove_data(region_info);
+    remove_meta(drop_region_id);
+    remove_snapshot_path(drop_region_id);
+    remove_log_entry(drop_region_id);
+    return 0;
+}
 int RegionControl::ingest_data_sst(const std::string& data_sst_file, int64_t region_id) {
     auto rocksdb = RocksWrapper::get_instance();
     rocksdb::IngestExternalFileOptions ifo;
@@ -0,0 +1,117 @@
+// Copyright (c) 2018-present Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "region_load_stat.h"
+#include <algorithm>
+#include <map>
+#include <cstdlib>
+
+namespace baikaldb {
+DEFINE_int64(hot_region_qps, 5000, "region with read+write qps above this is hot");
+DEFINE_int64(hot_region_cpu_time_us, 500 * 1000LL, "region with exec time per second above this is hot");
+DEFINE_int32(hot_region_periods, 3, "region is hot after this many consecutive hot heartbeats");
+DEFINE_int32(load_sample_size, 1000, "max sampled access keys per heartbeat period");
+DEFINE_int32(load_split_min_ratio, 10, "each side of load split should take at least N% access");
+DEFINE_int32(load_sample_rate, 16, "sample one of every N accesses for load split");
+
+void RegionLoadStat::sample_key(const std::string& key) {
+    if (key.empty()) {
+        return;
+    }
+    // 写路径上先按概率过滤, 只有命中的访问才加锁; 锁被占用时丢弃本次采样, 不阻塞apply
+    if (FLAGS_load_sample_rate > 1 && butil::fast_rand() % FLAGS_load_sample_rate != 0) {
+        return;
+    }
+    std::unique_lock<std::mutex> lock(_sample_mutex, std::try_to_lock);
+    if (!lock.owns_lock()) {
+        return;
+    }
+    ++_sample_seen;
+    if ((int64_t)_samples.size() < FLAGS_load_sample_size) {
+        _samples.push_back(key);
+        return;
+    }
+    int64_t idx = butil::fast_rand() % _sample_seen;
+    if (idx < FLAGS_load_sample_size) {
+        _samples[idx] = key;
+    }
+}
+
+void RegionLoadStat::update() {
+    int64_t elapsed_us = _last_update.get_time();
+    if (elapsed_us <= 0) {
+        return;
+    }
+    _last_update.reset();
+    int64_t read_qps = _read_count.exchange(0) * 1000000 / elapsed_us;
+    int64_t write_qps = _write_count.exchange(0) * 1000000 / elapsed_us;
+    int64_t cpu_time_per_second = _cpu_time_us.exchange(0) * 1000000 / elapsed_us;
+    _read_qps.store(read_qps, std::memory_order_relaxed);
+    _write_qps.store(write_qps, std::memory_order_relaxed);
+    _cpu_time_per_second.store(cpu_time_per_second, std::memory_order_relaxed);
+    if (read_qps + write_qps > FLAGS_hot_region_qps
+            || cpu_time_per_second > FLAGS_hot_region_cpu_time_us) {
+        _hot_periods.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        _hot_periods.store(0, std::memory_order_relaxed);
+    }
+    std::lock_guard<std::mutex> lock(_sample_mutex);
+    _last_samples.swap(_samples);
+    _samples.clear();
+    _sample_seen = 0;
+}
+
+int RegionLoadStat::get_split_key(const std::string& start_key, const std::string& end_key,
+        std::string& split_key) {
+    std::map<std::string, int64_t> key_counts;
+    {
+        std::lock_guard<std::mutex> lock(_sample_mutex);
+        for (auto& key : _last_samples) {
+            if (key <= start_key || (!end_key.empty() && key >= end_key)) {
+                continue;
+            }
+            key_counts[key]++;
+        }
+    }
+    int64_t total = 0;
+    for (auto& pair : key_counts) {
+        total += pair.second;
+    }
+    if (key_counts.size() < 2) {
+        return -1;
+    }
+    // 分裂点左侧为[start_key, key), 取左右访问量最接近的key
+    int64_t left = 0;
+    int64_t best_diff = INT64_MAX;
+    int64_t best_left = 0;
+    for (auto& pair : key_counts) {
+        if (left > 0) {
+            int64_t diff = std::abs(total - 2 * left);
+            if (diff < best_diff) {
+                best_diff = diff;
+                best_left = left;
+                split_key = pair.first;
+            }
+        }
+        left += pair.second;
+    }
+    int64_t min_side = std::min(best_left, total - best_left);
+    if (min_side * 100 < total * FLAGS_load_split_min_ratio) {
+        return -1;
+    }
+    return 0;
+}
+}
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
@@ -14,6 +14,7 @@
 
 #include <store.h>
 #include <sys/vfs.h>
+#include <algorithm>
 #include <boost/lexical_cast.hpp>
 #include <boost/scoped_array.hpp>
 #include <boost/filesystem.hpp>
@@ -36,6 +37,11 @@ DECLARE_int32(balance_periodicity);
 DECLARE_string(stable_uri);
 DECLARE_string(snapshot_uri);
 DEFINE_int32(reverse_merge_interval_us, 2 * 1000 * 1000,  "reverse_merge_interval(2 s)");
+DEFINE_int32(reverse_merge_concurrency, 4, "reverse merge concurrency, default:4");
+DEFINE_int64(reverse_merge_max_backlog_per_second, 0,
+            "max level-1 reverse nodes merged per second, 0 means no limit");
+DEFINE_int64(reverse_merge_idle_interval_us, 60 * 1000 * 1000LL,
+            "merge interval of regions without level-1 backlog, default(60 s)");
 //DEFINE_int32(update_status_interval_us, 2 * 1000 * 1000,  "update_status_interval(2 s)");
 DEFINE_int32(store_port, 8110, "Server port");
 DEFINE_string(db_path, "./rocks_db", "rocksdb path");
@@ -49,9 +55,17 @@ DEFINE_int64(flush_region_interval_us, 10 * 60 * 1000 * 1000LL,
 DEFINE_int64(transaction_clear_interval_ms, 1000LL,
             "transaction clear interval, defalut(1s)");
 DEFINE_int32(max_split_concurrency, 2, "max split region concurrency, default:2");
+DEFINE_bool(load_split, false, "split hot regions by access load");
+DEFINE_int64(load_split_min_lines, 1000, "min lines of a hot region to do load split");
+DEFINE_bool(store_delta_heartbeat, false, "only report changed leader regions in heartbeat, "
+            "take effect after meta advertises support");
+DEFINE_int32(store_full_heartbeat_interval, 10,
+            "report all leader regions every N heartbeats when delta heartbeat is on");
 DEFINE_int64(none_region_merge_interval_us, 5 * 60 * 1000 * 1000LL, 
              "none region merge interval, defalut(5 min)");
-Store::~Store() {}
+Store::~Store() {
+    bthread_mutex_destroy(&_heart_beat_mutex);
+}
 
 int Store::init_before_listen(std::vector<std::int64_t>& init_region_ids) {
     butil::EndPoint addr;
@@ -133,13 +147,18 @@ int Store::init_before_listen(std::vector<std::int64_t>& init_region_ids) {
         DB_FATAL("read region_infos from rocksdb fail");
         return ret;
     }
+    std::vector<pb::RegionInfo> dropped_region_infos;
     for (auto& region_info : region_infos) {
         DB_WARNING("region_info:%s when init store", region_info.ShortDebugString().c_str());
         int64_t region_id = region_info.region_id();
         if (region_info.version() == 0) {
             DB_WARNING("region_id: %ld version is 0, dropped. region_info: %s",
                     region_id, region_info.ShortDebugString().c_str() );
+            // 此时其他region还未加载, 无法判断区间是否被共享, 索引布局的区间数据等全部加载后再删除
             RegionControl::clear_all_infos_for_region(region_id);
+            if (region_info.index_key_layout()) {
+                dropped_region_infos.push_back(region_info);
+            }
             continue;
         }
         //construct region
@@ -167,6 +186,10 @@ int Store::init_before_listen(std::vector<std::int64_t>& init_region_ids) {
         _region_mapping.set(region_id, region);
         init_region_ids.push_back(region_id);
     }
+    // 与存活region区间重叠的数据仍在使用(分裂未完成), remove_key_range内会跳过
+    for (auto& region_info : dropped_region_infos) {
+        RegionControl::remove_key_range(region_info);
+    }
     //重启的region跟新建的region或者正常运行情况下的region有两点区别
     //1、重启region的on_snapshot_load不受并发数的限制
     //2、重启region的on_snapshot_load不加载sst文件
@@ -306,7 +329,9 @@ void Store::init_region(google::protobuf::RpcController* controller,
     Concurrency::get_instance()->init_region_concurrency.decrease_broadcast();
     if (ret < 0) {
         //删除该region相关的全部信息
-        RegionControl::clear_all_infos_for_region(region_id);
+        pb::RegionInfo region_info;
+        region->get_region_info(region_info);
+        RegionControl::clear_all_infos_for_region(region_info);
         erase_region(region_id);
         DB_FATAL("region init fail when add region, region_id: %ld, log_id:%lu",
                     region_id, log_id);
@@ -595,25 +620,85 @@ void Store::heart_beat_thread() {
 void Store::send_heart_beat() {
     pb::StoreHeartBeatRequest request;
     pb::StoreHeartBeatResponse response;
+    BAIDU_SCOPED_LOCK(_heart_beat_mutex);
     //1、构造心跳请求
     construct_heart_beat_request(request);
     print_heartbeat_info(request);
     //2、发送请求
     if (_meta_server_interact.send_request("store_heartbeat", request, response) != 0) {
         DB_WARNING("send heart beat request to meta server fail");
+        //meta可能没有收到本次的变化, 下次全量上报
+        _need_full_heartbeat = true;
     } else {
+        _meta_support_delta_heartbeat = response.support_delta_heartbeat();
+        if (response.need_full_heartbeat()) {
+            DB_WARNING("meta server need full heartbeat");
+            _need_full_heartbeat = true;
+        }
         //处理心跳
         process_heart_beat_response(response);
     }
     SELF_TRACE("heart beat response:%s", response.ShortDebugString().c_str());
 }
 
+// 每轮按1级倒排积压量从大到小并发merge
+// 积压为0的region只按reverse_merge_idle_interval_us兜底merge, 重启前残留的1级倒排没有计数
+// 限速时超出本轮额度的region推迟到下一轮, 积压保留, 仍然优先
 void Store::reverse_merge_thread() {
+    std::unordered_map<int64_t, TimeCost> last_merge_time;
     while (_is_running) {
-        traverse_copy_region_map([](SmartRegion& region) {
-            region->reverse_merge();
+        TimeCost round_cost;
+        std::vector<std::pair<int64_t, SmartRegion>> candidates;
+        std::unordered_map<int64_t, TimeCost> region_merge_time;
+        int64_t total_backlog = 0;
+        traverse_copy_region_map([&](SmartRegion& region) {
+            int64_t backlog = region->reverse_merge_backlog();
+            if (backlog < 0) {
+                return;
+            }
+            total_backlog += backlog;
+            int64_t region_id = region->get_region_id();
+            auto iter = last_merge_time.find(region_id);
+            if (iter != last_merge_time.end()) {
+                region_merge_time[region_id] = iter->second;
+                if (backlog == 0 && iter->second.get_time() < FLAGS_reverse_merge_idle_interval_us) {
+                    return;
+                }
+            }
+            candidates.emplace_back(backlog, region);
         });
-        bthread_usleep(FLAGS_reverse_merge_interval_us);
+        last_merge_time.swap(region_merge_time);
+        reverse_merge_backlog.set_value(total_backlog);
+        std::stable_sort(candidates.begin(), candidates.end(),
+                [](const std::pair<int64_t, SmartRegion>& l,
+                    const std::pair<int64_t, SmartRegion>& r) {
+                    return l.first > r.first;
+                });
+        int64_t budget = FLAGS_reverse_merge_max_backlog_per_second *
+            FLAGS_reverse_merge_interval_us / 1000000;
+        int64_t merged_backlog = 0;
+        ConcurrencyBthread merge_bth(FLAGS_reverse_merge_concurrency);
+        for (size_t i = 0; i < candidates.size() && _is_running; ++i) {
+            int64_t backlog = candidates[i].first;
+            // 至少merge积压最大的一个region, 避免额度过小时饿死
+            if (budget > 0 && i > 0 && merged_backlog + backlog > budget) {
+                reverse_merge_deferred << (candidates.size() - i);
+                break;
+            }
+            merged_backlog += backlog;
+            SmartRegion region = candidates[i].second;
+            last_merge_time[region->get_region_id()].reset();
+            merge_bth.run([this, region]() {
+                TimeCost cost;
+                region->reverse_merge();
+                reverse_merge_time_cost << cost.get_time();
+            });
+        }
+        merge_bth.join();
+        int64_t sleep_us = FLAGS_reverse_merge_interval_us - round_cost.get_time();
+        if (sleep_us > 0) {
+            bthread_usleep(sleep_us);
+        }
     }
 }
 
@@ -823,6 +908,14 @@ void Store::whether_split_thread() {
             }
             region_capacity = std::max(FLAGS_min_split_lines, region_capacity);
             //DB_WARNING("region_id: %ld, split_capacity: %ld", region_ids[i], region_capacity);
+            // ttl表的行数包含还未被compaction删除的过期行, 达到分裂行数时按未过期的行估算
+            if (ptr_region->is_leader()
+                    && ptr_region->get_status() == pb::IDLE
+                    && region_num_lines[i] >= std::min(region_capacity,
+                        FLAGS_split_threshold * region_capacity / 100)
+                    && ptr_region->use_ttl()) {
+                region_num_lines[i] = ptr_region->estimate_ttl_live_lines();
+            }
             std::string split_key;
             //如果是尾部分
             if (ptr_region->is_leader() 
@@ -845,6 +938,18 @@ void Store::whether_split_thread() {
                 process_split_request(ptr_region->get_table_id(), region_ids[i], false, split_key);
                 continue;
             }
+            //热点region按访问负载分裂, 不受行数限制
+            if (FLAGS_load_split
+                    && ptr_region->is_leader()
+                    && ptr_region->is_hot()
+                    && region_num_lines[i] >= FLAGS_load_split_min_lines
+                    && ptr_region->get_status() == pb::IDLE
+                    && _split_num.load() < FLAGS_max_split_concurrency) {
+                if (0 == ptr_region->get_load_split_key(split_key)) {
+                    process_split_request(ptr_region->get_table_id(), region_ids[i], false, split_key);
+                    continue;
+                }
+            }
             
             if (!_factory->get_merge_switch(ptr_region->get_table_id())) {
                 continue;
@@ -1010,6 +1115,13 @@ void Store::construct_heart_beat_request(pb::StoreHeartBeatRequest& request) {
         request.set_need_peer_balance(true);
         need_peer_balance = true;
     }
+    //leader均衡需要全部leader region的信息, 同时定期全量上报兜底
+    bool delta = FLAGS_store_delta_heartbeat && _meta_support_delta_heartbeat
+            && !_need_full_heartbeat
+            && !request.need_leader_balance()
+            && count % std::max(FLAGS_store_full_heartbeat_interval, 1) != 0;
+    request.set_delta_heartbeat(delta);
+    _need_full_heartbeat = false;
     //构造instance信息
     pb::InstanceInfo* instance_info = request.mutable_instance_info();
     instance_info->set_address(_address);
@@ -1042,8 +1154,10 @@ void Store::construct_heart_beat_request(pb::StoreHeartBeatRequest& request) {
     });
 
     //构造所有region的version信息
-    traverse_copy_region_map([&request, need_peer_balance, &ddl_wait_doing_table_ids](SmartRegion& region) {
-        region->construct_heart_beat_request(request, need_peer_balance, ddl_wait_doing_table_ids);
+    traverse_copy_region_map([&request, need_peer_balance, &ddl_wait_doing_table_ids, delta](
+                SmartRegion& region) {
+        region->construct_heart_beat_request(request, need_peer_balance,
+                ddl_wait_doing_table_ids, delta);
     });
 
 }
@@ -1130,16 +1244,20 @@ int Store::drop_region_from_store(int64_t drop_region_id) {
     region->shutdown();
     region->join();
     DB_WARNING("region node close, region_id: %ld", drop_region_id);
-    RegionControl::clear_all_infos_for_region(drop_region_id);
+    RegionControl::clear_all_infos_for_region(region_info);
     erase_region(drop_region_id);
     return 0; 
 }
 
 void Store::print_heartbeat_info(const pb::StoreHeartBeatRequest& request) {
-    SELF_TRACE("heart beat request(instance_info):%s, need_leader_balance: %d, need_peer_balance: %d", 
+    SELF_TRACE("heart beat request(instance_info):%s, need_leader_balance: %d, need_peer_balance: %d, "
+                "delta_heartbeat: %d, leader_regions: %d, unchanged_leader_regions: %d", 
                 request.instance_info().ShortDebugString().c_str(), 
                 request.need_leader_balance(), 
-                request.need_peer_balance());
+                request.need_peer_balance(),
+                request.delta_heartbeat(),
+                request.leader_regions_size(),
+                request.unchanged_leader_regions_size());
     std::string str_schema;
     for (auto& schema_info : request.schema_infos()) {
         str_schema += schema_info.ShortDebugString() + ", ";
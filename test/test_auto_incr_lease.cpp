@@ -0,0 +1,129 @@
+// Copyright (c) 2018-present Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+#include <functional>
+#include "auto_inc.h"
+
+int main(int argc, char* argv[]) {
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
+
+namespace baikaldb {
+// 模拟meta的自增状态机, 每次租用从next_id开始分配
+struct FakeMeta {
+    int64_t next_id = 1;
+    uint64_t epoch = 0;
+    int fetch_count = 0;
+    bool fail = false;
+    std::function<void()> on_fetch;
+
+    AutoIncrLease::FetchFunc fetch_func() {
+        return [this](int64_t count, pb::MetaManagerResponse& response) {
+            ++fetch_count;
+            if (on_fetch) {
+                on_fetch();
+            }
+            if (fail) {
+                return -1;
+            }
+            response.set_errcode(pb::SUCCESS);
+            response.set_start_id(next_id);
+            response.set_end_id(next_id + count);
+            response.set_auto_incr_epoch(epoch);
+            next_id += count;
+            return 0;
+        };
+    }
+};
+
+TEST(test_auto_incr_lease, alloc) {
+    FakeMeta meta;
+    AutoIncrLease lease(1, meta.fetch_func());
+    int64_t start_id = 0;
+    for (int64_t i = 1; i <= 50; ++i) {
+        ASSERT_EQ(0, lease.alloc(1, &start_id));
+        ASSERT_EQ(i, start_id);
+    }
+    // 一条语句的id连续分配
+    ASSERT_EQ(0, lease.alloc(10, &start_id));
+    ASSERT_EQ(51, start_id);
+    ASSERT_EQ(1, meta.fetch_count);
+    // 超过段长时按需获取
+    ASSERT_EQ(0, lease.alloc(1000, &start_id));
+    ASSERT_GT(start_id, 60);
+    ASSERT_EQ(2, meta.fetch_count);
+}
+
+TEST(test_auto_incr_lease, update_epoch) {
+    FakeMeta meta;
+    AutoIncrLease lease(1, meta.fetch_func());
+    int64_t start_id = 0;
+    ASSERT_EQ(0, lease.alloc(1, &start_id));
+    ASSERT_EQ(1, start_id);
+    // epoch未增大时保留已租用的段
+    lease.update_epoch(0);
+    ASSERT_EQ(0, lease.alloc(1, &start_id));
+    ASSERT_EQ(2, start_id);
+    ASSERT_EQ(1, meta.fetch_count);
+
+    // 其他节点显式插入id后心跳下发新的epoch, 本地段作废
+    meta.epoch = 5;
+    lease.update_epoch(5);
+    int64_t expect_id = meta.next_id;
+    ASSERT_EQ(0, lease.alloc(1, &start_id));
+    ASSERT_EQ(2, meta.fetch_count);
+    ASSERT_EQ(expect_id, start_id);
+    // 旧epoch不回退
+    lease.update_epoch(3);
+    int64_t next_id = 0;
+    ASSERT_EQ(0, lease.alloc(1, &next_id));
+    ASSERT_EQ(start_id + 1, next_id);
+    ASSERT_EQ(2, meta.fetch_count);
+}
+
+// 同步获取时不持有锁: 获取期间更新epoch不会死锁, 获取到的旧epoch的段被丢弃后重新获取
+TEST(test_auto_incr_lease, stale_fetch) {
+    FakeMeta meta;
+    AutoIncrLease lease(1, meta.fetch_func());
+    int64_t expect_id = 0;
+    meta.on_fetch = [&meta, &lease, &expect_id]() {
+        if (meta.fetch_count == 1) {
+            lease.update_epoch(2);
+        } else {
+            meta.epoch = 2;
+            expect_id = meta.next_id;
+        }
+    };
+    int64_t start_id = 0;
+    ASSERT_EQ(0, lease.alloc(1, &start_id));
+    ASSERT_EQ(2, meta.fetch_count);
+    ASSERT_GT(expect_id, 1);
+    ASSERT_EQ(expect_id, start_id);
+}
+
+TEST(test_auto_incr_lease, fetch_fail) {
+    FakeMeta meta;
+    meta.fail = true;
+    AutoIncrLease lease(1, meta.fetch_func());
+    int64_t start_id = 0;
+    ASSERT_EQ(-1, lease.alloc(1, &start_id));
+    meta.fail = false;
+    ASSERT_EQ(0, lease.alloc(1, &start_id));
+    ASSERT_EQ(1, start_id);
+}
+}  // namespace baikaldb
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
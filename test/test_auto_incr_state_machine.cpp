@@ -12,6 +12,7 @@
 // See the License for the specific language governing permissions and
 // limitations under the License. 
 
+#include <fstream>
 #include "gtest/gtest.h"
 #include "auto_incr_state_machine.h"
 
@@ -86,6 +87,67 @@ TEST_F(AutoIncrStateMachineTest, test_create_drop_modify) {
     ASSERT_EQ(1, _auto_incr->_auto_increment_map.size());
     ASSERT_EQ(39, _auto_incr->_auto_increment_map[1]);
 } // TEST_F
+
+TEST_F(AutoIncrStateMachineTest, test_lease_epoch) {
+    baikaldb::pb::MetaManagerRequest add_table_id_request;
+    add_table_id_request.set_op_type(baikaldb::pb::OP_ADD_ID_FOR_AUTO_INCREMENT);
+    add_table_id_request.mutable_auto_increment()->set_table_id(1);
+    add_table_id_request.mutable_auto_increment()->set_start_id(1);
+    _auto_incr->add_table_id(add_table_id_request, NULL);
+    ASSERT_EQ(0, _auto_incr->get_lease_epoch(1));
+
+    //test_point: 租用id不改变epoch
+    baikaldb::pb::MetaManagerRequest gen_id_request;
+    gen_id_request.set_op_type(baikaldb::pb::OP_GEN_ID_FOR_AUTO_INCREMENT);
+    gen_id_request.mutable_auto_increment()->set_table_id(1);
+    gen_id_request.mutable_auto_increment()->set_count(100);
+    gen_id_request.mutable_auto_increment()->set_start_id(0);
+    _auto_incr->_apply_index = 10;
+    _auto_incr->gen_id(gen_id_request, NULL);
+    ASSERT_EQ(101, _auto_incr->_auto_increment_map[1]);
+    ASSERT_EQ(0, _auto_incr->get_lease_epoch(1));
+
+    //test_point: 显式id小于当前自增值时也可能与已租出的段冲突
+    gen_id_request.mutable_auto_increment()->set_count(0);
+    gen_id_request.mutable_auto_increment()->set_start_id(50);
+    _auto_incr->_apply_index = 11;
+    _auto_incr->gen_id(gen_id_request, NULL);
+    ASSERT_EQ(101, _auto_incr->_auto_increment_map[1]);
+    ASSERT_EQ(11, _auto_incr->get_lease_epoch(1));
+
+    //test_point: alter修改自增值
+    baikaldb::pb::MetaManagerRequest update_id_request;
+    update_id_request.set_op_type(baikaldb::pb::OP_UPDATE_FOR_AUTO_INCREMENT);
+    update_id_request.mutable_auto_increment()->set_table_id(1);
+    update_id_request.mutable_auto_increment()->set_start_id(200);
+    _auto_incr->_apply_index = 12;
+    _auto_incr->update(update_id_request, NULL);
+    ASSERT_EQ(201, _auto_incr->_auto_increment_map[1]);
+    ASSERT_EQ(12, _auto_incr->get_lease_epoch(1));
+
+    baikaldb::pb::BaikalHeartBeatResponse response;
+    _auto_incr->process_baikal_heartbeat(&response);
+    ASSERT_EQ(1, response.auto_incr_epochs_size());
+    ASSERT_EQ(1, response.auto_incr_epochs(0).table_id());
+    ASSERT_EQ(12, response.auto_incr_epochs(0).epoch());
+
+    std::string epoch_string;
+    _auto_incr->save_lease_epoch(epoch_string);
+    _auto_incr->_lease_epoch_map.clear();
+    std::string epoch_file = "./lease_epoch.json";
+    std::ofstream fs(epoch_file, std::ofstream::out | std::ofstream::trunc);
+    fs << epoch_string;
+    fs.close();
+    ASSERT_EQ(0, _auto_incr->load_lease_epoch(epoch_file));
+    ASSERT_EQ(12, _auto_incr->get_lease_epoch(1));
+
+    //test_point: drop表后epoch删除
+    baikaldb::pb::MetaManagerRequest drop_id_request;
+    drop_id_request.set_op_type(baikaldb::pb::OP_DROP_ID_FOR_AUTO_INCREMENT);
+    drop_id_request.mutable_auto_increment()->set_table_id(1);
+    _auto_incr->drop_table_id(drop_id_request, NULL);
+    ASSERT_EQ(0, _auto_incr->get_lease_epoch(1));
+} // TEST_F
 int main(int argc, char** argv) {
     testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
@@ -0,0 +1,114 @@
+// Copyright (c) 2018-present Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+#include <string>
+#include "key_layout.h"
+
+int main(int argc, char* argv[]) {
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
+
+namespace baikaldb {
+static pb::RegionInfo make_region(int64_t region_id, bool index_key_layout,
+        const std::string& start_key, const std::string& end_key,
+        int64_t partition_id = 0, int64_t table_id = 1) {
+    pb::RegionInfo region_info;
+    region_info.set_region_id(region_id);
+    region_info.set_table_id(table_id);
+    region_info.set_partition_id(partition_id);
+    region_info.set_version(1);
+    region_info.set_start_key(start_key);
+    region_info.set_end_key(end_key);
+    region_info.set_index_key_layout(index_key_layout);
+    return region_info;
+}
+
+static std::string data_key(int64_t prefix, int64_t index_id, const std::string& key) {
+    MutTableKey table_key;
+    table_key.append_i64(prefix).append_i64(index_id).append_index(key);
+    return table_key.data();
+}
+
+TEST(test_key_layout, prefix) {
+    // 分区前缀为负数, 不与region_id冲突
+    EXPECT_EQ(-1, index_layout_prefix(0));
+    EXPECT_EQ(-4, index_layout_prefix(3));
+    EXPECT_EQ(10, data_key_prefix(make_region(10, false, "a", "b", 3)));
+    EXPECT_EQ(-4, data_key_prefix(make_region(10, true, "a", "b", 3)));
+}
+
+TEST(test_key_layout, region_id_range) {
+    std::string start;
+    std::string end;
+    region_data_range(make_region(10, false, "a", "b"), &start, &end);
+    MutTableKey expect_start;
+    MutTableKey expect_end;
+    expect_start.append_i64(10);
+    expect_end.append_i64(10).append_u64(UINT64_MAX);
+    EXPECT_EQ(expect_start.data(), start);
+    EXPECT_EQ(expect_end.data(), end);
+    // region_id布局与start_key/end_key无关, 相邻region_id的数据不在区间内
+    EXPECT_LT(data_key(10, 1, "zzz"), end);
+    EXPECT_GE(data_key(11, 1, ""), end);
+    EXPECT_LT(data_key(9, 1, "zzz"), start);
+}
+
+TEST(test_key_layout, index_layout_range) {
+    std::string start;
+    std::string end;
+    region_data_range(make_region(10, true, "b", "d", 3), &start, &end);
+    EXPECT_EQ(data_key(-4, 1, "b"), start);
+    EXPECT_EQ(data_key(-4, 1, "d"), end);
+    EXPECT_LE(start, data_key(-4, 1, "b"));
+    EXPECT_LT(data_key(-4, 1, "c"), end);
+    EXPECT_LE(end, data_key(-4, 1, "d"));
+
+    // 首个region的start_key为空, 末尾region的end_key为空时到下一个index_id为止
+    region_data_range(make_region(10, true, "", "", 3), &start, &end);
+    EXPECT_EQ(data_key(-4, 1, ""), start);
+    EXPECT_EQ(data_key(-4, 2, ""), end);
+    EXPECT_LT(data_key(-4, 1, "\xff\xff\xff"), end);
+    EXPECT_GE(data_key(-4, 2, ""), end);
+    // 不覆盖其他分区的数据
+    EXPECT_GE(data_key(-3, 1, ""), end);
+    EXPECT_LT(data_key(-5, 1, "zzz"), start);
+}
+
+TEST(test_key_layout, overlap) {
+    pb::RegionInfo left = make_region(1, true, "", "m", 3);
+    pb::RegionInfo right = make_region(2, true, "m", "", 3);
+    pb::RegionInfo whole = make_region(3, true, "", "", 3);
+    pb::RegionInfo middle = make_region(4, true, "f", "p", 3);
+    // 相邻区间不重叠
+    EXPECT_FALSE(region_data_overlap(left, right));
+    EXPECT_FALSE(region_data_overlap(right, left));
+    // 分裂未完成时老region仍覆盖新region的区间
+    EXPECT_TRUE(region_data_overlap(whole, left));
+    EXPECT_TRUE(region_data_overlap(right, whole));
+    EXPECT_TRUE(region_data_overlap(middle, left));
+    EXPECT_TRUE(region_data_overlap(middle, right));
+    // 空区间不与任何region重叠
+    EXPECT_FALSE(region_data_overlap(make_region(5, true, "g", "g", 3), whole));
+    // 不同分区或不同索引的key空间不共享
+    EXPECT_FALSE(region_data_overlap(whole, make_region(6, true, "", "", 4)));
+    EXPECT_FALSE(region_data_overlap(whole, make_region(7, true, "", "", 3, 2)));
+    // region_id布局的数据按region_id隔离
+    EXPECT_FALSE(region_data_overlap(make_region(8, false, "", ""), make_region(9, false, "", "")));
+    EXPECT_FALSE(region_data_overlap(whole, make_region(10, false, "", "")));
+}
+}  // namespace baikaldb
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
@@ -0,0 +1,95 @@
+// Copyright (c) 2018-present Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+#include "parallel_apply.h"
+
+int main(int argc, char* argv[]) {
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
+
+namespace baikaldb {
+typedef std::vector<std::pair<size_t, size_t>> Groups;
+
+static Groups split(const std::vector<std::vector<std::string>*>& footprints) {
+    std::vector<const std::vector<std::string>*> input(footprints.begin(), footprints.end());
+    Groups groups;
+    split_parallel_apply_groups(input, groups);
+    return groups;
+}
+
+// 分组首尾相接, 按组顺序、组内按日志顺序提交时applied_index连续推进
+static void check_applied_index(const Groups& groups, size_t count) {
+    int64_t applied_index = 100;
+    size_t next = 0;
+    for (auto& group : groups) {
+        ASSERT_EQ(next, group.first);
+        ASSERT_LT(group.first, group.second);
+        for (size_t i = group.first; i < group.second; ++i) {
+            int64_t index = 101 + i;
+            ASSERT_EQ(applied_index + 1, index);
+            applied_index = index;
+        }
+        next = group.second;
+    }
+    ASSERT_EQ(count, next);
+    ASSERT_EQ(100 + (int64_t)count, applied_index);
+}
+
+TEST(test_parallel_apply, disjoint) {
+    std::vector<std::string> a = {"pk_1", "uk_a"};
+    std::vector<std::string> b = {"pk_2", "uk_b"};
+    std::vector<std::string> c = {"pk_3", "uk_c"};
+    Groups groups = split({&a, &b, &c});
+    Groups expect = {{0, 3}};
+    EXPECT_EQ(expect, groups);
+    check_applied_index(groups, 3);
+    EXPECT_TRUE(split({}).empty());
+}
+
+// 唯一索引冲突的日志必须在前一组提交之后执行
+TEST(test_parallel_apply, conflict_key) {
+    std::vector<std::string> a = {"pk_1", "uk_a"};
+    std::vector<std::string> b = {"pk_2", "uk_b"};
+    std::vector<std::string> c = {"pk_3", "uk_a"};
+    std::vector<std::string> d = {"pk_4", "uk_d"};
+    std::vector<std::string> e = {"pk_5", "uk_d"};
+    Groups groups = split({&a, &b, &c, &d, &e});
+    Groups expect = {{0, 2}, {2, 4}, {4, 5}};
+    EXPECT_EQ(expect, groups);
+    check_applied_index(groups, 5);
+}
+
+// 不能并行的日志(update/delete/ddl/解析失败等)单独成组, 前后的日志不跨过屏障合并
+TEST(test_parallel_apply, barrier) {
+    std::vector<std::string> a = {"pk_1"};
+    std::vector<std::string> b = {"pk_2"};
+    std::vector<std::string> c = {"pk_3"};
+    Groups groups = split({&a, nullptr, &b, &c, nullptr, nullptr});
+    Groups expect = {{0, 1}, {1, 2}, {2, 4}, {4, 5}, {5, 6}};
+    EXPECT_EQ(expect, groups);
+    check_applied_index(groups, 6);
+
+    // 屏障两侧key相同也不会合并到同一组
+    groups = split({&a, nullptr, &a});
+    expect = {{0, 1}, {1, 2}, {2, 3}};
+    EXPECT_EQ(expect, groups);
+    check_applied_index(groups, 3);
+}
+}  // namespace baikaldb
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
@@ -20,6 +20,7 @@
 #include <ctime>
 #include <boost/regex.hpp>
 #include "predicate.h"
+#include "like_matcher.h"
 
 int main(int argc, char* argv[])
 {
@@ -46,4 +47,93 @@ TEST(test_covent_pattern, case_all) {
     }
 }
 
+TEST(test_like_matcher, case_all) {
+    struct Case {
+        std::string pattern;
+        bool exact_like;
+        LikeMatcher::MatchType type;
+        std::string str;
+        bool result;
+    };
+    std::vector<Case> cases = {
+        {"abc", false, LikeMatcher::LIKE_EXACT, "abc", true},
+        {"abc", false, LikeMatcher::LIKE_EXACT, "abcd", false},
+        {"abc%", false, LikeMatcher::LIKE_PREFIX, "abcd", true},
+        {"abc%%", false, LikeMatcher::LIKE_PREFIX, "xabc", false},
+        {"%abc", false, LikeMatcher::LIKE_SUFFIX, "xxabc", true},
+        {"%abc%", false, LikeMatcher::LIKE_CONTAINS, "xxabcxx", true},
+        {"%abc%", false, LikeMatcher::LIKE_CONTAINS, "xxabxcx", false},
+        {"%", false, LikeMatcher::LIKE_CONTAINS, "", true},
+        {"a_c", false, LikeMatcher::LIKE_GENERAL, "abc", true},
+        {"a%b%c", false, LikeMatcher::LIKE_GENERAL, "aXXbYYc", true},
+        {"a%b%c", false, LikeMatcher::LIKE_GENERAL, "aXXcYYb", false},
+        {"%?bd\\_vid%", false, LikeMatcher::LIKE_CONTAINS, "www.bad/aca?bd_vidxxx", true},
+        {"%?bd\\_vid%", false, LikeMatcher::LIKE_CONTAINS, "www.bad/aca?bdvid", false},
+        {"%ABC%", true, LikeMatcher::LIKE_CONTAINS, "xxaBcxx", true},
+        {"abc", true, LikeMatcher::LIKE_EXACT, "ABC", true},
+    };
+    for (auto& c : cases) {
+        LikeMatcher matcher;
+        matcher.compile(c.pattern, '\\', c.exact_like);
+        EXPECT_EQ(c.type, matcher.match_types()[0]) << c.pattern;
+        EXPECT_EQ(c.result, matcher.match(c.str)) << c.pattern << " " << c.str;
+    }
+    // 'a|b' => 'a%' or '%b'
+    LikeMatcher matcher;
+    matcher.compile("foo|bar", '\\', true);
+    EXPECT_TRUE(matcher.match("FOOxx"));
+    EXPECT_TRUE(matcher.match("xxBar"));
+    EXPECT_FALSE(matcher.match("xxfoo"));
+}
+
+// 与boost::regex对照, 并输出两者耗时
+static void bench_like(const std::string& pattern, bool exact_like) {
+    std::vector<std::string> rows;
+    for (int i = 0; i < 10000; ++i) {
+        std::string row = "http://www.baidu.com/s?wd=" + std::to_string(i * 7919);
+        if (i % 10 == 0) {
+            row += "&Tn=BaiduHome";
+        }
+        rows.push_back(row);
+    }
+    LikePredicate pred;
+    if (exact_like) {
+        pred.covent_exact_pattern(pattern);
+        pred._regex.assign(pred._regex_pattern, boost::regex::icase);
+    } else {
+        pred.covent_pattern(pattern);
+        pred._regex.assign(pred._regex_pattern);
+    }
+    LikeMatcher matcher;
+    matcher.compile(pattern, '\\', exact_like);
+    int regex_hits = 0;
+    TimeCost cost;
+    for (int loop = 0; loop < 10; ++loop) {
+        for (auto& row : rows) {
+            regex_hits += boost::regex_match(row, pred._regex);
+        }
+    }
+    int64_t regex_time = cost.get_time();
+    int matcher_hits = 0;
+    cost.reset();
+    for (int loop = 0; loop < 10; ++loop) {
+        for (auto& row : rows) {
+            matcher_hits += matcher.match(row);
+        }
+    }
+    int64_t matcher_time = cost.get_time();
+    EXPECT_EQ(regex_hits, matcher_hits) << pattern;
+    std::cout << "pattern:" << pattern << " exact_like:" << exact_like
+              << " regex:" << regex_time << "us matcher:" << matcher_time << "us\n";
+}
+
+TEST(test_like_matcher, bench) {
+    bench_like("http://www.baidu.com/s?wd=1%", false);
+    bench_like("%Tn=BaiduHome", false);
+    bench_like("%BaiduHome%", false);
+    bench_like("%wd=_1%Home%", false);
+    bench_like("%tn=baiduhome%", true);
+    bench_like("%wd=1%|%baiduhome%", true);
+}
+
 }  // namespace baikal
@@ -434,13 +434,13 @@ TEST_F(TestManagerTest, test_create_drop_modify) {
     request_update_region_feed.mutable_region_info()->set_log_index(1);
     _region_manager->update_region(request_update_region_feed, NULL);
     ASSERT_EQ(1, _region_manager->_region_info_map.size());
-    ASSERT_EQ(3, _region_manager->_instance_region_map.size());
-    ASSERT_EQ(1, _region_manager->_instance_region_map["127.0.0.1:8010"].size());
-    ASSERT_EQ(1, _region_manager->_instance_region_map["127.0.0.1:8011"].size());
-    ASSERT_EQ(1, _region_manager->_instance_region_map["127.0.0.1:8012"].size());
-    ASSERT_EQ(1, _region_manager->_instance_region_map["127.0.0.1:8010"][1].size());
-    ASSERT_EQ(1, _region_manager->_instance_region_map["127.0.0.1:8011"][1].size());
-    ASSERT_EQ(1, _region_manager->_instance_region_map["127.0.0.1:8012"][1].size());
+    ASSERT_EQ(3, _region_manager->get_shard(1).instance_region_map.size());
+    ASSERT_EQ(1, _region_manager->get_shard(1).instance_region_map["127.0.0.1:8010"].size());
+    ASSERT_EQ(1, _region_manager->get_shard(1).instance_region_map["127.0.0.1:8011"].size());
+    ASSERT_EQ(1, _region_manager->get_shard(1).instance_region_map["127.0.0.1:8012"].size());
+    ASSERT_EQ(1, _region_manager->get_shard(1).instance_region_map["127.0.0.1:8010"][1].size());
+    ASSERT_EQ(1, _region_manager->get_shard(1).instance_region_map["127.0.0.1:8011"][1].size());
+    ASSERT_EQ(1, _region_manager->get_shard(1).instance_region_map["127.0.0.1:8012"][1].size());
     ASSERT_EQ(1, _region_manager->_region_info_map[1]->conf_version());
     for (auto& region_info : _region_manager->_region_info_map) {
         DB_WARNING("region_id: %ld", region_info.first, region_info.second->ShortDebugString().c_str());
@@ -453,19 +453,19 @@ TEST_F(TestManagerTest, test_create_drop_modify) {
     request_update_region_feed.mutable_region_info()->add_peers("127.0.0.1:8022");
     _region_manager->update_region(request_update_region_feed, NULL);
     ASSERT_EQ(1, _region_manager->_region_info_map.size());
-    ASSERT_EQ(6, _region_manager->_instance_region_map.size());
-    ASSERT_EQ(0, _region_manager->_instance_region_map["127.0.0.1:8010"].size());
-    ASSERT_EQ(0, _region_manager->_instance_region_map["127.0.0.1:8011"].size());
-    ASSERT_EQ(0, _region_manager->_instance_region_map["127.0.0.1:8012"].size());
-    ASSERT_EQ(1, _region_manager->_instance_region_map["127.0.0.1:8020"].size());
-    ASSERT_EQ(1, _region_manager->_instance_region_map["127.0.0.1:8021"].size());
-    ASSERT_EQ(1, _region_manager->_instance_region_map["127.0.0.1:8022"].size());
-    ASSERT_EQ(1, _region_manager->_instance_region_map["127.0.0.1:8020"][1].size());
-    ASSERT_EQ(0, _region_manager->_instance_region_map["127.0.0.1:8011"][1].size());
-    ASSERT_EQ(0, _region_manager->_instance_region_map["127.0.0.1:8012"][1].size());
-    ASSERT_EQ(0, _region_manager->_instance_region_map["127.0.0.1:8010"][1].size());
-    ASSERT_EQ(1, _region_manager->_instance_region_map["127.0.0.1:8021"][1].size());
-    ASSERT_EQ(1, _region_manager->_instance_region_map["127.0.0.1:8022"][1].size());
+    ASSERT_EQ(6, _region_manager->get_shard(1).instance_region_map.size());
+    ASSERT_EQ(0, _region_manager->get_shard(1).instance_region_map["127.0.0.1:8010"].size());
+    ASSERT_EQ(0, _region_manager->get_shard(1).instance_region_map["127.0.0.1:8011"].size());
+    ASSERT_EQ(0, _region_manager->get_shard(1).instance_region_map["127.0.0.1:8012"].size());
+    ASSERT_EQ(1, _region_manager->get_shard(1).instance_region_map["127.0.0.1:8020"].size());
+    ASSERT_EQ(1, _region_manager->get_shard(1).instance_region_map["127.0.0.1:8021"].size());
+    ASSERT_EQ(1, _region_manager->get_shard(1).instance_region_map["127.0.0.1:8022"].size());
+    ASSERT_EQ(1, _region_manager->get_shard(1).instance_region_map["127.0.0.1:8020"][1].size());
+    ASSERT_EQ(0, _region_manager->get_shard(1).instance_region_map["127.0.0.1:8011"][1].size());
+    ASSERT_EQ(0, _region_manager->get_shard(1).instance_region_map["127.0.0.1:8012"][1].size());
+    ASSERT_EQ(0, _region_manager->get_shard(1).instance_region_map["127.0.0.1:8010"][1].size());
+    ASSERT_EQ(1, _region_manager->get_shard(1).instance_region_map["127.0.0.1:8021"][1].size());
+    ASSERT_EQ(1, _region_manager->get_shard(1).instance_region_map["127.0.0.1:8022"][1].size());
     ASSERT_EQ(2, _region_manager->_region_info_map[1]->conf_version());
     for (auto& region_info : _region_manager->_region_info_map) {
         DB_WARNING("region_id: %ld", region_info.first, region_info.second->ShortDebugString().c_str());
@@ -506,7 +506,7 @@ TEST_F(TestManagerTest, test_create_drop_modify) {
     _region_manager->drop_region(drop_region_request, NULL);
     ASSERT_EQ(0, _region_manager->_region_info_map.size());
     ASSERT_EQ(0, _region_manager->_region_state_map.size());
-    ASSERT_EQ(0, _region_manager->_instance_region_map.size());
+    ASSERT_EQ(0, _region_manager->get_shard(1).instance_region_map.size());
     ASSERT_EQ(0, _table_manager->_table_info_map[1].partition_regions[0].size());
     _schema_manager->load_snapshot();
     for (auto& table_mem : _table_manager->_table_info_map) {
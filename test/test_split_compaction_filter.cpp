@@ -0,0 +1,184 @@
+// Copyright (c) 2018-present Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <atomic>
+#include <vector>
+#include "common.h"
+#include "mut_table_key.h"
+#include "schema_factory.h"
+#include "split_compaction_filter.h"
+#include "ttl_value.h"
+
+namespace baikaldb {
+DEFINE_int32(bench_region_count, 10000, "region count of compaction filter benchmark");
+DEFINE_int32(bench_keys_per_region, 100, "keys per region of compaction filter benchmark");
+DEFINE_int32(bench_threads, 8, "compaction threads of compaction filter benchmark");
+
+const int64_t TABLE_ID = 1;
+const int64_t TTL_TABLE_ID = 2;
+const int64_t LEGACY_TTL_TABLE_ID = 3;
+
+static void add_table(int64_t table_id, const std::string& name, int64_t ttl_duration,
+        int32_t ttl_format_version) {
+    pb::SchemaInfo info;
+    info.set_namespace_name("test_namespace");
+    info.set_database("test_database");
+    info.set_table_name(name);
+    info.set_partition_num(1);
+    info.set_namespace_id(1);
+    info.set_database_id(1);
+    info.set_table_id(table_id);
+    info.set_version(1);
+    info.set_ttl_duration(ttl_duration);
+    info.set_ttl_format_version(ttl_format_version);
+    pb::FieldInfo* field = info.add_fields();
+    field->set_field_name("id");
+    field->set_field_id(1);
+    field->set_mysql_type(pb::INT64);
+    pb::IndexInfo* index_pk = info.add_indexs();
+    index_pk->set_index_type(pb::I_PRIMARY);
+    index_pk->set_index_name("pk_index");
+    index_pk->add_field_ids(1);
+    index_pk->set_index_id(table_id);
+    SchemaFactory::get_instance()->update_table(info);
+}
+}  // namespace baikaldb
+
+int main(int argc, char* argv[]) {
+    testing::InitGoogleTest(&argc, argv);
+    google::ParseCommandLineFlags(&argc, &argv, true);
+    baikaldb::SchemaFactory::get_instance()->init();
+    baikaldb::add_table(baikaldb::TABLE_ID, "test_split_filter", 0, 0);
+    baikaldb::add_table(baikaldb::TTL_TABLE_ID, "test_ttl_filter", 3600, 1);
+    // 之前版本建的ttl表, value不带过期时间
+    baikaldb::add_table(baikaldb::LEGACY_TTL_TABLE_ID, "test_legacy_ttl_filter", 3600, 0);
+    return RUN_ALL_TESTS();
+}
+
+namespace baikaldb {
+// 每个region的主键为[region_id * 1000, region_id * 1000 + 1000), 分裂后end_key为+500
+static std::string pk_key(int64_t region_id, int64_t id) {
+    MutTableKey key;
+    key.append_i64(region_id).append_i64(TABLE_ID).append_i64(id);
+    return key.data();
+}
+
+static std::string end_key(int64_t region_id) {
+    MutTableKey key;
+    key.append_i64(region_id * 1000 + 500);
+    return key.data();
+}
+
+TEST(test_split_compaction_filter, filter) {
+    auto filter = SplitCompactionFilter::get_instance();
+    filter->set_range_key(1, "", end_key(1));
+    SplitFilterCache cache;
+    for (auto c : {(SplitFilterCache*)nullptr, &cache}) {
+        EXPECT_FALSE(filter->filter(pk_key(1, 1000), "", c));
+        EXPECT_FALSE(filter->filter(pk_key(1, 1499), "", c));
+        EXPECT_TRUE(filter->filter(pk_key(1, 1500), "", c));
+        EXPECT_TRUE(filter->filter(pk_key(1, 1999), "", c));
+        // 未注册的region和索引布局的负数前缀不过滤
+        EXPECT_FALSE(filter->filter(pk_key(2, 2999), "", c));
+        EXPECT_FALSE(filter->filter(pk_key(-1, 1999), "", c));
+    }
+    // 区间更新后缓存失效
+    filter->set_range_key(1, "", "");
+    EXPECT_FALSE(filter->filter(pk_key(1, 1999), "", &cache));
+    filter->set_range_key(1, "", end_key(1));
+    EXPECT_TRUE(filter->filter(pk_key(1, 1999), "", &cache));
+}
+
+TEST(test_split_compaction_filter, ttl) {
+    auto filter = SplitCompactionFilter::get_instance();
+    MutTableKey key;
+    key.append_i64(100).append_i64(TTL_TABLE_ID).append_i64(1);
+    int64_t now_us = butil::gettimeofday_us();
+    int64_t grace_us = FLAGS_ttl_compaction_grace_s * 1000000LL;
+    std::string expired_value = "value";
+    ttl_encode(now_us - grace_us - 1, &expired_value);
+    // 刚过期的行可能还会被落后的副本按更早的时间读到, grace内不删除
+    std::string grace_value = "value";
+    ttl_encode(now_us - 1, &grace_value);
+    std::string live_value = "value";
+    ttl_encode(ttl_expire_time_us(3600, now_us), &live_value);
+    EXPECT_TRUE(filter->filter(key.data(), expired_value, nullptr));
+    EXPECT_FALSE(filter->filter(key.data(), grace_value, nullptr));
+    EXPECT_FALSE(filter->filter(key.data(), live_value, nullptr));
+    rocksdb::Slice value(live_value);
+    EXPECT_EQ(ttl_expire_time_us(3600, now_us), ttl_decode(&value));
+    EXPECT_EQ("value", value.ToString());
+    // 非ttl表和旧格式ttl表的value不解析过期时间
+    EXPECT_FALSE(filter->filter(pk_key(100, 1), expired_value, nullptr));
+    MutTableKey legacy_key;
+    legacy_key.append_i64(100).append_i64(LEGACY_TTL_TABLE_ID).append_i64(1);
+    EXPECT_FALSE(filter->filter(legacy_key.data(), expired_value, nullptr));
+}
+
+// 模拟多个compaction线程各自按key顺序过滤
+static int64_t bench(const std::vector<std::string>& keys, bool use_cache, int64_t* removed) {
+    std::atomic<int64_t> removed_count(0);
+    TimeCost cost;
+    ConcurrencyBthread bths(FLAGS_bench_threads);
+    for (int i = 0; i < FLAGS_bench_threads; ++i) {
+        bths.run([&keys, &removed_count, use_cache]() {
+            CachedSplitCompactionFilter cached_filter;
+            int64_t count = 0;
+            for (auto& key : keys) {
+                bool filtered = false;
+                if (use_cache) {
+                    filtered = cached_filter.Filter(0, key, "", nullptr, nullptr);
+                } else {
+                    filtered = SplitCompactionFilter::get_instance()->Filter(
+                            0, key, "", nullptr, nullptr);
+                }
+                if (filtered) {
+                    ++count;
+                }
+            }
+            removed_count += count;
+        });
+    }
+    bths.join();
+    *removed = removed_count.load();
+    return cost.get_time();
+}
+
+TEST(test_split_compaction_filter, benchmark) {
+    auto filter = SplitCompactionFilter::get_instance();
+    std::vector<std::string> keys;
+    keys.reserve((size_t)FLAGS_bench_region_count * FLAGS_bench_keys_per_region);
+    for (int64_t region_id = 1; region_id <= FLAGS_bench_region_count; ++region_id) {
+        filter->set_range_key(region_id, "", end_key(region_id));
+        for (int64_t i = 0; i < FLAGS_bench_keys_per_region; ++i) {
+            keys.push_back(pk_key(region_id, region_id * 1000 + i * 1000 / FLAGS_bench_keys_per_region));
+        }
+    }
+    int64_t total = (int64_t)keys.size() * FLAGS_bench_threads;
+    int64_t removed = 0;
+    int64_t cached_removed = 0;
+    int64_t cost = bench(keys, false, &removed);
+    int64_t cached_cost = bench(keys, true, &cached_removed);
+    EXPECT_EQ(removed, cached_removed);
+    EXPECT_EQ(removed, total / 2);
+    DB_WARNING("regions: %d, threads: %d, keys: %ld, uncached: %ld us (%ld keys/s), "
+            "cached: %ld us (%ld keys/s)", FLAGS_bench_region_count, FLAGS_bench_threads, total,
+            cost, total * 1000000 / std::max(cost, 1L),
+            cached_cost, total * 1000000 / std::max(cached_cost, 1L));
+}
+}  // namespace baikaldb
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
@@ -0,0 +1,129 @@
+// Copyright (c) 2018-present Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <string>
+#include "common.h"
+#include "local_tokenizer.h"
+#include "reverse_common.h"
+
+namespace baikaldb {
+DECLARE_string(local_seg_dict_path);
+
+// gbk编码
+const std::string ZHONG = "\xD6\xD0";   // 中
+const std::string GUO = "\xB9\xFA";     // 国
+const std::string REN = "\xC8\xCB";     // 人
+const std::string HAO = "\xBA\xC3";     // 好
+
+static std::map<std::string, float> tokenize(LocalTokenizer* tokenizer, const std::string& word) {
+    TermBuffer buf;
+    EXPECT_EQ(0, tokenizer->tokenize(word, buf));
+    std::map<std::string, float> term_map;
+    buf.to_term_map(term_map);
+    return term_map;
+}
+
+static std::string write_dict(const std::string& content) {
+    std::string path = "./test_tokenizer.dic";
+    std::ofstream fp(path);
+    fp << content;
+    return path;
+}
+
+TEST(test_ngram_tokenizer, case_all) {
+    bool punctuation[256] = {false};
+    punctuation[(uint8_t)','] = true;
+    NgramTokenizer unigram(1, punctuation);
+    NgramTokenizer bigram(2, punctuation);
+    std::map<std::string, float> expect = {{"a", 2}, {"b", 1}};
+    EXPECT_EQ(expect, tokenize(&unigram, "a,ba"));
+    expect = {{ZHONG, 1}, {GUO, 1}};
+    EXPECT_EQ(expect, tokenize(&unigram, ZHONG + GUO));
+    expect = {{"ab", 1}, {"bc", 1}};
+    EXPECT_EQ(expect, tokenize(&bigram, "abc"));
+    // 历史实现只转换了slow_pos处的字符, 已有索引依赖该结果
+    expect = {{"ab", 1}, {"bC", 1}};
+    EXPECT_EQ(expect, tokenize(&bigram, "ABC"));
+    expect = {{ZHONG + GUO, 1}, {GUO + REN, 1}};
+    EXPECT_EQ(expect, tokenize(&bigram, ZHONG + GUO + REN));
+    // 不足word_count时整体成词
+    expect = {{"a", 1}};
+    EXPECT_EQ(expect, tokenize(&bigram, "a"));
+    EXPECT_TRUE(tokenize(&bigram, "").empty());
+}
+
+TEST(test_es_standard_tokenizer, case_all) {
+    Q2bGbkMap q2b;
+    // 全角Ａ
+    q2b[gbk_code("\xA3\xC1")] = 'a';
+    EsStandardTokenizer tokenizer(&q2b);
+    std::map<std::string, float> expect = {{"hello", 1}, {"world", 1}, {"3.14", 1}};
+    EXPECT_EQ(expect, tokenize(&tokenizer, "Hello World 3.14"));
+    expect = {{"ab", 1}, {ZHONG, 1}, {"c", 1}};
+    EXPECT_EQ(expect, tokenize(&tokenizer, "ab" + ZHONG + "c"));
+    expect = {{"ab", 1}};
+    EXPECT_EQ(expect, tokenize(&tokenizer, "\xA3\xC1" "b"));
+    // 数字只允许一个小数点
+    expect = {{"1.2", 1}, {"3", 1}};
+    EXPECT_EQ(expect, tokenize(&tokenizer, "1.2.3"));
+}
+
+TEST(test_dict_tokenizer, case_all) {
+    Q2bGbkMap q2b;
+    DictTokenizer tokenizer(&q2b);
+    EXPECT_EQ(-1, tokenizer.load("./not_exist_tokenizer.dic"));
+    EXPECT_EQ(-1, tokenizer.load(write_dict("")));
+    std::string path = write_dict(ZHONG + GUO + "\t100\n" + GUO + REN + "\t10\n"
+            + REN + "\t50\n" + ZHONG + "\t5\nabc\t10\n");
+    ASSERT_EQ(0, tokenizer.load(path));
+    // 非汉字词不进词典
+    EXPECT_EQ(4u, tokenizer.word_count());
+    // 中国|人 的概率大于 中|国人
+    std::map<std::string, float> expect = {{ZHONG + GUO, 1}, {REN, 1}};
+    EXPECT_EQ(expect, tokenize(&tokenizer, ZHONG + GUO + REN));
+    // 词典外的汉字单字成词, 英文数字整体成词, 其余半角字符丢弃
+    expect = {{ZHONG + GUO, 1}, {HAO, 1}, {"ab12", 1}, {"x", 1}};
+    EXPECT_EQ(expect, tokenize(&tokenizer, ZHONG + GUO + HAO + "AB12, x"));
+    expect = {{ZHONG + GUO, 2}};
+    EXPECT_EQ(expect, tokenize(&tokenizer, ZHONG + GUO + " " + ZHONG + GUO));
+    remove(path.c_str());
+}
+
+TEST(test_tokenizer_dict_load_fail, case_all) {
+    FLAGS_local_seg_dict_path = "./not_exist_tokenizer.dic";
+    ASSERT_EQ(0, Tokenizer::get_instance()->init());
+    // 词典加载失败时不提供词典切词
+    EXPECT_FALSE(Tokenizer::get_instance()->is_local_segment(pb::S_WORDRANK));
+    EXPECT_FALSE(Tokenizer::get_instance()->is_local_segment(pb::S_WORDSEG_BASIC));
+    EXPECT_TRUE(Tokenizer::get_instance()->is_local_segment(pb::S_UNIGRAMS));
+    std::map<std::string, float> term_map;
+    EXPECT_EQ(0, Tokenizer::get_instance()->segment("ab", pb::S_UNIGRAMS, term_map));
+    std::map<std::string, float> expect = {{"a", 1}, {"b", 1}};
+    EXPECT_EQ(expect, term_map);
+#ifndef BAIDU_INTERNAL
+    term_map.clear();
+    EXPECT_EQ(-1, Tokenizer::get_instance()->segment(ZHONG + GUO, pb::S_WORDRANK, term_map));
+#endif
+}
+}  // namespace baikaldb
+
+int main(int argc, char* argv[]) {
+    testing::InitGoogleTest(&argc, argv);
+    google::ParseCommandLineFlags(&argc, &argv, true);
+    return RUN_ALL_TESTS();
+}
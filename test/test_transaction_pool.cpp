@@ -0,0 +1,209 @@
+// Copyright (c) 2018-present Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <atomic>
+#include "common.h"
+#include "rocks_wrapper.h"
+#include "transaction_pool.h"
+
+namespace baikaldb {
+DEFINE_int32(bench_txn_count, 1000, "active txns of transaction pool benchmark");
+DEFINE_int32(bench_lookups, 200000, "lookups per thread of transaction pool benchmark");
+DEFINE_int32(bench_churn, 2000, "begin/remove per thread of transaction pool benchmark");
+DEFINE_int32(bench_threads, 8, "threads of transaction pool benchmark");
+DECLARE_int32(rocks_transaction_lock_timeout_ms);
+}  // namespace baikaldb
+
+int main(int argc, char* argv[]) {
+    testing::InitGoogleTest(&argc, argv);
+    google::ParseCommandLineFlags(&argc, &argv, true);
+    // 关闭死锁检测的事务靠等锁超时退出
+    baikaldb::FLAGS_rocks_transaction_lock_timeout_ms = 500;
+    auto rocksdb = baikaldb::RocksWrapper::get_instance();
+    if (rocksdb->init("./rocks_db") != 0) {
+        DB_FATAL("rocksdb init failed");
+        return -1;
+    }
+    return RUN_ALL_TESTS();
+}
+
+namespace baikaldb {
+TEST(test_transaction_pool, begin_remove) {
+    TransactionPool pool;
+    pool.init(1);
+    SmartTransaction txn;
+    ASSERT_EQ(0, pool.begin_txn(100, txn));
+    ASSERT_EQ(-1, pool.begin_txn(100, txn));
+    ASSERT_EQ(txn, pool.get_txn(100));
+    ASSERT_EQ(nullptr, pool.get_txn(101));
+    ASSERT_EQ(1, pool.num_began());
+    txn->dml_num_affected_rows = 3;
+    txn->rollback();
+    pool.remove_txn(100);
+    ASSERT_EQ(nullptr, pool.get_txn(100));
+    ASSERT_EQ(0, pool.num_began());
+    // 已结束事务的影响行数用于幂等
+    ASSERT_EQ(3, pool.get_finished_txn_affected_rows(100));
+    ASSERT_EQ(-1, pool.get_finished_txn_affected_rows(101));
+}
+
+// 合并提交的dml: 每个子请求一个save point, 失败的子请求只回滚自己, 其余一起提交
+TEST(test_transaction_pool, batch_save_point) {
+    SmartTransaction txn(new Transaction(0, nullptr));
+    ASSERT_EQ(0, txn->begin());
+    std::vector<std::string> keys = {"batch_key_1", "batch_key_2", "batch_key_3"};
+    for (int i = 0; i < (int)keys.size(); ++i) {
+        int seq_id = i + 1;
+        txn->set_seq_id(seq_id);
+        txn->set_save_point();
+        ASSERT_EQ(0, txn->put_kv(keys[i], "value"));
+        txn->num_increase_rows += 1;
+        // 第二个子请求执行失败
+        if (seq_id == 2) {
+            txn->rollback_to_point(seq_id);
+        }
+    }
+    ASSERT_EQ(2, txn->num_increase_rows);
+    ASSERT_TRUE(txn->commit().ok());
+    auto rocksdb = RocksWrapper::get_instance();
+    rocksdb::ReadOptions read_opt;
+    std::string value;
+    ASSERT_TRUE(rocksdb->get(read_opt, rocksdb->get_data_handle(), keys[0], &value).ok());
+    ASSERT_TRUE(rocksdb->get(read_opt, rocksdb->get_data_handle(), keys[1], &value).IsNotFound());
+    ASSERT_TRUE(rocksdb->get(read_opt, rocksdb->get_data_handle(), keys[2], &value).ok());
+}
+
+// txn1持有a等b, txn2持有b等a, 后等锁的txn2被选为victim
+TEST(test_transaction_pool, deadlock) {
+    TransactionPool pool;
+    pool.init(3);
+    SmartTransaction txn1;
+    SmartTransaction txn2;
+    ASSERT_EQ(0, pool.begin_txn(1, txn1));
+    ASSERT_EQ(0, pool.begin_txn(2, txn2));
+    std::string value;
+    ASSERT_EQ(-2, txn1->get_for_update("deadlock_key_a", &value));
+    ASSERT_EQ(-2, txn2->get_for_update("deadlock_key_b", &value));
+    int txn1_ret = 0;
+    Bthread bth;
+    bth.run([&txn1, &txn1_ret]() {
+        std::string value;
+        txn1_ret = txn1->get_for_update("deadlock_key_b", &value);
+    });
+    bthread_usleep(100 * 1000);
+    ASSERT_EQ(-1, txn2->get_for_update("deadlock_key_a", &value));
+    ASSERT_TRUE(txn2->is_deadlock());
+    // victim回滚后另一个事务拿到锁
+    txn2->rollback();
+    bth.join();
+    ASSERT_EQ(-2, txn1_ret);
+    ASSERT_FALSE(txn1->is_deadlock());
+    txn1->rollback();
+    pool.remove_txn(1);
+    pool.remove_txn(2);
+}
+
+// apply中的事务关闭死锁检测, 成环时只能等锁超时, 不会被选为victim
+TEST(test_transaction_pool, deadlock_detect_disabled) {
+    TransactionPool pool;
+    pool.init(4);
+    SmartTransaction txn1;
+    SmartTransaction txn2;
+    ASSERT_EQ(0, pool.begin_txn(1, txn1, false));
+    ASSERT_EQ(0, pool.begin_txn(2, txn2, false));
+    std::string value;
+    ASSERT_EQ(-2, txn1->get_for_update("deadlock_key_c", &value));
+    ASSERT_EQ(-2, txn2->get_for_update("deadlock_key_d", &value));
+    int txn1_ret = 0;
+    Bthread bth;
+    bth.run([&txn1, &txn1_ret]() {
+        std::string value;
+        txn1_ret = txn1->get_for_update("deadlock_key_d", &value);
+    });
+    bthread_usleep(100 * 1000);
+    TimeCost cost;
+    ASSERT_EQ(-1, txn2->get_for_update("deadlock_key_c", &value));
+    ASSERT_FALSE(txn2->is_deadlock());
+    ASSERT_GE(cost.get_time(), 300 * 1000);
+    bth.join();
+    ASSERT_EQ(-1, txn1_ret);
+    ASSERT_FALSE(txn1->is_deadlock());
+    txn1->rollback();
+    txn2->rollback();
+    pool.remove_txn(1);
+    pool.remove_txn(2);
+}
+
+// 多个线程并发查找活跃事务和已结束事务
+TEST(test_transaction_pool, benchmark) {
+    TransactionPool pool;
+    pool.init(2);
+    for (uint64_t txn_id = 1; txn_id <= (uint64_t)FLAGS_bench_txn_count; ++txn_id) {
+        SmartTransaction txn;
+        ASSERT_EQ(0, pool.begin_txn(txn_id, txn));
+    }
+    std::atomic<int64_t> found(0);
+    TimeCost lookup_cost;
+    ConcurrencyBthread lookup_bths(FLAGS_bench_threads);
+    for (int i = 0; i < FLAGS_bench_threads; ++i) {
+        lookup_bths.run([&pool, &found, i]() {
+            int64_t count = 0;
+            for (int j = 0; j < FLAGS_bench_lookups; ++j) {
+                uint64_t txn_id = (uint64_t)(i * FLAGS_bench_lookups + j) % (FLAGS_bench_txn_count * 2) + 1;
+                if (pool.get_txn(txn_id) != nullptr) {
+                    ++count;
+                } else {
+                    pool.get_finished_txn_affected_rows(txn_id);
+                }
+            }
+            found += count;
+        });
+    }
+    lookup_bths.join();
+    int64_t lookup_time = lookup_cost.get_time();
+    int64_t lookups = (int64_t)FLAGS_bench_lookups * FLAGS_bench_threads;
+    EXPECT_GT(found.load(), 0);
+
+    // 每个线程begin/remove自己的事务, 与查找线程竞争
+    TimeCost churn_cost;
+    ConcurrencyBthread churn_bths(FLAGS_bench_threads);
+    for (int i = 0; i < FLAGS_bench_threads; ++i) {
+        churn_bths.run([&pool, i]() {
+            for (int j = 0; j < FLAGS_bench_churn; ++j) {
+                uint64_t txn_id = ((uint64_t)(i + 1) << 32) + j;
+                SmartTransaction txn;
+                if (pool.begin_txn(txn_id, txn) != 0) {
+                    continue;
+                }
+                pool.get_txn(txn_id);
+                txn->rollback();
+                pool.remove_txn(txn_id);
+            }
+        });
+    }
+    churn_bths.join();
+    int64_t churn_time = churn_cost.get_time();
+    int64_t churns = (int64_t)FLAGS_bench_churn * FLAGS_bench_threads;
+    EXPECT_EQ(FLAGS_bench_txn_count, pool.num_began());
+    DB_WARNING("threads: %d, lookups: %ld, cost: %ld us (%ld ops/s), begin_remove: %ld, "
+            "cost: %ld us (%ld ops/s)", FLAGS_bench_threads,
+            lookups, lookup_time, lookups * 1000000 / std::max(lookup_time, 1L),
+            churns, churn_time, churns * 1000000 / std::max(churn_time, 1L));
+    pool.clear();
+}
+}  // namespace baikaldb
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */